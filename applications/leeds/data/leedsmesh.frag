@@ -17,14 +17,21 @@ uniform float uMaxX;
 uniform float uMaxY;
 uniform bool uShowPos; 
 
-uniform vec3 uCam0;
-uniform vec3 uCam1;
-uniform vec3 uCam2;
-uniform vec3 uCam3;
-uniform vec3 uCam4;
-uniform vec3 uCam5;
-uniform vec3 uCam6;
-uniform vec3 uCam7;
+// Per frame values, set once for every program by Leeds - see LeedsFrame in app.hpp
+layout(std140, binding = 0) uniform LeedsFrame {
+	mat4 uMVPMatrix;
+	mat4 uMVMatrix;
+	mat4 uNMatrix;
+	vec3 uLight0;
+	vec3 uCam0;
+	vec3 uCam1;
+	vec3 uCam2;
+	vec3 uCam3;
+	vec3 uCam4;
+	vec3 uCam5;
+	vec3 uCam6;
+	vec3 uCam7;
+};
 
 ///\todo pass in face normals so we can work out the best texture to use based in the shader
 
@@ -12,10 +12,21 @@ out vec2 vTexCoord5;
 out vec2 vTexCoord6;
 out vec2 vTexCoord7;
 
-uniform mat4 uMVPMatrix;
-uniform mat4 uMVMatrix;
-uniform mat4 uNMatrix;
-uniform vec3 uLight0;
+// Per frame values, set once for every program by Leeds - see LeedsFrame in app.hpp
+layout(std140, binding = 0) uniform LeedsFrame {
+	mat4 uMVPMatrix;
+	mat4 uMVMatrix;
+	mat4 uNMatrix;
+	vec3 uLight0;
+	vec3 uCam0;
+	vec3 uCam1;
+	vec3 uCam2;
+	vec3 uCam3;
+	vec3 uCam4;
+	vec3 uCam5;
+	vec3 uCam6;
+	vec3 uCam7;
+};
 
 layout (location = 0) in vec3 attribVertPosition;
 layout (location = 1) in vec3 attribNormal;
@@ -0,0 +1,78 @@
+#version 420 compatibility
+
+// leedsmesh.vert for GeometryPNT8Q - quantised positions, octahedral normals and
+// half float texture coordinates. The GL normalises and widens the attributes, the
+// decode below matches s9/vertex_compress.hpp. Set uPosMin / uPosExtent from
+// Geometry::getQuant()
+
+out vec4 vLightPos;
+out vec4 vVertexNormal;
+out vec4 vVertexPosition;
+out vec2 vTexCoord0;
+out vec2 vTexCoord1;
+out vec2 vTexCoord2;
+out vec2 vTexCoord3;
+out vec2 vTexCoord4;
+out vec2 vTexCoord5;
+out vec2 vTexCoord6;
+out vec2 vTexCoord7;
+
+// Per frame values, set once for every program by Leeds - see LeedsFrame in app.hpp
+layout(std140, binding = 0) uniform LeedsFrame {
+	mat4 uMVPMatrix;
+	mat4 uMVMatrix;
+	mat4 uNMatrix;
+	vec3 uLight0;
+	vec3 uCam0;
+	vec3 uCam1;
+	vec3 uCam2;
+	vec3 uCam3;
+	vec3 uCam4;
+	vec3 uCam5;
+	vec3 uCam6;
+	vec3 uCam7;
+};
+uniform vec3 uPosMin;
+uniform vec3 uPosExtent;
+
+layout (location = 0) in vec4 attribVertPosition;	// GL_UNSIGNED_SHORT normalised, w unused
+layout (location = 1) in vec2 attribNormal;			// GL_SHORT normalised, octahedral
+layout (location = 2) in vec2 attribTexCoord0;		// GL_HALF_FLOAT
+layout (location = 3) in vec2 attribTexCoord1;
+layout (location = 4) in vec2 attribTexCoord2;
+layout (location = 5) in vec2 attribTexCoord3;
+layout (location = 6) in vec2 attribTexCoord4;
+layout (location = 7) in vec2 attribTexCoord5;
+layout (location = 8) in vec2 attribTexCoord6;
+layout (location = 9) in vec2 attribTexCoord7;
+
+vec3 decodePosition(vec4 p) {
+    return uPosMin + p.xyz * uPosExtent;
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
+
+void main() {
+    vec3 position = decodePosition(attribVertPosition);
+    vec3 normal = octDecode(attribNormal);
+
+    vVertexNormal = vec4(-normal,1.0);
+    vLightPos = normalize( vec4(uLight0,1.0));
+    vVertexPosition = vec4(position,1.0);
+    gl_Position = uMVPMatrix * vec4(position,1.0);
+
+    vTexCoord0 = attribTexCoord0;
+    vTexCoord1 = attribTexCoord1;
+    vTexCoord2 = attribTexCoord2;
+    vTexCoord3 = attribTexCoord3;
+    vTexCoord4 = attribTexCoord4;
+    vTexCoord5 = attribTexCoord5;
+    vTexCoord6 = attribTexCoord6;
+    vTexCoord7 = attribTexCoord7;
+}
@@ -13,7 +13,10 @@
 #include "s9/common.hpp"
 #include "s9/gl/shapes.hpp"
 #include "s9/gl/shader.hpp"
+#include "s9/gl/uniform_buffer.hpp"
 #include "s9/gl/video.hpp"
+#include "s9/frame_sync.hpp"
+#include "s9/pipeline.hpp"
 #include "s9/gl/glasset.hpp"
 #include "s9/gl/glfw_app.hpp"
 
@@ -30,6 +33,19 @@ namespace s9 {
 	// special typedefs
 	typedef Geometry<VertPNT8F> GeometryLeeds;
 
+	/*
+	 * The LeedsFrame uniform block shared by the mesh shaders. The vec3s in the block
+	 * each take a vec4 under std140
+	 */
+
+	struct LeedsFrame {
+		glm::mat4 mMVP;
+		glm::mat4 mMV;
+		glm::mat4 mN;
+		glm::vec4 mLight;
+		glm::vec4 mCam[8];		// Camera normals
+	};
+
 	/*
  	 * An Basic App that draws a quad and provides a basic camera
  	 */
@@ -76,12 +92,14 @@ namespace s9 {
 		// Video Cameras
 		std::vector<gl::VidCam> vCameras;
 		std::vector<gl::CVVidCam> vCVCameras;
+		FrameSync mSync;		// Empty unless settings ask for synchronised cameras
 
 		// Shaders
 		gl::Shader mShaderCamera;
 		gl::Shader mShaderBasic;
 		gl::Shader mShaderLighting;
 		gl::Shader mShaderLeeds;
+		gl::UniformBuffer<LeedsFrame> mFrameUniforms;
 
 		uint32_t mScreenW, mScreenH;
 	};
@@ -10,6 +10,7 @@
 
 
 #include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
 #include <signal.h>
 
 using namespace std;
@@ -21,6 +22,28 @@ using namespace s9::gl;
 namespace po = boost::program_options;
 
 
+/*
+ * Caches go under the user's cache directory, never beside the data. Empty, and no
+ * caching, if there is no home to put it in
+ */
+
+static string userCacheDir() {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    string dir;
+    if (xdg != NULL && *xdg != 0)
+        dir = xdg;
+    else if (home != NULL && *home != 0)
+        dir = string(home) + "/.cache";
+    else
+        return "";
+
+    dir += "/s9gear/leeds";
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(dir, ec);
+    return ec ? "" : dir;
+}
+
 /*
  * Called when the mainloop starts, just once
  */
@@ -33,10 +56,28 @@ void Leeds::init(){
 
     mCamera.move(glm::vec3(0,0,20.0f));
 
-    mShaderCamera.load("./data/quad_texture.vert", "./data/quad_texture.frag");
-    mShaderBasic.load("./data/quad.vert", "./data/quad.frag");
-    mShaderLighting.load("./data/basic_lighting.vert", "./data/basic_lighting.frag");
-    mShaderLeeds.load("./data/leedsmesh.vert","./data/leedsmesh.frag");
+    // Program binaries and imported meshes make the second start warm
+    string cache = userCacheDir();
+    if (!cache.empty()) {
+        gl::Shader::setCache(true, cache);
+        AssetImporter::setCache(true, cache);
+    }
+
+    // Start every program before waiting on any, so the driver can compile them together
+    double_t start = timeMonotonicS9();
+    mShaderCamera.load("./data/quad_texture.vert", "./data/quad_texture.frag", false);
+    mShaderBasic.load("./data/quad.vert", "./data/quad.frag", false);
+    mShaderLighting.load("./data/basic_lighting.vert", "./data/basic_lighting.frag", false);
+    mShaderLeeds.load("./data/leedsmesh.vert","./data/leedsmesh.frag", false);
+    mShaderCamera.finish();
+    mShaderBasic.finish();
+    mShaderLighting.finish();
+    mShaderLeeds.finish();
+
+    int cached = mShaderCamera.isCached() + mShaderBasic.isCached() + mShaderLighting.isCached() + mShaderLeeds.isCached();
+    cout << "Leeds - Shaders ready in " << fixed << setprecision(1) << (timeMonotonicS9() - start) * 1000.0 << "ms, "
+        << cached << " of 4 from the cache" << endl;
+    mFrameUniforms = gl::UniformBuffer<LeedsFrame>(0);
 
     parseXML("./data/settings.xml");
 
@@ -115,6 +156,12 @@ void Leeds::createTextured() {
  */
 		
 void Leeds::display(double_t dt){
+
+    // Every uniform is set each frame, so a reloaded program needs nothing more
+    mShaderCamera.update();
+    mShaderBasic.update();
+    mShaderLighting.update();
+    mShaderLeeds.update();
     
     glClearBufferfv(GL_COLOR, 0, &glm::vec4(0.9f, 0.9f, 0.9f, 1.0f)[0]);
     GLfloat depth = 1.0f;
@@ -136,34 +183,34 @@ void Leeds::display(double_t dt){
     if(mMeshTextured) {
         mShaderLeeds.bind();
         glm::mat4 mv = mCamera.getViewMatrix() * mMeshTextured.getMatrix();
-        glm::mat4 mn =  glm::transpose(glm::inverse(mv));
 
-        mShaderLeeds.s("uMVPMatrix",mvp).s("uShininess",128.0f).s("uMVMatrix",mv)
-        .s("uNMatrix",mn).s("uLight0",glm::vec3(15.0,15.0,15.0)).s("uMaxX",640.0f).s("uMaxY",320.0f).s("uShowPos",0);
+        LeedsFrame &f = mFrameUniforms.data();
+        f.mMVP = mvp;
+        f.mMV = mv;
+        f.mN = glm::transpose(glm::inverse(mv));
+        f.mLight = glm::vec4(15.0,15.0,15.0,0.0);
 
-       for (int i=0; i < vCVCameras.size(); i++){
-            glActiveTexture(GL_TEXTURE0 + i);
+        for (size_t i=0; i < vCVCameras.size() && i < 8; i++){
+            gl::State::activeTexture(GL_TEXTURE0 + i);
             vCVCameras[i].bind();
-            
-            std::stringstream Num;
-            std::string str;
-            Num << i;
-            str = "uCam" + Num.str();
-            
+
             cv::Mat n = vCVCameras[i].getNormal();
             glm::vec3 nn (n.at<double_t>(0,0),n.at<double_t>(1,0),n.at<double_t>(2,0));
-            nn  = glm::normalize(nn);
-            mShaderLeeds.s(str.c_str(), nn);
+            f.mCam[i] = glm::vec4(glm::normalize(nn), 0.0f);
         }
+        mFrameUniforms.update();
+
+        mShaderLeeds.s("uShininess",128.0f).s("uMaxX",640.0f).s("uMaxY",320.0f).s("uShowPos",0);
 
         mMeshTextured.draw();
 
         mShaderLeeds.unbind();
 
-        for (int i=0; i < vCVCameras.size(); i++){
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
+        for (size_t i=0; i < vCVCameras.size() && i < 8; i++){
+            gl::State::activeTexture(GL_TEXTURE0 + i);
+            vCVCameras[i].unbind();
         }
+        gl::State::activeTexture(GL_TEXTURE0);
 
     }
 
@@ -171,9 +218,15 @@ void Leeds::display(double_t dt){
     else if(mMesh) {
         mShaderLighting.bind();
         glm::mat4 mv = mCamera.getViewMatrix() * mMesh.getMatrix();
-        glm::mat4 mn =  glm::transpose(glm::inverse(mv));
-        mShaderLighting.s("uMVPMatrix",mvp).s("uShininess",128.0f).s("uMVMatrix",mv)
-        .s("uNMatrix",mn).s("uLight0",glm::vec3(15.0,15.0,15.0));
+
+        LeedsFrame &f = mFrameUniforms.data();
+        f.mMVP = mvp;
+        f.mMV = mv;
+        f.mN = glm::transpose(glm::inverse(mv));
+        f.mLight = glm::vec4(15.0,15.0,15.0,0.0);
+        mFrameUniforms.update();
+
+        mShaderLighting.s("uShininess",128.0f);
 
         mMesh.draw();
         mShaderLighting.unbind();
@@ -181,11 +234,17 @@ void Leeds::display(double_t dt){
 
     mCamera.update(dt);
 
-    BOOST_FOREACH(VidCam c, vCameras)
-        c.update();
-
-    BOOST_FOREACH(CVVidCam c, vCVCameras)
-        c.update();
+    // Synchronised cameras change texture together, or not at all
+    if (mSync.size() > 0) {
+        if (mSync.update()) {
+            for (size_t i = 0; i < vCVCameras.size(); ++i)
+                vCVCameras[i].update(mSync.getFrame(i));
+        }
+    } else {
+        // Each wraps the VidCam of the same index and updates it
+        BOOST_FOREACH(CVVidCam c, vCVCameras)
+            c.update();
+    }
 
     drawCameras();
 
@@ -207,7 +266,7 @@ void Leeds::fireEvent(MouseEvent e){
  */
 
 void Leeds::fireEvent(ResizeEvent e){
-    glViewport(0,0,e.mW,e.mH);
+    gl::State::viewport(0,0,e.mW,e.mH);
     mCamera.setRatio( static_cast<float_t>(e.mW) / e.mH);
     mScreenCamera.setDim( e.mW, e.mH);
 
@@ -233,6 +292,53 @@ void Leeds::fireEvent(KeyboardEvent e){
        createTextured();
        cout << "Leeds - Created Textured" << endl;
     }
+
+#ifdef _GEAR_X11_GLX
+    // Toggle recording every live camera to ./data/record<n>.s9v
+    if (e.mKey == GLFW_KEY_C && e.mAction == 0){
+        for (size_t i = 0; i < vCameras.size(); ++i) {
+            boost::shared_ptr<VideoSource> source = vCameras[i].getSource();
+            Pipeline *p = dynamic_cast<Pipeline*>(source.get());
+            UVCVideo *uvc = dynamic_cast<UVCVideo*>(p != NULL ? p->getSource().get() : source.get());
+            if (uvc == NULL) continue;
+            if (uvc->isRecording()) {
+                uvc->stopRecording();
+                cout << "Leeds - Camera " << i << " recording stopped" << endl;
+            } else if (uvc->startRecording("./data/record" + toStringS9(i) + ".s9v"))
+                cout << "Leeds - Camera " << i << " recording" << endl;
+        }
+    }
+#endif
+
+    if (e.mKey == GLFW_KEY_V && e.mAction == 0){
+        for (size_t i = 0; i < vCameras.size(); ++i) {
+            VidCamStats st = vCameras[i].getStats();
+            cout << "Leeds - Camera " << i << " captured " << st.mCaptured << " uploaded " << st.mUploaded
+                << " dropped " << st.mDropped << " duplicated " << st.mDuplicated << fixed << setprecision(1)
+                << " latency " << st.mLatency * 1000.0 << "ms mean " << st.mLatencyMean * 1000.0
+                << "ms max " << st.mLatencyMax * 1000.0 << "ms" << endl;
+
+            Pipeline *p = dynamic_cast<Pipeline*>(vCameras[i].getSource().get());
+            if (p == NULL) continue;
+            std::vector<StageStats> ps = p->getStats();
+            for (size_t j = 0; j < ps.size(); ++j)
+                cout << "Leeds -   " << ps[j].mName << " worker " << ps[j].mWorker << " frames " << ps[j].mFrames
+                    << " dropped " << ps[j].mDropped << fixed << setprecision(2) << " mean " << ps[j].mLatencyMean * 1000.0
+                    << "ms max " << ps[j].mLatencyMax * 1000.0 << "ms wait " << ps[j].mWaitMean * 1000.0
+                    << "ms depth " << ps[j].mDepthMean << " max " << ps[j].mDepthMax << endl;
+        }
+        const gl::StateCounts &gc = gl::State::countsLastFrame();
+        cout << "Leeds - GL binds last frame " << gc.mIssued + gc.mSkipped << " issued " << gc.mIssued
+            << " skipped " << gc.mSkipped << endl;
+        if (mSync.size() > 0) {
+            SyncStats ss = mSync.getStats();
+            cout << "Leeds - Sync sets " << ss.mSets << " outside tolerance " << ss.mOutside << " dropped " << ss.mDropped
+                << fixed << setprecision(1) << " skew " << ss.mSkew * 1000.0 << "ms mean " << ss.mSkewMean * 1000.0
+                << "ms max " << ss.mSkewMax * 1000.0 << "ms waited " << ss.mWaited << "s" << endl;
+            for (size_t i = 0; i < ss.vOffset.size(); ++i)
+                cout << "Leeds - Camera " << i << " offset " << ss.vOffset[i] * 1000.0 << "ms" << endl;
+        }
+    }
 }
 
 /*
@@ -245,23 +351,79 @@ void Leeds::parseXML(std::string filename) {
         uint32_t w = fromStringS9<uint32_t> ( mSettings["leeds/cameras/width"]);
         uint32_t h = fromStringS9<uint32_t> ( mSettings["leeds/cameras/height"]);
         uint32_t f = fromStringS9<uint32_t> ( mSettings["leeds/cameras/fps"]);
+        string nb = mSettings["leeds/cameras/buffers"];
+        uint32_t b = nb.empty() ? 4 : fromStringS9<uint32_t>(nb);
+        DecodeMode d = mSettings["leeds/cameras/decode"] == "gpu" ? DECODE_GPU : DECODE_CPU;
+        TextureUpload u = mSettings["leeds/cameras/upload"] == "pbo" ? UPLOAD_PBO : UPLOAD_DIRECT;
+        CaptureFormat cf = mSettings["leeds/cameras/format"] == "mjpeg" ? CAPTURE_MJPEG : CAPTURE_YUYV;
+        string pipeline = mSettings["leeds/cameras/pipeline"];
         
         XMLIterator i = mSettings.iterator("leeds/cameras/cam");
         while (i){
             
             string dev = i["dev"];
-            
-            VidCam p (dev,w,h,f);
-            vCameras.push_back(p);
+            string replay = i["replay"];
+
+#ifdef _GEAR_X11_GLX
+            // Play a recording from the C key in place of the device
+            if (!replay.empty() && pipeline.empty()) {
+                boost::shared_ptr<ReplayVideo> r (new ReplayVideo());
+                r->startCapture("./data/" + replay, w, h, f);
+                vCameras.push_back(VidCam(r, w, h, d));
+            } else if (!pipeline.empty()) {
+                // Convert on the pipeline, off the capture thread
+                boost::shared_ptr<VideoSource> source;
+                if (!replay.empty()) {
+                    ReplayVideo *r = new ReplayVideo();
+                    source.reset(r);
+                    r->setRaw(true);
+                    r->startCapture("./data/" + replay, w, h, f);
+                } else {
+                    UVCVideo *uvc = new UVCVideo();
+                    source.reset(uvc);
+                    uvc->setRaw(true);
+                    if (!uvc->startCapture(dev, w, h, f, b, cf)) {
+                        cerr << "Leeds - Skipping camera " << dev << endl;
+                        i.next();
+                        continue;
+                    }
+                }
+                boost::shared_ptr<Pipeline> p (new Pipeline(source));
+                if (d == DECODE_CPU)
+                    p->add(boost::shared_ptr<PipelineStage>(new ConvertStage(w, h)), pipeline == "fused");
+                p->start();
+                vCameras.push_back(VidCam(p, w, h, d));
+            } else
+#endif
+            {
+                VidCam p (dev,w,h,f,b,d,cf);
+                if (!p) {
+                    cerr << "Leeds - Skipping camera " << dev << endl;
+                    i.next();
+                    continue;
+                }
+                vCameras.push_back(p);
+            }
             
             CVVidCam c(vCameras.back());
+            c.setUpload(u);
             c.loadParameters("./data/" + i["in"]);
             
             vCVCameras.push_back(c);
                     
             i.next();
         }
-        
+
+        // nearest, drop or wait - absent leaves each camera to update on its own
+        string sync = mSettings["leeds/cameras/sync"];
+        if (!sync.empty()) {
+            mSync.setPolicy(sync == "wait" ? SYNC_WAIT : sync == "drop" ? SYNC_DROP : SYNC_NEAREST);
+            string tol = mSettings["leeds/cameras/tolerance"];
+            if (!tol.empty())
+                mSync.setTolerance(fromStringS9<double_t>(tol) / 1000.0);
+            for (size_t j = 0; j < vCameras.size(); ++j)
+                mSync.add(vCameras[j].getSource());
+        }
     }
 }
 
@@ -279,7 +441,8 @@ int main (int argc, const char * argv[]) {
     // Declare the supported options.
     po::options_description desc("Allowed options");
     desc.add_options()
-    ("help", "S9Gear Basic Application - No Options")
+    ("help", "S9Gear Leeds Application")
+    ("reload", "reload shaders in ./data when they change on disk")
     ;
     
     po::variables_map vm;
@@ -291,6 +454,9 @@ int main (int argc, const char * argv[]) {
         cout << desc << "\n";
         return 1;
     }
+
+    // Edits to the shader files show up without a restart
+    gl::Shader::setHotReload(vm.count("reload") > 0);
   
     Leeds b;
 
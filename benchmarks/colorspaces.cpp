@@ -0,0 +1,173 @@
+/**
+* @brief Bit exactness check and throughput of the SIMD colour conversion kernels
+* @file colorspaces.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 14/08/2012
+*
+*/
+
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+
+extern "C" {
+	#include "s9/colorspaces.h"
+}
+
+using namespace std;
+using namespace boost;
+
+namespace po = boost::program_options;
+
+
+typedef void (*Convert) (BYTE *src, BYTE *dst, int width, int height);
+
+struct Kernel {
+	const char *mName;
+	Convert mDispatched;
+	Convert mScalar;
+	size_t mSrcBytes;		// Per 2x2 pixels
+	size_t mDstBytes;
+};
+
+static const Kernel gKernels[] = {
+	{ "yuyv2rgb", yuyv2rgb, yuyv2rgb_c, 8, 12 },
+	{ "yuyv2bgr", yuyv2bgr, yuyv2bgr_c, 8, 12 },
+	{ "yuyv2bgr1", yuyv2bgr1, yuyv2bgr1_c, 8, 12 },
+	{ "nv12_to_yuyv", nv12_to_yuyv, nv12_to_yuyv_c, 6, 8 },
+	{ "yuv420_to_yuyv", yuv420_to_yuyv, yuv420_to_yuyv_c, 6, 8 },
+	{ "uyvy_to_yuyv", uyvy_to_yuyv, uyvy_to_yuyv_c, 8, 8 }
+};
+
+static const size_t NUM_KERNELS = sizeof(gKernels) / sizeof(Kernel);
+
+static const char *gLevels[] = { "scalar", "SSE2", "SSSE3", "AVX2" };
+
+// The *_to_yuyv functions take (dst, src) - swap so every kernel is called (src, dst)
+static void call(const Kernel &k, Convert f, vector<BYTE> &src, vector<BYTE> &dst, int w, int h) {
+	if (k.mDstBytes == 12) f(&src[0], &dst[0], w, h);
+	else f(&dst[0], &src[0], w, h);
+}
+
+static bool matches(const Kernel &k, vector<BYTE> &src, int w, int h) {
+	size_t n = (w / 2) * (h / 2) * k.mDstBytes;
+	vector<BYTE> a (n + 64, 0xcd), b (n + 64, 0xcd);
+	call(k, k.mScalar, src, a, w, h);
+	call(k, k.mDispatched, src, b, w, h);
+	return a == b;		// Includes the guard bytes past the end
+}
+
+/*
+ * Every kernel against its scalar reference - odd sized frames exercise the vector tails and
+ * a sweep of all y, u and v combinations covers the clamping
+ */
+
+static bool checkExact() {
+	const int sizes[][2] = { {640, 360}, {642, 4}, {2, 2}, {38, 6}, {1282, 2}, {96, 10} };
+	bool ok = true;
+
+	for (int level = CS_SIMD_SSE2; level <= colorspaces_simd_detect(); ++level) {
+		colorspaces_set_simd_level(level);
+
+		for (size_t k = 0; k < NUM_KERNELS; ++k) {
+			bool good = true;
+
+			for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+				int w = sizes[s][0], h = sizes[s][1];
+				vector<BYTE> src ((w / 2) * (h / 2) * gKernels[k].mSrcBytes + 64);
+				for (size_t i = 0; i < src.size(); ++i) src[i] = rand() & 0xff;
+				good = good && matches(gKernels[k], src, w, h);
+			}
+
+			// 256 frames of every u,v pair with y swept across them
+			if (gKernels[k].mSrcBytes == 8) {
+				vector<BYTE> src (256 * 256 * 4 + 64);
+				for (int y = 0; y < 256 && good; ++y) {
+					for (int i = 0; i < 65536; ++i) {
+						src[i * 4] = y;
+						src[i * 4 + 1] = i & 0xff;
+						src[i * 4 + 2] = 255 - y;
+						src[i * 4 + 3] = i >> 8;
+					}
+					good = matches(gKernels[k], src, 512, 256);
+				}
+			}
+
+			if (!good) {
+				cout << "S9Gear - " << gKernels[k].mName << " " << gLevels[level] << " differs from scalar" << endl;
+				ok = false;
+			}
+		}
+	}
+
+	colorspaces_set_simd_level(colorspaces_simd_detect());
+	return ok;
+}
+
+// How far the fixed point maths is from the floating point formula it replaced
+static int floatDifference() {
+	int worst = 0;
+	for (int y = 0; y < 256; ++y)
+		for (int u = 0; u < 256; ++u)
+			for (int v = 0; v < 256; ++v) {
+				BYTE in[4] = { (BYTE)y, (BYTE)u, (BYTE)y, (BYTE)v }, out[6];
+				yuyv2rgb_c(in, out, 2, 1);
+				double_t f[3] = { y + 1.402 * (v - 128), y - 0.34414 * (u - 128) - 0.71414 * (v - 128), y + 1.772 * (u - 128) };
+				for (int c = 0; c < 3; ++c)
+					worst = std::max(worst, abs(static_cast<int>(out[c]) - static_cast<int>(CLIP(f[c]))));
+			}
+	return worst;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Colour conversion benchmark - checks each SIMD level against scalar then times them")
+	("width", po::value<int>()->default_value(640), "frame width")
+	("height", po::value<int>()->default_value(360), "frame height")
+	("runs", po::value<size_t>()->default_value(200), "frames per measurement")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	int w = vm["width"].as<int>() & ~1, h = vm["height"].as<int>() & ~1;
+	size_t runs = vm["runs"].as<size_t>();
+	int best = colorspaces_simd_detect();
+
+	cout << "S9Gear - " << w << "x" << h << ", best instruction set " << gLevels[best] << endl;
+
+	bool ok = checkExact();
+	cout << "Bit exact against scalar: " << (ok ? "yes" : "NO") << endl;
+	cout << "Largest difference from the floating point formula: " << floatDifference() << endl << endl;
+
+	cout << setw(18) << left << "MPix/s";
+	for (int l = 0; l <= best; ++l) cout << setw(10) << right << gLevels[l];
+	cout << endl;
+
+	for (size_t k = 0; k < NUM_KERNELS; ++k) {
+		vector<BYTE> src ((w / 2) * (h / 2) * gKernels[k].mSrcBytes);
+		vector<BYTE> dst ((w / 2) * (h / 2) * gKernels[k].mDstBytes);
+		for (size_t i = 0; i < src.size(); ++i) src[i] = rand() & 0xff;
+
+		cout << setw(18) << left << gKernels[k].mName;
+		for (int l = 0; l <= best; ++l) {
+			colorspaces_set_simd_level(l);
+			double_t t = timeNowS9();
+			for (size_t r = 0; r < runs; ++r) call(gKernels[k], gKernels[k].mDispatched, src, dst, w, h);
+			t = timeNowS9() - t;
+			cout << setw(10) << right << fixed << setprecision(1) << static_cast<double_t>(w) * h * runs / t / 1.0e6;
+		}
+		cout << endl;
+	}
+
+	colorspaces_set_simd_level(best);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
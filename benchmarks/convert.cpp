@@ -0,0 +1,144 @@
+/**
+* @brief Benchmark for Geometry vertex conversion
+* @file convert.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 02/08/2012
+*
+*/
+
+#include "s9/geometry.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+
+/*
+ * The original push_back conversion for comparison
+ */
+
+GeometryPNT8F convertReferencePNT8F(GeometryPNF g) {
+	vector<VertPNT8F> vtemp;
+	vector<VertPNF> vstart = g.getBuffer();
+	for (vector<VertPNF>::iterator it = vstart.begin(); it != vstart.end(); it++) {
+		VertPNT8F tp;
+		tp.mP = it->mP;
+		tp.mN = it->mN;
+		for (int i = 0; i < 8; ++i){
+			tp.mT[i].x = 0.0f; tp.mT[i].y = 0.0f;
+		}
+		vtemp.push_back(tp);
+	}
+	GeometryPNT8F b (vtemp);
+	b.addIndices(g.getIndices());
+	return b;
+}
+
+GeometryFullFloat convertReferencePNCTF(GeometryPNF g) {
+	vector<VertPNCTF> vtemp;
+	vector<VertPNF> vstart = g.getBuffer();
+	for (vector<VertPNF>::iterator it = vstart.begin(); it != vstart.end(); it++) {
+		VertPNCTF tp;
+		tp.mP = it->mP;
+		tp.mN = it->mN;
+		tp.mC.x = tp.mC.y = tp.mC.z = 0.5f;
+		tp.mC.w = 1.0f;
+		tp.mT.x = tp.mT.y = 0.0f;
+		vtemp.push_back(tp);
+	}
+	GeometryFullFloat b (vtemp);
+	b.addIndices(g.getIndices());
+	return b;
+}
+
+void report(string name, size_t n, size_t runs, double_t t) {
+	cout << setw(36) << left << name << setw(10) << right << fixed << setprecision(2) 
+		<< (static_cast<double_t>(n) * runs / t) / 1.0e6 << " MVerts/s" << endl;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Vertex conversion benchmark")
+	("vertices", po::value<size_t>()->default_value(2000000), "number of vertices")
+	("runs", po::value<size_t>()->default_value(5), "runs per conversion")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t n = vm["vertices"].as<size_t>();
+	size_t runs = vm["runs"].as<size_t>();
+
+	vector<VertPNF> verts (n);
+	for (size_t i = 0; i < n; ++i){
+		float_t f = static_cast<float_t>(i);
+		VertPNF v = { {f, f * 0.5f, f * 0.25f}, {0.0f, 1.0f, 0.0f} };
+		verts[i] = v;
+	}
+	vector<uint32_t> indices (n);
+	for (size_t i = 0; i < n; ++i) indices[i] = i;
+
+	GeometryPNF g;
+	g.createEmpty();
+	g.swapBuffer(verts);
+	g.swapIndices(indices);
+
+	cout << "S9Gear - Converting " << n << " vertices, " << WorkerPool::get().size() << " threads" << endl;
+
+	double_t t;
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) convertReferencePNT8F(g);
+	report("PNF -> PNT8F reference", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	{
+		vector<VertPNT8F> out (n);
+		for (size_t r = 0; r < runs; ++r) convertVertices(g.getBufferView().data(), &out[0], n);
+	}
+	report("PNF -> PNT8F kernel, one thread", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) g.convert<GeometryPNT8F>();
+	report("PNF -> PNT8F convert<>", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) convertReferencePNCTF(g);
+	report("PNF -> PNCTF reference", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	{
+		vector<VertPNCTF> out (n);
+		for (size_t r = 0; r < runs; ++r) convertVertices(g.getBufferView().data(), &out[0], n);
+	}
+	report("PNF -> PNCTF kernel, one thread", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) g.convert<GeometryFullFloat>();
+	report("PNF -> PNCTF convert<>", n, runs, timeNowS9() - t);
+
+	// Check the fast path agrees with the reference
+	GeometryPNT8F a = convertReferencePNT8F(g);
+	GeometryPNT8F b = g.convert<GeometryPNT8F>();
+	GeometryFullFloat c = convertReferencePNCTF(g);
+	GeometryFullFloat d = g.convert<GeometryFullFloat>();
+	if (memcmp(a.addr(), b.addr(), n * sizeof(VertPNT8F)) != 0 || memcmp(c.addr(), d.addr(), n * sizeof(VertPNCTF)) != 0) {
+		cerr << "S9Gear - Conversion output does not match the reference" << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/**
+* @brief Benchmark for building mesh connectivity
+* @file halfedge.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 06/08/2012
+*
+*/
+
+#include "s9/asset.hpp"
+#include "s9/wingedge.hpp"
+#include "s9/halfedge.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+
+/*
+ * A flat grid of quads, two triangles each
+ */
+
+GeometryPNF makeGrid(size_t side) {
+	vector<VertPNF> verts ((side + 1) * (side + 1));
+	for (size_t y = 0; y <= side; ++y) {
+		for (size_t x = 0; x <= side; ++x) {
+			VertPNF v = { {static_cast<float_t>(x), static_cast<float_t>(y), 0.0f}, {0.0f, 0.0f, 1.0f} };
+			verts[y * (side + 1) + x] = v;
+		}
+	}
+
+	vector<uint32_t> indices;
+	indices.reserve(side * side * 6);
+	for (size_t y = 0; y < side; ++y) {
+		for (size_t x = 0; x < side; ++x) {
+			uint32_t a = y * (side + 1) + x;
+			uint32_t b = a + 1;
+			uint32_t c = a + side + 1;
+			uint32_t d = c + 1;
+			indices.push_back(a); indices.push_back(b); indices.push_back(d);
+			indices.push_back(a); indices.push_back(d); indices.push_back(c);
+		}
+	}
+
+	GeometryPNF g;
+	g.createEmpty();
+	g.swapBuffer(verts);
+	g.swapIndices(indices);
+	return g;
+}
+
+void run(string name, GeometryPNF g, bool wingedge) {
+	cout << name << " - " << g.size() << " vertices, " << g.indexsize() / 3 << " triangles" << endl;
+
+	double_t t;
+	if (wingedge) {
+		t = timeNowS9();
+		WingedEdge we;
+		we.make(g);
+		cout << "  WingedEdge              " << fixed << setprecision(3) << timeNowS9() - t << "s" << endl;
+	}
+
+	t = timeNowS9();
+	HalfEdgeMesh a;
+	a.make(g, false);
+	cout << "  HalfEdgeMesh serial     " << fixed << setprecision(3) << timeNowS9() - t << "s" << endl;
+
+	t = timeNowS9();
+	HalfEdgeMesh b;
+	b.make(g, true);
+	cout << "  HalfEdgeMesh parallel   " << fixed << setprecision(3) << timeNowS9() - t << "s  (" 
+		<< b.numBoundary() << " boundary, " << b.numDiscarded() << " discarded)" << endl;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Mesh connectivity benchmark - WingedEdge against HalfEdgeMesh")
+	("file", po::value<string>()->default_value("../data/bunny.ply"), "mesh to load")
+	("grid", po::value<size_t>()->default_value(2237), "side of the synthetic grid in quads (2237 is ~10M triangles)")
+	("wingedge", "also time WingedEdge on the grid - this is slow")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	cout << "S9Gear - " << WorkerPool::get().size() << " threads" << endl;
+
+	AssetBasic bunny = AssetImporter::load(vm["file"].as<string>(), IMPORT_MINIMAL);
+	if (bunny)
+		run(vm["file"].as<string>(), bunny.getGeometry(), true);
+
+	run("Grid", makeGrid(vm["grid"].as<size_t>()), vm.count("wingedge") > 0);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,369 @@
+/**
+* @brief Benchmark for the vertex cache, overdraw and fetch reordering passes
+* @file mesh_optimise.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 10/08/2012
+*
+*/
+
+#include "s9/asset.hpp"
+#include "s9/mesh_optimise.hpp"
+#include "s9/utils.hpp"
+#include "s9/gl/shader.hpp"
+#include "s9/gl/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+namespace po = boost::program_options;
+
+
+/*
+ * A vertex stage with enough work that each run through it shows - the cache passes cut
+ * invocations, which is only visible if they cost something. The fragment stage is flat
+ */
+
+static const char *gVert =
+	"#version 330\n"
+	"layout(location = 0) in vec3 aPos;\n"
+	"layout(location = 1) in vec3 aNormal;\n"
+	"uniform mat4 uMVPMatrix;\n"
+	"out vec3 vColour;\n"
+	"void main() {\n"
+	"	vec3 c = vec3(0.0);\n"
+	"	for (int i = 0; i < 32; ++i) {\n"
+	"		vec3 l = normalize(vec3(sin(i * 0.7), cos(i * 1.3), 1.0));\n"
+	"		c += max(dot(aNormal, l), 0.0) * vec3(sin(i * 0.3), 0.5, cos(i * 0.2)) / 32.0;\n"
+	"	}\n"
+	"	vColour = c;\n"
+	"	gl_Position = uMVPMatrix * vec4(aPos, 1.0);\n"
+	"}\n";
+
+static const char *gFrag =
+	"#version 330\n"
+	"in vec3 vColour;\n"
+	"out vec4 fragColour;\n"
+	"void main() { fragColour = vec4(vColour, 1.0); }\n";
+
+/*
+ * A mesh on the GPU with its indices at both widths - 16 bit only if every vertex fits
+ */
+
+struct DrawMesh {
+	DrawMesh() : mVAO(0), mVBO(0), mIBO16(0), mIBO32(0), mCount(0) {};
+	GLuint mVAO, mVBO, mIBO16, mIBO32;
+	size_t mCount;
+};
+
+struct DrawContext {
+	DrawContext() : mPasses(0) {};
+	Shader mShader;
+	glm::mat4 mMVP;
+	size_t mPasses;
+};
+
+/*
+ * The simulated FIFO cache figures go alongside real draws when there is a context -
+ * ACMR tracks vertex shader invocations closely on real hardware
+ */
+
+static void report(string name, const VertexCacheStats &st, double_t t) {
+	cout << "  " << setw(22) << left << name << "ACMR " << fixed << setprecision(3) << st.mACMR
+		<< "  ATVR " << st.mATVR << "  " << setprecision(2) << t * 1000.0 << " ms" << endl;
+}
+
+static DrawMesh upload(BufferView<const VertPNF> verts, BufferView<const uint32_t> indices) {
+	DrawMesh m;
+	m.mCount = indices.size();
+
+	glGenVertexArrays(1, &m.mVAO);
+	State::bindVertexArray(m.mVAO);
+
+	glGenBuffers(1, &m.mVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, m.mVBO);
+	glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(VertPNF), verts.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertPNF), 0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertPNF), reinterpret_cast<GLvoid*>(sizeof(Float3)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &m.mIBO32);
+	State::bindElementBuffer(m.mVAO, m.mIBO32);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+
+	if (verts.size() <= 0x10000) {
+		vector<uint16_t> shorts (indices.begin(), indices.end());
+		glGenBuffers(1, &m.mIBO16);
+		State::bindElementBuffer(m.mVAO, m.mIBO16);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shorts.size() * sizeof(uint16_t), &shorts[0], GL_STATIC_DRAW);
+	}
+
+	State::unbindVertexArray();
+	return m;
+}
+
+static void release(DrawMesh &m) {
+	State::forgetVertexArray(m.mVAO);
+	glDeleteVertexArrays(1, &m.mVAO);
+	glDeleteBuffers(1, &m.mVBO);
+	glDeleteBuffers(1, &m.mIBO32);
+	if (m.mIBO16 != 0) glDeleteBuffers(1, &m.mIBO16);
+}
+
+/*
+ * Milliseconds per glDrawElements of the whole mesh. Depth is cleared each pass so every
+ * pass tests the same fragments, and glFinish brackets the lot
+ */
+
+static double_t timeDraws(DrawContext &ctx, const DrawMesh &m, GLenum type) {
+	GLuint ibo = type == GL_UNSIGNED_SHORT ? m.mIBO16 : m.mIBO32;
+	if (ibo == 0) return 0;
+
+	ctx.mShader.bind();
+	ctx.mShader.s("uMVPMatrix", ctx.mMVP);
+	State::bindElementBuffer(m.mVAO, ibo);
+
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDrawElements(GL_TRIANGLES, m.mCount, type, 0);		// Warm up
+	glFinish();
+
+	double_t t = timeMonotonicS9();
+	for (size_t i = 0; i < ctx.mPasses; ++i) {
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glDrawElements(GL_TRIANGLES, m.mCount, type, 0);
+	}
+	glFinish();
+	t = timeMonotonicS9() - t;
+
+	State::unbindVertexArray();
+	ctx.mShader.unbind();
+	CXGLERROR
+	return t * 1000.0 / ctx.mPasses;
+}
+
+static void reportDraws(string name, double_t ms, size_t triangles) {
+	cout << "  " << setw(22) << left << name;
+	if (ms == 0)
+		cout << "more than 65536 vertices" << endl;
+	else
+		cout << fixed << setprecision(3) << ms << " ms/draw  " << setprecision(1) << triangles / ms / 1000.0 << " Mtri/s" << endl;
+}
+
+// A regular grid with its triangles shuffled - the worst case input
+static GeometryPNF syntheticGrid(size_t side) {
+	vector<VertPNF> verts (side * side);
+	for (size_t y = 0; y < side; ++y)
+		for (size_t x = 0; x < side; ++x) {
+			verts[y * side + x].mP = fromVec3<Float3>(glm::vec3(x, y, 0.0f));
+			verts[y * side + x].mN = fromVec3<Float3>(glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+
+	vector<size_t> quads;
+	for (size_t q = 0; q < (side - 1) * (side - 1); ++q) quads.push_back(q);
+	srand(1);
+	random_shuffle(quads.begin(), quads.end());
+
+	vector<uint32_t> indices;
+	for (size_t i = 0; i < quads.size(); ++i) {
+		uint32_t x = quads[i] % (side - 1), y = quads[i] / (side - 1);
+		uint32_t a = y * side + x, b = a + 1, c = a + side, d = c + 1;
+		uint32_t t[6] = { a, b, c, b, d, c };
+		indices.insert(indices.end(), t, t + 6);
+	}
+
+	GeometryPNF g;
+	g.createEmpty();
+	g.swapBuffer(verts);
+	g.swapIndices(indices);
+	return g;
+}
+
+static void benchmark(string name, GeometryPNF &g, size_t cachesize, DrawContext *ctx) {
+	BufferView<const VertPNF> verts = static_cast<const GeometryPNF&>(g).getBufferView();
+	BufferView<const uint32_t> in = static_cast<const GeometryPNF&>(g).getIndexView();
+	size_t nv = verts.size();
+
+	cout << "S9Gear - " << name << " " << nv << " vertices, " << in.size() / 3 << " triangles, cache "
+		<< cachesize << endl;
+
+	if (in.size() < 3) {
+		cout << "  no indexed triangles" << endl << endl;
+		return;
+	}
+
+	report("input", analyseVertexCache(in, nv, cachesize), 0.0);
+
+	double_t t = timeNowS9();
+	vector<uint32_t> indices;
+	optimiseVertexCache(in, nv, indices, cachesize);
+	t = timeNowS9() - t;
+	report("tipsify", analyseVertexCache(BufferView<const uint32_t>(&indices[0], indices.size()), nv, cachesize), t);
+
+	vector<glm::vec3> positions (nv);
+	for (size_t i = 0; i < nv; ++i) positions[i] = toVec3(verts[i].mP);
+
+	t = timeNowS9();
+	optimiseOverdraw(indices, positions, cachesize);
+	t = timeNowS9() - t;
+	report("+ overdraw", analyseVertexCache(BufferView<const uint32_t>(&indices[0], indices.size()), nv, cachesize), t);
+
+	vector<uint32_t> remap;
+	t = timeNowS9();
+	size_t used = optimiseVertexFetch(indices, nv, remap);
+	t = timeNowS9() - t;
+	report("+ fetch", analyseVertexCache(BufferView<const uint32_t>(&indices[0], indices.size()), used, cachesize), t);
+
+	// The whole thing as the importer runs it
+	vector<VertPNF> vb (verts.begin(), verts.end());
+	vector<uint32_t> ib (in.begin(), in.end());
+	GeometryPNF copy;
+	copy.createEmpty();
+	copy.swapBuffer(vb);
+	copy.swapIndices(ib);
+
+	MeshOptimiseStats st;
+	optimiseGeometry(copy, &st, cachesize);
+	report("optimiseGeometry", st.mAfter, st.mTime);
+
+	size_t isize = used <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+	cout << "  index buffer " << fixed << setprecision(2) << indices.size() * sizeof(uint32_t) / 1024.0 << " KB -> "
+		<< indices.size() * isize / 1024.0 << " KB, " << st.mDroppedVertices << " unused vertices dropped" << endl;
+
+	if (ctx == NULL) {
+		cout << endl;
+		return;
+	}
+
+	// Fit the mesh's bounds to the view so every triangle is rasterised
+	glm::vec3 lo = toVec3(verts[0].mP), hi = lo;
+	for (size_t i = 1; i < nv; ++i) {
+		lo = glm::min(lo, toVec3(verts[i].mP));
+		hi = glm::max(hi, toVec3(verts[i].mP));
+	}
+	glm::vec3 centre = (lo + hi) * 0.5f;
+	float_t radius = std::max(glm::length(hi - lo) * 0.5f, 1.0e-6f);
+	ctx->mMVP = glm::ortho(-radius, radius, -radius, radius, -radius, radius)
+		* glm::rotate(glm::mat4(1.0f), 30.0f, glm::vec3(1.0f, 1.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), -centre);
+
+	DrawMesh before = upload(verts, in);
+	DrawMesh after = upload(static_cast<const GeometryPNF&>(copy).getBufferView(), static_cast<const GeometryPNF&>(copy).getIndexView());
+	size_t triangles = in.size() / 3;
+
+	reportDraws("draw input 32 bit", timeDraws(*ctx, before, GL_UNSIGNED_INT), triangles);
+	reportDraws("draw input 16 bit", timeDraws(*ctx, before, GL_UNSIGNED_SHORT), triangles);
+	reportDraws("draw optimised 32 bit", timeDraws(*ctx, after, GL_UNSIGNED_INT), triangles);
+	reportDraws("draw optimised 16 bit", timeDraws(*ctx, after, GL_UNSIGNED_SHORT), triangles);
+	cout << endl;
+
+	release(before);
+	release(after);
+}
+
+/*
+ * A small window for the draws. False, and simulated figures only, if there is no context
+ */
+
+static bool openContext() {
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return false;
+	}
+
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 320, GLFW_WINDOWED, "S9Gear Mesh Optimise", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return false;
+	}
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return false;
+	}
+	glEnable(GL_DEPTH_TEST);
+	return true;
+}
+
+/*
+ * Every mesh, then the grid. The program lives here so it goes before the context does
+ */
+
+static void run(const vector<string> &files, size_t side, size_t cachesize, size_t passes) {
+	DrawContext draw;
+	DrawContext *ctx = NULL;
+	if (passes > 0 && draw.mShader.loadSource(gVert, gFrag, "mesh optimise benchmark")) {
+		draw.mPasses = passes;
+		ctx = &draw;
+		cout << "S9Gear - Drawing on " << glGetString(GL_RENDERER) << endl << endl;
+	} else
+		cout << "S9Gear - No GL draws, simulated figures only" << endl << endl;
+
+	for (size_t i = 0; i < files.size(); ++i) {
+		AssetBasic a = AssetImporter::load(files[i], IMPORT_FULL);
+		if (!a) continue;
+		GeometryPNF g = a.getGeometry();
+		benchmark(files[i], g, cachesize, ctx);
+	}
+
+	if (side > 1) {
+		GeometryPNF g = syntheticGrid(side);
+		benchmark("shuffled grid", g, cachesize, ctx);
+	}
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Mesh optimise benchmark - simulated post transform cache before and after each pass, then timed draws")
+	("file", po::value< vector<string> >()->multitoken(), "meshes to load")
+	("grid", po::value<size_t>()->default_value(300), "side of the shuffled synthetic grid, 0 for none")
+	("cache", po::value<size_t>()->default_value(VERTEX_CACHE_SIZE), "simulated cache size")
+	("passes", po::value<size_t>()->default_value(200), "timed draws per index buffer, at least one")
+	("nogl", "simulated figures only, without opening a window")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	vector<string> files;
+	if (vm.count("file"))
+		files = vm["file"].as< vector<string> >();
+	else {
+		files.push_back("../data/bunny.ply");
+		files.push_back("../applications/leeds/data/gripper.stl");
+		files.push_back("../applications/leeds/data/ground.stl");
+	}
+
+	size_t cachesize = vm["cache"].as<size_t>();
+
+	// Measure the passes on the raw import, not on what the importer already did
+	AssetImporter::setCache(false);
+	AssetImporter::setOptimise(false);
+
+	bool gl = !vm.count("nogl") && openContext();
+	run(files, vm["grid"].as<size_t>(), cachesize, gl ? std::max(vm["passes"].as<size_t>(), static_cast<size_t>(1)) : 0);
+
+	if (gl)
+		glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/**
+* @brief Benchmark for cold Assimp import against a warm .s9mesh cache load
+* @file meshcache.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 03/08/2012
+*
+*/
+
+#include "s9/asset.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Mesh cache benchmark - cold Assimp import against warm mmap load")
+	("file", po::value<string>()->default_value("../data/bunny.ply"), "mesh to load")
+	("cachedir", po::value<string>()->default_value("/tmp"), "where to put the cache")
+	("minimal", "use IMPORT_MINIMAL post processing")
+	("runs", po::value<size_t>()->default_value(3), "runs of each")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	string file = vm["file"].as<string>();
+	size_t runs = vm["runs"].as<size_t>();
+	unsigned int flags = vm.count("minimal") ? IMPORT_MINIMAL : IMPORT_FULL;
+
+	AssetImportStats st;
+	double_t cold = 0, warm = 0;
+
+	AssetImporter::setCache(false);
+	for (size_t r = 0; r < runs; ++r) {
+		double_t t = timeNowS9();
+		AssetImporter::load(file, flags, &st);
+		cold += timeNowS9() - t;
+	}
+
+	cout << "S9Gear - " << file << " " << st.mVertices << " vertices, " << st.mIndices / 3 << " triangles" << endl;
+	cout << "Cold import  " << fixed << setprecision(4) << cold / runs << "s  (parse " << st.mParse 
+		<< "s, post-process " << st.mPostProcess << "s, convert " << st.mConvert << "s)" << endl;
+
+	// Prime the cache then time the mapped loads
+	AssetImporter::setCache(true, vm["cachedir"].as<string>());
+	AssetImporter::load(file, flags);
+
+	for (size_t r = 0; r < runs; ++r) {
+		double_t t = timeNowS9();
+		AssetImporter::load(file, flags, &st);
+		warm += timeNowS9() - t;
+	}
+
+	if (!st.mCacheHit) {
+		cerr << "S9Gear - Cache was not used" << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "Warm mmap    " << warm / runs << "s" << endl;
+	cout << "Speedup      " << setprecision(1) << cold / warm << "x" << endl;
+
+	return EXIT_SUCCESS;
+}
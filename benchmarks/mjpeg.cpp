@@ -0,0 +1,430 @@
+/**
+* @brief MJPEG decode speed and quality against the guvcview jpeg_decode
+* @file mjpeg.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 17/08/2012
+*
+*/
+
+#include "s9/mjpeg.hpp"
+#include "s9/utils.hpp"
+#include "s9/parallel.hpp"
+
+#include <fstream>
+#include <boost/program_options.hpp>
+
+extern "C" {
+	#include "s9/jpeg.h"
+	#include "s9/colorspaces.h"
+	#include "s9/huffman.h"
+}
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+typedef std::vector<unsigned char> Bytes;
+
+
+/*
+ * Enough of a baseline encoder to make 4:2:2 frames like a UVC camera sends, so the benchmark
+ * runs without stored footage. Standard Huffman tables, IJG quality scaling
+ */
+
+static const int gZigZag[64] = {
+	0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const int gLumaQ[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+
+static const int gChromaQ[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99
+};
+
+struct HuffCodes {
+	unsigned short mCode[256];
+	unsigned char mLen[256];
+};
+
+class Encoder {
+public:
+	Encoder(int quality) {
+		int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+		for (int i = 0; i < 64; ++i) {
+			mQ[0][i] = std::min(255, std::max(1, (gLumaQ[i] * scale + 50) / 100));
+			mQ[1][i] = std::min(255, std::max(1, (gChromaQ[i] * scale + 50) / 100));
+		}
+		for (int u = 0; u < 8; ++u)
+			for (int x = 0; x < 8; ++x)
+				mCos[u][x] = cos((2 * x + 1) * u * M_PI / 16.0) * (u == 0 ? sqrt(0.5) : 1.0);
+
+		// DC0 DC1 AC0 AC1 - indexed by class * 2 + table as the decoder does
+		const unsigned char *p = JPEGHuffmanTable, *end = p + JPG_HUFFMAN_TABLE_LENGTH;
+		while (p < end) {
+			int t = (*p >> 4) * 2 + (*p & 15);
+			HuffCodes &h = mHuff[t];
+			int n = 0, code = 0;
+			for (int len = 1; len <= 16; ++len, code <<= 1)
+				for (int i = 0; i < p[len]; ++i, ++n, ++code) {
+					h.mCode[p[17 + n]] = code;
+					h.mLen[p[17 + n]] = len;
+				}
+			mTables.push_back(Bytes(p, p + 17 + n));
+			p += 17 + n;
+		}
+	}
+
+	void encode(const Bytes &yuyv, int w, int h, int restart, bool dht, Bytes &out) {
+		out.clear();
+		marker(out, 0xd8);
+
+		// Both quantisation tables in one segment, zigzag order
+		marker(out, 0xdb);
+		word(out, 2 + 2 * 65);
+		for (int t = 0; t < 2; ++t) {
+			out.push_back(t);
+			for (int k = 0; k < 64; ++k) out.push_back(mQ[t][gZigZag[k]]);
+		}
+
+		marker(out, 0xc0);
+		word(out, 17);
+		out.push_back(8);
+		word(out, h); word(out, w);
+		out.push_back(3);
+		const unsigned char comps[9] = { 1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1 };
+		out.insert(out.end(), comps, comps + 9);
+
+		if (dht) {
+			size_t len = 2;
+			for (size_t i = 0; i < mTables.size(); ++i) len += mTables[i].size();
+			marker(out, 0xc4);
+			word(out, len);
+			for (size_t i = 0; i < mTables.size(); ++i) out.insert(out.end(), mTables[i].begin(), mTables[i].end());
+		}
+
+		if (restart > 0) {
+			marker(out, 0xdd);
+			word(out, 4);
+			word(out, restart);
+		}
+
+		marker(out, 0xda);
+		word(out, 12);
+		const unsigned char scan[10] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+		out.insert(out.end(), scan, scan + 10);
+
+		mAcc = 0; mBits = 0;
+		int mcusX = (w + 15) / 16, mcusY = (h + 7) / 8;
+		int pred[3] = { 0, 0, 0 }, rst = 0;
+		for (int m = 0; m < mcusX * mcusY; ++m) {
+			if (restart > 0 && m > 0 && m % restart == 0) {
+				flush(out);
+				marker(out, 0xd0 + (rst++ & 7));
+				pred[0] = pred[1] = pred[2] = 0;
+			}
+			int x0 = (m % mcusX) * 16, y0 = (m / mcusX) * 8;
+			double_t b[64];
+			for (int blk = 0; blk < 4; ++blk) {
+				int c = blk < 2 ? 0 : blk - 1;
+				for (int y = 0; y < 8; ++y)
+					for (int x = 0; x < 8; ++x) {
+						int py = std::min(y0 + y, h - 1);
+						// Luma blocks are 8 pixels apart, a chroma block covers all 16
+						int px = c == 0 ? std::min(x0 + blk * 8 + x, w - 1) : std::min(x0 + x * 2, w - 2) & ~1;
+						int off = c == 0 ? 0 : (c == 1 ? 1 : 3);
+						b[y * 8 + x] = yuyv[(py * w + px) * 2 + off] - 128.0;
+					}
+				block(out, b, c == 0 ? 0 : 1, pred[c]);
+			}
+		}
+		flush(out);
+		marker(out, 0xd9);
+	}
+
+protected:
+
+	static void marker(Bytes &out, int m) { out.push_back(0xff); out.push_back(m); };
+	static void word(Bytes &out, int v) { out.push_back(v >> 8); out.push_back(v & 0xff); };
+
+	void put(Bytes &out, uint32_t code, int len) {
+		mAcc = (mAcc << len) | (code & ((1u << len) - 1));
+		mBits += len;
+		while (mBits >= 8) {
+			unsigned char c = (mAcc >> (mBits - 8)) & 0xff;
+			out.push_back(c);
+			if (c == 0xff) out.push_back(0);
+			mBits -= 8;
+		}
+	}
+
+	void flush(Bytes &out) {
+		if (mBits > 0) put(out, 0x7f, 8 - mBits);
+		mAcc = 0;
+	}
+
+	void value(Bytes &out, const HuffCodes &h, int run, int v) {
+		int a = abs(v), size = 0;
+		while (a) { ++size; a >>= 1; }
+		int sym = (run << 4) | size;
+		put(out, h.mCode[sym], h.mLen[sym]);
+		if (size) put(out, v < 0 ? v - 1 : v, size);
+	}
+
+	void block(Bytes &out, const double_t *b, int t, int &pred) {
+		int q[64];
+		for (int v = 0; v < 8; ++v)
+			for (int u = 0; u < 8; ++u) {
+				double_t s = 0;
+				for (int y = 0; y < 8; ++y)
+					for (int x = 0; x < 8; ++x)
+						s += b[y * 8 + x] * mCos[u][x] * mCos[v][y];
+				double_t f = s / 4.0 / mQ[t][v * 8 + u];
+				q[v * 8 + u] = static_cast<int>(floor(f + 0.5));
+			}
+
+		value(out, mHuff[t], 0, q[0] - pred);
+		pred = q[0];
+
+		int run = 0;
+		for (int k = 1; k < 64; ++k) {
+			int c = q[gZigZag[k]];
+			if (c == 0) { ++run; continue; }
+			while (run > 15) { put(out, mHuff[2 + t].mCode[0xf0], mHuff[2 + t].mLen[0xf0]); run -= 16; }
+			value(out, mHuff[2 + t], run, c);
+			run = 0;
+		}
+		if (run > 0) put(out, mHuff[2 + t].mCode[0], mHuff[2 + t].mLen[0]);
+	}
+
+	int mQ[2][64];
+	double_t mCos[8][8];
+	HuffCodes mHuff[4];
+	std::vector<Bytes> mTables;
+	uint32_t mAcc;
+	int mBits;
+};
+
+/*
+ * A scene with flat areas, gradients, hard edges and texture, moving each frame
+ */
+
+static void makeScene(Bytes &yuyv, int w, int h, int frame) {
+	yuyv.resize(w * h * 2);
+	unsigned int seed = 1234;
+	for (int y = 0; y < h; ++y)
+		for (int x = 0; x < w; ++x) {
+			int cx = x - w / 2 - frame * 3, cy = y - h / 2;
+			int lum = (x * 200 / w + 30);
+			if (cx * cx + cy * cy < (h / 4) * (h / 4)) lum = 230 - ((x + y + frame) & 15) * 4;
+			if (((x / 32) + (y / 32)) % 5 == 0) lum = (lum + 60) & 0xff;
+			seed = seed * 1103515245 + 12345;
+			lum = std::min(255, std::max(0, lum + static_cast<int>((seed >> 16) & 7) - 3));
+			unsigned char *p = &yuyv[(y * w + x) * 2];
+			p[0] = lum;
+			p[1] = (x & 1) ? 128 + (y * 40 / h) - 20 : 128 + ((x + frame * 2) % w * 40 / w) - 20;
+		}
+}
+
+// Concatenated JPEGs, as a raw MJPEG dump or a recording
+static bool loadFrames(const string &path, std::vector<Bytes> &frames) {
+	ifstream in (path.c_str(), ios::binary);
+	if (!in.is_open()) return false;
+	Bytes all ((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+	size_t start = all.size();
+	for (size_t i = 0; i + 1 < all.size(); ++i) {
+		if (all[i] != 0xff) continue;
+		if (all[i + 1] == 0xd8 && start == all.size()) start = i;
+		else if (all[i + 1] == 0xd9 && start != all.size()) {
+			frames.push_back(Bytes(all.begin() + start, all.begin() + i + 2));
+			start = all.size();
+		}
+	}
+	return !frames.empty();
+}
+
+static bool frameSize(const Bytes &f, int &w, int &h) {
+	for (size_t i = 2; i + 9 < f.size(); ) {
+		if (f[i] != 0xff) return false;
+		if (f[i + 1] == 0xc0 || f[i + 1] == 0xc1) {
+			h = (f[i + 5] << 8) | f[i + 6];
+			w = (f[i + 7] << 8) | f[i + 8];
+			return true;
+		}
+		i += 2 + ((f[i + 2] << 8) | f[i + 3]);
+	}
+	return false;
+}
+
+static double_t psnr(const Bytes &a, const Bytes &b, size_t stride, size_t offset, size_t count) {
+	double_t err = 0;
+	for (size_t i = 0; i < count; ++i) {
+		double_t d = static_cast<double_t>(a[i * stride + offset]) - b[i * stride + offset];
+		err += d * d;
+	}
+	err /= count;
+	return err == 0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / err);
+}
+
+
+/*
+ * Damaged frames must be turned away or decoded to something, never crash the decoder. An
+ * over-subscribed DHT - three codes where length one and two only have room for two and then
+ * none - has to be rejected before it reaches the lookup tables
+ */
+
+static bool corruptFrames(MJPEGDecoder &dec, const Bytes &frame, Bytes &out, int w, int h) {
+	bool ok = true;
+
+	const unsigned char dht[] = { 0xff, 0xc4, 0x00, 0x16, 0x00, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3 };
+	Bytes bad (frame.begin(), frame.begin() + 2);
+	bad.insert(bad.end(), dht, dht + sizeof(dht));
+	bad.insert(bad.end(), frame.begin() + 2, frame.end());
+	ok = !dec.decode(&bad[0], bad.size(), &out[0], w, h) && ok;
+
+	bad.assign(frame.begin(), frame.begin() + frame.size() / 2);
+	ok = !dec.decode(&bad[0], bad.size(), &out[0], w, h) && ok;
+
+	srand(9);
+	for (int i = 0; i < 16; ++i) {
+		bad = frame;
+		for (int j = 0; j < 32; ++j) bad[rand() % bad.size()] ^= 1 << (rand() & 7);
+		dec.decode(&bad[0], bad.size(), &out[0], w, h);
+	}
+	return ok;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "MJPEG decode benchmark - the new decoder against jpeg_decode")
+	("frames", po::value<string>(), "file of concatenated JPEG frames, synthetic frames if not given")
+	("width", po::value<int>()->default_value(640), "synthetic frame width")
+	("height", po::value<int>()->default_value(360), "synthetic frame height")
+	("count", po::value<int>()->default_value(8), "synthetic frames")
+	("quality", po::value<int>()->default_value(80), "synthetic JPEG quality")
+	("restart", po::value<int>()->default_value(40), "synthetic restart interval in MCUs, 0 for none")
+	("dht", "include Huffman tables in synthetic frames - MJPEG cameras usually omit them")
+	("runs", po::value<int>()->default_value(20), "passes over the frames per measurement")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	std::vector<Bytes> frames, sources;
+	int w = vm["width"].as<int>() & ~1, h = vm["height"].as<int>();
+	int runs = vm["runs"].as<int>();
+
+	if (vm.count("frames")) {
+		if (!loadFrames(vm["frames"].as<string>(), frames) || !frameSize(frames[0], w, h)) {
+			cerr << "S9Gear - No JPEG frames in " << vm["frames"].as<string>() << endl;
+			return EXIT_FAILURE;
+		}
+	} else {
+		Encoder enc (vm["quality"].as<int>());
+		for (int i = 0; i < vm["count"].as<int>(); ++i) {
+			sources.push_back(Bytes());
+			makeScene(sources.back(), w, h, i);
+			frames.push_back(Bytes());
+			enc.encode(sources.back(), w, h, vm["restart"].as<int>(), vm.count("dht") > 0, frames.back());
+		}
+	}
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < frames.size(); ++i) bytes += frames[i].size();
+
+	MJPEGDecoder dec;
+	Bytes yuyv (w * h * 2), simd (w * h * 2), rgb (w * h * 3);
+
+	// Correctness - SIMD against scalar, then both decoders against the source in RGB if we
+	// made it, or against each other for stored frames
+	bool exact = true, ok = true;
+	double_t quality = 0, errNew = 0, errOld = 0;
+	Bytes ref (w * h * 3);
+	unsigned char *pic = static_cast<unsigned char*>(malloc(w * (h + 8) * 3));
+	size_t count = w * ((h / 8 - 1) * 8) * 3;		// jpeg_decode stops an MCU row early
+
+	for (size_t i = 0; i < frames.size(); ++i) {
+		dec.setSIMD(false);
+		ok = dec.decode(&frames[i][0], frames[i].size(), &yuyv[0], w, h) && ok;
+		dec.setSIMD(true);
+		ok = dec.decode(&frames[i][0], frames[i].size(), &simd[0], w, h) && ok;
+		exact = exact && yuyv == simd;
+
+		yuyv2rgb(&simd[0], &rgb[0], w, h);
+		jpeg_decode(&pic, &frames[i][0], w, h);
+
+		if (!sources.empty()) {
+			quality += psnr(yuyv, sources[i], 2, 0, w * h) / frames.size();
+			yuyv2rgb(&sources[i][0], &ref[0], w, h);
+		} else
+			ref = rgb;
+
+		double_t dn = 0, dold = 0;
+		for (size_t p = 0; p < count; ++p) {
+			dn += abs(static_cast<int>(rgb[p]) - ref[p]);
+			dold += abs(static_cast<int>(pic[p]) - ref[p]);
+		}
+		errNew += dn / count / frames.size();
+		errOld += dold / count / frames.size();
+	}
+
+	bool rejected = corruptFrames(dec, frames[0], yuyv, w, h);
+
+	cout << "S9Gear - " << frames.size() << " frames of " << w << "x" << h << ", " << bytes / frames.size() / 1024
+		<< "KB each, " << dec.getIntervals() << " restart intervals, " << WorkerPool::get().size() << " threads" << endl;
+	cout << "Decoded without error: " << (ok ? "yes" : "NO") << endl;
+	cout << "SSE2 IDCT matches scalar: " << (exact ? "yes" : "NO") << endl;
+	cout << "Corrupt frames rejected: " << (rejected ? "yes" : "NO") << endl;
+	cout << fixed << setprecision(2);
+	if (!sources.empty()) {
+		cout << "Luma PSNR against the source: " << quality << "dB" << endl;
+		cout << "Mean RGB error against the source: " << errNew << ", jpeg_decode " << errOld << endl << endl;
+	} else
+		cout << "Mean RGB difference from jpeg_decode: " << errOld << endl << endl;
+
+	// Throughput - jpeg_decode writes RGB so the new decoder is also timed with yuyv2rgb after
+	const char *names[] = { "jpeg_decode (RGB)", "scalar", "SSE2", "SSE2 parallel", "SSE2 parallel + RGB" };
+	cout << setw(22) << left << "Decoder" << setw(12) << right << "Frames/s" << setw(12) << "MPix/s" << endl;
+
+	for (int t = 0; t < 5; ++t) {
+		dec.setSIMD(t >= 2);
+		dec.setParallel(t >= 3);
+		double_t start = timeNowS9();
+		for (int r = 0; r < runs; ++r)
+			for (size_t i = 0; i < frames.size(); ++i) {
+				if (t == 0) {
+					jpeg_decode(&pic, &frames[i][0], w, h);
+					continue;
+				}
+				dec.decode(&frames[i][0], frames[i].size(), &yuyv[0], w, h);
+				if (t == 4) yuyv2rgb(&yuyv[0], &rgb[0], w, h);
+			}
+		double_t fps = runs * frames.size() / (timeNowS9() - start);
+		cout << setw(22) << left << names[t] << fixed << setprecision(1) << setw(12) << right << fps
+			<< setw(12) << fps * w * h / 1.0e6 << endl;
+	}
+
+	free(pic);
+	return ok && exact && rejected ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,284 @@
+/**
+* @brief Throughput and latency of per camera pipelines - conversion on the capture thread, fused stages and split stages
+* @file pipeline.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 20/08/2012
+*
+*/
+
+#include "s9/pipeline.hpp"
+#include "s9/linux/replay_camera.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+/*
+ * A thread publishing a scrolling YUYV test card, converting it itself unless set raw,
+ * as UVCVideo's capture thread would. An fps of 0 publishes as fast as it can
+ */
+
+class SimulatedCamera : public VideoSource {
+public:
+	SimulatedCamera(size_t w, size_t h, size_t fps, bool raw) : mW(w), mH(h), mFPS(fps), mRunning(true), mSeq(0) {
+		mRaw = raw;
+		vYUYV.resize(w * h * 2);
+		for (size_t y = 0; y < h; ++y)
+			for (size_t x = 0; x < w; ++x) {
+				unsigned char *p = &vYUYV[(y * w + x) * 2];
+				p[0] = (x + y) & 0xff;
+				p[1] = (x & 1) ? (y * 255 / h) : (x * 255 / w);
+			}
+		VideoFrame init;
+		init.mData.resize(w * h * 3, 0);
+		mFrames.reset(init);
+		pThread = new boost::thread(boost::ref(*this));
+	}
+
+	~SimulatedCamera() { stop(); }
+
+	void stop() {
+		if (pThread == NULL) return;
+		mRunning = false;
+		pThread->join();
+		delete pThread;
+		pThread = NULL;
+	}
+
+	void operator()() {
+		double_t next = timeMonotonicS9();
+		while (mRunning) {
+			VideoFrame &f = mFrames.back();
+			size_t shift = (mSeq * 4) % vYUYV.size();
+			if (mRaw) {
+				f.mData.resize(mW * mH * 2);
+				memcpy(&f.mData[0], &vYUYV[shift], vYUYV.size() - shift);
+				memcpy(&f.mData[vYUYV.size() - shift], &vYUYV[0], shift);
+				f.mFormat = FRAME_YUYV;
+			} else {
+				f.mData.resize(mW * mH * 3);
+				yuyv2rgb(&vYUYV[0], &f.mData[0], mW, mH);
+				f.mFormat = FRAME_RGB;
+			}
+			f.mSeq = ++mSeq;
+			f.mTimestamp = timeMonotonicS9();
+			_publish();
+
+			if (mFPS > 0) {
+				next += 1.0 / mFPS;
+				double_t wait = next - timeMonotonicS9();
+				if (wait > 0) boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(wait * 1.0e6)));
+			} else
+				boost::this_thread::yield();
+		}
+	}
+
+protected:
+	size_t mW, mH, mFPS;
+	volatile bool mRunning;
+	uint64_t mSeq;
+	std::vector<unsigned char> vYUYV;
+	boost::thread *pThread;
+};
+
+typedef enum {
+	LAYOUT_CAPTURE,		// The source converts, the pipeline only stages
+	LAYOUT_FUSED,		// Every stage on the capture worker
+	LAYOUT_SPLIT		// A worker per stage
+} Layout;
+
+struct Result {
+	Result() : mFPS(0), mLatency(0), mDropped(0), mAvailable(true) {};
+	double_t mFPS;			// Frames reaching the render thread, all cameras
+	double_t mLatency;		// Capture to render thread, seconds
+	uint64_t mDropped;
+	bool mAvailable;
+	std::vector<StageStats> vStats;		// Camera 0
+};
+
+/*
+ * The render thread takes each new frame and copies it out, as a PBO upload would, so
+ * the figures include getting frames off the pipeline
+ */
+
+static Result run(size_t cameras, size_t w, size_t h, size_t fps, double_t seconds, size_t depth, Layout layout,
+	bool undistort, const string &replay) {
+	std::vector<boost::shared_ptr<Pipeline> > pipes;
+	Result r;
+
+#ifdef _GEAR_OPENCV
+	cv::Mat M = cv::Mat::eye(3, 3, CV_64F);
+	M.at<double_t>(0,0) = M.at<double_t>(1,1) = w * 0.8;
+	M.at<double_t>(0,2) = w * 0.5;
+	M.at<double_t>(1,2) = h * 0.5;
+	cv::Mat D = cv::Mat::zeros(1, 5, CV_64F);
+	D.at<double_t>(0) = -0.31;
+	D.at<double_t>(1) = 0.11;
+#else
+	(void)undistort;		// No undistort stage without OpenCV
+#endif
+
+	for (size_t i = 0; i < cameras; ++i) {
+		boost::shared_ptr<VideoSource> source;
+		if (replay.empty())
+			source.reset(new SimulatedCamera(w, h, fps, layout != LAYOUT_CAPTURE));
+		else {
+			ReplayVideo *rv = new ReplayVideo();
+			source.reset(rv);
+			rv->setRaw(layout != LAYOUT_CAPTURE);
+			if (!rv->startCapture(replay, w, h, fps)) {
+				r.mAvailable = false;
+				return r;
+			}
+		}
+
+		boost::shared_ptr<Pipeline> p (new Pipeline(source, depth));
+		if (layout != LAYOUT_CAPTURE)
+			p->add(boost::shared_ptr<PipelineStage>(new ConvertStage(w, h)), layout == LAYOUT_FUSED);
+#ifdef _GEAR_OPENCV
+		if (undistort)
+			p->add(boost::shared_ptr<PipelineStage>(new UndistortStage(M, D, w, h)), layout != LAYOUT_SPLIT);
+#endif
+		p->start();
+		pipes.push_back(p);
+	}
+
+	std::vector<unsigned char> staging (w * h * 3);
+	std::vector<uint64_t> before (cameras);
+	uint64_t frames = 0;
+	double_t latency = 0;
+
+	// Warm up, then count from a clean slate
+	double_t start = timeMonotonicS9();
+	while (timeMonotonicS9() - start < 0.5)
+		for (size_t i = 0; i < cameras; ++i)
+			pipes[i]->newFrame();
+	for (size_t i = 0; i < cameras; ++i)
+		before[i] = pipes[i]->framesDropped();
+
+	start = timeMonotonicS9();
+	while (timeMonotonicS9() - start < seconds) {
+		bool any = false;
+		for (size_t i = 0; i < cameras; ++i) {
+			if (!pipes[i]->newFrame())
+				continue;
+			const VideoFrame &f = pipes[i]->getFrame();
+			memcpy(&staging[0], &f.mData[0], std::min(f.mData.size(), staging.size()));
+			frames++;
+			latency += timeMonotonicS9() - f.mTimestamp;
+			any = true;
+		}
+		if (!any)
+			boost::this_thread::yield();
+	}
+	double_t elapsed = timeMonotonicS9() - start;
+
+	r.mFPS = frames / elapsed;
+	r.mLatency = frames > 0 ? latency / frames : 0;
+	r.vStats = pipes[0]->getStats();
+	for (size_t i = 0; i < cameras; ++i) {
+		pipes[i]->stop();
+		r.mDropped += pipes[i]->framesDropped() - before[i];
+	}
+	return r;
+}
+
+static void printStats(const std::vector<StageStats> &stats) {
+	cout << "  " << setw(12) << left << "Stage" << setw(8) << right << "Worker" << setw(10) << "Frames" << setw(10) << "Dropped"
+		<< setw(11) << "Mean ms" << setw(10) << "Max ms" << setw(10) << "Wait ms" << setw(12) << "Mean depth"
+		<< setw(11) << "Max depth" << endl;
+	for (size_t i = 0; i < stats.size(); ++i) {
+		const StageStats &s = stats[i];
+		cout << "  " << setw(12) << left << s.mName << setw(8) << right << s.mWorker << setw(10) << s.mFrames
+			<< setw(10) << s.mDropped << fixed << setprecision(3) << setw(11) << s.mLatencyMean * 1000.0
+			<< setw(10) << s.mLatencyMax * 1000.0 << setw(10) << s.mWaitMean * 1000.0 << setprecision(2)
+			<< setw(12) << s.mDepthMean << setw(11) << s.mDepthMax << endl;
+	}
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Camera pipeline benchmark")
+	("width", po::value<size_t>()->default_value(640), "frame width")
+	("height", po::value<size_t>()->default_value(360), "frame height")
+	("cameras", po::value<size_t>()->default_value(8), "number of simulated cameras")
+	("fps", po::value<size_t>()->default_value(30), "capture rate of each camera, 0 for unlimited")
+	("seconds", po::value<double_t>()->default_value(5.0), "measurement time per layout")
+	("depth", po::value<size_t>()->default_value(2), "frames each queue between stages holds")
+	("undistort", "add an undistort stage after conversion")
+	("replay", po::value<string>(), "every camera plays this recording, at its size, in place of the test card")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t w = vm["width"].as<size_t>() & ~1, h = vm["height"].as<size_t>();
+	size_t cameras = vm["cameras"].as<size_t>();
+	size_t fps = vm["fps"].as<size_t>();
+	double_t seconds = vm["seconds"].as<double_t>();
+	size_t depth = vm["depth"].as<size_t>();
+	bool undistort = vm.count("undistort") > 0;
+	string replay = vm.count("replay") ? vm["replay"].as<string>() : "";
+
+#ifndef _GEAR_OPENCV
+	if (undistort) {
+		cerr << "S9Gear - Built without OpenCV, so no undistort stage" << endl;
+		undistort = false;
+	}
+#endif
+
+	cout << "S9Gear - " << cameras << " cameras at " << w << "x" << h << ", ";
+	if (fps > 0) cout << fps << " fps";
+	else cout << "unlimited fps";
+	cout << (undistort ? ", undistorting" : "") << ", queue depth " << depth << ", "
+		<< boost::thread::hardware_concurrency() << " cores" << endl << endl;
+
+	const char *names[] = { "capture converts", "fused stages", "split stages" };
+	const Layout layouts[] = { LAYOUT_CAPTURE, LAYOUT_FUSED, LAYOUT_SPLIT };
+	std::vector<Result> results;
+
+	for (int l = 0; l < 3; ++l) {
+		// Capture converting has no stage to undistort in
+		if (undistort && layouts[l] == LAYOUT_CAPTURE) {
+			results.push_back(Result());
+			results.back().mAvailable = false;
+			continue;
+		}
+		results.push_back(run(cameras, w, h, fps, seconds, depth, layouts[l], undistort, replay));
+	}
+
+	cout << setw(18) << left << "Layout" << setw(14) << right << "Frames/s" << setw(14) << "Per camera"
+		<< setw(14) << "Latency ms" << setw(10) << "Dropped" << endl;
+	for (int l = 0; l < 3; ++l) {
+		const Result &r = results[l];
+		cout << setw(18) << left << names[l];
+		if (!r.mAvailable) {
+			cout << "  unavailable" << endl;
+			continue;
+		}
+		cout << fixed << setprecision(1) << setw(14) << right << r.mFPS << setw(14) << r.mFPS / cameras
+			<< setw(14) << r.mLatency * 1000.0 << setw(10) << r.mDropped << endl;
+	}
+
+	for (int l = 0; l < 3; ++l) {
+		if (!results[l].mAvailable) continue;
+		cout << endl << names[l] << ", camera 0:" << endl;
+		printStats(results[l].vStats);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+/**
+* @brief Submitting 10k mixed primitives - drawn in code order, through the RenderQueue, and instanced
+* @file render_queue.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 24/08/2012
+*
+*/
+
+#include "s9/gl/render_queue.hpp"
+#include "s9/gl/shapes.hpp"
+#include "s9/gl/glasset.hpp"
+#include "s9/gl/utils.hpp"
+#include "s9/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+namespace po = boost::program_options;
+
+/*
+ * Two programs in two forms - per draw uniforms, and the instance block. Every vertex type
+ * here has its position at location 0, which is all they read
+ */
+
+static const char *gPlainVert =
+	"#version 330\n"
+	"layout(location = 0) in vec3 aPos;\n"
+	"uniform mat4 uMVPMatrix;\n"
+	"uniform vec4 uColour;\n"
+	"out vec4 vColour;\n"
+	"out vec2 vCoord;\n"
+	"void main() {\n"
+	"	vColour = uColour;\n"
+	"	vCoord = aPos.xy;\n"
+	"	gl_Position = uMVPMatrix * vec4(aPos, 1.0);\n"
+	"}\n";
+
+static const char *gInstancedVert =
+	"#version 330\n"
+	"layout(location = 0) in vec3 aPos;\n"
+	"struct S9Instance { mat4 uMVP; vec4 uColour; };\n"
+	"layout(std140) uniform S9Instances { S9Instance uInstances[128]; };\n"
+	"out vec4 vColour;\n"
+	"out vec2 vCoord;\n"
+	"void main() {\n"
+	"	vColour = uInstances[gl_InstanceID].uColour;\n"
+	"	vCoord = aPos.xy;\n"
+	"	gl_Position = uInstances[gl_InstanceID].uMVP * vec4(aPos, 1.0);\n"
+	"}\n";
+
+static const char *gFrags[] = {
+	"#version 330\n"
+	"uniform sampler2D uTex;\n"
+	"in vec4 vColour;\n"
+	"in vec2 vCoord;\n"
+	"out vec4 fragColour;\n"
+	"void main() { fragColour = vColour * texture(uTex, vCoord); }\n",
+
+	"#version 330\n"
+	"uniform sampler2D uTex;\n"
+	"in vec4 vColour;\n"
+	"in vec2 vCoord;\n"
+	"out vec4 fragColour;\n"
+	"void main() { fragColour = vColour + texture(uTex, vCoord) * 0.5; }\n"
+};
+
+static const size_t gNumTextures = 4;
+
+typedef enum {
+	METHOD_UNCACHED,	// Code order, every bind sent - as before State
+	METHOD_IMMEDIATE,	// Code order through State
+	METHOD_QUEUE,		// Sorted, a draw per primitive
+	METHOD_INSTANCED	// Sorted, shared geometry instanced
+} Method;
+
+struct Object {
+	size_t mGeometry;
+	size_t mProgram;
+	size_t mTexture;
+	glm::mat4 mModel;
+	glm::vec4 mColour;
+};
+
+struct Result {
+	Result() : mMicros(0), mDraws(0), mIssued(0), mSkipped(0) {};
+	double_t mMicros;
+	double_t mDraws;
+	double_t mIssued;
+	double_t mSkipped;
+};
+
+/*
+ * Eight vertices and twelve triangles, for the asset
+ */
+
+static GeometryPNF makeCube() {
+	vector<VertPNF> verts;
+	for (int i = 0; i < 8; ++i) {
+		glm::vec3 p ((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f);
+		glm::vec3 n = glm::normalize(p);
+		VertPNF v = { {p.x, p.y, p.z}, {n.x, n.y, n.z} };
+		verts.push_back(v);
+	}
+
+	static const uint32_t faces[] = {
+		0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5
+	};
+	vector<uint32_t> indices (faces, faces + sizeof(faces) / sizeof(faces[0]));
+
+	GeometryPNF g;
+	g.createEmpty();
+	g.swapBuffer(verts);
+	g.swapIndices(indices);
+	return g;
+}
+
+static vector<Object> makeObjects(size_t count) {
+	vector<Object> objects (count);
+	srand(9);
+	for (size_t i = 0; i < count; ++i) {
+		Object &o = objects[i];
+		o.mGeometry = rand() % 3;
+		o.mProgram = rand() % 2;
+		o.mTexture = rand() % gNumTextures;
+		glm::vec3 pos ((rand() % 2000) / 100.0f - 10.0f, (rand() % 2000) / 100.0f - 10.0f, -(rand() % 4000) / 100.0f - 5.0f);
+		o.mModel = glm::scale(glm::translate(glm::mat4(1.0f), pos), glm::vec3(0.2f));
+		o.mColour = glm::vec4((rand() % 255) / 255.0f, (rand() % 255) / 255.0f, (rand() % 255) / 255.0f, 1.0f);
+	}
+	return objects;
+}
+
+/*
+ * Submission only - the time to get every draw queued. glFinish now and then, outside
+ * the timing, keeps the command queue from growing without limit
+ */
+
+static Result run(Method method, const vector<Object> &objects, size_t frames, vector<ViaVAO*> &geometry,
+	const vector<GLuint> &textures) {
+
+	bool instanced = method == METHOD_INSTANCED;
+	Shader shaders[2];
+	for (size_t i = 0; i < 2; ++i) {
+		if (!shaders[i].loadSource(instanced ? gInstancedVert : gPlainVert, gFrags[i], "render queue benchmark"))
+			return Result();
+		shaders[i].bind();
+		shaders[i].s("uTex", 0);
+		shaders[i].unbind();
+	}
+
+	RenderQueue queue (1);
+	Result r;
+	double_t elapsed = 0;
+	State::endFrame();
+
+	for (size_t f = 0; f < frames; ++f) {
+		glm::mat4 vp = glm::perspective(50.0f, 1.6f, 0.1f, 100.0f)
+			* glm::rotate(glm::mat4(1.0f), f * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		double_t start = timeMonotonicS9();
+
+		for (size_t i = 0; i < objects.size(); ++i) {
+			const Object &o = objects[i];
+			Shader &s = shaders[o.mProgram];
+			glm::mat4 mvp = vp * o.mModel;
+
+			if (method == METHOD_QUEUE || method == METHOD_INSTANCED) {
+				queue.submit(*geometry[o.mGeometry], s, mvp).texture(0, GL_TEXTURE_2D, textures[o.mTexture]).colour(o.mColour);
+				continue;
+			}
+
+			if (method == METHOD_UNCACHED)
+				State::invalidate();
+			s.bind();
+			State::activeTexture(GL_TEXTURE0);
+			State::bindTexture(GL_TEXTURE_2D, textures[o.mTexture]);
+			s.s("uMVPMatrix", mvp).s("uColour", o.mColour);
+			geometry[o.mGeometry]->drawInstanced(1);
+			geometry[o.mGeometry]->unbind();
+			State::unbindTexture(GL_TEXTURE_2D);
+			s.unbind();
+			if (method == METHOD_UNCACHED)
+				State::flush();
+		}
+
+		if (method == METHOD_QUEUE || method == METHOD_INSTANCED) {
+			queue.draw();
+			r.mDraws += queue.getStats().mDraws;
+		} else
+			r.mDraws += objects.size();
+
+		elapsed += timeMonotonicS9() - start;
+
+		State::endFrame();
+		r.mIssued += State::countsLastFrame().mIssued;
+		r.mSkipped += State::countsLastFrame().mSkipped;
+		if (f % 8 == 7) glFinish();
+	}
+
+	glFinish();
+	State::flush();
+	CXGLERROR
+
+	r.mMicros = elapsed * 1.0e6 / frames;
+	r.mDraws /= frames;
+	r.mIssued /= frames;
+	r.mSkipped /= frames;
+	return r;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Render queue benchmark - intended for Mesa llvmpipe, run with LIBGL_ALWAYS_SOFTWARE=1")
+	("frames", po::value<size_t>()->default_value(200), "frames per method")
+	("objects", po::value<size_t>()->default_value(10000), "primitives per frame")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t frames = vm["frames"].as<size_t>();
+	size_t count = vm["objects"].as<size_t>();
+
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return EXIT_FAILURE;
+	}
+
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 180, GLFW_WINDOWED, "S9Gear Render Queue", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glEnable(GL_DEPTH_TEST);
+
+	// A quad, a triangle and a cube, each shared by a third of the primitives
+	gl::Quad quad (1.0f, 1.0f);
+	gl::Triangle triangle (1.0f, 1.0f);
+	GLAsset<GeometryPNF> cube (makeCube());
+	vector<ViaVAO*> geometry;
+	geometry.push_back(&quad);
+	geometry.push_back(&triangle);
+	geometry.push_back(&cube);
+
+	vector<GLuint> textures (gNumTextures);
+	glGenTextures(gNumTextures, &textures[0]);
+	for (size_t i = 0; i < gNumTextures; ++i) {
+		vector<uint8_t> texels (16 * 16 * 4, static_cast<uint8_t>(64 * i));
+		State::bindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+	State::unbindTexture(GL_TEXTURE_2D);
+
+	vector<Object> objects = makeObjects(count);
+
+	cout << "S9Gear - " << count << " primitives of 3 geometries, 2 programs and " << gNumTextures << " textures on "
+		<< glGetString(GL_RENDERER) << endl << endl;
+
+	const char *names[] = { "code order, uncached", "code order", "render queue", "render queue, instanced" };
+	const Method methods[] = { METHOD_UNCACHED, METHOD_IMMEDIATE, METHOD_QUEUE, METHOD_INSTANCED };
+	double_t base = 0;
+
+	cout << setw(26) << left << "Submission" << setw(12) << right << "ms/frame" << setw(10) << "Speedup"
+		<< setw(10) << "Draws" << setw(10) << "Binds" << setw(10) << "Skipped" << endl;
+	for (int m = 0; m < 4; ++m) {
+		Result r = run(methods[m], objects, frames, geometry, textures);
+		cout << setw(26) << left << names[m];
+		if (r.mMicros == 0) {
+			cout << "  unavailable" << endl;
+			continue;
+		}
+		if (m == 0) base = r.mMicros;
+		cout << fixed << setprecision(2) << setw(12) << right << r.mMicros / 1000.0 << setw(9) << base / r.mMicros << "x"
+			<< setprecision(0) << setw(10) << r.mDraws << setw(10) << r.mIssued << setw(10) << r.mSkipped << endl;
+	}
+
+	glDeleteTextures(gNumTextures, &textures[0]);
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
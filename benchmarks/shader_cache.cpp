@@ -0,0 +1,151 @@
+/**
+* @brief Startup cost of the Leeds programs - compiled one at a time, compiled together, and from the binary cache
+* @file shader_cache.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 21/08/2012
+*
+*/
+
+#include "s9/gl/shader.hpp"
+#include "s9/gl/utils.hpp"
+#include "s9/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+namespace po = boost::program_options;
+
+static const char *gPrograms[][2] = {
+	{ "quad_texture.vert", "quad_texture.frag" },
+	{ "quad.vert", "quad.frag" },
+	{ "basic_lighting.vert", "basic_lighting.frag" },
+	{ "leedsmesh.vert", "leedsmesh.frag" }
+};
+
+static const size_t gNumPrograms = sizeof(gPrograms) / sizeof(gPrograms[0]);
+
+typedef enum {
+	START_SERIAL,		// Each program finished before the next starts
+	START_TOGETHER		// Every program started, then each finished
+} Start;
+
+struct Result {
+	Result() : mSeconds(0), mCached(0), mFailed(0) {};
+	double_t mSeconds;
+	size_t mCached;
+	size_t mFailed;
+};
+
+static string cachePath(size_t i) {
+	return "bench_shader" + toStringS9(i) + ".s9prog";
+}
+
+/*
+ * Sources are read up front so only the GL work is timed. glFinish first so nothing
+ * queued earlier lands in the figure
+ */
+
+static Result run(const vector<string> &sources, Start start, bool cache) {
+	Shader::setCache(cache);
+	vector<Shader> shaders (gNumPrograms);
+	Result r;
+
+	glFinish();
+	double_t t = timeMonotonicS9();
+	for (size_t i = 0; i < gNumPrograms; ++i) {
+		shaders[i].begin(sources[i * 2], sources[i * 2 + 1], gPrograms[i][0], cache ? cachePath(i) : "");
+		if (start == START_SERIAL && !shaders[i].finish())
+			r.mFailed++;
+	}
+	if (start == START_TOGETHER)
+		for (size_t i = 0; i < gNumPrograms; ++i)
+			if (!shaders[i].finish())
+				r.mFailed++;
+	r.mSeconds = timeMonotonicS9() - t;
+
+	for (size_t i = 0; i < gNumPrograms; ++i)
+		r.mCached += shaders[i].isCached();
+	return r;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Program startup benchmark - run with MESA_SHADER_CACHE_DISABLE=true so the cold figures are cold")
+	("shaders", po::value<string>()->default_value("../applications/leeds/data"), "directory holding the Leeds shaders")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	string dir = vm["shaders"].as<string>();
+	vector<string> sources;
+	for (size_t i = 0; i < gNumPrograms; ++i)
+		for (size_t j = 0; j < 2; ++j) {
+			sources.push_back(textFileRead(dir + "/" + gPrograms[i][j]));
+			if (sources.back().empty())
+				return EXIT_FAILURE;
+		}
+
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return EXIT_FAILURE;
+	}
+
+	// The Leeds shaders are #version 420 compatibility
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 4);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 180, GLFW_WINDOWED, "S9Gear Shader Cache", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	cout << "S9Gear - " << gNumPrograms << " programs on " << glGetString(GL_RENDERER) << ", binaries "
+		<< (GLEW_ARB_get_program_binary ? "supported" : "unsupported") << ", parallel compile "
+		<< (Shader::parallelCompile() ? "supported" : "unsupported") << endl << endl;
+
+	for (size_t i = 0; i < gNumPrograms; ++i)
+		remove(cachePath(i).c_str());
+
+	const char *names[] = { "compiled one at a time", "compiled together", "cold cache", "warm cache" };
+	Result results[4];
+	results[0] = run(sources, START_SERIAL, false);
+	results[1] = run(sources, START_TOGETHER, false);
+	results[2] = run(sources, START_TOGETHER, true);
+	results[3] = run(sources, START_TOGETHER, true);
+
+	cout << setw(26) << left << "Startup" << setw(12) << right << "ms" << setw(10) << "Cached" << setw(10) << "Failed" << endl;
+	for (int i = 0; i < 4; ++i)
+		cout << setw(26) << left << names[i] << fixed << setprecision(2) << setw(12) << right << results[i].mSeconds * 1000.0
+			<< setw(10) << results[i].mCached << setw(10) << results[i].mFailed << endl;
+
+	for (size_t i = 0; i < gNumPrograms; ++i)
+		remove(cachePath(i).c_str());
+
+	CXGLERROR
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,270 @@
+/**
+* @brief Per frame cost of undistorting a camera - undistort every frame, precomputed remap, remap on the pool and the shader
+* @file undistort.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/08/2012
+*
+*/
+
+#include "s9/gl/video.hpp"
+#include "s9/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+using namespace cv;
+
+namespace po = boost::program_options;
+
+/*
+ * Publishes the same image as a new frame each push, on the calling thread, so every
+ * update has a frame to undistort and nothing else competes for the CPU
+ */
+
+class StillCamera : public VideoSource {
+public:
+	StillCamera(const Mat &image) : mSeq(0) {
+		VideoFrame f;
+		f.mData.assign(image.data, image.data + image.total() * 3);
+		mFrames.reset(f);
+	}
+
+	void stop() {}
+
+	void push() {
+		VideoFrame &f = mFrames.back();
+		f.mFormat = FRAME_RGB;
+		f.mSeq = ++mSeq;
+		f.mTimestamp = timeMonotonicS9();
+		_publish();
+	}
+
+protected:
+	uint64_t mSeq;
+};
+
+struct Result {
+	Result() : mUpdate(0), mVisible(0), mAvailable(true) {};
+	double_t mUpdate;		// ms per frame inside update
+	double_t mVisible;		// ms per frame the render thread lost, GPU work included
+	bool mAvailable;
+};
+
+/*
+ * Spin rather than sleep - the render thread would be busy drawing, not idle
+ */
+
+static void render(double_t ms) {
+	double_t end = timeMonotonicS9() + ms / 1000.0;
+	while (timeMonotonicS9() < end);
+}
+
+static Result timeUndistort(const Mat &image, const Mat &M, const Mat &D, size_t frames) {
+	Mat out;
+	double_t start = timeMonotonicS9();
+	for (size_t i = 0; i < frames; ++i)
+		undistort(image, out, M, D);
+	Result r;
+	r.mUpdate = r.mVisible = (timeMonotonicS9() - start) * 1000.0 / frames;
+	return r;
+}
+
+static Result timeRemap(const Mat &image, const Mat &M, const Mat &D, size_t frames) {
+	Mat map1, map2, out;
+	initUndistortRectifyMap(M, D, Mat(), M, image.size(), CV_16SC2, map1, map2);
+	double_t start = timeMonotonicS9();
+	for (size_t i = 0; i < frames; ++i)
+		remap(image, out, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+	Result r;
+	r.mUpdate = r.mVisible = (timeMonotonicS9() - start) * 1000.0 / frames;
+	return r;
+}
+
+/*
+ * The camera classes as an app would drive them - update, draw, swap. glFinish stands in
+ * for the swap so the shader's cost lands in this frame
+ */
+
+static Result timeCamera(const Mat &image, const string &params, UndistortMode mode, size_t frames, double_t renderMs,
+	Mat &rectified) {
+	boost::shared_ptr<StillCamera> source (new StillCamera(image));
+	VidCam cam (source, image.cols, image.rows);
+	CVVidCam corrected (cam);
+	Result r;
+
+	if (!corrected.loadParameters(params) || !corrected.setUndistort(mode)) {
+		r.mAvailable = false;
+		return r;
+	}
+
+	for (size_t i = 0; i < 10; ++i) {
+		source->push();
+		corrected.update();
+		glFinish();
+	}
+
+	double_t update = 0;
+	double_t start = timeMonotonicS9();
+	for (size_t i = 0; i < frames; ++i) {
+		source->push();
+		double_t t = timeMonotonicS9();
+		corrected.update();
+		update += timeMonotonicS9() - t;
+		render(renderMs);
+		glFinish();
+	}
+	double_t elapsed = timeMonotonicS9() - start;
+
+	r.mUpdate = update * 1000.0 / frames;
+	r.mVisible = (elapsed * 1000.0 - renderMs * frames) / frames;
+
+	rectified = Mat(image.size(), CV_8UC3);
+	if (mode == UNDISTORT_CPU)
+		corrected.getImageRectified().copyTo(rectified);
+	else {
+		glBindTexture(GL_TEXTURE_RECTANGLE, corrected.getRectifiedTexture());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_RECTANGLE, 0, GL_RGB, GL_UNSIGNED_BYTE, rectified.data);
+		glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+	}
+
+	cam.stop();
+	CXGLERROR
+	return r;
+}
+
+/*
+ * Mean absolute difference per channel, ignoring a border where the two treat pixels
+ * sampled from just outside the image differently
+ */
+
+static double_t difference(const Mat &a, const Mat &b) {
+	const int border = 4;
+	double_t sum = 0;
+	size_t n = 0;
+	for (int y = border; y < a.rows - border; ++y)
+		for (int x = border * 3; x < (a.cols - border) * 3; ++x) {
+			sum += abs(static_cast<int>(a.ptr<unsigned char>(y)[x]) - static_cast<int>(b.ptr<unsigned char>(y)[x]));
+			n++;
+		}
+	return n > 0 ? sum / n : 0;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Undistortion benchmark - intended for Mesa llvmpipe, run with LIBGL_ALWAYS_SOFTWARE=1")
+	("width", po::value<int>()->default_value(640), "frame width")
+	("height", po::value<int>()->default_value(360), "frame height")
+	("frames", po::value<size_t>()->default_value(200), "frames per method")
+	("render", po::value<double_t>()->default_value(5.0), "ms of other render thread work per frame, for the pool to overlap")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	int w = vm["width"].as<int>(), h = vm["height"].as<int>();
+	size_t frames = vm["frames"].as<size_t>();
+	double_t renderMs = vm["render"].as<double_t>();
+
+	// A wide angle webcam - strong barrel distortion, slightly off centre
+	Mat M = Mat::eye(3, 3, CV_64F);
+	M.at<double_t>(0,0) = w * 0.8;
+	M.at<double_t>(1,1) = w * 0.8;
+	M.at<double_t>(0,2) = w * 0.5 + 3.2;
+	M.at<double_t>(1,2) = h * 0.5 - 2.1;
+	Mat D = Mat::zeros(1, 5, CV_64F);
+	D.at<double_t>(0) = -0.31;
+	D.at<double_t>(1) = 0.11;
+	D.at<double_t>(2) = 0.0012;
+	D.at<double_t>(3) = -0.0009;
+	D.at<double_t>(4) = -0.02;
+
+	string params = "undistort_bench.yml";
+	{
+		Mat zero = Mat::zeros(3, 1, CV_64F);
+		FileStorage fs(params, CV_STORAGE_WRITE);
+		fs << "M" << M << "D" << D << "R" << zero << "T" << zero;
+		fs.release();
+	}
+
+	// Checks with smooth colour gradients - edges show the distortion, gradients the filtering
+	Mat image (h, w, CV_8UC3);
+	for (int y = 0; y < h; ++y)
+		for (int x = 0; x < w; ++x) {
+			unsigned char *p = image.ptr<unsigned char>(y) + x * 3;
+			bool check = ((x / 32) + (y / 32)) & 1;
+			p[0] = check ? 220 : 40;
+			p[1] = static_cast<unsigned char>(x * 255 / w);
+			p[2] = static_cast<unsigned char>(y * 255 / h);
+		}
+
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return EXIT_FAILURE;
+	}
+
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 180, GLFW_WINDOWED, "S9Gear Undistort", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	cout << "S9Gear - " << w << "x" << h << " on " << glGetString(GL_RENDERER) << ", " << WorkerPool::get().size()
+		<< " threads, " << renderMs << "ms other work a frame" << endl << endl;
+
+	Mat map1, map2, reference, cpu, gpu;
+	initUndistortRectifyMap(M, D, Mat(), M, image.size(), CV_16SC2, map1, map2);
+	remap(image, reference, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+
+	Result results[4];
+	results[0] = timeUndistort(image, M, D, frames);
+	results[1] = timeRemap(image, M, D, frames);
+	results[2] = timeCamera(image, params, UNDISTORT_CPU, frames, renderMs, cpu);
+	results[3] = timeCamera(image, params, UNDISTORT_GPU, frames, renderMs, gpu);
+
+	const char *names[] = { "undistort every frame", "remap, maps built once", "CVVidCam, pool remap", "CVVidCam, shader" };
+
+	cout << setw(26) << left << "Method" << setw(14) << right << "Update ms" << setw(14) << "Visible ms" << endl;
+	for (int i = 0; i < 4; ++i) {
+		cout << setw(26) << left << names[i];
+		if (!results[i].mAvailable) {
+			cout << "  unavailable" << endl;
+			continue;
+		}
+		cout << fixed << setprecision(3) << setw(14) << right << results[i].mUpdate << setw(14) << results[i].mVisible << endl;
+	}
+
+	cout << endl << "Mean difference from remap: pool " << setprecision(3) << difference(reference, cpu);
+	if (results[3].mAvailable)
+		cout << ", shader " << difference(reference, gpu);
+	cout << " (0-255)" << endl;
+
+	remove(params.c_str());
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/**
+* @brief CPU cost of setting a frame's uniforms - looked up by name, cached locations and a uniform block
+* @file uniforms.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 21/08/2012
+*
+*/
+
+#include "s9/gl/shader.hpp"
+#include "s9/gl/uniform_buffer.hpp"
+#include "s9/gl/utils.hpp"
+#include "s9/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+namespace po = boost::program_options;
+
+/*
+ * The uniforms leedsmesh sets each frame, as separate uniforms and as a block. Every
+ * one reaches the output so none is optimised away
+ */
+
+static const char *gPlainVert =
+	"#version 150\n"
+	"uniform mat4 uMVPMatrix;\n"
+	"uniform mat4 uMVMatrix;\n"
+	"uniform mat4 uNMatrix;\n"
+	"uniform vec3 uLight0;\n"
+	"uniform vec3 uCam0;\n"
+	"uniform vec3 uCam1;\n"
+	"uniform vec3 uCam2;\n"
+	"uniform vec3 uCam3;\n"
+	"uniform vec3 uCam4;\n"
+	"uniform vec3 uCam5;\n"
+	"uniform vec3 uCam6;\n"
+	"uniform vec3 uCam7;\n"
+	"out vec4 vColour;\n"
+	"void main() {\n"
+	"	vec3 c = uCam0 + uCam1 + uCam2 + uCam3 + uCam4 + uCam5 + uCam6 + uCam7;\n"
+	"	vColour = uNMatrix * vec4(c + uLight0, 1.0);\n"
+	"	gl_Position = uMVPMatrix * uMVMatrix * vec4(0.0, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *gBlockVert =
+	"#version 150\n"
+	"layout(std140) uniform Frame {\n"
+	"	mat4 uMVPMatrix;\n"
+	"	mat4 uMVMatrix;\n"
+	"	mat4 uNMatrix;\n"
+	"	vec3 uLight0;\n"
+	"	vec3 uCam0;\n"
+	"	vec3 uCam1;\n"
+	"	vec3 uCam2;\n"
+	"	vec3 uCam3;\n"
+	"	vec3 uCam4;\n"
+	"	vec3 uCam5;\n"
+	"	vec3 uCam6;\n"
+	"	vec3 uCam7;\n"
+	"};\n"
+	"out vec4 vColour;\n"
+	"void main() {\n"
+	"	vec3 c = uCam0 + uCam1 + uCam2 + uCam3 + uCam4 + uCam5 + uCam6 + uCam7;\n"
+	"	vColour = uNMatrix * vec4(c + uLight0, 1.0);\n"
+	"	gl_Position = uMVPMatrix * uMVMatrix * vec4(0.0, 0.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *gFrag =
+	"#version 150\n"
+	"uniform float uShininess;\n"
+	"uniform float uMaxX;\n"
+	"uniform float uMaxY;\n"
+	"uniform int uShowPos;\n"
+	"in vec4 vColour;\n"
+	"out vec4 fragColour;\n"
+	"void main() {\n"
+	"	fragColour = vColour * uShininess + vec4(uMaxX, uMaxY, float(uShowPos), 0.0);\n"
+	"}\n";
+
+struct Frame {
+	glm::mat4 mMVP;
+	glm::mat4 mMV;
+	glm::mat4 mN;
+	glm::vec4 mLight;
+	glm::vec4 mCam[8];
+};
+
+typedef enum {
+	METHOD_LOOKUP,		// glGetUniformLocation on every set, camera names built each frame
+	METHOD_CACHED,		// Shader::s with the link time table
+	METHOD_BLOCK		// One UniformBuffer update, scalars through the table
+} Method;
+
+static void frameValues(size_t i, glm::mat4 &mvp, glm::mat4 &mv, glm::mat4 &mn, glm::vec3 *cams) {
+	float_t a = i * 0.001f;
+	mv = glm::rotate(glm::mat4(1.0f), a, glm::vec3(0.0f, 1.0f, 0.0f));
+	mvp = glm::perspective(50.0f, 1.6f, 0.1f, 100.0f) * mv;
+	mn = glm::transpose(glm::inverse(mv));
+	for (size_t c = 0; c < 8; ++c)
+		cams[c] = glm::normalize(glm::vec3(cos(a + c), sin(a + c), 1.0f));
+}
+
+/*
+ * Submission only - the time to set everything and queue the draw. glFinish now and
+ * then, outside the timing, keeps the command queue from growing without limit
+ */
+
+static double_t run(Method method, size_t frames, size_t objects) {
+	Shader shader;
+	if (!shader.loadSource(method == METHOD_BLOCK ? gBlockVert : gPlainVert, gFrag, "uniform benchmark"))
+		return 0;
+
+	UniformBuffer<Frame> block;
+	if (method == METHOD_BLOCK) {
+		block = UniformBuffer<Frame>(0);
+		shader.block("Frame", 0);
+	}
+
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	static const char *camNames[] = { "uCam0", "uCam1", "uCam2", "uCam3", "uCam4", "uCam5", "uCam6", "uCam7" };
+	glm::mat4 mvp, mv, mn;
+	glm::vec3 cams[8];
+	double_t elapsed = 0;
+
+	for (size_t i = 0; i < frames; ++i) {
+		frameValues(i, mvp, mv, mn, cams);
+		double_t start = timeMonotonicS9();
+
+		shader.bind();
+		for (size_t o = 0; o < objects; ++o) {
+			GLuint p = shader.getProgram();
+			switch (method) {
+			case METHOD_LOOKUP:
+				glUniformMatrix4fv(glGetUniformLocation(p, "uMVPMatrix"), 1, GL_FALSE, glm::value_ptr(mvp));
+				glUniformMatrix4fv(glGetUniformLocation(p, "uMVMatrix"), 1, GL_FALSE, glm::value_ptr(mv));
+				glUniformMatrix4fv(glGetUniformLocation(p, "uNMatrix"), 1, GL_FALSE, glm::value_ptr(mn));
+				glUniform3f(glGetUniformLocation(p, "uLight0"), 15.0f, 15.0f, 15.0f);
+				glUniform1f(glGetUniformLocation(p, "uShininess"), 128.0f);
+				glUniform1f(glGetUniformLocation(p, "uMaxX"), 640.0f);
+				glUniform1f(glGetUniformLocation(p, "uMaxY"), 320.0f);
+				glUniform1i(glGetUniformLocation(p, "uShowPos"), 0);
+				for (size_t c = 0; c < 8; ++c) {
+					std::stringstream num;
+					num << c;
+					string name = "uCam" + num.str();
+					glUniform3f(glGetUniformLocation(p, name.c_str()), cams[c].x, cams[c].y, cams[c].z);
+				}
+				break;
+
+			case METHOD_CACHED:
+				shader.s("uMVPMatrix", mvp).s("uMVMatrix", mv).s("uNMatrix", mn).s("uLight0", glm::vec3(15.0f, 15.0f, 15.0f))
+					.s("uShininess", 128.0f).s("uMaxX", 640.0f).s("uMaxY", 320.0f).s("uShowPos", 0);
+				for (size_t c = 0; c < 8; ++c)
+					shader.s(camNames[c], cams[c]);
+				break;
+
+			case METHOD_BLOCK: {
+				Frame &f = block.data();
+				f.mMVP = mvp;
+				f.mMV = mv;
+				f.mN = mn;
+				f.mLight = glm::vec4(15.0f, 15.0f, 15.0f, 0.0f);
+				for (size_t c = 0; c < 8; ++c)
+					f.mCam[c] = glm::vec4(cams[c], 0.0f);
+				block.update();
+				shader.s("uShininess", 128.0f).s("uMaxX", 640.0f).s("uMaxY", 320.0f).s("uShowPos", 0);
+				break;
+			}
+			}
+			glDrawArrays(GL_POINTS, 0, 1);
+		}
+		shader.unbind();
+
+		elapsed += timeMonotonicS9() - start;
+		if (i % 16 == 15) glFinish();
+	}
+
+	glFinish();
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+	CXGLERROR
+	return elapsed * 1.0e6 / frames;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Uniform submission benchmark - intended for Mesa llvmpipe, run with LIBGL_ALWAYS_SOFTWARE=1")
+	("frames", po::value<size_t>()->default_value(2000), "frames per method")
+	("objects", po::value<size_t>()->default_value(4), "draws per frame, each setting every uniform")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t frames = vm["frames"].as<size_t>();
+	size_t objects = vm["objects"].as<size_t>();
+
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return EXIT_FAILURE;
+	}
+
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 180, GLFW_WINDOWED, "S9Gear Uniforms", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	cout << "S9Gear - " << objects << " draws a frame, each with the leedsmesh uniforms, on " << glGetString(GL_RENDERER)
+		<< endl << endl;
+
+	const char *names[] = { "looked up by name", "cached locations", "uniform block" };
+	const Method methods[] = { METHOD_LOOKUP, METHOD_CACHED, METHOD_BLOCK };
+	double_t base = 0;
+
+	cout << setw(22) << left << "Method" << setw(14) << right << "us/frame" << setw(12) << "Speedup" << endl;
+	for (int m = 0; m < 3; ++m) {
+		double_t us = run(methods[m], frames, objects);
+		cout << setw(22) << left << names[m];
+		if (us == 0) {
+			cout << "  unavailable" << endl;
+			continue;
+		}
+		if (m == 0) base = us;
+		cout << fixed << setprecision(2) << setw(14) << right << us << setw(11) << (base > 0 ? base / us : 0) << "x" << endl;
+	}
+
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/**
+* @brief Benchmark for the compressed vertex types - size, throughput and accuracy
+* @file vertex_compress.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 09/08/2012
+*
+*/
+
+#include "s9/asset.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/program_options.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+namespace po = boost::program_options;
+
+
+/*
+ * Touch every byte of a buffer the way vertex fetch would - a stand in for the
+ * bandwidth each layout costs
+ */
+
+static volatile uint64_t gSink;
+
+static uint64_t streamBuffer(const void *p, size_t bytes) {
+	const uint64_t *q = static_cast<const uint64_t*>(p);
+	uint64_t s = 0;
+	for (size_t i = 0; i < bytes / sizeof(uint64_t); ++i) s += q[i];
+	return s;
+}
+
+static void reportSize(string name, size_t vsize, size_t n) {
+	cout << setw(28) << left << name << setw(4) << right << vsize << " bytes/vertex "
+		<< setw(10) << fixed << setprecision(2) << (static_cast<double_t>(vsize) * n) / (1024.0 * 1024.0) << " MB" << endl;
+}
+
+static void reportRate(string name, size_t n, size_t runs, double_t t) {
+	cout << setw(36) << left << name << setw(10) << right << fixed << setprecision(2)
+		<< (static_cast<double_t>(n) * runs / t) / 1.0e6 << " MVerts/s" << endl;
+}
+
+template <class T>
+static void reportStream(string name, Geometry<T> &g, size_t runs) {
+	double_t t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) gSink += streamBuffer(g.addr(), g.size() * sizeof(T));
+	t = timeNowS9() - t;
+	cout << setw(36) << left << name << setw(10) << right << fixed << setprecision(2)
+		<< (static_cast<double_t>(g.size()) * sizeof(T) * runs / t) / 1.0e9 << " GB/s "
+		<< (static_cast<double_t>(g.size()) * runs / t) / 1.0e6 << " MVerts/s" << endl;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "Compressed vertex benchmark - quantised positions, octahedral normals, half float UVs")
+	("file", po::value<string>(), "mesh to load, otherwise a random sphere is used")
+	("vertices", po::value<size_t>()->default_value(2000000), "vertices in the random sphere")
+	("runs", po::value<size_t>()->default_value(5), "runs per measurement")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t runs = vm["runs"].as<size_t>();
+	GeometryPNF g;
+
+	if (vm.count("file")) {
+		AssetBasic a = AssetImporter::load(vm["file"].as<string>(), IMPORT_MINIMAL);
+		if (!a) return EXIT_FAILURE;
+		g = a.getGeometry();
+	} else {
+		size_t n = vm["vertices"].as<size_t>();
+		vector<VertPNF> verts (n);
+		srand(1);
+		for (size_t i = 0; i < n; ++i) {
+			glm::vec3 d (rand() / (float_t)RAND_MAX - 0.5f, rand() / (float_t)RAND_MAX - 0.5f, rand() / (float_t)RAND_MAX - 0.5f);
+			if (glm::length(d) < 1e-6f) d = glm::vec3(0.0f, 0.0f, 1.0f);
+			d = glm::normalize(d);
+			verts[i].mP = fromVec3<Float3>(d * 10.0f);
+			verts[i].mN = fromVec3<Float3>(d);
+		}
+		g.createEmpty();
+		g.swapBuffer(verts);
+	}
+
+	size_t n = g.size();
+
+	// Fill the eight UV sets so the half floats have something to do
+	GeometryPNT8F full = g.convert<GeometryPNT8F>();
+	BufferView<VertPNT8F> fv = full.getBufferView();
+	for (size_t i = 0; i < n; ++i)
+		for (int j = 0; j < 8; ++j) {
+			fv[i].mT[j].x = rand() / (float_t)RAND_MAX;
+			fv[i].mT[j].y = rand() / (float_t)RAND_MAX;
+		}
+
+	cout << "S9Gear - " << n << " vertices, " << WorkerPool::get().size() << " threads" << endl << endl;
+
+	reportSize("PNF", sizeof(VertPNF), n);
+	reportSize("PNQ", sizeof(VertPNQ), n);
+	reportSize("PNT8F", sizeof(VertPNT8F), n);
+	reportSize("PNT8Q", sizeof(VertPNT8Q), n);
+	cout << endl;
+
+	double_t t;
+	GeometryPNQ pq;
+	GeometryPNT8Q packed;
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) pq = g.convert<GeometryPNQ>();
+	reportRate("PNF -> PNQ encode", n, runs, timeNowS9() - t);
+
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) packed = full.convert<GeometryPNT8Q>();
+	reportRate("PNT8F -> PNT8Q encode", n, runs, timeNowS9() - t);
+
+	GeometryPNT8F back;
+	t = timeNowS9();
+	for (size_t r = 0; r < runs; ++r) back = packed.convert<GeometryPNT8F>();
+	reportRate("PNT8Q -> PNT8F decode", n, runs, timeNowS9() - t);
+	cout << endl;
+
+	reportStream("PNF stream", g, runs);
+	reportStream("PNQ stream", pq, runs);
+	reportStream("PNT8F stream", full, runs);
+	reportStream("PNT8Q stream", packed, runs);
+	cout << endl;
+
+	// Accuracy of the round trip against the float originals
+	const PositionQuant &q = packed.getQuant();
+	double_t diag = glm::length(q.mExtent);
+	double_t pmax = 0.0, psum = 0.0, amax = 0.0, asum = 0.0, tmax = 0.0;
+	BufferView<VertPNT8F> bv = back.getBufferView();
+
+	for (size_t i = 0; i < n; ++i) {
+		double_t pe = glm::length(toVec3(fv[i].mP) - toVec3(bv[i].mP)) / diag;
+		pmax = std::max(pmax, pe);
+		psum += pe;
+
+		glm::vec3 na = toVec3(fv[i].mN), nb = toVec3(bv[i].mN);
+		if (glm::length(na) > 0.0f) {
+			double_t c = glm::dot(glm::normalize(na), nb);
+			double_t ae = acos(std::min(1.0, std::max(-1.0, c))) * 180.0 / M_PI;
+			amax = std::max(amax, ae);
+			asum += ae;
+		}
+
+		for (int j = 0; j < 8; ++j) {
+			tmax = std::max(tmax, static_cast<double_t>(fabs(fv[i].mT[j].x - bv[i].mT[j].x)));
+			tmax = std::max(tmax, static_cast<double_t>(fabs(fv[i].mT[j].y - bv[i].mT[j].y)));
+		}
+	}
+
+	cout << scientific << setprecision(3);
+	cout << "Position error / bounds diagonal  max " << pmax << " mean " << psum / n << endl;
+	cout << "Normal error (degrees)            max " << amax << " mean " << asum / n << endl;
+	cout << "UV error                          max " << tmax << endl;
+
+	return EXIT_SUCCESS;
+}
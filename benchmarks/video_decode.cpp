@@ -0,0 +1,243 @@
+/**
+* @brief Frames per second of CPU against GPU YUYV decode, direct and PBO uploads, for a rig of simulated or replayed cameras
+* @file video_decode.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 15/08/2012
+*
+*/
+
+#include "s9/gl/video.hpp"
+#include "s9/utils.hpp"
+
+#include <GL/glfw3.h>
+#include <boost/program_options.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+namespace po = boost::program_options;
+
+/*
+ * Stands in for a UVCVideo - a thread publishing a moving YUYV test card at a fixed rate,
+ * converting it on the CPU first unless set raw, exactly as the capture thread would.
+ * An fps of 0 publishes as fast as it can
+ */
+
+class SimulatedCamera : public VideoSource {
+public:
+	SimulatedCamera(size_t w, size_t h, size_t fps) : mW(w), mH(h), mFPS(fps), mRunning(true), mSeq(0) {
+		vYUYV.resize(w * h * 2);
+		for (size_t y = 0; y < h; ++y)
+			for (size_t x = 0; x < w; ++x) {
+				unsigned char *p = &vYUYV[(y * w + x) * 2];
+				p[0] = (x + y) & 0xff;
+				p[1] = (x & 1) ? (y * 255 / h) : (x * 255 / w);
+			}
+		VideoFrame init;
+		init.mData.resize(w * h * 3, 0);
+		mFrames.reset(init);
+		pThread = new boost::thread(boost::ref(*this));
+	}
+
+	~SimulatedCamera() { stop(); }
+
+	void stop() {
+		if (pThread == NULL) return;
+		mRunning = false;
+		pThread->join();
+		delete pThread;
+		pThread = NULL;
+	}
+
+	void operator()() {
+		double_t next = timeMonotonicS9();
+		while (mRunning) {
+			VideoFrame &f = mFrames.back();
+			// Scroll the card so every frame differs
+			size_t shift = (mSeq * 4) % vYUYV.size();
+			if (mRaw) {
+				f.mData.resize(mW * mH * 2);
+				memcpy(&f.mData[0], &vYUYV[shift], vYUYV.size() - shift);
+				memcpy(&f.mData[vYUYV.size() - shift], &vYUYV[0], shift);
+				f.mFormat = FRAME_YUYV;
+			} else {
+				f.mData.resize(mW * mH * 3);
+				yuyv2rgb(&vYUYV[0], &f.mData[0], mW, mH);
+				f.mFormat = FRAME_RGB;
+			}
+			f.mSeq = ++mSeq;
+			f.mTimestamp = timeMonotonicS9();
+			_publish();
+
+			if (mFPS > 0) {
+				next += 1.0 / mFPS;
+				double_t wait = next - timeMonotonicS9();
+				if (wait > 0) boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(wait * 1.0e6)));
+			} else
+				boost::this_thread::yield();
+		}
+	}
+
+protected:
+	size_t mW, mH, mFPS;
+	volatile bool mRunning;
+	uint64_t mSeq;
+	std::vector<unsigned char> vYUYV;
+	boost::thread *pThread;
+};
+
+struct Result {
+	double_t mFPS;
+	double_t mLatency;
+	uint64_t mDropped;
+};
+
+/*
+ * Update every camera as fast as the render loop will go and draw nothing else, so the
+ * figure is the upload and decode cost alone. glFinish each pass to count completed work
+ */
+
+static Result run(size_t cameras, size_t w, size_t h, size_t fps, double_t seconds, DecodeMode mode, TextureUpload upload,
+	const string &replay) {
+	std::vector<VidCam> cams;
+	for (size_t i = 0; i < cameras; ++i) {
+		boost::shared_ptr<VideoSource> source;
+		if (replay.empty())
+			source.reset(new SimulatedCamera(w, h, fps));
+		else {
+			ReplayVideo *r = new ReplayVideo();
+			source.reset(r);
+			if (!r->startCapture(replay, w, h, fps)) {
+				Result none;
+				none.mFPS = none.mLatency = 0;
+				none.mDropped = 0;
+				return none;
+			}
+		}
+		cams.push_back(VidCam(source, w, h, mode));
+		cams.back().setUpload(upload);
+	}
+
+	Result r;
+	r.mFPS = r.mLatency = 0;
+	r.mDropped = 0;
+
+	if (mode == DECODE_GPU && cams[0].getDecode() != DECODE_GPU) {
+		for (size_t i = 0; i < cameras; ++i) cams[i].stop();
+		return r;
+	}
+
+	// Warm up - first uploads allocate in the driver
+	double_t start = timeMonotonicS9();
+	while (timeMonotonicS9() - start < 0.5) {
+		for (size_t i = 0; i < cameras; ++i) cams[i].update();
+		glFinish();
+	}
+
+	std::vector<VidCamStats> before;
+	for (size_t i = 0; i < cameras; ++i) before.push_back(cams[i].getStats());
+
+	start = timeMonotonicS9();
+	while (timeMonotonicS9() - start < seconds) {
+		for (size_t i = 0; i < cameras; ++i) cams[i].update();
+		glFinish();
+		glfwSwapBuffers();
+		glfwPollEvents();
+	}
+	double_t elapsed = timeMonotonicS9() - start;
+
+	for (size_t i = 0; i < cameras; ++i) {
+		VidCamStats st = cams[i].getStats();
+		r.mFPS += (st.mUploaded - before[i].mUploaded) / elapsed;
+		r.mDropped += st.mDropped - before[i].mDropped;
+		r.mLatency += st.mLatencyMean / cameras;
+		cams[i].stop();
+	}
+
+	CXGLERROR
+	return r;
+}
+
+int main (int argc, const char * argv[]) {
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+	("help", "YUYV decode benchmark - intended for Mesa llvmpipe, run with LIBGL_ALWAYS_SOFTWARE=1")
+	("width", po::value<size_t>()->default_value(640), "frame width")
+	("height", po::value<size_t>()->default_value(360), "frame height")
+	("cameras", po::value<size_t>()->default_value(8), "number of simulated cameras")
+	("fps", po::value<size_t>()->default_value(0), "capture rate of each camera, 0 for unlimited")
+	("seconds", po::value<double_t>()->default_value(5.0), "measurement time per mode")
+	("replay", po::value<string>(), "every camera plays this recording, at its size, in place of the test card")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		cout << desc << "\n";
+		return 1;
+	}
+
+	size_t w = vm["width"].as<size_t>() & ~1, h = vm["height"].as<size_t>();
+	size_t cameras = vm["cameras"].as<size_t>();
+	size_t fps = vm["fps"].as<size_t>();
+	double_t seconds = vm["seconds"].as<double_t>();
+	string replay = vm.count("replay") ? vm["replay"].as<string>() : "";
+
+	if (!glfwInit()) {
+		cerr << "S9Gear - Failed to initialise GLFW" << endl;
+		return EXIT_FAILURE;
+	}
+
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MAJOR, 3);
+	glfwOpenWindowHint(GLFW_OPENGL_VERSION_MINOR, 2);
+	glfwOpenWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_COMPAT_PROFILE);
+
+	GLFWwindow win = glfwOpenWindow(320, 180, GLFW_WINDOWED, "S9Gear Video Decode", NULL);
+	if (!win) {
+		cerr << "S9Gear - Failed to open GLFW window: " << glfwErrorString(glfwGetError()) << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+	glfwSwapInterval(0);
+
+	glewExperimental = true;
+	if (glewInit() != GLEW_OK) {
+		cerr << "S9Gear - GLEWInit failed" << endl;
+		glfwTerminate();
+		return EXIT_FAILURE;
+	}
+
+	cout << "S9Gear - " << cameras << " cameras at " << w << "x" << h << " on " << glGetString(GL_RENDERER) << endl;
+	cout << "Upload per frame: CPU " << w * h * 3 / 1024 << "KB, GPU " << w * h * 2 / 1024 << "KB" << endl << endl;
+
+	const char *names[] = { "CPU", "GPU" };
+	const DecodeMode modes[] = { DECODE_CPU, DECODE_GPU };
+	const char *uploadNames[] = { "direct", "PBO" };
+	const TextureUpload uploads[] = { UPLOAD_DIRECT, UPLOAD_PBO };
+
+	cout << setw(8) << left << "Decode" << setw(8) << "Upload" << setw(14) << right << "Frames/s" << setw(14) << "Per camera"
+		<< setw(14) << "Latency ms" << setw(10) << "Dropped" << endl;
+
+	for (int m = 0; m < 2; ++m) {
+		for (int u = 0; u < 2; ++u) {
+			Result r = run(cameras, w, h, fps, seconds, modes[m], uploads[u], replay);
+			cout << setw(8) << left << names[m] << setw(8) << uploadNames[u];
+			if (r.mFPS == 0) {
+				cout << "  unavailable" << endl;
+				continue;
+			}
+			cout << fixed << setprecision(1)
+				<< setw(14) << right << r.mFPS << setw(14) << r.mFPS / cameras
+				<< setw(14) << r.mLatency * 1000.0 << setw(10) << r.mDropped << endl;
+		}
+	}
+
+	glfwTerminate();
+	return EXIT_SUCCESS;
+}
@@ -53,13 +53,13 @@ void VideoApp::display(double_t dt){
     glm::mat4 mvp = mCamera.getMatrix() * mTestQuad.getMatrix();
 
     mShader.s("uMVPMatrix",mvp);
-    mVideo.bind();
+    if (mVideo) mVideo.bind();
 
     mTestQuad.draw();
-    mVideo.unbind();
+    if (mVideo) mVideo.unbind();
 
     mShader.unbind();
-    mVideo.update();
+    if (mVideo) mVideo.update();
 
     CXGLERROR
 }
@@ -12,6 +12,8 @@
 #include "common.hpp"
 #include "geometry.hpp"
 #include "primitive.hpp"
+#include "meshcache.hpp"
+#include "mesh_optimise.hpp"
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
@@ -36,7 +38,7 @@ namespace s9 {
 		Asset() {};
 		virtual operator int() const { return mObj.use_count() > 0; };
 		Asset(T geom) {mObj.reset(new SharedObj()); mObj->mGeom = geom; }
-		T getGeometry() { return mObj->mGeom; };
+		T& getGeometry() { return mObj->mGeom; };
 
 	};
 
@@ -46,19 +48,58 @@ namespace s9 {
 	typedef Asset<GeometryPNF> AssetBasic;
 	typedef Asset<GeometryFullFloat> AssetFull;
 	
+	/*
+	 * Post-processing presets for the importer. MINIMAL only runs the steps PNF geometry needs
+	 */
+
+	const unsigned int IMPORT_FULL = aiProcessPreset_TargetRealtime_MaxQuality;
+	const unsigned int IMPORT_MINIMAL = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices
+		| aiProcess_GenSmoothNormals | aiProcess_SortByPType;
+
+	/*
+	 * Load time metrics, all in seconds
+	 */
+
+	struct AssetImportStats {
+		AssetImportStats() : mParse(0), mPostProcess(0), mConvert(0), mOptimise(0), mCacheLoad(0), mCacheHit(false), mVertices(0), mIndices(0) {};
+		double_t mParse;
+		double_t mPostProcess;
+		double_t mConvert;
+		double_t mOptimise;
+		double_t mCacheLoad;
+		VertexCacheStats mCacheBefore;		// Post transform cache, before and after optimising
+		VertexCacheStats mCacheAfter;
+		bool mCacheHit;
+		size_t mVertices;
+		size_t mIndices;
+	};
+
 	/*
  	 * A wrapper around the Assimp library
- 	 * \todo do something better with pScene
+ 	 * Meshes are decoded straight into interleaved PNF across the worker pool.
+ 	 * Single node imports are optimised for drawing and, with the cache turned on, written
+ 	 * to a .s9mesh file and mapped back on later loads
  	 */
 	
 	class AssetImporter {
 	public:
-		static AssetBasic load(std::string filename);
+		static AssetBasic load(std::string filename, unsigned int flags = IMPORT_FULL, AssetImportStats *stats = NULL);
+
+		// The binary cache is off by default. An empty dir puts the cache beside the source,
+		// so pass a writable directory when the assets are shared or read only
+		static void setCache(bool enabled, std::string dir = "") { mCacheEnabled = enabled; mCacheDir = dir; };
+
+		// Reorder single node imports for the vertex cache, overdraw and fetch. On by default
+		static void setOptimise(bool enabled) { mOptimise = enabled; };
 		
 		virtual ~AssetImporter();
 
 	protected:
 
+		static bool mCacheEnabled;
+		static std::string mCacheDir;
+		static bool mOptimise;
+
 		static AssetPtr _load (const struct aiScene *sc, const struct aiNode* nd, AssetPtr p);
 		static const struct aiScene* pScene;
 
@@ -265,5 +265,44 @@ yuv400pto422(int * out,unsigned char *pic,int width);
 
 void yuv422ptoRGB(int * out, unsigned char *pic, int width);
 
+/*------------------------- SIMD kernels and dispatch ------------------------*/
+
+/* yuyv to rgb/bgr in 14 bit fixed point, rounded to nearest:
+*      r = y + ((CS_RV * (v-128) + CS_ROUND) >> CS_FIX)
+*      g = y + ((CS_GU * (u-128) + CS_GV * (v-128) + CS_ROUND) >> CS_FIX)
+*      b = y + ((CS_BU * (u-128) + CS_ROUND) >> CS_FIX)
+* the scalar and SIMD versions all produce exactly this
+*/
+#define CS_FIX   14
+#define CS_ROUND (1 << (CS_FIX - 1))
+#define CS_RV    22970   /*  1.402   */
+#define CS_GU    -5638   /* -0.34414 */
+#define CS_GV    -11700  /* -0.71414 */
+#define CS_BU    29032   /*  1.772   */
+
+#define CS_SIMD_NONE  0
+#define CS_SIMD_SSE2  1
+#define CS_SIMD_SSSE3 2
+#define CS_SIMD_AVX2  3
+
+/* best instruction set this cpu and os support */
+int colorspaces_simd_detect (void);
+
+/* instruction set the dispatched converters use - the detected one by default */
+int colorspaces_simd_level (void);
+
+/* force a lower level, for testing and benchmarks. returns the level in use */
+int colorspaces_set_simd_level (int level);
+
+/* scalar references - yuyv2rgb, yuyv2bgr, yuyv2bgr1, nv12_to_yuyv, yuv420_to_yuyv
+*  and uyvy_to_yuyv dispatch to the SIMD kernels and fall back to these
+*/
+void yuyv2rgb_c (BYTE *pyuv, BYTE *prgb, int width, int height);
+void yuyv2bgr_c (BYTE *pyuv, BYTE *pbgr, int width, int height);
+void yuyv2bgr1_c (BYTE *pyuv, BYTE *pbgr, int width, int height);
+void nv12_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height);
+void yuv420_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height);
+void uyvy_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height);
+
 #endif
 
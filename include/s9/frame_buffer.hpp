@@ -0,0 +1,111 @@
+/**
+* @brief Lock free hand off of frames between a producer and a consumer thread
+* @file frame_buffer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 13/08/2012
+*
+*/
+
+#ifndef S9_FRAME_BUFFER_HPP
+#define S9_FRAME_BUFFER_HPP
+
+#include "common.hpp"
+
+#include <boost/noncopyable.hpp>
+
+namespace s9 {
+
+	/*
+	 * A decoded video frame. mSeq counts up from 1 per frame the source produced, so gaps
+	 * are drops. mTimestamp is when it was captured, in seconds on the timeMonotonicS9 clock
+	 */
+
+	typedef enum {
+		FRAME_RGB,			// 3 bytes per pixel
+		FRAME_YUYV			// 2 bytes per pixel, u and v shared by each pair
+	} FrameFormat;
+
+	struct VideoFrame {
+		VideoFrame() : mFormat(FRAME_RGB), mSeq(0), mTimestamp(0) {};
+		std::vector<unsigned char> mData;
+		FrameFormat mFormat;
+		uint64_t mSeq;
+		double_t mTimestamp;
+	};
+
+	/*
+	 * Triple buffer for one writer thread and one reader thread. The writer fills back()
+	 * and publishes it, the reader fetches the newest published slot into front(). Neither
+	 * side ever waits - the writer overwrites a frame the reader has not taken (a drop) and
+	 * the reader keeps its current frame until a new one arrives.
+	 *
+	 * The middle slot index and a fresh bit share one word that both sides swap with a
+	 * full barrier compare and swap, so slot contents are visible before the index is
+	 */
+
+	template <class T>
+	class TripleBuffer : boost::noncopyable {
+	public:
+		TripleBuffer() : mFront(0), mBack(2), mState(1), mPublished(0), mDropped(0) {};
+
+		// Only while neither thread is running
+		void reset(const T &init) {
+			for (int i = 0; i < 3; ++i) vSlots[i] = init;
+			mFront = 0; mBack = 2; mState = 1;
+			mPublished = mDropped = 0;
+		}
+
+		// Writer side
+		T& back() { return vSlots[mBack]; };
+
+		// Returns true if an unread frame was overwritten
+		bool publish() {
+			uint32_t old = _swap(mBack | FRESH);
+			mBack = old & INDEX;
+			__sync_fetch_and_add(&mPublished, 1);
+			if (old & FRESH) {
+				__sync_fetch_and_add(&mDropped, 1);
+				return true;
+			}
+			return false;
+		}
+
+		// Reader side - true if front() now holds a frame it has not seen
+		bool fetch() {
+			if (!(mState & FRESH)) return false;
+			mFront = _swap(mFront) & INDEX;
+			return true;
+		}
+
+		// True if fetch would find a new frame
+		bool ready() const { return (mState & FRESH) != 0; };
+
+		T& front() { return vSlots[mFront]; };
+		const T& front() const { return vSlots[mFront]; };
+
+		// Safe from either thread
+		uint64_t published() { return __sync_fetch_and_add(&mPublished, 0); };
+		uint64_t dropped() { return __sync_fetch_and_add(&mDropped, 0); };
+
+	protected:
+
+		static const uint32_t INDEX = 3;
+		static const uint32_t FRESH = 4;
+
+		uint32_t _swap(uint32_t v) {
+			uint32_t old;
+			do { old = mState; } while (!__sync_bool_compare_and_swap(&mState, old, v));
+			return old;
+		}
+
+		T vSlots[3];
+		uint32_t mFront;				// Reader only
+		uint32_t mBack;					// Writer only
+		volatile uint32_t mState;		// Middle slot | FRESH
+		volatile uint64_t mPublished;
+		volatile uint64_t mDropped;
+	};
+
+}
+
+#endif
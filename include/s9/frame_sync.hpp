@@ -0,0 +1,117 @@
+/**
+* @brief Timestamp aligned frame sets from several cameras
+* @file frame_sync.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/08/2012
+*
+*/
+
+#ifndef S9_FRAME_SYNC_HPP
+#define S9_FRAME_SYNC_HPP
+
+#include "common.hpp"
+#include "video_source.hpp"
+
+namespace s9 {
+
+	/*
+	 * What to do when the best set on offer spans more than the tolerance. NEAREST shows it
+	 * anyway, so the picture never stalls. DROP shows nothing new until the cameras line up
+	 * again. WAIT blocks update, up to the timeout, for a set that does line up
+	 */
+
+	typedef enum {
+		SYNC_NEAREST,
+		SYNC_DROP,
+		SYNC_WAIT
+	} SyncPolicy;
+
+	/*
+	 * Skew is the spread of capture times within a set. Offsets are each camera's mean
+	 * capture time relative to the set's, so a persistently early or late camera stands out
+	 */
+
+	struct SyncStats {
+		SyncStats() : mSets(0), mOutside(0), mDropped(0), mSkew(0), mSkewMean(0), mSkewMax(0), mWaited(0) {};
+		uint64_t mSets;				// Handed to the renderer
+		uint64_t mOutside;			// Of those, shown beyond the tolerance
+		uint64_t mDropped;			// Sets given up on - DROP, or WAIT timing out
+		double_t mSkew;				// Seconds, of the last set
+		double_t mSkewMean;
+		double_t mSkewMax;
+		double_t mWaited;			// Seconds update spent blocked in total
+		std::vector<double_t> vOffset;
+	};
+
+	/*
+	 * Gathers frames from several sources into sets captured at the same moment, so a
+	 * renderer texturing from all of them shows one instant rather than whatever each
+	 * happened to hold. Sources should stamp frames with capture time - UVCVideo uses the
+	 * driver's timestamp.
+	 *
+	 * update takes every new frame out of the sources into a short history each. The set's
+	 * time is the newest instant every camera has reached, and each camera offers its frame
+	 * nearest to it. A set is new if any of those frames has not been shown. After update
+	 * returns true getFrame holds the whole set until the next call, so the renderer swaps
+	 * every texture together.
+	 *
+	 * The sync consumes the sources - do not also call newFrame on them, or VidCam::update
+	 * without a frame. Render thread only
+	 */
+
+	class FrameSync : boost::noncopyable {
+	public:
+		FrameSync(double_t tolerance = 0.01, SyncPolicy policy = SYNC_NEAREST, size_t history = 4);
+
+		void add(boost::shared_ptr<VideoSource> source);
+		size_t size() const { return vCameras.size(); };
+
+		// True if a new set is ready
+		bool update();
+
+		const VideoFrame& getFrame(size_t i) const { return vCameras[i].mShown; };
+		double_t getTimestamp() const { return mTimestamp; };
+
+		void setPolicy(SyncPolicy policy) { mPolicy = policy; };
+		SyncPolicy getPolicy() const { return mPolicy; };
+		void setTolerance(double_t tolerance) { mTolerance = tolerance; };
+		double_t getTolerance() const { return mTolerance; };
+		void setTimeout(double_t timeout) { mTimeout = timeout; };
+		double_t getTimeout() const { return mTimeout; };
+
+		SyncStats getStats() const { return mStats; };
+
+	protected:
+
+		struct Camera {
+			boost::shared_ptr<VideoSource> pSource;
+			std::vector<VideoFrame> vHistory;	// Ring, oldest at mHead
+			size_t mHead, mCount;
+			VideoFrame mShown;
+			size_t mPick;						// Index into the ring, or NOT_PICKED for mShown
+		};
+
+		static const size_t NOT_PICKED = static_cast<size_t>(-1);
+
+		void _gather();
+		bool _choose(double_t &skew);
+		void _show(double_t skew);
+		void _prune(double_t before);
+
+		VideoFrame& _at(Camera &c, size_t i) { return c.vHistory[(c.mHead + i) % c.vHistory.size()]; };
+
+		std::vector<Camera> vCameras;
+		size_t mHistory;
+		double_t mTolerance;
+		double_t mTimeout;
+		SyncPolicy mPolicy;
+
+		double_t mTimestamp;		// Of the set on show
+		double_t mCandidate;		// Time of the set being considered
+		double_t mLastDropped;
+		SyncStats mStats;
+	};
+
+}
+
+#endif
@@ -17,9 +17,74 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "vertex_types.hpp"
+#include "vertex_compress.hpp"
+#include "parallel.hpp"
 
 namespace s9 {
+
+	/*
+	 * A non-owning view over a contiguous run of elements - vertices or indices.
+	 * Valid only as long as the Geometry it came from is not resized
+	 */
+
+	template <class T>
+	class BufferView {
+	public:
+		typedef T value_type;
+		typedef T* iterator;
+
+		BufferView() : pData(NULL), mSize(0) {};
+		BufferView(T *d, size_t s) : pData(d), mSize(s) {};
+
+		T* data() const { return pData; };
+		size_t size() const { return mSize; };
+		bool empty() const { return mSize == 0; };
+		size_t bytes() const { return mSize * sizeof(T); };
+
+		T* begin() const { return pData; };
+		T* end() const { return pData + mSize; };
+		T& operator[](size_t i) const { return pData[i]; };
+
+		// Narrow the view to a sub range
+		BufferView<T> sub(size_t offset, size_t count) const { return BufferView<T>(pData + offset, count); };
+
+		// Allow a mutable view to be passed where a const one is expected
+		operator BufferView<const T>() const { return BufferView<const T>(pData,mSize); };
+
+	protected:
+		T *pData;
+		size_t mSize;
+	};
 	
+	/*
+	 * What has changed in a geometry since it was last uploaded. Vertices are tracked as a
+	 * single [begin,end) span - the union of every change - which suits deformers that
+	 * touch contiguous runs and keeps the bookkeeping to a couple of compares
+	 */
+
+	struct DirtyRange {
+		DirtyRange() : mBegin(0), mEnd(0), mIndices(false), mResized(false) {};
+
+		void add(uint32_t b, uint32_t e) {
+			if (b >= e) return;
+			if (mBegin == mEnd) { mBegin = b; mEnd = e; }
+			else { mBegin = std::min(mBegin, b); mEnd = std::max(mEnd, e); }
+		};
+
+		void add(const DirtyRange &d) {
+			add(d.mBegin, d.mEnd);
+			mIndices |= d.mIndices;
+			mResized |= d.mResized;
+		};
+
+		bool vertices() const { return mBegin != mEnd; };
+		bool any() const { return vertices() || mIndices || mResized; };
+
+		uint32_t mBegin, mEnd;		// Vertices that changed
+		bool mIndices;				// Index buffer replaced
+		bool mResized;				// Vertex count changed
+	};
+
 	/*
 	 * Base Geometry. Used by the primitive
 	 * \todo rather than use a dirty flag, register a listener or similar. Make implicit!
@@ -29,11 +94,16 @@ namespace s9 {
 	public:
 		virtual bool isDirty(){ return false;}
 		virtual void setDirty(bool b) {}
+		virtual DirtyRange getDirty() { return DirtyRange(); }
+		virtual void clearDirty() {}
+		virtual int elementsize() { return 0; }
 		virtual void* addr() {return NULL; }
 		virtual bool isIndexed(){return false; }
 		virtual uint32_t* indexaddr(){return NULL; }
 		virtual uint32_t size() {return 0;}
 		virtual uint32_t indexsize() {return 0;}
+
+		BufferView<uint32_t> getIndexView() { return BufferView<uint32_t>(indexaddr(), indexsize()); };
 	};
 	
 	
@@ -50,25 +120,28 @@ namespace s9 {
 	template <class T>
 	class Geometry : public DrawableGeometry{
 	public:
+		typedef T VertexType;
+
 		Geometry() {};
 		
-		Geometry(std::vector<glm::vec3> v, std::vector<glm::vec3> n) {};
-		Geometry (std::vector<float_t> v, std::vector<float_t> n) {};
-		Geometry(std::vector<float_t> v, std::vector<float_t> n, std::vector<float_t> t, std::vector<float_t> c) {};
+		Geometry(const std::vector<glm::vec3> &v, const std::vector<glm::vec3> &n) {};
+		Geometry (const std::vector<float_t> &v, const std::vector<float_t> &n) {};
+		Geometry(const std::vector<float_t> &v, const std::vector<float_t> &n, const std::vector<float_t> &t, const std::vector<float_t> &c) {};
 
 	protected:
 	
 		struct SharedObj {
 			std::vector<T> vBuffer;
 			std::vector<uint32_t> vIndices;
-			bool mDirty;
+			DirtyRange mDirty;
+			PositionQuant mQuant;		// Only meaningful for quantised vertex types
 		};
 		
 		boost::shared_ptr<SharedObj> mObj;
 	
 	public:
 		
-		Geometry(std::vector<T> v) {
+		Geometry(const std::vector<T> &v) {
 			mObj.reset(new SharedObj());
 			mObj->vBuffer = v;
 		};
@@ -78,25 +151,53 @@ namespace s9 {
 		template<class U>
 		U convert() {};
 
-		std::vector<T> getBuffer() {return mObj->vBuffer; };
+		// Zero copy access to the underlying data. Views are invalidated by add / del
+		const std::vector<T>& getBuffer() const {return mObj->vBuffer; };
+		BufferView<T> getBufferView() { return BufferView<T>(data(), mObj->vBuffer.size()); };
+		BufferView<const T> getBufferView() const { return BufferView<const T>(data(), mObj->vBuffer.size()); };
+		BufferView<uint32_t> getIndexView() { return BufferView<uint32_t>(indexdata(), mObj->vIndices.size()); };
+		BufferView<const uint32_t> getIndexView() const { return BufferView<const uint32_t>(indexdata(), mObj->vIndices.size()); };
+
+		// Take ownership of an existing buffer by swapping - v is left with our old contents.
+		// Every vertex is marked dirty, as a buffer that still fits only sends the dirty span
+		void swapBuffer(std::vector<T> &v) { mObj->vBuffer.swap(v); mObj->mDirty.mResized = true; markDirty(0, size()); };
+		void swapIndices(std::vector<uint32_t> &idx) { mObj->vIndices.swap(idx); mObj->mDirty.mIndices = true; };
+
+		// Writable view of a span, marked dirty for the next upload
+		BufferView<T> editRange(uint32_t b, uint32_t e) { markDirty(b, e); return getBufferView().sub(b, e - b); };
 	
 		virtual operator int() const { return mObj.use_count() > 0; };
 	
-		void* addr() { return &(mObj->vBuffer[0]); };
-		uint32_t* indexaddr() { return &(mObj->vIndices[0]); };
+		T* data() const { return mObj->vBuffer.empty() ? NULL : &(mObj->vBuffer[0]); };
+		uint32_t* indexdata() const { return mObj->vIndices.empty() ? NULL : &(mObj->vIndices[0]); };
+
+		void* addr() { return data(); };
+		uint32_t* indexaddr() { return indexdata(); };
 		
 		uint32_t size() { return mObj->vBuffer.size(); };
 		uint32_t indexsize() { return mObj->vIndices.size(); };
 		int elementsize() { return sizeof(T); };
 		
 		bool isIndexed() {return mObj->vIndices.size() > 0; };
-		bool isDirty() {return mObj->mDirty;};
-		void setDirty(bool b) {mObj->mDirty = b; };
-		std::vector<uint32_t>  getIndices() {return mObj->vIndices; };
-		void addVertex(T v) {mObj->push_back(v); setDirty(true); };
-		void setVertex(T v, uint32_t p) { mObj->vBuffer[p] = v; setDirty(true); };
-		void delVertex(uint32_t p) { mObj->vBuffer.erase( mObj->vBuffer.begin() + p); setDirty(true); };
-		void addIndices(std::vector<uint32_t> idx) { mObj->vIndices = idx; };
+		bool isDirty() {return mObj->mDirty.any(); };
+
+		// true marks everything for upload, false forgets any changes
+		void setDirty(bool b) {
+			mObj->mDirty = DirtyRange();
+			if (b) { mObj->mDirty.add(0, size()); mObj->mDirty.mIndices = true; }
+		};
+
+		void markDirty(uint32_t b, uint32_t e) { mObj->mDirty.add(b, e); };
+		DirtyRange getDirty() { return mObj->mDirty; };
+		void clearDirty() { mObj->mDirty = DirtyRange(); };
+
+		const std::vector<uint32_t>& getIndices() const {return mObj->vIndices; };
+		const PositionQuant& getQuant() const { return mObj->mQuant; };
+		void setQuant(const PositionQuant &q) { mObj->mQuant = q; };
+		void addVertex(const T &v) {mObj->vBuffer.push_back(v); mObj->mDirty.mResized = true; markDirty(size() - 1, size()); };
+		void setVertex(const T &v, uint32_t p) { mObj->vBuffer[p] = v; markDirty(p, p + 1); };
+		void delVertex(uint32_t p) { mObj->vBuffer.erase( mObj->vBuffer.begin() + p); mObj->mDirty.mResized = true; markDirty(p, size()); };
+		void addIndices(const std::vector<uint32_t> &idx) { mObj->vIndices = idx; mObj->mDirty.mIndices = true; };
 	
 	};
 
@@ -106,11 +207,12 @@ namespace s9 {
 	// Specialist contructors for speed - basically, zipping from different vectors
 	
 	template<>
-	inline Geometry<VertPNG>::Geometry(std::vector<glm::vec3> v, std::vector<glm::vec3> n) {
+	inline Geometry<VertPNG>::Geometry(const std::vector<glm::vec3> &v, const std::vector<glm::vec3> &n) {
 		mObj.reset(new SharedObj());
 		
 		if (v.size() != n.size()) { std::cerr << "S9Gear - Counts do not match" << std::endl; throw; return; }
 		
+		mObj->vBuffer.reserve(v.size());
 		for (uint32_t i=0; i < v.size(); ++i){
 			VertPNG png = {v[i],n[i]};
 			mObj->vBuffer.push_back( png );
@@ -118,11 +220,12 @@ namespace s9 {
 	}
 	
 	template<>
-	inline Geometry<VertPNF>::Geometry (std::vector<float_t> v, std::vector<float_t> n) {
+	inline Geometry<VertPNF>::Geometry (const std::vector<float_t> &v, const std::vector<float_t> &n) {
 		mObj.reset(new SharedObj());
 		
 		if (v.size() != n.size()) { std::cerr << "S9Gear - Counts do not match" << std::endl; throw; return; }
 		
+		mObj->vBuffer.reserve(v.size() / 3);
 		for (uint32_t i=0; i < v.size(); i+=3){
 			Float3 a = {v[i],v[i+1],v[i+2]}; 
 			Float3 b = {n[i],n[i+1],n[i+2]};
@@ -133,10 +236,11 @@ namespace s9 {
 	
 
 	template<>
-	inline Geometry<VertPNCTF>::Geometry(std::vector<float_t> v, std::vector<float_t> n, std::vector<float_t> t, std::vector<float_t> c) {
+	inline Geometry<VertPNCTF>::Geometry(const std::vector<float_t> &v, const std::vector<float_t> &n, const std::vector<float_t> &t, const std::vector<float_t> &c) {
 		mObj.reset(new SharedObj());
 		///\todo add size checking heres
 		
+		mObj->vBuffer.reserve(v.size() / 3);
 		for (uint32_t i=0; i < v.size() / 3; i++){
 			Float3 v0 = {v[i*3],v[i*3+1],v[i*3+2]};
 			Float3 v1 = {n[i*3],n[i*3+1],n[i*3+2]};
@@ -149,7 +253,36 @@ namespace s9 {
 		}
 	}
 
-	// Conversion templates - probaby inefficient ><
+	/*
+	 * Conversion kernels over raw runs of vertices - SSE where available. See geometry.cpp
+	 */
+
+	void convertVertices(const VertPNF *src, VertPNT8F *dst, size_t n);
+	void convertVertices(const VertPNF *src, VertPNCTF *dst, size_t n);
+
+	/*
+	 * Runs a conversion kernel over one chunk of a parallelFor
+	 */
+
+	template <class T, class U>
+	struct ConvertRange {
+		ConvertRange(const T *s, U *d) : pSrc(s), pDst(d) {};
+		void operator()(size_t b, size_t e) const { convertVertices(pSrc + b, pDst + b, e - b); };
+		const T *pSrc;
+		U *pDst;
+	};
+
+	/*
+	 * Convert a whole buffer into a preallocated destination across the worker pool
+	 */
+
+	template <class T, class U>
+	inline void convertVerticesParallel(BufferView<const T> src, BufferView<U> dst) {
+		if (src.size() != dst.size()) { std::cerr << "S9Gear - Conversion counts do not match" << std::endl; return; }
+		parallelFor(src.size(), ConvertRange<T,U>(src.data(), dst.data()), 16384);
+	}
+
+	// Conversion templates
 
 	/*
 	 * Conversion from basic to 8 texture parameters - Quite specific
@@ -159,22 +292,15 @@ namespace s9 {
 	template <>
 	inline Geometry<VertPNT8F> Geometry<VertPNF>::convert() {
 
-		std::vector<VertPNT8F> vtemp;
-		std::vector<VertPNF> vstart = this->mObj->vBuffer;
-		for (std::vector<VertPNF>::iterator it = vstart.begin(); it != vstart.end(); it++) {
-			VertPNF p = *it;
-			VertPNT8F tp;
-			tp.mP = p.mP;
-			tp.mN = p.mN;
-
-			for (int i = 0; i < 8; ++i){
-				Float2 tt; tt.x = 0.0f; tt.y = 0.0f;
-				tp.mT[i] = tt;
-			}
-			vtemp.push_back(tp);
-		}
+		BufferView<const VertPNF> vstart = getBufferView();
+		std::vector<VertPNT8F> vtemp (vstart.size());
 
-		Geometry<VertPNT8F> b (vtemp);
+		if (!vtemp.empty())
+			convertVerticesParallel(vstart, BufferView<VertPNT8F>(&vtemp[0], vtemp.size()));
+
+		Geometry<VertPNT8F> b;
+		b.createEmpty();
+		b.swapBuffer(vtemp);
 		b.addIndices(getIndices());
 
 		return b;
@@ -187,30 +313,91 @@ namespace s9 {
 	template <>
 	template <>
 	inline Geometry<VertPNCTF> Geometry<VertPNF>::convert() {
-		std::vector<VertPNCTF> vtemp;
-		std::vector<VertPNF> vstart = this->mObj->vBuffer;
-		for (std::vector<VertPNF>::iterator it = vstart.begin(); it != vstart.end(); it++) {
-			VertPNF p = *it;
-			VertPNCTF tp;
-			tp.mP = p.mP;
-			tp.mN = p.mN;
-			tp.mC.x = tp.mC.y = tp.mC.z = 0.5f;
-			tp.mC.w = 1.0f;
-			tp.mT.x = tp.mT.y = 0.0f;
-			vtemp.push_back(tp);
-		}
 
-		Geometry<VertPNCTF> b (vtemp);
+		BufferView<const VertPNF> vstart = getBufferView();
+		std::vector<VertPNCTF> vtemp (vstart.size());
+
+		if (!vtemp.empty())
+			convertVerticesParallel(vstart, BufferView<VertPNCTF>(&vtemp[0], vtemp.size()));
+
+		Geometry<VertPNCTF> b;
+		b.createEmpty();
+		b.swapBuffer(vtemp);
 		b.addIndices(getIndices());
 		return b;
 	}
 
+	/*
+	 * Compress to or from the quantised vertex types. Encoding measures the bounds and
+	 * stores them on the result for the shader, decoding reads them back
+	 */
+
+	template <class T, class U>
+	inline Geometry<U> encodeGeometry(const Geometry<T> &g) {
+		BufferView<const T> src = g.getBufferView();
+		std::vector<U> vtemp (src.size());
+
+		EncodeRange<T,U> er;
+		er.pSrc = src.data();
+		er.pDst = vtemp.empty() ? NULL : &vtemp[0];
+		er.mQuant = quantForPositions(src.data(), src.size());
+		parallelFor(src.size(), er, 16384);
+
+		Geometry<U> b;
+		b.createEmpty();
+		b.swapBuffer(vtemp);
+		b.addIndices(g.getIndices());
+		b.setQuant(er.mQuant);
+		return b;
+	}
+
+	template <class T, class U>
+	inline Geometry<U> decodeGeometry(const Geometry<T> &g) {
+		BufferView<const T> src = g.getBufferView();
+		std::vector<U> vtemp (src.size());
+
+		DecodeRange<T,U> dr;
+		dr.pSrc = src.data();
+		dr.pDst = vtemp.empty() ? NULL : &vtemp[0];
+		dr.mQuant = g.getQuant();
+		parallelFor(src.size(), dr, 16384);
+
+		Geometry<U> b;
+		b.createEmpty();
+		b.swapBuffer(vtemp);
+		b.addIndices(g.getIndices());
+		return b;
+	}
+
+	template <> template <>
+	inline Geometry<VertPNQ> Geometry<VertPNF>::convert() { return encodeGeometry<VertPNF, VertPNQ>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNT8Q> Geometry<VertPNF>::convert() { return encodeGeometry<VertPNF, VertPNT8Q>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNTQ> Geometry<VertPNTF>::convert() { return encodeGeometry<VertPNTF, VertPNTQ>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNT8Q> Geometry<VertPNT8F>::convert() { return encodeGeometry<VertPNT8F, VertPNT8Q>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNF> Geometry<VertPNQ>::convert() { return decodeGeometry<VertPNQ, VertPNF>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNTF> Geometry<VertPNTQ>::convert() { return decodeGeometry<VertPNTQ, VertPNTF>(*this); }
+
+	template <> template <>
+	inline Geometry<VertPNT8F> Geometry<VertPNT8Q>::convert() { return decodeGeometry<VertPNT8Q, VertPNT8F>(*this); }
+
 	// Handy Typedefs
 	
 	typedef Geometry<VertPNCTF> GeometryFullFloat;
 	typedef Geometry<VertPNCTG> GeometryFullGLM;
 	typedef Geometry<VertPNF> GeometryPNF;
 	typedef Geometry<VertPNT8F> GeometryPNT8F;
+	typedef Geometry<VertPNQ> GeometryPNQ;
+	typedef Geometry<VertPNT8Q> GeometryPNT8Q;
 
 }
 
@@ -0,0 +1,95 @@
+/**
+* @brief OpenGL buffers for Geometry - attribute layouts and incremental uploads
+* @file buffer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 08/08/2012
+*
+*/
+
+#ifndef GL_BUFFER_HPP
+#define GL_BUFFER_HPP
+
+#include "../common.hpp"
+#include "common.hpp"
+#include "../geometry.hpp"
+
+namespace s9 {
+
+	namespace gl {
+
+		/*
+		 * Enable and point attributes 0..n-1 at the currently bound GL_ARRAY_BUFFER
+		 * following a VertexLayout, eg bindVertexFormat(VertexLayout<VertPNF>::get())
+		 */
+
+		void bindVertexFormat(const VertexFormat &f);
+
+		/*
+		 * UPLOAD_SUBDATA keeps one buffer and sends the dirty span with glBufferSubData.
+		 * UPLOAD_RING splits the buffer into segments that are written through unsynchronised
+		 * glMapBufferRange, each fenced after the draw that reads it, so the CPU never waits
+		 * on a buffer the GPU is still using. Each segment carries its own pending range so
+		 * a change is written once per segment rather than re-sending the whole mesh
+		 */
+
+		typedef enum {
+			UPLOAD_SUBDATA,
+			UPLOAD_RING
+		} UploadMode;
+
+		class GeometryBuffer {
+		public:
+			static const size_t RING_SEGMENTS = 3;
+
+			GeometryBuffer() {};
+			GeometryBuffer(UploadMode mode);
+			virtual operator int() const { return mObj.use_count() > 0; };
+
+			/*
+			 * Bring vbo (and ibo, if non zero) up to date with the geometry and clear its dirty
+			 * state. The ibo is element state of vao, which is bound to send it. The first
+			 * call, or a vertex count beyond capacity, reallocates
+			 */
+
+			size_t update(DrawableGeometry &g, GLuint vao, GLuint vbo, GLuint ibo);
+
+			// Draw from the current segment, instances copies. In ring mode this also fences it
+			void draw(DrawableGeometry &g, GLenum prim = GL_TRIANGLES, GLsizei instances = 1);
+
+			UploadMode getMode() const { return mObj->mMode; };
+
+			// Bytes sent by every GeometryBuffer - call endFrame once per frame
+			static size_t bytesThisFrame() { return mBytesFrame; };
+			static size_t bytesLastFrame() { return mBytesLast; };
+			static void endFrame() { mBytesLast = mBytesFrame; mBytesFrame = 0; };
+
+		protected:
+
+			size_t _updateSubData(DrawableGeometry &g, const DirtyRange &d);
+			size_t _updateRing(DrawableGeometry &g, const DirtyRange &d);
+
+			struct SharedObj {
+				SharedObj() : mMode(UPLOAD_SUBDATA), mCapacity(0), mIndexCapacity(0), mIndexType(GL_UNSIGNED_INT), mSegment(0) {
+					for (size_t i = 0; i < RING_SEGMENTS; ++i) vFences[i] = 0;
+				};
+				~SharedObj();
+
+				UploadMode mMode;
+				size_t mCapacity;						// Vertices per segment
+				size_t mIndexCapacity;
+				GLenum mIndexType;						// GL_UNSIGNED_SHORT when the vertex count allows
+				size_t mSegment;
+				GLsync vFences[RING_SEGMENTS];
+				DirtyRange vPending[RING_SEGMENTS];		// Changes not yet written to each segment
+			};
+
+			boost::shared_ptr<SharedObj> mObj;
+
+			static size_t mBytesFrame;
+			static size_t mBytesLast;
+		};
+
+	}
+}
+
+#endif
@@ -14,18 +14,25 @@
 #define GL_COMMON_HPP
 
 #include "GL/glew.h"
+#include "state.hpp"
 
 namespace s9 {
 	namespace gl {
 		
 		/*
-		 * Small Interface class to wrap the VAO state for an object
+		 * Small Interface class to wrap the VAO state for an object. Binds go through
+		 * State, so drawing the same object twice binds it once
 		 */
 
 		class ViaVAO {
 		public:
-			void bind() { glBindVertexArray(mVAO); };
-			void unbind()  { glBindVertexArray(0); };
+			virtual ~ViaVAO() {};
+			void bind() { State::bindVertexArray(mVAO); };
+			void unbind()  { State::unbindVertexArray(); };
+
+			// Draws count copies and leaves the VAO bound - RenderQueue draws through this
+			virtual void drawInstanced(GLsizei count) = 0;
+
 			GLuint mVAO;
 			unsigned int *handle;
 
@@ -41,15 +41,15 @@ namespace s9 {
 
 			virtual operator int() const { return mObj.use_count() > 0; };
 
-			void bind() { glBindFramebuffer(GL_FRAMEBUFFER, mObj->mID); glViewport(0,0,mObj->mW,mObj->mH); };
-			void unbind() { glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); } ;
+			void bind() { State::bindFramebuffer(GL_FRAMEBUFFER, mObj->mID); State::viewport(0,0,mObj->mW,mObj->mH); };
+			void unbind() { State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); } ;
 			bool checkStatus();
 			void printFramebufferInfo();
 			void resize(size_t w, size_t h);
-			void bindColour() { glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour); }
-			void unbindColour() { glBindTexture(GL_TEXTURE_RECTANGLE, 0); }
-			void bindDepth() { glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mDepth); }
-			void unbindDepth() { glBindTexture(GL_TEXTURE_RECTANGLE, 0);  }
+			void bindColour() { State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour); }
+			void unbindColour() { State::unbindTexture(GL_TEXTURE_RECTANGLE); }
+			void bindDepth() { State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mDepth); }
+			void unbindDepth() { State::unbindTexture(GL_TEXTURE_RECTANGLE);  }
 			
 			GLuint getWidth() {return mObj->mW; };
 			GLuint getHeight() {return mObj->mH; }
@@ -12,6 +12,7 @@
 #include "../common.hpp"
 #include "common.hpp"
 #include "utils.hpp"
+#include "buffer.hpp"
 #include "../primitive.hpp"
 #include "../asset.hpp"
 
@@ -32,175 +33,67 @@ namespace s9 {
 		class GLAsset : public Asset<T>, public ViaVAO {
 
 		protected:
-			virtual void _gen() {}
-			virtual void _allocate() {
-				glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-				glBufferData(GL_ARRAY_BUFFER, getGeometry().size() * getGeometry().elementsize(), getGeometry().addr(), GL_STATIC_DRAW);
+			/*
+			 * Creating a VAO around a basic Asset. The attributes come from the vertex
+			 * type's layout so any VertexP* type can be drawn
+			 */
 
-				glBindBuffer(GL_ARRAY_BUFFER, 0);
+			virtual void _gen() {
+				glGenVertexArrays(1, &(this->mVAO));
+				int s = getGeometry().indexsize() > 0 ? 2 : 1;
 
-				if (getGeometry().indexsize() > 0){
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-					glBufferData(GL_ELEMENT_ARRAY_BUFFER, getGeometry().indexsize() * sizeof(uint32_t), getGeometry().indexaddr(), GL_STATIC_DRAW);
-					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
-				}	
-			}
-		
-		public:
-			GLAsset() {};
-			GLAsset(T a) : Asset<T>(a) {  mVAO = 0; };
-			GLAsset(Asset<T> b) : Asset<T>(b) { mVAO = 0; }
-			T getGeometry() { return this->mObj->mGeom; }
-
-			virtual operator int() const { return mVAO != 0; };
+				handle = new unsigned int[s];
+				glGenBuffers(s,handle);
 
-			// Override this 
-			virtual void draw() {
-				if(mVAO == 0) _gen();
-				
 				bind();
 
-				if (getGeometry().isDirty()) _allocate();
-
-				if ( getGeometry().indexsize() > 0){
-					glDrawElements(GL_TRIANGLES, getGeometry().indexsize(), GL_UNSIGNED_INT, 0);
-				}
-				else{
-					glDrawArrays(GL_TRIANGLES,0, getGeometry().size());
-				}
-
-				unbind();
-			 }
-		};
-
-
-		/*
-		 * Creating a VAO around a basic Asset
-		 */
-
-		template<>
-		inline void GLAsset<GeometryPNF>::_gen() {
-			glGenVertexArrays(1, &(this->mVAO));
-			int s = getGeometry().indexsize() > 0 ? 2 : 1;
-			
-			handle = new unsigned int[s];
-			glGenBuffers(s,handle);
-
-			_allocate();
-
-			bind();
-
-			glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-
-			glEnableVertexAttribArray(0); // Pos
-			glEnableVertexAttribArray(1); // Normal
-		
-			glVertexAttribPointer(0,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNF,mP) );
-			glVertexAttribPointer(1,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNF,mN) );
-
-			// Indices
-			if (getGeometry().indexsize() > 0){
-				glEnableVertexAttribArray(2); // Indices
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-				glVertexAttribPointer(2, 1,GL_UNSIGNED_INT,GL_FALSE,0, (GLubyte*) NULL);
-			}
-
-			unbind();
-
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
-
-		}
-
-		/*
-		 * Assets with 8 texture buffers!
-		 */
-
-
-		template<>
-		inline void GLAsset<GeometryPNT8F>::_gen() {
-			glGenVertexArrays(1, &(this->mVAO));
-			int s = getGeometry().indexsize() > 0 ? 2 : 1;
-			
-			handle = new unsigned int[s];
-			glGenBuffers(s,handle);
-
-			_allocate();
+				_allocate();
 
-			bind();
+				glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
+				bindVertexFormat(VertexLayout<typename T::VertexType>::get());
 
-			glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
+				if (getGeometry().indexsize() > 0)
+					State::bindElementBuffer(mVAO, handle[1]);
 
-			glEnableVertexAttribArray(0); // Pos
-			glEnableVertexAttribArray(1); // Normal
-		
-			glVertexAttribPointer(0,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNT8F,mP) );
-			glVertexAttribPointer(1,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNT8F,mN) );
+				unbind();
 
-			// Textures
-			for (int i=0; i < 8; ++i){
-				glEnableVertexAttribArray(i+2);
-				glVertexAttribPointer(i+2,2, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNT8F,mT) + (sizeof(Float2) * i) );		
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
 			}
 
-			// Indices
-			if (getGeometry().indexsize() > 0){
-				glEnableVertexAttribArray(10); // Indices
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-				glVertexAttribPointer(10, 1,GL_UNSIGNED_INT,GL_FALSE,0, (GLubyte*) NULL);
+			// Only the ranges that changed since the last draw are sent
+			virtual void _allocate() {
+				mBuffer.update(getGeometry(), mVAO, handle[0], getGeometry().indexsize() > 0 ? handle[1] : 0);
 			}
 
-			unbind();
-
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
-
-		}
-
-		/*
-		 * Full Geometry
-		 */
+			GeometryBuffer mBuffer;
+		
+		public:
+			GLAsset() {};
+			GLAsset(T a) : Asset<T>(a), mBuffer(UPLOAD_SUBDATA) {  mVAO = 0; };
+			GLAsset(Asset<T> b) : Asset<T>(b), mBuffer(UPLOAD_SUBDATA) { mVAO = 0; }
+			T& getGeometry() { return this->mObj->mGeom; }
 
+			// Switching mode re-sends the whole geometry on the next draw
+			void setUploadMode(UploadMode m) { mBuffer = GeometryBuffer(m); };
 
-		template<>
-		inline void GLAsset<GeometryFullFloat>::_gen() {
-			glGenVertexArrays(1, &(this->mVAO));
-			int s = getGeometry().indexsize() > 0 ? 2 : 1;
-			
-			handle = new unsigned int[s];
-			glGenBuffers(s,handle);
+			virtual operator int() const { return mVAO != 0; };
 
-			_allocate();
+			// Override this 
+			virtual void draw() {
+				drawInstanced(1);
+				unbind();
+			 }
 
-			bind();
+			virtual void drawInstanced(GLsizei count) {
+				if(mVAO == 0) _gen();
+				
+				bind();
 
-			glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
+				if (getGeometry().isDirty()) _allocate();
 
-			glEnableVertexAttribArray(0); // Pos
-			glEnableVertexAttribArray(1); // Normal
-			glEnableVertexAttribArray(2); // Colour
-			glEnableVertexAttribArray(3); // Texture
-		
-			glVertexAttribPointer(0,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNCTF,mP) );
-			glVertexAttribPointer(1,3, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNCTF,mN) );
-			glVertexAttribPointer(2,4, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNCTF,mC) );
-			glVertexAttribPointer(3,2, GL_FLOAT, GL_FALSE, getGeometry().elementsize(), (GLvoid*)offsetof(VertPNCTF,mT) );
-
-			// Indices
-			if (getGeometry().indexsize() > 0){
-				glEnableVertexAttribArray(4); // Indices
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-				glVertexAttribPointer(4, 1,GL_UNSIGNED_INT,GL_FALSE,0, (GLubyte*) NULL);
+				mBuffer.draw(getGeometry(), GL_TRIANGLES, count);
 			}
-
-			unbind();
-
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
-
-
-		}
-
+		};
 
 
 	}
@@ -13,6 +13,7 @@
 #include "common.hpp"
 #include "../visualapp.hpp"
 #include "utils.hpp"
+#include "buffer.hpp"
 
 #include <GL/glfw3.h>
 #include <anttweakbar/AntTweakBar.h>
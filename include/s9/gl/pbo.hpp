@@ -0,0 +1,71 @@
+/**
+* @brief Pixel unpack buffer ring for streaming textures
+* @file pbo.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 16/08/2012
+*
+*/
+
+
+#ifndef S9_PBO_HPP
+#define S9_PBO_HPP
+
+#include "../common.hpp"
+#include "common.hpp"
+#include "utils.hpp"
+
+namespace s9 {
+
+	namespace gl {
+
+		/*
+		 * How a streamed frame reaches its texture. UPLOAD_DIRECT hands client memory to
+		 * glTexSubImage2D, which blocks until the driver has copied it. UPLOAD_PBO copies
+		 * into the next buffer of a ring and uploads from there, so the transfer is queued
+		 * and overlaps with rendering
+		 */
+
+		typedef enum {
+			UPLOAD_DIRECT,
+			UPLOAD_PBO
+		} TextureUpload;
+
+		/*
+		 * A ring of pixel unpack buffers. Each upload takes the next buffer and orphans it
+		 * on mapping, so the driver never waits for a transfer still reading the old storage.
+		 * Two or three buffers are enough - more only adds memory
+		 */
+
+		class PBORing {
+		public:
+			PBORing() {};
+			PBORing(size_t bytes, size_t count = 3);
+
+			// Copies w x h pixels of data into the ring and queues the upload to tex
+			void upload(GLuint tex, GLenum target, size_t w, size_t h, GLenum format, const unsigned char *data);
+
+			size_t getSize() { return mObj->mBytes; };
+			size_t getCount() { return mObj->vPBO.size(); };
+
+			virtual operator int() const { return mObj.use_count() > 0; };
+
+		protected:
+			class SharedObj {
+			public:
+				SharedObj() : mBytes(0), mNext(0) {};
+				~SharedObj();
+				std::vector<GLuint> vPBO;
+				size_t mBytes;
+				size_t mNext;
+			};
+
+			boost::shared_ptr<SharedObj> mObj;
+		};
+
+		// Bytes per pixel of the unsigned byte formats the video code streams
+		size_t bytesPerPixel(GLenum format);
+
+	}
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+* @brief Draw packets sorted by state once a frame and drawn in as few calls as possible
+* @file render_queue.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 24/08/2012
+*
+*/
+
+
+#ifndef S9_RENDER_QUEUE_HPP
+#define S9_RENDER_QUEUE_HPP
+
+#include "../common.hpp"
+#include "common.hpp"
+#include "shader.hpp"
+
+namespace s9 {
+
+	namespace gl {
+
+		/*
+		 * One draw - what to draw, with what, and where. The geometry and shader are held by
+		 * pointer and must live until the queue is drawn. Textures go on the unit of their
+		 * slot. Depth orders draws front to back within a state, and defaults to the clip w
+		 * of the object's origin - its distance from a perspective camera
+		 */
+
+		struct DrawPacket {
+			static const size_t MAX_TEXTURES = 4;
+
+			DrawPacket() : pGeometry(NULL), pShader(NULL), mColour(1.0f), mDepth(0) {
+				for (size_t i = 0; i < MAX_TEXTURES; ++i) {
+					mTargets[i] = GL_TEXTURE_2D;
+					mTextures[i] = 0;
+				}
+			};
+
+			DrawPacket& texture(size_t unit, GLenum target, GLuint tex) {
+				mTargets[unit] = target;
+				mTextures[unit] = tex;
+				return *this;
+			};
+
+			DrawPacket& colour(const glm::vec4 &c) { mColour = c; return *this; };
+			DrawPacket& depth(float_t d) { mDepth = d; return *this; };
+
+			ViaVAO *pGeometry;
+			Shader *pShader;
+			glm::mat4 mMVP;
+			glm::vec4 mColour;
+			float_t mDepth;
+			GLenum mTargets[MAX_TEXTURES];
+			GLuint mTextures[MAX_TEXTURES];
+		};
+
+		struct RenderQueueStats {
+			RenderQueueStats() : mPackets(0), mDraws(0), mInstanced(0), mBytes(0) {};
+			size_t mPackets;
+			size_t mDraws;			// Calls into the driver
+			size_t mInstanced;		// Packets drawn as instances of another
+			size_t mBytes;			// Instance data sent
+		};
+
+		/*
+		 * Submit packets through the frame, then draw them all at once. Packets are sorted by
+		 * program, textures, geometry and depth, so each state is set once, and bind through
+		 * State so nothing already bound is sent again.
+		 *
+		 * Runs of packets with the same program, textures and geometry become one instanced
+		 * draw when the program declares the instance block -
+		 *
+		 *   struct S9Instance { mat4 uMVP; vec4 uColour; };
+		 *   layout(std140) uniform S9Instances { S9Instance uInstances[128]; };
+		 *
+		 * read with uInstances[gl_InstanceID]. The whole frame's instance data goes up in one
+		 * buffer upload. Any other program is drawn a packet at a time with uMVPMatrix and,
+		 * if it has one, uColour set.
+		 *
+		 * Opaque draws only - nothing here orders blended ones back to front
+		 */
+
+		class RenderQueue {
+		public:
+			static const size_t MAX_INSTANCES = 128;
+
+			RenderQueue() {};
+			// The uniform buffer binding point the instance block is attached to
+			RenderQueue(GLuint binding);
+
+			virtual operator int() const { return mObj.use_count() > 0; };
+
+			// The packet can be changed until the next submit
+			DrawPacket& submit(ViaVAO &geometry, Shader &shader, const glm::mat4 &mvp);
+			void submit(const DrawPacket &packet) { mObj->vPackets.push_back(packet); };
+
+			// Sorts and draws everything submitted, then empties the queue
+			void draw();
+			void clear() { mObj->vPackets.clear(); };
+
+			size_t size() const { return mObj->vPackets.size(); };
+			const RenderQueueStats& getStats() const { return mObj->mStats; };
+
+			static const char * INSTANCE_BLOCK;
+
+		protected:
+
+			// A run of sorted packets drawn with one call
+			struct Batch {
+				size_t mBegin, mEnd;
+				bool mInstanced;
+				size_t mOffset;		// Into the instance buffer
+			};
+
+			struct InstanceData {
+				glm::mat4 mMVP;
+				glm::vec4 mColour;
+			};
+
+			static uint64_t _key(const DrawPacket &p);
+			static bool _sameState(const DrawPacket &a, const DrawPacket &b);
+			bool _instanced(Shader *shader);
+
+			struct SharedObj {
+				SharedObj() : mBinding(0), mBuffer(0), mAlign(256) {};
+				~SharedObj() { if (mBuffer != 0) glDeleteBuffers(1, &mBuffer); };
+
+				std::vector<DrawPacket> vPackets;
+				std::vector< std::pair<uint64_t, uint32_t> > vOrder;	// Key and packet
+				std::vector<Batch> vBatches;
+				std::vector<uint8_t> vStaging;
+				std::vector< std::pair<Shader*, bool> > vPrograms;	// Instancing, asked this frame
+
+				GLuint mBinding;
+				GLuint mBuffer;
+				size_t mAlign;				// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+				RenderQueueStats mStats;
+			};
+
+			boost::shared_ptr<SharedObj> mObj;
+		};
+	}
+}
+
+#endif
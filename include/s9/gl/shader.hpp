@@ -25,31 +25,108 @@ namespace s9 {
 
 	namespace gl {
 
+		/*
+		 * Linked programs are cached on disk with glGetProgramBinary, keyed by a hash of the
+		 * source and the driver, so a later launch skips compiling. A stale or rejected
+		 * binary falls back to compiling and is replaced.
+		 *
+		 * Where the driver has KHR_parallel_shader_compile, begin returns as soon as the work
+		 * is queued. Start every program, then finish each, and they compile side by side.
+		 *
+		 * With hot reload on, loaded files are watched. Call update once a frame and an
+		 * edited program is rebuilt behind the running one, replacing it only once it links
+		 */
+
 		class Shader {
 		public:
-			void load(std::string vert, std::string frag);
+			Shader() : mVS(0), mFS(0), mProgram(0), mKey(0), mPending(false), mCached(false),
+				mVertGen(0), mFragGen(0) {};
+
+			// With wait false the files are read and compiling started - call finish before use
+			void load(std::string vert, std::string frag, bool wait = true);
+			// Compiled in shaders - name is only used in error messages
+			bool loadSource(const std::string &vert, const std::string &frag, std::string name = "source");
+
+			// Starts a program. cache is the binary's file, or empty for the setCache directory
+			void begin(const std::string &vert, const std::string &frag, std::string name = "source", std::string cache = "");
+			bool isReady();			// Never blocks
+			bool finish();			// Blocks until linked, false and reports on failure
+
+			// Loaded from the binary cache rather than compiled
+			bool isCached() const { return mCached; };
+
 			GLuint getProgram() { return mProgram; };
 			
-			GLint location(const char * name) {return glGetUniformLocation(mProgram, name); }
+			// From the table built at link time, so no call into the driver. -1 if not active
+			GLint location(const char * name) const;
+
+			// Attaches a uniform block to a UniformBuffer's binding point, for shaders that
+			// do not give it one with layout(binding = n). False if the block is not active
+			bool block(const char * name, GLuint binding);
 			
 			// Fluent interface for quick setting
 
+			Shader& s(const char * name, glm::vec2 v);
 			Shader& s(const char * name, glm::vec3 v);
 			Shader& s(const char * name, glm::vec4 v);
 			Shader& s(const char * name, glm::mat4 v);
 			Shader& s(const char * name, float_t f);
 			Shader& s(const char * name, int i);
 
-			void bind() { glUseProgram(mProgram);};
-			void unbind() {glUseProgram(0);};
+			void bind() { State::useProgram(mProgram);};
+			void unbind() { State::unbindProgram();};
 			
-			~Shader() { glDetachShader(mProgram, mVS); glDetachShader(mProgram, mFS);  } 
+			~Shader() { if (mProgram != 0 && mVS != 0) { glDetachShader(mProgram, mVS); glDetachShader(mProgram, mFS); } } 
+
+			// The program binary cache is off by default. Binaries go in dir, one file per key -
+			// a hash of both sources and the GL vendor, renderer and version strings - so an
+			// edited shader or updated driver misses and writes a new file. Old files are never
+			// removed. A binary the driver rejects is compiled again and rewritten. With no dir
+			// only programs begun with their own cache file are cached
+			static void setCache(bool enabled, std::string dir = "") { mCacheEnabled = enabled; mCacheDir = dir; };
+
+			// Does the driver compile in the background? Needs a context
+			static bool parallelCompile();
+
+			// Watch the files of shaders loaded from now on. Linux only
+			static void setHotReload(bool enabled) { mHotReload = enabled; };
+
+			// Render thread, between frames. Starts a rebuild when a watched file changes and
+			// swaps it in once linked. True when the program changed - its uniforms are back
+			// to their defaults. On an error the old program stays
+			bool update();
 			
 		protected:
+
+			void _reflect();
+			bool _readCache();
+			void _writeCache();
+			bool _check(GLuint shader, const char *stage);
+			void _swap(Shader &s);
 		   
 			GLuint mVS, mFS;
 			GLuint mProgram;
 
+			std::string mName;
+			std::string mCachePath;
+			uint64_t mKey;			// Sources and driver
+			bool mPending;
+			bool mCached;
+
+			static bool mCacheEnabled;
+			static std::string mCacheDir;
+			static bool mHotReload;
+
+			// Hot reload - empty paths when not watched. The sources are the latest read of each
+			std::string mVertPath, mFragPath;
+			std::string mVertSource, mFragSource;
+			uint64_t mVertGen, mFragGen;
+			boost::shared_ptr<Shader> pReload;
+			std::vector< std::pair<std::string, GLuint> > vBlocks;	// Given again after a swap
+
+			// Active uniforms sorted by name. Arrays appear as both "a" and "a[0]"
+			std::vector< std::pair<std::string, GLint> > vUniforms;
+
 		};
 	}
 }
@@ -12,6 +12,7 @@
 #include "../common.hpp"
 #include "common.hpp"
 #include "utils.hpp"
+#include "buffer.hpp"
 #include "../shapes.hpp"
 #include "../primitive.hpp"
 
@@ -28,11 +29,13 @@ namespace s9 {
 		protected:
 			void _gen();
 			void _allocate();
+			GeometryBuffer mBuffer;
 
 		public:
 			Quad(){};
-			Quad(float_t w, float_t h) : s9::Quad(w,h) { mVAO = 0; }
+			Quad(float_t w, float_t h) : s9::Quad(w,h), mBuffer(UPLOAD_SUBDATA) { mVAO = 0; }
 			void draw();
+			void drawInstanced(GLsizei count);
 			
 	
 		};
@@ -45,11 +48,13 @@ namespace s9 {
 		protected:
 			void _gen();
 			void _allocate();
+			GeometryBuffer mBuffer;
 	
 		public:
 			Triangle() {};
-			Triangle(float_t w, float_t h) : s9::Triangle(w,h) { mVAO = 0; }
+			Triangle(float_t w, float_t h) : s9::Triangle(w,h), mBuffer(UPLOAD_SUBDATA) { mVAO = 0; }
 			void draw();
+			void drawInstanced(GLsizei count);
 		
 		};
 
@@ -0,0 +1,126 @@
+/**
+* @brief Shadows the GL binding state so redundant binds never reach the driver
+* @file state.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 23/08/2012
+*
+*/
+
+
+#ifndef S9_GL_STATE_HPP
+#define S9_GL_STATE_HPP
+
+#include "../common.hpp"
+#include "GL/glew.h"
+
+namespace s9 {
+
+	namespace gl {
+
+		/*
+		 * Counts of binding calls made through State. Issued went to the driver, skipped
+		 * matched what was already bound
+		 */
+
+		struct StateCounts {
+			StateCounts() : mIssued(0), mSkipped(0) {};
+			uint64_t mIssued;
+			uint64_t mSkipped;
+		};
+
+		/*
+		 * A copy of the program, vertex array, framebuffers, active unit, texture bindings
+		 * and viewport of the current context. A bind that matches the copy is skipped.
+		 *
+		 * Unbinding a program, vertex array or texture only marks it free - the next bind
+		 * of the same object then costs nothing, so the bind, draw, unbind pattern used
+		 * throughout collapses to one bind. The element buffer belongs to the vertex array,
+		 * so bindElementBuffer takes the array it is for and binds that first - whatever was
+		 * left bound, free or not, never picks up another mesh's indices.
+		 * Framebuffers unbind at once, as the draws that follow go wherever is bound.
+		 *
+		 * Render thread only. Anything that binds behind State's back, or a change of
+		 * context, needs invalidate. Raw GL that expects nothing bound needs flush
+		 */
+
+		class State {
+		public:
+			static void useProgram(GLuint program);
+			static void unbindProgram();
+
+			static void bindVertexArray(GLuint vao);
+			static void unbindVertexArray();
+			static void bindElementBuffer(GLuint vao, GLuint ibo);
+
+			// GL_FRAMEBUFFER sets both the draw and read bindings, as in GL
+			static void bindFramebuffer(GLenum target, GLuint fbo);
+
+			// Takes GL_TEXTURE0 + n, as glActiveTexture does
+			static void activeTexture(GLenum unit);
+			// On the active unit. Targets other than 2D and rectangle are passed straight on
+			static void bindTexture(GLenum target, GLuint tex);
+			static void unbindTexture(GLenum target);
+
+			static void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+
+			// Current values, asking GL only for ones not yet known
+			static GLuint getProgram();
+			static GLuint getVertexArray();
+			static GLuint getFramebuffer();		// Draw binding
+			static GLenum getActiveTexture();
+			static GLuint getTexture(GLenum target);
+			static void getViewport(GLint *v);
+
+			// Call before deleting - GL unbinds deleted objects, and may reuse the name
+			static void forgetProgram(GLuint program);
+			static void forgetVertexArray(GLuint vao);
+			static void forgetFramebuffer(GLuint fbo);
+			static void forgetTexture(GLuint tex);
+
+			// Unbinds anything only marked free
+			static void flush();
+
+			// Forget everything - the next bind of each kind goes to the driver
+			static void invalidate();
+
+			// Counts since the last endFrame - call endFrame once per frame
+			static const StateCounts& countsThisFrame() { return mFrame; };
+			static const StateCounts& countsLastFrame() { return mLast; };
+			static void endFrame() { mLast = mFrame; mFrame = StateCounts(); };
+
+			static const GLuint UNKNOWN = 0xffffffff;
+			static const size_t MAX_UNITS = 32;		// Units past this are not shadowed
+
+		protected:
+
+			// One binding point. Free is set by an unbind that has not reached GL yet
+			struct Slot {
+				Slot() : mBound(UNKNOWN), mFree(false) {};
+				bool bind(GLuint id);
+				void unbind();
+				GLuint mBound;
+				bool mFree;
+			};
+
+			struct Unit {
+				Slot m2D;
+				Slot mRect;
+			};
+
+			static Slot* _texture(GLenum target);
+
+			static Slot mProgram;
+			static Slot mVAO;
+			static GLuint mDrawFBO, mReadFBO;
+			static GLenum mActive;
+			static Unit mUnits[MAX_UNITS];
+			static GLint mViewport[4];
+			static bool mViewportKnown;
+
+			static StateCounts mFrame;
+			static StateCounts mLast;
+		};
+	}
+}
+
+#endif
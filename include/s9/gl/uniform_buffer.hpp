@@ -0,0 +1,86 @@
+/**
+* @brief Uniform buffer objects holding a block of uniforms as one C++ struct
+* @file uniform_buffer.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 21/08/2012
+*
+*/
+
+
+#ifndef S9_UNIFORM_BUFFER_HPP
+#define S9_UNIFORM_BUFFER_HPP
+
+#include "../common.hpp"
+#include "common.hpp"
+
+namespace s9 {
+
+	namespace gl {
+
+		/*
+		 * T mirrors a std140 uniform block - glm::mat4 and glm::vec4 members lay out the
+		 * same on both sides, and a vec3 in the block takes a whole glm::vec4. Write the
+		 * members through data() then update once a frame, and every program using the
+		 * block sees the lot for one buffer upload, whatever it holds.
+		 *
+		 * The buffer sits on its binding point from creation. Shaders attach their block
+		 * with layout(std140, binding = n) or Shader::block. Needs a GL context
+		 */
+
+		template<class T>
+		class UniformBuffer {
+		public:
+			UniformBuffer() {};
+
+			UniformBuffer(GLuint binding) {
+				mObj.reset(new SharedObj());
+				mObj->mBinding = binding;
+				glGenBuffers(1, &mObj->mBuffer);
+				glBindBuffer(GL_UNIFORM_BUFFER, mObj->mBuffer);
+				glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_STREAM_DRAW);
+				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+				bind();
+			}
+
+			// Marks the block changed
+			T& data() { mObj->mDirty = true; return mObj->mData; };
+			const T& getData() const { return mObj->mData; };
+
+			// Sends the block if it changed. Respecifying the whole store lets the driver
+			// hand back fresh memory rather than wait on draws still reading the old
+			void update() {
+				if (!mObj->mDirty) return;
+				glBindBuffer(GL_UNIFORM_BUFFER, mObj->mBuffer);
+				glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &mObj->mData, GL_STREAM_DRAW);
+				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+				mObj->mDirty = false;
+				mObj->mUpdates++;
+			}
+
+			// Only needed if something else has taken the binding point
+			void bind() { glBindBufferBase(GL_UNIFORM_BUFFER, mObj->mBinding, mObj->mBuffer); };
+
+			GLuint getBinding() const { return mObj->mBinding; };
+			uint64_t getUpdates() const { return mObj->mUpdates; };
+
+			virtual operator int() const { return mObj.use_count() > 0; };
+
+		protected:
+			class SharedObj {
+			public:
+				SharedObj() : mBuffer(0), mBinding(0), mDirty(true), mUpdates(0) {};
+				~SharedObj() { if (mBuffer != 0) glDeleteBuffers(1, &mBuffer); };
+				T mData;
+				GLuint mBuffer;
+				GLuint mBinding;
+				bool mDirty;
+				uint64_t mUpdates;
+			};
+
+			boost::shared_ptr<SharedObj> mObj;
+		};
+
+	}
+}
+
+#endif
@@ -14,6 +14,10 @@
 #include "../common.hpp"
 #include "common.hpp"
 #include "utils.hpp"
+#include "shader.hpp"
+#include "pbo.hpp"
+#include "../video_source.hpp"
+#include "../parallel.hpp"
 
 #ifdef _GEAR_OPENCV
 #include <opencv2/opencv.hpp>
@@ -21,6 +25,7 @@
 
 #ifdef _GEAR_X11_GLX
 #include "s9/linux/uvc_camera.hpp"
+#include "s9/linux/replay_camera.hpp"
 #endif
 
 
@@ -28,36 +33,104 @@ namespace s9 {
 
 	namespace gl {
 
+		/*
+		 * Frame accounting for a VidCam. Dropped frames were never shown - lost by the driver,
+		 * superseded before decoding or replaced before update took them. Duplicated counts
+		 * updates that had no new frame, so the texture showed the previous one again.
+		 * Latency runs from the driver's capture timestamp to the end of the texture upload
+		 */
+
+		struct VidCamStats {
+			VidCamStats() : mCaptured(0), mUploaded(0), mDropped(0), mDuplicated(0), mSeq(0), mTimestamp(0),
+				mLatency(0), mLatencyMean(0), mLatencyMax(0) {};
+			uint64_t mCaptured;
+			uint64_t mUploaded;
+			uint64_t mDropped;
+			uint64_t mDuplicated;
+			uint64_t mSeq;				// Of the frame in the texture
+			double_t mTimestamp;
+			double_t mLatency;			// Seconds, of the last upload
+			double_t mLatencyMean;
+			double_t mLatencyMax;
+		};
+
+		/*
+		 * Where YUYV becomes RGB. DECODE_CPU has the capture thread convert and uploads 3 bytes
+		 * a pixel. DECODE_GPU uploads the raw 2 bytes a pixel as an RG texture and converts it
+		 * into the RGB texture with a fullscreen pass
+		 */
+
+		typedef enum {
+			DECODE_CPU,
+			DECODE_GPU
+		} DecodeMode;
+
 		/*
 		 * Access to a camera device - OS dependent and using OpenGL as the texture method
+		 * update uploads only when the capture thread has published a new frame and returns
+		 * true if it did. getTexture is always RGB whichever decode mode is in use
 		 */
 
 		class VidCam {
 		public:
 			VidCam() {};
-			VidCam (std::string dev, size_t w, size_t h, size_t fps);
+			VidCam (std::string dev, size_t w, size_t h, size_t fps, size_t buffers = 4, DecodeMode decode = DECODE_CPU,
+				CaptureFormat format = CAPTURE_YUYV);
+			VidCam (boost::shared_ptr<VideoSource> source, size_t w, size_t h, DecodeMode decode = DECODE_CPU);
 			void stop();
 			glm::vec2 getSize() {return glm::vec2(mObj->mW, mObj->mH);};
 			GLuint getTexture() {return mObj->mTexID; };
 			
 			void bind();	// Texture bind
 			void unbind();
-			void update();
-			unsigned char* getBuffer() {return mObj->pCam->getBuffer(); };
+			bool update();
+
+			// Shows a frame taken from the source elsewhere, by a FrameSync for instance. It
+			// must stay untouched until the next update
+			void update(const VideoFrame &frame);
+
+			// Falls back to DECODE_CPU, returning false, if the GPU path cannot be set up
+			bool setDecode(DecodeMode decode);
+			DecodeMode getDecode() { return mObj->mDecode; };
+
+			void setUpload(TextureUpload upload);
+			TextureUpload getUpload() { return mObj->mUpload; };
+
+			// The frame behind the texture - YUYV rather than RGB when decoding on the GPU
+			const VideoFrame& getFrame() { return mObj->pFrame != NULL ? *mObj->pFrame : mObj->pCam->getFrame(); };
+			unsigned char* getBuffer() {return const_cast<unsigned char*>(&(getFrame().mData[0])); };
+			boost::shared_ptr<VideoSource> getSource() { return mObj->pCam; };
+			VidCamStats getStats();
 
+			// False if the device would not start capturing
 			virtual operator int() const { return mObj.use_count() > 0; };
 			
 		protected:
+			void _init(size_t w, size_t h, DecodeMode decode);
+			bool _initGPU();
+			void _show(const VideoFrame &frame);
+			void _decodeGPU(const unsigned char *yuyv);
+			void _upload(GLuint tex, GLenum format, const unsigned char *data);
+
 			class SharedObj {
 			public:
+				SharedObj() : mTexID(0), mRawTexID(0), mFBO(0), mVAO(0), mDecode(DECODE_CPU), mUpload(UPLOAD_DIRECT), pFrame(NULL),
+					mRawWarned(false) {};
+				~SharedObj();
 
-#ifdef _GEAR_X11_GLX
-				boost::shared_ptr<UVCVideo> pCam;
-#else
-				boost::shared_ptr<QuicktimeVideo> pCam;
-#endif
+				boost::shared_ptr<VideoSource> pCam;
 				size_t mW,mH,mFPS;
 				GLuint mTexID;
+				GLuint mRawTexID;		// YUYV as RG, GPU decode only
+				GLuint mFBO;
+				GLuint mVAO;
+				boost::shared_ptr<Shader> pDecodeShader;
+				DecodeMode mDecode;
+				TextureUpload mUpload;
+				PBORing mRing;			// Created on first use of UPLOAD_PBO
+				VidCamStats mStats;
+				const VideoFrame *pFrame;	// Shown by update(frame), NULL for the source's own
+				bool mRawWarned;			// Once per camera, not once a frame
 
 			};
 			
@@ -81,6 +154,19 @@ namespace s9 {
 			bool mCalibrated;			// Is this calibrated and distortion free?
 		};
 
+		/*
+		 * Where a CVVidCam takes out lens distortion. UNDISTORT_CPU remaps each frame through
+		 * fixed point maps built once from the parameters, on the worker pool while the render
+		 * thread carries on, so the rectified texture trails the camera by one update.
+		 * UNDISTORT_GPU runs the distortion model in a shader over the camera texture, with no
+		 * CPU work unless the images are asked for
+		 */
+
+		typedef enum {
+			UNDISTORT_CPU,
+			UNDISTORT_GPU
+		} UndistortMode;
+
 		/*
 		 * OpenCV style camera with correction - wraps the other camera
 		 * \todo decorator pattern?
@@ -96,13 +182,24 @@ namespace s9 {
 			
 			bool loadParameters(std::string filename);
 			bool saveParameters(std::string filename);
+
+			// Rebuilds the undistortion maps - loadParameters calls it, call it after changing getParams
+			bool initUndistort();
+
+			// Falls back to UNDISTORT_CPU, returning false, if the shader path cannot be set up
+			bool setUndistort(UndistortMode mode);
+			UndistortMode getUndistort() { return mObj->mUndistort; };
 			
 			bool isSecondary() { return  mObj->mSecondary;};
 			bool isRectified() { return  mObj->mP.mCalibrated;};
 				
-			cv::Mat& getImage() { return  mObj->mImage; };
-			cv::Mat& getImageRectified() {return  mObj->mImageRectified; };
+			// Made on demand when undistorting on the GPU, and current on return either way
+			cv::Mat& getImage();
+			cv::Mat& getImageRectified();
+
+			// Upload with updateResult after drawing into it
 			cv::Mat& getResult() {return  mObj->mResult; };
+			void updateResult();
 			glm::vec2 getSize() {return mObj->mCam.getSize(); };
 			void computeNormal();
 			
@@ -114,14 +211,32 @@ namespace s9 {
 			void bindResult();
 			void unbind();
 			
-			void update();
+			// Updates the wrapped camera too - it needs no update of its own
+			bool update();
+
+			// As VidCam::update(frame), then undistorts it - the frame a FrameSync handed out
+			void update(const VideoFrame &frame);
+
+			// Applies to the wrapped camera as well as the rectified and result textures
+			void setUpload(TextureUpload upload);
+			TextureUpload getUpload() { return mObj->mCam.getUpload(); };
 			
 		protected:
 
+			void _upload(GLuint tex, cv::Mat &image);
+			void _fillImage();
+			void _undistort();
+			void _startRemap();
+			void _finishRemap();
+			bool _initGPU();
+			void _undistortGPU();
+
 			class SharedObj {
 			public:
 
-				SharedObj(VidCam cam) {mCam = cam; };
+				SharedObj(VidCam cam) : mUndistort(UNDISTORT_CPU), mImageStale(true), mRectifiedStale(true), mShown(0), mRectifiedTexID(0),
+					mTexResultID(0), mFBO(0), mVAO(0) {mCam = cam; };
+				~SharedObj();
 				CameraParameters mP;
 				bool mSecondary;
 				cv::Mat mPlaneNormal;	// Normal to the camera plane
@@ -129,10 +244,20 @@ namespace s9 {
 				cv::Mat mImage;
 				cv::Mat mImageRectified;
 				cv::Mat mResult;
+				cv::Mat mMap1, mMap2;		// Fixed point remap from initUndistort
+				UndistortMode mUndistort;
+				WorkerPool::Job mJob;		// Remap of mImage into mImageRectified in flight
+				bool mImageStale;			// mImage is behind the camera's frame
+				bool mRectifiedStale;
+				uint64_t mShown;			// Camera uploads already undistorted
 					
 				GLuint mRectifiedTexID;
 				GLuint mTexResultID;
 				VidCam mCam;
+				PBORing mRing;
+				boost::shared_ptr<Shader> pUndistortShader;
+				GLuint mFBO;
+				GLuint mVAO;
 
 			};
 
@@ -0,0 +1,77 @@
+/**
+* @brief Flat, index based half edge mesh
+* @file halfedge.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 06/08/2012
+*
+*/
+
+#ifndef S9_HALFEDGE_HPP
+#define S9_HALFEDGE_HPP
+
+#include "common.hpp"
+#include "geometry.hpp"
+
+/*
+ * Connectivity for an indexed triangle mesh held in plain uint32_t arrays rather than
+ * a graph of shared pointers. Half edge h belongs to face h / 3 and runs from vertex(h)
+ * to vertex(next(h)). Twins are matched by bucketing packed 64 bit directed edge keys
+ * by origin vertex (a counting sort) and scanning the twin's bucket.
+ */
+
+namespace s9 {
+
+	/*
+	 * The bad winding rule shared with WingedEdge - walking faces in order, a face is
+	 * discarded if any of its directed edges is already used by an earlier kept face.
+	 * Fills keep with 1 / 0 per triangle and returns the number discarded
+	 */
+
+	size_t markWellWound(BufferView<const uint32_t> indices, std::vector<uint8_t> &keep, bool parallel = true);
+
+	class HalfEdgeMesh {
+	public:
+		static const uint32_t NONE = 0xffffffff;
+
+		HalfEdgeMesh() {};
+		virtual operator int() const { return mObj.use_count() > 0; };
+
+		template <class T>
+		void make(Geometry<T> geom, bool parallel = true) { make(geom.getIndexView(), geom.size(), parallel); };
+
+		void make(BufferView<const uint32_t> indices, size_t numverts, bool parallel = true);
+
+		size_t numHalfEdges() const { return mObj->vVertex.size(); };
+		size_t numFaces() const { return mObj->vFaceEdge.size(); };
+		size_t numVertices() const { return mObj->vVertexEdge.size(); };
+		size_t numDiscarded() const { return mObj->mDiscarded; };
+		size_t numBoundary() const { return mObj->mBoundary; };
+
+		uint32_t next(uint32_t h) const { return mObj->vNext[h]; };
+		uint32_t prev(uint32_t h) const { return mObj->vPrev[h]; };
+		uint32_t twin(uint32_t h) const { return mObj->vTwin[h]; };
+		uint32_t vertex(uint32_t h) const { return mObj->vVertex[h]; };
+		uint32_t target(uint32_t h) const { return mObj->vVertex[mObj->vNext[h]]; };
+		uint32_t face(uint32_t h) const { return mObj->vFace[h]; };
+
+		uint32_t faceEdge(uint32_t f) const { return mObj->vFaceEdge[f]; };
+		uint32_t faceSource(uint32_t f) const { return mObj->vFaceSource[f]; };		// Triangle in the original index buffer
+		uint32_t vertexEdge(uint32_t v) const { return mObj->vVertexEdge[v]; };		// An outgoing edge or NONE
+
+	protected:
+
+		struct SharedObj {
+			SharedObj() : mDiscarded(0), mBoundary(0) {};
+			std::vector<uint32_t> vNext, vPrev, vTwin, vVertex, vFace;
+			std::vector<uint32_t> vFaceEdge, vFaceSource;
+			std::vector<uint32_t> vVertexEdge;
+			size_t mDiscarded;
+			size_t mBoundary;
+		};
+
+		boost::shared_ptr<SharedObj> mObj;
+	};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+/**
+* @brief Watches files for changes with inotify, reading them back on its own thread
+* @file file_watcher.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 22/08/2012
+*
+*/
+
+#ifndef S9_FILE_WATCHER_HPP
+#define S9_FILE_WATCHER_HPP
+
+#include "s9/common.hpp"
+
+#include <map>
+#include <boost/thread.hpp>
+
+namespace s9 {
+
+	/*
+	 * One thread watches the directories of every added file, since editors often save by
+	 * writing a new file and renaming it over the old. A file is read back once it has been
+	 * quiet for a moment, so a save in several writes is read whole, and its generation goes
+	 * up. Callers compare generations from any thread and take the contents when it moves.
+	 *
+	 * Only the file contents change hands - what to do with them is up to the caller
+	 */
+
+	class FileWatcher : boost::noncopyable {
+	public:
+		static FileWatcher& get();
+
+		// Safe to add the same file more than once
+		bool add(const std::string &path);
+
+		// Zero until the file first changes. Cheap - a lock and a lookup
+		uint64_t generation(const std::string &path);
+
+		// The contents as of the returned generation. False if the file has not changed
+		bool read(const std::string &path, std::string &contents, uint64_t &generation);
+
+		~FileWatcher();
+
+	protected:
+		FileWatcher();
+
+		void _run();
+		static void _split(const std::string &path, std::string &dir, std::string &name);
+
+		struct Entry {
+			Entry() : mGeneration(0), mChanged(0) {};
+			uint64_t mGeneration;
+			double_t mChanged;			// When the last event came in, zero once read
+			std::string mContents;
+		};
+
+		int mFD;
+		int mWake[2];					// Written to on shutdown so the thread leaves poll
+		boost::thread *pThread;
+
+		std::map<int, std::vector<std::string> > mDirs;	// Watch descriptor to directory
+		std::map<std::string, Entry> mFiles;		// By directory + "/" + name
+		boost::mutex mMutex;
+	};
+
+}
+
+#endif
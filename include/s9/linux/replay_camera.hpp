@@ -0,0 +1,115 @@
+/**
+* @brief Recording camera streams to disk and replaying them as a camera
+* @file replay_camera.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 18/08/2012
+*
+*/
+
+#ifndef S9_REPLAY_CAMERA_HPP
+#define S9_REPLAY_CAMERA_HPP
+
+#include "s9/linux/uvc_camera.hpp"
+
+/*
+ * A dump is a header then every frame as the camera sent it - YUYV or a JPEG - each behind
+ * a frame header and padded to 8 bytes. Fields are in host byte order. A dump cut short by
+ * a crash replays up to its last whole frame
+ */
+
+#define S9_DUMP_MAGIC	"S9VD"
+#define S9_DUMP_VERSION	1
+
+struct DumpHeader {
+	char mMagic[4];
+	uint32_t mVersion;
+	uint32_t mWidth, mHeight;
+	uint32_t mFormat;			// s9::CaptureFormat
+	uint32_t mFPS;				// As requested of the camera
+};
+
+struct DumpFrame {
+	uint32_t mBytes;
+	uint32_t mSeq;				// Capture sequence - gaps are frames the camera dropped
+	double_t mTimestamp;		// Capture time, timeMonotonicS9 seconds
+};
+
+
+/*
+ * Appends captured buffers to a dump. Writes are buffered but happen on the capturing
+ * thread, so record to a disk that keeps up with the cameras
+ */
+
+class FrameRecorder : boost::noncopyable {
+public:
+	FrameRecorder() : pFile(NULL), mFrames(0) {};
+	~FrameRecorder() { close(); };
+
+	bool open(std::string filename, unsigned int width, unsigned int height, s9::CaptureFormat format, unsigned int fps);
+	bool write(const unsigned char *data, size_t bytes, uint64_t seq, double_t timestamp);
+	void close();
+
+	uint64_t getFrames() const { return mFrames; };
+
+protected:
+	FILE *pFile;
+	uint64_t mFrames;
+};
+
+
+/*
+ * Plays a dump back as if it were the camera, through the same decode, so the rest of
+ * the pipeline can be profiled and tested without hardware. Hand it to VidCam as a source.
+ *
+ * The file is mapped rather than read, so the page cache serves repeated runs. Frames go
+ * out at a fixed rate, as fast as they decode with an fps of 0, or with their recorded
+ * spacing using REPLAY_RECORDED. Timestamps are replay time, not the recorded ones, so
+ * latency figures mean the same as live
+ */
+
+class ReplayVideo : public s9::VideoSource {
+public:
+	static const unsigned int REPLAY_RECORDED = 0xffffffff;
+
+	ReplayVideo() : mRunning(false), pThread(NULL), pMap(NULL), mMapBytes(0), mFormat(s9::CAPTURE_YUYV),
+		mWidth(0), mHeight(0), mFPS(0), mLoop(true), mSkipped(0), mFinished(false) {};
+	~ReplayVideo() { stop(); };
+
+	// Width and height must match the dump. Without loop the source stops after the last frame
+	bool startCapture(std::string filename, unsigned int width, unsigned int height, unsigned int fps, bool loop = true);
+	void stop();
+
+	uint64_t framesDropped() { return mFrames.dropped() + __sync_fetch_and_add(&mSkipped, 0); };
+
+	size_t getFrameCount() const { return vIndex.size(); };
+	s9::CaptureFormat getFormat() const { return mFormat; };
+	bool isFinished() const { return mFinished; };
+
+protected:
+	bool _index();
+	void _run();
+
+	struct Entry {
+		const unsigned char *pData;
+		uint32_t mBytes;
+		double_t mTimestamp;
+	};
+
+	volatile bool mRunning;
+	boost::thread *pThread;
+
+	void *pMap;
+	size_t mMapBytes;
+	std::vector<Entry> vIndex;
+
+	s9::CaptureFormat mFormat;
+	unsigned int mWidth, mHeight;
+	unsigned int mFPS;
+	bool mLoop;
+
+	CaptureDecoder mDecoder;
+	volatile uint64_t mSkipped;
+	volatile bool mFinished;
+};
+
+#endif
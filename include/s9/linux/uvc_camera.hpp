@@ -28,9 +28,15 @@
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+
+#include <set>
 
 #include <boost/thread.hpp>
 
+#include "s9/video_source.hpp"
+#include "s9/mjpeg.hpp"
+
 // videodev2 under ubuntu apparently
 #include <linux/videodev2.h>
 
@@ -71,16 +77,79 @@ extern "C" {
 #define Y4M_CHROMA_444ALPHA    7  /* 4:4:4 with an alpha channel          */
 
 
+class UVCVideo;
+class FrameRecorder;
+
+/*
+ * Turns one captured buffer, YUYV or MJPEG as the camera sent it, into a VideoFrame - RGB,
+ * or YUYV if raw. Shared by live capture and replay so both publish exactly the same frames
+ */
+
+class CaptureDecoder {
+public:
+	// False if the buffer is corrupt or too short for w x h - f is then left unpublishable
+	bool decode(s9::VideoFrame &f, const unsigned char *src, size_t bytes, s9::CaptureFormat format,
+		size_t w, size_t h, bool raw);
+
+protected:
+	s9::MJPEGDecoder mDecoder;
+	std::vector<unsigned char> vYUYV;	// Decoded MJPEG on its way to RGB
+};
+
+/*
+ * One epoll loop services every running camera rather than a thread each. Devices are
+ * non blocking and armed one shot, so with several threads a camera is only ever serviced
+ * by one at a time. setThreads must be called before the first camera starts
+ */
+
+class CaptureEngine {
+public:
+	static CaptureEngine& get();
+	static void setThreads(size_t n) { mThreads = n; };
+
+	bool add(UVCVideo *cam);
+	void remove(UVCVideo *cam);		// Waits for any service of cam in progress
+
+	~CaptureEngine();
+
+protected:
+	CaptureEngine(size_t nthreads);
+	void _run();
+
+	std::vector<boost::thread*> vThreads;
+	std::set<UVCVideo*> mCams;
+	std::set<UVCVideo*> mBusy;
+	boost::mutex mMutex;
+	boost::condition_variable mIdle;
+	int mEpoll;
+	int mWake[2];
+
+	static size_t mThreads;
+};
+
+
 /*
  * Class to deal directly with the video. Does not contain OpenCV methods - this is decoupled into the camera manager
+ * The capture engine decodes into the source's triple buffer
  */
 
-class UVCVideo {
+class UVCVideo : public s9::VideoSource {
 public:
-	UVCVideo () {};
-	bool startCapture(std::string devname, unsigned int width, unsigned int height, unsigned int fps);
+	UVCVideo () : mRunning(false), dev(-1), mBuffers(0), mSkipped(0), mSeq(0), mLastSequence(0), mFormat(s9::CAPTURE_YUYV),
+		pRecorder(NULL) {};
+	~UVCVideo() { stop(); };
+
+	// nbufs is clamped to [2, V4L_BUFFERS_MAX]
+	bool startCapture(std::string devname, unsigned int width, unsigned int height, unsigned int fps,
+		unsigned int nbufs = V4L_BUFFERS_DEFAULT, s9::CaptureFormat format = s9::CAPTURE_YUYV);
 	void stop();
-	unsigned char* getBuffer();
+
+	// Write every buffer the camera sends, undecoded, to a dump ReplayVideo can play back
+	bool startRecording(std::string filename);
+	void stopRecording();
+	bool isRecording();
+
+	uint64_t framesDropped() { return mFrames.dropped() + __sync_fetch_and_add(&mSkipped, 0); };
 
 	void video_list_controls(int dev);
 	void set_control(unsigned int id, int value) { uvc_set_control(dev,id,value); };
@@ -101,23 +170,36 @@ protected:
 	int video_get_input(int dev);
 	int video_set_input(int dev, unsigned int input);
 
+	void _release(unsigned int mapped);
+
 	// Decoding functions
 	void decode_frame(unsigned char *jpeg_data, int len, unsigned char *raw);
 	void toRGB(unsigned char *jpeg_data, int len, unsigned char *raw);
 
-	void capture();
+	// Called by the capture engine when the device is readable. False on a device error
+	friend class CaptureEngine;
+	bool _service();
+
 	bool mRunning;
-	boost::thread *pWorkerThread;
-	boost::mutex mMutex;
 	
 	bool mT;
 	int mWidth, mHeight;
 	int mFPS;
 	void *mem[V4L_BUFFERS_MAX];
+	unsigned int mMemLength[V4L_BUFFERS_MAX];
 	int dev;
-	unsigned char *jbuffer;
-	unsigned int mBufferSize;
 	struct v4l2_buffer buf;
+
+	unsigned int mBuffers;
+	volatile uint64_t mSkipped;		// Never decoded - dropped by the driver or superseded
+	uint64_t mSeq;
+	uint32_t mLastSequence;
+
+	s9::CaptureFormat mFormat;
+	CaptureDecoder mDecoder;
+
+	FrameRecorder *pRecorder;
+	boost::mutex mRecordMutex;		// Recording starts and stops while the engine services us
 	
 };
 
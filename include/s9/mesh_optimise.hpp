@@ -0,0 +1,116 @@
+/**
+* @brief Index and vertex reordering for faster drawing
+* @file mesh_optimise.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 10/08/2012
+*
+*/
+
+#ifndef S9_MESH_OPTIMISE_HPP
+#define S9_MESH_OPTIMISE_HPP
+
+#include "common.hpp"
+#include "geometry.hpp"
+#include "utils.hpp"
+
+/*
+ * Three passes over an indexed triangle list, in this order:
+ *
+ * - Post transform cache - Tipsify (Sander, Nehab and Barczak 2007), which fans around
+ *   vertices still likely to be in the cache and is linear in the triangle count
+ * - Overdraw - the cache ordered triangles are cut into clusters wherever the cache
+ *   would restart anyway (or the local miss rate allows), then clusters facing out from
+ *   the mesh centre are drawn first so the depth test rejects more of what follows
+ * - Vertex fetch - vertices renumbered in first use order so fetches stream through
+ *   memory. Unreferenced vertices are dropped
+ */
+
+namespace s9 {
+
+	/*
+	 * ACMR - cache misses per triangle (0.5 is ideal for a large regular mesh, 3 the worst)
+	 * ATVR - cache misses per referenced vertex (1.0 is ideal)
+	 */
+
+	struct VertexCacheStats {
+		VertexCacheStats() : mACMR(0), mATVR(0) {};
+		double_t mACMR;
+		double_t mATVR;
+	};
+
+	struct MeshOptimiseStats {
+		MeshOptimiseStats() : mTime(0), mDroppedVertices(0) {};
+		VertexCacheStats mBefore;
+		VertexCacheStats mAfter;
+		double_t mTime;
+		size_t mDroppedVertices;
+	};
+
+	const size_t VERTEX_CACHE_SIZE = 16;
+
+	// Simulate a FIFO post transform cache over the index buffer
+	VertexCacheStats analyseVertexCache(BufferView<const uint32_t> indices, size_t numverts, size_t cachesize = VERTEX_CACHE_SIZE);
+
+	// Tipsify. out may not alias indices
+	void optimiseVertexCache(BufferView<const uint32_t> indices, size_t numverts, std::vector<uint32_t> &out,
+		size_t cachesize = VERTEX_CACHE_SIZE);
+
+	/*
+	 * Reorder clusters of a cache optimised list. threshold is how much worse than the
+	 * input ACMR a cluster may get before it is split - 1.05 loses about 5%
+	 */
+
+	void optimiseOverdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions,
+		size_t cachesize = VERTEX_CACHE_SIZE, double_t threshold = 1.05);
+
+	/*
+	 * Renumber in first use order. remap[old] is the new index or 0xffffffff if unused.
+	 * Returns the number of vertices still referenced
+	 */
+
+	size_t optimiseVertexFetch(std::vector<uint32_t> &indices, size_t numverts, std::vector<uint32_t> &remap);
+
+
+	/*
+	 * All three passes on a Geometry, permuting the vertex buffer to match
+	 */
+
+	template <class T>
+	inline void optimiseGeometry(Geometry<T> &g, MeshOptimiseStats *stats = NULL, size_t cachesize = VERTEX_CACHE_SIZE) {
+		MeshOptimiseStats st;
+		double_t t = timeNowS9();
+
+		BufferView<const T> verts = static_cast<const Geometry<T>&>(g).getBufferView();
+		BufferView<const uint32_t> in = static_cast<const Geometry<T>&>(g).getIndexView();
+		if (in.size() < 3 || verts.empty()) return;
+
+		st.mBefore = analyseVertexCache(in, verts.size(), cachesize);
+
+		std::vector<uint32_t> indices;
+		optimiseVertexCache(in, verts.size(), indices, cachesize);
+
+		std::vector<glm::vec3> positions (verts.size());
+		for (size_t i = 0; i < verts.size(); ++i)
+			positions[i] = toVec3(verts[i].mP);
+		optimiseOverdraw(indices, positions, cachesize);
+
+		std::vector<uint32_t> remap;
+		size_t used = optimiseVertexFetch(indices, verts.size(), remap);
+
+		std::vector<T> vb (used);
+		for (size_t i = 0; i < verts.size(); ++i)
+			if (remap[i] != 0xffffffff) vb[remap[i]] = verts[i];
+
+		st.mDroppedVertices = verts.size() - used;
+		g.swapBuffer(vb);
+		g.swapIndices(indices);
+
+		st.mAfter = analyseVertexCache(static_cast<const Geometry<T>&>(g).getIndexView(), used, cachesize);
+		st.mTime = timeNowS9() - t;
+
+		if (stats != NULL) *stats = st;
+	}
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+/**
+* @brief Binary mesh cache - memory mapped interleaved geometry
+* @file meshcache.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 03/08/2012
+*
+*/
+
+#ifndef S9_MESHCACHE_HPP
+#define S9_MESHCACHE_HPP
+
+#include "common.hpp"
+#include "geometry.hpp"
+
+/*
+ * A .s9mesh file is a fixed 128 byte header followed by the interleaved vertex buffer
+ * and then the 32 bit index buffer, exactly as they sit in a Geometry. Loading is a
+ * mmap and a single copy (or a direct GL upload from getVertices) - no parsing.
+ */
+
+namespace s9 {
+
+	/*
+	 * Tags stored in the cache so a file is never read back as the wrong vertex type
+	 */
+
+	template <class T> struct VertexTag { static const uint32_t value = 0; };
+	template <> struct VertexTag<VertPNF> { static const uint32_t value = 1; };
+	template <> struct VertexTag<VertPNCTF> { static const uint32_t value = 2; };
+	template <> struct VertexTag<VertPNT8F> { static const uint32_t value = 3; };
+
+	const uint32_t MESHCACHE_VERSION = 1;
+
+	// Processing done on top of the import flags
+	const uint32_t MESHCACHE_OPTIMISED = 1;
+
+	/*
+	 * On disk header. Fields are fixed width and ordered so there is no padding
+	 */
+
+	struct MeshCacheHeader {
+		char mMagic[8];				// "S9MESH"
+		uint32_t mVersion;
+		uint32_t mVertexTag;
+		uint32_t mVertexSize;
+		uint32_t mImportFlags;
+		uint64_t mNumVertices;
+		uint64_t mNumIndices;
+		uint64_t mSourceSize;		// Source file this was built from
+		int64_t mSourceMTime;
+		uint64_t mSourceHash;		// FNV-1a of the source contents
+		float_t mMin[3];			// Bounds of the positions
+		float_t mMax[3];
+		uint32_t mOptions;			// MESHCACHE_ bits
+		uint8_t mPad[36];
+	};
+
+	/*
+	 * Identity of a source file - cheap fields plus an optional content hash
+	 */
+
+	struct MeshSource {
+		MeshSource() : mSize(0), mMTime(0), mHash(0) {};
+		std::string mPath;
+		uint64_t mSize;
+		int64_t mMTime;
+		uint64_t mHash;
+	};
+
+	/*
+	 * A read only, memory mapped cache file. Shared handle - the mapping lives as long as any copy
+	 */
+
+	class MeshCache {
+	public:
+		MeshCache() {};
+		virtual operator int() const { return mObj.use_count() > 0; };
+
+		bool open(std::string path);
+
+		const MeshCacheHeader& getHeader() const { return *mObj->pHeader; };
+
+		// Is this file still a faithful copy of the source, built with these flags and options?
+		bool isValidFor(MeshSource &src, uint32_t flags, uint32_t options = 0);
+
+		template <class T>
+		BufferView<const T> getVertices() const {
+			if (mObj->pHeader->mVertexTag != VertexTag<T>::value) return BufferView<const T>();
+			return BufferView<const T>(reinterpret_cast<const T*>(mObj->pData + sizeof(MeshCacheHeader)), mObj->pHeader->mNumVertices);
+		}
+
+		BufferView<const uint32_t> getIndices() const {
+			const uint8_t *p = mObj->pData + sizeof(MeshCacheHeader) + mObj->pHeader->mNumVertices * mObj->pHeader->mVertexSize;
+			return BufferView<const uint32_t>(reinterpret_cast<const uint32_t*>(p), mObj->pHeader->mNumIndices);
+		}
+
+		/*
+		 * Copy the mapped buffers into a new Geometry - one memcpy per buffer
+		 */
+
+		template <class T>
+		bool toGeometry(Geometry<T> &g) const {
+			BufferView<const T> v = getVertices<T>();
+			if (v.data() == NULL) return false;
+			BufferView<const uint32_t> i = getIndices();
+
+			std::vector<T> vb (v.begin(), v.end());
+			std::vector<uint32_t> ib (i.begin(), i.end());
+			g.createEmpty();
+			g.swapBuffer(vb);
+			g.swapIndices(ib);
+			return true;
+		}
+
+		template <class T>
+		static bool write(std::string path, Geometry<T> &g, const MeshSource &src, uint32_t flags, uint32_t options = 0);
+
+		static std::string cachePath(std::string source, std::string dir, uint32_t flags);
+		static bool refresh(std::string path, const MeshSource &src);
+		static bool stat(std::string path, MeshSource &src);
+		static uint64_t hashFile(std::string path);
+
+	protected:
+
+		static bool _write(std::string path, const MeshCacheHeader &h, const void *verts, const void *indices);
+
+		struct SharedObj {
+			SharedObj() : pData(NULL), pHeader(NULL), mSize(0) {};
+			~SharedObj();
+			const uint8_t *pData;
+			const MeshCacheHeader *pHeader;
+			size_t mSize;
+		};
+
+		boost::shared_ptr<SharedObj> mObj;
+	};
+
+
+	/*
+	 * Write a geometry out as a cache file. Positions must be three floats
+	 */
+
+	template <class T>
+	inline bool MeshCache::write(std::string path, Geometry<T> &g, const MeshSource &src, uint32_t flags, uint32_t options) {
+		MeshCacheHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.mMagic, "S9MESH", 6);
+		h.mVersion = MESHCACHE_VERSION;
+		h.mVertexTag = VertexTag<T>::value;
+		h.mVertexSize = sizeof(T);
+		h.mImportFlags = flags;
+		h.mOptions = options;
+		h.mNumVertices = g.size();
+		h.mNumIndices = g.indexsize();
+		h.mSourceSize = src.mSize;
+		h.mSourceMTime = src.mMTime;
+		h.mSourceHash = src.mHash;
+
+		BufferView<const T> v = g.getBufferView();
+		for (int j = 0; j < 3; ++j) { h.mMin[j] = 0.0f; h.mMax[j] = 0.0f; }
+		if (!v.empty()) {
+			h.mMin[0] = h.mMax[0] = v[0].mP.x;
+			h.mMin[1] = h.mMax[1] = v[0].mP.y;
+			h.mMin[2] = h.mMax[2] = v[0].mP.z;
+		}
+		for (size_t i = 0; i < v.size(); ++i) {
+			h.mMin[0] = std::min(h.mMin[0], v[i].mP.x); h.mMax[0] = std::max(h.mMax[0], v[i].mP.x);
+			h.mMin[1] = std::min(h.mMin[1], v[i].mP.y); h.mMax[1] = std::max(h.mMax[1], v[i].mP.y);
+			h.mMin[2] = std::min(h.mMin[2], v[i].mP.z); h.mMax[2] = std::max(h.mMax[2], v[i].mP.z);
+		}
+
+		return _write(path, h, g.addr(), g.indexaddr());
+	}
+
+}
+
+#endif
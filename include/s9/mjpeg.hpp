@@ -0,0 +1,98 @@
+/**
+* @brief Baseline JPEG decoder for MJPEG camera streams
+* @file mjpeg.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 17/08/2012
+*
+*/
+
+#ifndef S9_MJPEG_HPP
+#define S9_MJPEG_HPP
+
+#include "common.hpp"
+
+#include <boost/noncopyable.hpp>
+
+namespace s9 {
+
+	/*
+	 * Decodes the baseline frames UVC cameras send straight to YUYV, so the output can go
+	 * to the GPU decode path untouched or through yuyv2rgb. Huffman codes come from lookup
+	 * tables, with short AC coefficients decoded in the same lookup, and the float AAN
+	 * IDCT runs four columns at a time with SSE2.
+	 *
+	 * Frames with a restart interval are split at the RST markers and the intervals decoded
+	 * on the worker pool. Frames without DHT segments use the standard tables, as MJPEG
+	 * allows. Luma may be sampled 1 or 2 times chroma in each direction, or be alone.
+	 *
+	 * One decoder per stream - it keeps the default tables and scratch state between frames
+	 */
+
+	class MJPEGDecoder : boost::noncopyable {
+	public:
+		MJPEGDecoder();
+
+		// False if the frame is corrupt, unsupported or not w x h. yuyv holds w * h * 2 bytes
+		bool decode(const unsigned char *src, size_t bytes, unsigned char *yuyv, size_t w, size_t h);
+
+		void setParallel(bool parallel) { mParallel = parallel; };
+		bool isParallel() const { return mParallel; };
+
+		// Scalar IDCT when false - for comparison, output is identical
+		void setSIMD(bool simd);
+		bool isSIMD() const { return mSIMD; };
+
+		// Restart intervals in the last frame, 1 if it had none
+		size_t getIntervals() const { return vSegments.size(); };
+
+		// Code lookup - public only so the inlined block decoding in mjpeg.cpp can see it
+		static const int FAST_BITS = 9;
+
+		struct Huffman {
+			uint8_t mFastSize[1 << FAST_BITS];	// Code length, 0 if longer than FAST_BITS
+			uint8_t mFastSym[1 << FAST_BITS];
+			int16_t mFastAC[1 << FAST_BITS];	// value << 8 | run << 4 | bits, 0 if not short
+			uint32_t mMaxCode[18];				// One past the last code of each length, left aligned
+			int32_t mDelta[17];					// Code to symbol index for each length
+			uint8_t mSymbols[256];
+			int mCount;
+		};
+
+	protected:
+
+		struct Component {
+			int mId, mH, mV, mTQ, mTD, mTA;
+		};
+
+		struct Segment {
+			const unsigned char *mBegin, *mEnd;
+			size_t mFirst, mCount;				// MCUs
+		};
+
+		bool _buildHuffman(Huffman &h, const unsigned char *counts, const unsigned char *symbols);
+		bool _readTables(const unsigned char *&p, const unsigned char *end, bool &dht);
+		bool _split(const unsigned char *p, const unsigned char *end);
+		void _decodeSegments(size_t begin, size_t end);
+		bool _decodeSegment(const Segment &s);
+
+		Huffman mDefault[4];		// DC0 DC1 AC0 AC1
+		Huffman mTables[4];
+		float mQuant[4][64];		// Natural order, IDCT scaling folded in
+		Component mComps[3];
+		int mNumComps;
+		int mHMax, mVMax;
+		size_t mMCUsX, mMCUsY;
+		size_t mRestart;
+
+		std::vector<Segment> vSegments;
+		unsigned char *pOut;
+		size_t mW, mH;
+		volatile uint32_t mErrors;
+
+		bool mParallel;
+		bool mSIMD;
+	};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+/**
+* @brief Worker pool for data parallel loops
+* @file parallel.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 02/08/2012
+*
+*/
+
+#ifndef S9_PARALLEL_HPP
+#define S9_PARALLEL_HPP
+
+#include "common.hpp"
+
+#include <deque>
+#include <boost/thread.hpp>
+
+namespace s9 {
+
+	/*
+	 * A persistent pool of worker threads, one per hardware thread. Loops are split into
+	 * contiguous [begin,end) chunks that the workers and the calling thread pull from.
+	 * The calling thread helps out, so nested parallelFor calls do not deadlock.
+	 * Range functions must not throw.
+	 */
+
+	class WorkerPool {
+	public:
+		typedef boost::function<void (size_t, size_t)> RangeFunc;
+
+		static WorkerPool& get();
+
+		size_t size() const { return vThreads.size() + 1; };
+
+		void parallelFor(size_t count, RangeFunc f, size_t grain = 4096);
+
+	protected:
+		struct Batch;
+
+	public:
+
+		/*
+		 * A parallelFor the caller does not wait on. finish helps with any chunks still
+		 * queued then blocks until the rest are done - call it before touching anything the
+		 * loop writes. Without worker threads the loop runs inside start
+		 */
+
+		class Job {
+		public:
+			bool pending() const { return pBatch.get() != NULL; };
+		protected:
+			friend class WorkerPool;
+			boost::shared_ptr<Batch> pBatch;
+		};
+
+		Job start(size_t count, RangeFunc f, size_t grain = 4096);
+		void finish(Job &job);
+
+		~WorkerPool();
+
+	protected:
+		WorkerPool(size_t nthreads);
+
+		struct Batch {
+			Batch() : mRemaining(0) {};
+			RangeFunc mFunc;
+			size_t mRemaining;
+			boost::mutex mMutex;
+			boost::condition_variable mDone;
+		};
+
+		struct Chunk {
+			boost::shared_ptr<Batch> pBatch;
+			size_t mBegin, mEnd;
+		};
+
+		bool _pop(Chunk &c);
+		void _execute(Chunk &c);
+		void _run();
+
+		std::vector<boost::thread*> vThreads;
+		std::deque<Chunk> mQueue;
+		boost::mutex mMutex;
+		boost::condition_variable mWake;
+		bool mStop;
+	};
+
+	/*
+	 * Shorthand for the shared pool
+	 */
+
+	inline void parallelFor(size_t count, WorkerPool::RangeFunc f, size_t grain = 4096) {
+		WorkerPool::get().parallelFor(count, f, grain);
+	}
+
+}
+
+#endif
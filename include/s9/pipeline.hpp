@@ -0,0 +1,199 @@
+/**
+* @brief Per camera processing pipeline - stages on workers joined by bounded queues
+* @file pipeline.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 20/08/2012
+*
+*/
+
+#ifndef S9_PIPELINE_HPP
+#define S9_PIPELINE_HPP
+
+#include "common.hpp"
+#include "video_source.hpp"
+
+#include <deque>
+#include <boost/thread.hpp>
+
+#ifdef _GEAR_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace s9 {
+
+	/*
+	 * One step of the per frame work - conversion, undistortion and so on. process works
+	 * on the frame in place and returns false to drop it. Called from one worker at a time
+	 */
+
+	class PipelineStage : boost::noncopyable {
+	public:
+		PipelineStage(std::string name) : mName(name) {};
+		virtual ~PipelineStage() {};
+
+		virtual bool process(VideoFrame &frame) = 0;
+
+		const std::string& getName() const { return mName; };
+
+	protected:
+		std::string mName;
+	};
+
+	/*
+	 * Latency is the time inside the stage, wait the time queued in front of it - zero for
+	 * a stage fused onto the one before. Depth is sampled each time a frame is queued
+	 */
+
+	struct StageStats {
+		StageStats() : mWorker(0), mFrames(0), mDropped(0), mLatencyMean(0), mLatencyMax(0), mWaitMean(0),
+			mDepth(0), mDepthMax(0), mDepthMean(0) {};
+		std::string mName;
+		size_t mWorker;
+		uint64_t mFrames;
+		uint64_t mDropped;			// Refused by the stage, or pushed out of a full queue in front of it
+		double_t mLatencyMean;		// Seconds
+		double_t mLatencyMax;
+		double_t mWaitMean;
+		size_t mDepth;
+		size_t mDepthMax;
+		double_t mDepthMean;
+	};
+
+	/*
+	 * Runs a source's frames through a chain of stages and publishes the results, so it is
+	 * a source in turn - hand it to VidCam or FrameSync as any other. The chain always
+	 * starts with capture, taking frames from the source, and ends with staging, which
+	 * leaves them for the render thread to upload.
+	 *
+	 * Each stage runs on its own worker unless fused to the one before. Workers are joined
+	 * by queues that hold depth frames and push out the oldest when full, so a slow stage
+	 * costs frames rather than latency, and its queue depth shows it. Frames are recycled,
+	 * so nothing is allocated per frame once running.
+	 *
+	 * Set the source raw and add a ConvertStage to take colour conversion off the capture
+	 * thread. add stages before start
+	 */
+
+	class Pipeline : public VideoSource {
+	public:
+		Pipeline(boost::shared_ptr<VideoSource> source, size_t depth = 2);
+		~Pipeline() { stop(); };
+
+		void add(boost::shared_ptr<PipelineStage> stage, bool fuse = false);
+
+		bool start();
+		void stop();
+
+		uint64_t framesDropped();
+
+		// Passed on to the source, which stays raw if a ConvertStage has been added
+		void setRaw(bool raw);
+
+		// Capture first and staging last
+		std::vector<StageStats> getStats();
+
+		// Source capture time to staging, seconds
+		double_t getLatency();
+
+		boost::shared_ptr<VideoSource> getSource() { return pSource; };
+
+	protected:
+
+		/*
+		 * Mutex and condition rather than anything clever - a handful of frames a second
+		 * pass through each and the workers sleep in between
+		 */
+
+		class FrameQueue {
+		public:
+			FrameQueue(size_t depth) : mDepth(depth), mClosed(false) {};
+
+			// Returns the frame pushed out to make room, or NULL
+			VideoFrame* push(VideoFrame *frame, size_t &depth);
+			VideoFrame* pop();		// NULL once closed
+			void close();
+
+		protected:
+			std::deque<VideoFrame*> mQueue;
+			size_t mDepth;
+			bool mClosed;
+			boost::mutex mMutex;
+			boost::condition_variable mReady;
+		};
+
+		struct Worker {
+			size_t mFirst, mLast;				// Stages, inclusive
+			boost::shared_ptr<FrameQueue> pIn;	// Empty for the capture worker
+			boost::thread *pThread;
+		};
+
+		void _capture();
+		void _work(size_t w);
+		void _forward(size_t w, VideoFrame *frame);
+		void _stage(VideoFrame *frame);
+		void _drop(size_t stage, VideoFrame *frame);
+
+		VideoFrame* _acquire();
+		void _release(VideoFrame *frame);
+
+		boost::shared_ptr<VideoSource> pSource;
+		std::vector<boost::shared_ptr<PipelineStage> > vStages;	// Capture and staging are implicit
+		std::vector<bool> vFused;
+		std::vector<Worker> vWorkers;
+		size_t mDepth;
+		volatile bool mRunning;
+
+		std::vector<VideoFrame> vPool;
+		std::vector<VideoFrame*> vFree;
+		boost::mutex mFreeMutex;
+
+		std::vector<double_t> vQueued;		// When each pooled frame entered its queue
+		std::vector<StageStats> vStats;
+		std::vector<uint64_t> vDepthSamples;
+		double_t mLatency;
+		uint64_t mStaged;
+		boost::mutex mStatsMutex;
+	};
+
+
+#ifdef _GEAR_X11_GLX
+
+	/*
+	 * YUYV to RGB, leaving frames already RGB alone
+	 */
+
+	class ConvertStage : public PipelineStage {
+	public:
+		ConvertStage(size_t w, size_t h) : PipelineStage("convert"), mW(w), mH(h) {};
+		bool process(VideoFrame &frame);
+
+	protected:
+		size_t mW, mH;
+		std::vector<unsigned char> vRGB;
+	};
+
+#endif
+
+#ifdef _GEAR_OPENCV
+
+	/*
+	 * Lens undistortion through fixed point maps built once, as CVVidCam does. RGB frames
+	 * only - anything else passes through untouched
+	 */
+
+	class UndistortStage : public PipelineStage {
+	public:
+		UndistortStage(const cv::Mat &M, const cv::Mat &D, size_t w, size_t h);
+		bool process(VideoFrame &frame);
+
+	protected:
+		cv::Mat mMap1, mMap2;
+		std::vector<unsigned char> vOut;
+		size_t mW, mH;
+	};
+
+#endif
+
+}
+
+#endif
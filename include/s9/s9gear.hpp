@@ -18,5 +18,6 @@
 #include "s9xml.hpp"
 #include "visualapp.hpp"
 #include "wingedge.hpp"
+#include "halfedge.hpp"
 
 #endif
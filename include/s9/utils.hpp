@@ -12,6 +12,8 @@
 
 #include "common.hpp"
 
+#include <sys/time.h>
+
 template<class T> inline std::string toStringS9(const T& t) {
 	std::ostringstream stream;
 	stream << t;
@@ -27,23 +29,49 @@ template<class T> inline T fromStringS9(const std::string& s) {
 }
 
 /*
- * Basic text file reading
+ * Wall clock time in seconds - for timing and metrics
+ */
+
+inline double_t timeNowS9() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<double_t>(tv.tv_sec) + static_cast<double_t>(tv.tv_usec) * 1.0e-6;
+}
+
+/*
+ * Monotonic time in seconds - the clock V4L2 stamps buffers with, so use this for latency
+ */
+
+inline double_t timeMonotonicS9() {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<double_t>(ts.tv_sec) + static_cast<double_t>(ts.tv_nsec) * 1.0e-9;
+#else
+	return timeNowS9();
+#endif
+}
+
+/*
+ * Basic text file reading - the whole file in one read
  */
 
 std::string inline textFileRead(std::string filename) {
-	std::string line;
-	std::string rval;
-	std::ifstream myfile (filename.c_str());
-	if (myfile.is_open()){
-		while ( myfile.good() )	{
-			getline (myfile,line);
-			rval += line +"\n";
-		}
-		myfile.close();
+	std::ifstream myfile (filename.c_str(), std::ios::in | std::ios::binary);
+	if (!myfile.is_open()) {
+		std::cerr << "S9Gear - Unable to open shader file " << filename << std::endl;
+		return "";
 	}
 
-	else std::cerr << "S9Gear - Unable to open shader file " << filename << std::endl;
-
+	std::string rval;
+	myfile.seekg(0, std::ios::end);
+	std::streamoff size = myfile.tellg();
+	if (size > 0) {
+		rval.resize(static_cast<size_t>(size));
+		myfile.seekg(0, std::ios::beg);
+		myfile.read(&rval[0], size);
+		rval.resize(static_cast<size_t>(myfile.gcount()));
+	}
 	return rval;
 }
 
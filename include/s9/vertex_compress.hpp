@@ -0,0 +1,182 @@
+/**
+* @brief Encoders and decoders for the compressed vertex types
+* @file vertex_compress.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 09/08/2012
+*
+*/
+
+#ifndef VERTEX_COMPRESS_HPP
+#define VERTEX_COMPRESS_HPP
+
+#include "common.hpp"
+#include "vertex_types.hpp"
+
+#include <cmath>
+
+/*
+ * Positions are stored as 16 bit unsigned normalised values across the mesh bounds, so
+ * the GPU sees [0,1] and the shader applies min + p * extent. Normals use the octahedral
+ * mapping (fold the octahedron flat onto a square) in two signed normalised shorts.
+ * Texture coordinates are half floats. Decoding here matches the GLSL in
+ * applications/leeds/data/leedsmesh_packed.vert bit for bit on the integer inputs
+ */
+
+namespace s9 {
+
+	/*
+	 * Per mesh decode parameters - pass these to the shader as uPosMin / uPosExtent
+	 */
+
+	struct PositionQuant {
+		PositionQuant() : mMin(0.0f, 0.0f, 0.0f), mExtent(1.0f, 1.0f, 1.0f) {};
+		glm::vec3 mMin;
+		glm::vec3 mExtent;
+	};
+
+	template <class T>
+	inline PositionQuant quantForPositions(const T *v, size_t n) {
+		PositionQuant q;
+		if (n == 0) return q;
+
+		glm::vec3 lo = toVec3(v[0].mP), hi = lo;
+		for (size_t i = 1; i < n; ++i) {
+			glm::vec3 p = toVec3(v[i].mP);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+
+		q.mMin = lo;
+		q.mExtent = hi - lo;
+		for (int j = 0; j < 3; ++j)
+			if (q.mExtent[j] <= 0.0f) q.mExtent[j] = 1.0f;		// Flat axis - everything encodes to 0
+		return q;
+	}
+
+	inline uint16_t toUNorm16(float_t f) {
+		f = std::min(std::max(f, 0.0f), 1.0f);
+		return static_cast<uint16_t>(std::floor(f * 65535.0f + 0.5f));
+	}
+
+	inline int16_t toSNorm16(float_t f) {
+		f = std::min(std::max(f, -1.0f), 1.0f);
+		return static_cast<int16_t>(std::floor(f * 32767.0f + 0.5f));
+	}
+
+	// The GL rules for normalised integers
+	inline float_t fromUNorm16(uint16_t v) { return v / 65535.0f; }
+	inline float_t fromSNorm16(int16_t v) { return std::max(v / 32767.0f, -1.0f); }
+
+	inline UShort4N quantisePosition(const glm::vec3 &p, const PositionQuant &q) {
+		glm::vec3 n = (p - q.mMin) / q.mExtent;
+		UShort4N r = { toUNorm16(n.x), toUNorm16(n.y), toUNorm16(n.z), 0 };
+		return r;
+	}
+
+	inline glm::vec3 dequantisePosition(const UShort4N &p, const PositionQuant &q) {
+		return q.mMin + glm::vec3(fromUNorm16(p.x), fromUNorm16(p.y), fromUNorm16(p.z)) * q.mExtent;
+	}
+
+	inline Short2N octEncode(const glm::vec3 &n) {
+		float_t l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		Short2N r = { 0, 0 };
+		if (l1 <= 0.0f) return r;
+
+		float_t x = n.x / l1, y = n.y / l1;
+		if (n.z < 0.0f) {
+			float_t ox = x;
+			x = (1.0f - std::fabs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+			y = (1.0f - std::fabs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		r.x = toSNorm16(x);
+		r.y = toSNorm16(y);
+		return r;
+	}
+
+	inline glm::vec3 octDecode(const Short2N &e) {
+		glm::vec3 v (fromSNorm16(e.x), fromSNorm16(e.y), 0.0f);
+		v.z = 1.0f - std::fabs(v.x) - std::fabs(v.y);
+		float_t t = std::max(-v.z, 0.0f);
+		v.x += v.x >= 0.0f ? -t : t;
+		v.y += v.y >= 0.0f ? -t : t;
+		return glm::normalize(v);
+	}
+
+	inline Half2 toHalf2(const Float2 &t) { Half2 h = { floatToHalf(t.x), floatToHalf(t.y) }; return h; }
+	inline Float2 fromHalf2(const Half2 &h) { Float2 t = { halfToFloat(h.x), halfToFloat(h.y) }; return t; }
+
+
+	/*
+	 * Per vertex encoders and decoders. Overloaded on the source and destination types
+	 */
+
+	inline void encodeVertex(const VertPNF &s, VertPNQ &d, const PositionQuant &q) {
+		d.mP = quantisePosition(toVec3(s.mP), q);
+		d.mN = octEncode(toVec3(s.mN));
+	}
+
+	inline void encodeVertex(const VertPNTF &s, VertPNTQ &d, const PositionQuant &q) {
+		d.mP = quantisePosition(toVec3(s.mP), q);
+		d.mN = octEncode(toVec3(s.mN));
+		d.mT = toHalf2(s.mT);
+	}
+
+	inline void encodeVertex(const VertPNF &s, VertPNT8Q &d, const PositionQuant &q) {
+		d.mP = quantisePosition(toVec3(s.mP), q);
+		d.mN = octEncode(toVec3(s.mN));
+		memset(d.mT, 0, sizeof(d.mT));
+	}
+
+	inline void encodeVertex(const VertPNT8F &s, VertPNT8Q &d, const PositionQuant &q) {
+		d.mP = quantisePosition(toVec3(s.mP), q);
+		d.mN = octEncode(toVec3(s.mN));
+		for (int i = 0; i < 8; ++i)
+			d.mT[i] = toHalf2(s.mT[i]);
+	}
+
+	inline void decodeVertex(const VertPNQ &s, VertPNF &d, const PositionQuant &q) {
+		d.mP = fromVec3<Float3>(dequantisePosition(s.mP, q));
+		d.mN = fromVec3<Float3>(octDecode(s.mN));
+	}
+
+	inline void decodeVertex(const VertPNTQ &s, VertPNTF &d, const PositionQuant &q) {
+		d.mP = fromVec3<Float3>(dequantisePosition(s.mP, q));
+		d.mN = fromVec3<Float3>(octDecode(s.mN));
+		d.mT = fromHalf2(s.mT);
+	}
+
+	inline void decodeVertex(const VertPNT8Q &s, VertPNT8F &d, const PositionQuant &q) {
+		d.mP = fromVec3<Float3>(dequantisePosition(s.mP, q));
+		d.mN = fromVec3<Float3>(octDecode(s.mN));
+		for (int i = 0; i < 8; ++i)
+			d.mT[i] = fromHalf2(s.mT[i]);
+	}
+
+	/*
+	 * One chunk of a parallelFor over encodeVertex / decodeVertex
+	 */
+
+	template <class T, class U>
+	struct EncodeRange {
+		const T *pSrc;
+		U *pDst;
+		PositionQuant mQuant;
+		void operator()(size_t b, size_t e) const {
+			for (size_t i = b; i < e; ++i) encodeVertex(pSrc[i], pDst[i], mQuant);
+		}
+	};
+
+	template <class T, class U>
+	struct DecodeRange {
+		const T *pSrc;
+		U *pDst;
+		PositionQuant mQuant;
+		void operator()(size_t b, size_t e) const {
+			for (size_t i = b; i < e; ++i) decodeVertex(pSrc[i], pDst[i], mQuant);
+		}
+	};
+
+}
+
+#endif
@@ -38,8 +38,27 @@ namespace s9 {
 	struct Float3 { float_t x,y,z; };
 	
 	struct Float4 { float_t x,y,z,w;};
-	
-	///\todo uint
+
+	// Packed widths for shrinking vertices. Half types hold IEEE 754 half floats, the N
+	// types are normalised integers that the GPU maps to [-1,1] or [0,1]
+
+	struct Half2 { uint16_t x,y; };
+
+	struct Half3 { uint16_t x,y,z; };
+
+	struct Half4 { uint16_t x,y,z,w; };
+
+	struct Byte4N { int8_t x,y,z,w; };
+
+	struct UByte4N { uint8_t x,y,z,w; };
+
+	struct Short2N { int16_t x,y; };
+
+	struct Short4N { int16_t x,y,z,w; };
+
+	struct UShort2N { uint16_t x,y; };
+
+	struct UShort4N { uint16_t x,y,z,w; };
 	
 	template <class T>
 	struct VertexP {
@@ -121,8 +140,214 @@ namespace s9 {
 
 	typedef VertexPNT8<Float3, Float3, Float2> VertPNT8F;
 
+	// Compressed - positions quantised to the mesh bounds (w unused), octahedral
+	// normals and half float texture coordinates. See vertex_compress.hpp
+
+	typedef VertexPN<UShort4N, Short2N> VertPNQ;
+	typedef VertexPNT<UShort4N, Short2N, Half2> VertPNTQ;
+	typedef VertexPNT8<UShort4N, Short2N, Half2> VertPNT8Q;
+
+
+#pragma pack(pop)
+
+	/*
+	 * Float to half with round to nearest even. Overflow goes to infinity, tiny values
+	 * to half denormals
+	 */
+
+	inline uint16_t floatToHalf(float_t f) {
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+		uint32_t a = x & 0x7fffffff;
+
+		if (a >= 0x7f800000) return sign | 0x7c00 | (a > 0x7f800000 ? 0x200 : 0);	// Inf / NaN
+		if (a >= 0x47800000) return sign | 0x7c00;
+		if (a < 0x33000000) return sign;
+
+		uint32_t h, rem, halfway;
+		if (a < 0x38800000) {
+			uint32_t shift = 126 - (a >> 23);
+			uint32_t m = (a & 0x7fffff) | 0x800000;
+			h = m >> shift;
+			rem = m & ((1u << shift) - 1);
+			halfway = 1u << (shift - 1);
+		} else {
+			h = (a - 0x38000000) >> 13;
+			rem = a & 0x1fff;
+			halfway = 0x1000;
+		}
+
+		if (rem > halfway || (rem == halfway && (h & 1))) h++;		// May carry into the exponent
+		return sign | static_cast<uint16_t>(h);
+	}
+
+	inline float_t halfToFloat(uint16_t h) {
+		uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		uint32_t e = (h >> 10) & 0x1f;
+		uint32_t m = h & 0x3ff;
+		uint32_t x;
+
+		if (e == 0) {
+			if (m == 0) x = sign;
+			else {
+				e = 113;
+				while (!(m & 0x400)) { m <<= 1; e--; }
+				x = sign | (e << 23) | ((m & 0x3ff) << 13);
+			}
+		}
+		else if (e == 31) x = sign | 0x7f800000 | (m << 13);
+		else x = sign | ((e + 112) << 23) | (m << 13);
+
+		float_t f;
+		memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+
+	/*
+	 * Layout descriptors. AttribTraits says how one member is read by the GPU and
+	 * VertexLayout<V> lists the members of each vertex template in declaration order,
+	 * so attribute locations are 0, 1, 2... as the shaders expect. Structs are packed,
+	 * so offsets are the running sum of member sizes. An unknown member type fails to
+	 * compile rather than drawing nothing
+	 */
+
+	typedef enum {
+		ATTRIB_FLOAT,
+		ATTRIB_DOUBLE,
+		ATTRIB_HALF,
+		ATTRIB_BYTE,
+		ATTRIB_UBYTE,
+		ATTRIB_SHORT,
+		ATTRIB_USHORT
+	} AttribFormat;
+
+	template <class C> struct AttribTraits;
+
+#define S9_ATTRIB_TRAITS(C, N, F, NORM) \
+	template <> struct AttribTraits<C> { \
+		static const uint32_t components = N; \
+		static const AttribFormat format = F; \
+		static const bool normalised = NORM; \
+	};
+
+	S9_ATTRIB_TRAITS(glm::vec2, 2, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(glm::vec3, 3, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(glm::vec4, 4, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(Float2, 2, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(Float3, 3, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(Float4, 4, ATTRIB_FLOAT, false)
+	S9_ATTRIB_TRAITS(Double2, 2, ATTRIB_DOUBLE, false)
+	S9_ATTRIB_TRAITS(Double3, 3, ATTRIB_DOUBLE, false)
+	S9_ATTRIB_TRAITS(Double4, 4, ATTRIB_DOUBLE, false)
+	S9_ATTRIB_TRAITS(Half2, 2, ATTRIB_HALF, false)
+	S9_ATTRIB_TRAITS(Half3, 3, ATTRIB_HALF, false)
+	S9_ATTRIB_TRAITS(Half4, 4, ATTRIB_HALF, false)
+	S9_ATTRIB_TRAITS(Byte4N, 4, ATTRIB_BYTE, true)
+	S9_ATTRIB_TRAITS(UByte4N, 4, ATTRIB_UBYTE, true)
+	S9_ATTRIB_TRAITS(Short2N, 2, ATTRIB_SHORT, true)
+	S9_ATTRIB_TRAITS(Short4N, 4, ATTRIB_SHORT, true)
+	S9_ATTRIB_TRAITS(UShort2N, 2, ATTRIB_USHORT, true)
+	S9_ATTRIB_TRAITS(UShort4N, 4, ATTRIB_USHORT, true)
+
+#undef S9_ATTRIB_TRAITS
+
+	struct VertexAttrib {
+		uint32_t mComponents;
+		AttribFormat mFormat;
+		bool mNormalised;
+		size_t mOffset;
+	};
+
+	struct VertexFormat {
+		static const size_t MAX_ATTRIBS = 16;		// The GL minimum for GL_MAX_VERTEX_ATTRIBS
+
+		VertexFormat() : mCount(0), mStride(0) {};
+
+		// Append n consecutive members of type C
+		template <class C>
+		void add(size_t n = 1) {
+			for (size_t i = 0; i < n && mCount < MAX_ATTRIBS; ++i) {
+				VertexAttrib &a = vAttribs[mCount++];
+				a.mComponents = AttribTraits<C>::components;
+				a.mFormat = AttribTraits<C>::format;
+				a.mNormalised = AttribTraits<C>::normalised;
+				a.mOffset = mStride;
+				mStride += sizeof(C);
+			}
+		};
 
-#pragma pack(pop)  
+		VertexAttrib vAttribs[MAX_ATTRIBS];
+		size_t mCount;
+		size_t mStride;
+	};
+
+	template <class V> struct VertexLayout;
+
+	template <class T>
+	struct VertexLayout< VertexP<T> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); return f; };
+	};
+
+	template <class T, class U>
+	struct VertexLayout< VertexPN<T,U> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); return f; };
+	};
+
+	template <class T, class U, class V>
+	struct VertexLayout< VertexPNT<T,U,V> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); f.add<V>(); return f; };
+	};
+
+	template <class T, class U, class V>
+	struct VertexLayout< VertexPNC<T,U,V> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); f.add<V>(); return f; };
+	};
+
+	template <class T, class U, class V>
+	struct VertexLayout< VertexPCT<T,U,V> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); f.add<V>(); return f; };
+	};
+
+	template <class T, class U, class V, class W>
+	struct VertexLayout< VertexPNCT<T,U,V,W> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); f.add<V>(); f.add<W>(); return f; };
+	};
+
+	template <class T, class U, class V>
+	struct VertexLayout< VertexPNT8<T,U,V> > {
+		static VertexFormat get() { VertexFormat f; f.add<T>(); f.add<U>(); f.add<V>(8); return f; };
+	};
+
+
+	/*
+	 * Generic accessors so templated mesh code can read positions and write normals
+	 * whatever the component types. Values are passed by copy - members are packed
+	 */
+
+	inline glm::vec3 toVec3(const glm::vec3 &v) { return v; };
+	inline glm::vec3 toVec3(const Float3 &v) { return glm::vec3(v.x, v.y, v.z); };
+	inline glm::vec3 toVec3(const Double3 &v) { return glm::vec3(v.x, v.y, v.z); };
+
+	template <class U> inline U fromVec3(const glm::vec3 &v);
+	template <> inline glm::vec3 fromVec3<glm::vec3>(const glm::vec3 &v) { return v; };
+	template <> inline Float3 fromVec3<Float3>(const glm::vec3 &v) { Float3 f = {v.x, v.y, v.z}; return f; };
+	template <> inline Double3 fromVec3<Double3>(const glm::vec3 &v) { Double3 d = {v.x, v.y, v.z}; return d; };
+
+	// Types without a normal ignore the write
+	template <class V> inline void setNormal(V &v, const glm::vec3 &n) {};
+
+	template <class T, class U>
+	inline void setNormal(VertexPN<T,U> &v, const glm::vec3 &n) { v.mN = fromVec3<U>(n); };
+	template <class T, class U, class V>
+	inline void setNormal(VertexPNT<T,U,V> &v, const glm::vec3 &n) { v.mN = fromVec3<U>(n); };
+	template <class T, class U, class V>
+	inline void setNormal(VertexPNC<T,U,V> &v, const glm::vec3 &n) { v.mN = fromVec3<U>(n); };
+	template <class T, class U, class V, class W>
+	inline void setNormal(VertexPNCT<T,U,V,W> &v, const glm::vec3 &n) { v.mN = fromVec3<U>(n); };
+	template <class T, class U, class V>
+	inline void setNormal(VertexPNT8<T,U,V> &v, const glm::vec3 &n) { v.mN = fromVec3<U>(n); };
 
 }
 
@@ -0,0 +1,92 @@
+/**
+* @brief Base for anything that produces camera frames for VidCam
+* @file video_source.hpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 15/08/2012
+*
+*/
+
+#ifndef S9_VIDEO_SOURCE_HPP
+#define S9_VIDEO_SOURCE_HPP
+
+#include "common.hpp"
+#include "frame_buffer.hpp"
+
+#include <boost/thread.hpp>
+
+namespace s9 {
+
+	/*
+	 * A source fills back() of its triple buffer on its own thread and publishes it. The
+	 * render thread calls newFrame then reads getFrame / getBuffer, which stay valid and
+	 * untorn until its next newFrame call.
+	 *
+	 * Sources convert YUYV to RGB unless set raw, in which case frames arrive as YUYV for
+	 * the consumer to decode, on the GPU for instance. Each frame records its own format
+	 * so switching while running is safe
+	 */
+
+	/*
+	 * What a camera is asked to send. MJPEG needs far less USB bandwidth than YUYV at the
+	 * same size and rate, at the cost of decoding on the capture thread
+	 */
+
+	typedef enum {
+		CAPTURE_YUYV,
+		CAPTURE_MJPEG
+	} CaptureFormat;
+
+	class VideoSource : boost::noncopyable {
+	public:
+		VideoSource() : mRaw(false) {};
+		virtual ~VideoSource() {};
+
+		virtual void stop() = 0;
+
+		bool newFrame() { return mFrames.fetch(); };
+		const VideoFrame& getFrame() const { return mFrames.front(); };
+		unsigned char* getBuffer() { return &(mFrames.front().mData[0]); };
+
+		// Swaps the fetched frame into f, leaving f's old storage for the source to fill again.
+		// getFrame is meaningless until the next newFrame
+		void takeFrame(VideoFrame &f) {
+			VideoFrame &front = mFrames.front();
+			f.mData.swap(front.mData);
+			f.mFormat = front.mFormat;
+			f.mSeq = front.mSeq;
+			f.mTimestamp = front.mTimestamp;
+		}
+
+		uint64_t framesCaptured() { return mFrames.published(); };
+		virtual uint64_t framesDropped() { return mFrames.dropped(); };
+
+		// Raw frames are YUYV, left for the consumer to convert
+		virtual void setRaw(bool raw) { mRaw = raw; };
+		bool isRaw() const { return mRaw; };
+
+		// Blocks until newFrame would succeed, or timeout seconds pass. For consumers with a thread to spare
+		bool waitFrame(double_t timeout) {
+			boost::mutex::scoped_lock lock(mPublishMutex);
+			boost::system_time until = boost::get_system_time() + boost::posix_time::microseconds(static_cast<int64_t>(timeout * 1.0e6));
+			while (!mFrames.ready())
+				if (!mPublished.timed_wait(lock, until)) break;
+			return newFrame();
+		}
+
+	protected:
+		// Sources publish back() through here so waitFrame wakes
+		void _publish() {
+			mFrames.publish();
+			boost::mutex::scoped_lock lock(mPublishMutex);
+			mPublished.notify_all();
+		}
+
+		TripleBuffer<VideoFrame> mFrames;
+		volatile bool mRaw;
+		boost::mutex mPublishMutex;
+		boost::condition_variable mPublished;
+	};
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 
 #include "common.hpp"
 #include "geometry.hpp"
+#include "parallel.hpp"
 
 /*
  * Given a primtive with indices, create a winged edge structure for it
@@ -44,32 +45,148 @@ namespace s9 {
 	typedef boost::shared_ptr<WE_Face> WEP_Face;
 
 
+	typedef enum {
+		FLATTEN_FACE_NORMALS,		// Three vertices per face, each carrying the face normal. Not indexed
+		FLATTEN_SMOOTH_NORMALS		// The original vertices with area weighted normals, indexed by face
+	} FlattenMode;
+
 	class WingedEdge {
 	public:
 		WingedEdge(){};
-		void make(DrawableGeometry geom);
+
+		// Geometry is a shared handle so this only copies the handle, never the buffers
+		template<class T>
+		void make(Geometry<T> geom) { make( boost::shared_ptr<DrawableGeometry>(new Geometry<T>(geom)) ); };
+
+		void make(boost::shared_ptr<DrawableGeometry> geom);
 		std::vector<WEP_Face> getFaces() {return mObj->mWE; };
 		virtual operator int() const { return mObj.use_count() > 0; };
 	
 	protected:
+
+		// Vertex indices of each face, three per face in winding order
+		void _faceCorners(std::vector<uint32_t> &corners);
+
+		// Faces touching each vertex as offsets into a flat list
+		static void _vertexFaces(const std::vector<uint32_t> &corners, size_t numverts,
+			std::vector<uint32_t> &starts, std::vector<uint32_t> &faces);
+
 		class SharedObj {
 		public:
 			std::vector<WEP_Face> mWE;
-			DrawableGeometry mGeom;
+			boost::shared_ptr<DrawableGeometry> mGeom;
 		};
 		
 		boost::shared_ptr<SharedObj> mObj;
 	};
 
 
+	/*
+	 * Parallel kernels for flatten. Face normals are left unnormalised, their length being
+	 * twice the face area, so summing them gives area weighted vertex normals for free
+	 */
+
+	template <class T>
+	struct FlattenFaces {
+		const T *pSrc;
+		const uint32_t *pCorners;
+		glm::vec3 *pNormals;
+		T *pDst;				// NULL when only the normals are wanted
+
+		void operator()(size_t b, size_t e) const {
+			for (size_t f = b; f < e; ++f) {
+				const uint32_t *c = pCorners + f * 3;
+				glm::vec3 p0 = toVec3(pSrc[c[0]].mP);
+				glm::vec3 n = glm::cross(toVec3(pSrc[c[1]].mP) - p0, toVec3(pSrc[c[2]].mP) - p0);
+				pNormals[f] = n;
+
+				if (pDst == NULL) continue;
+
+				float_t l = glm::length(n);
+				for (size_t j = 0; j < 3; ++j) {
+					pDst[f * 3 + j] = pSrc[c[j]];
+					if (l > 0.0f) setNormal(pDst[f * 3 + j], n / l);	// Degenerate faces keep their normals
+				}
+			}
+		}
+	};
+
+	template <class T>
+	struct SmoothNormals {
+		const uint32_t *pStarts;
+		const uint32_t *pFaces;
+		const glm::vec3 *pNormals;
+		T *pDst;
+
+		void operator()(size_t b, size_t e) const {
+			for (size_t v = b; v < e; ++v) {
+				glm::vec3 n (0.0f, 0.0f, 0.0f);
+				for (uint32_t i = pStarts[v]; i < pStarts[v + 1]; ++i)
+					n += pNormals[pFaces[i]];
+
+				float_t l = glm::length(n);
+				if (l > 0.0f) setNormal(pDst[v], n / l);
+			}
+		}
+	};
+
+
 	/*
 	 * Type safe version of the WingedEdge class for returning geometry flattened
 	 */
 
 	template <class T>
 	class WingedEdgeT : public WingedEdge {
-			Geometry<T> flatten(); 
+	public:
+		Geometry<T> flatten(FlattenMode mode = FLATTEN_FACE_NORMALS);
 	};
+
+
+	/*
+	 * Write the kept faces into a preallocated buffer in parallel. Vertex types without
+	 * a normal are still flattened, the normal write is simply dropped
+	 */
+
+	template <class T>
+	inline Geometry<T> WingedEdgeT<T>::flatten(FlattenMode mode) {
+		Geometry<T> g;
+		Geometry<T> *src = dynamic_cast< Geometry<T>* >(mObj->mGeom.get());
+		if (src == NULL) {
+			std::cerr << "S9Gear - Winged Edge flatten called with the wrong vertex type" << std::endl;
+			return g;
+		}
+
+		std::vector<uint32_t> corners;
+		_faceCorners(corners);
+
+		size_t nf = corners.size() / 3;
+		std::vector<glm::vec3> normals (nf);
+		std::vector<T> verts;
+
+		g.createEmpty();
+		if (nf == 0) return g;
+
+		FlattenFaces<T> ff = { src->data(), &corners[0], &normals[0], NULL };
+
+		if (mode == FLATTEN_SMOOTH_NORMALS) {
+			verts.assign(src->getBuffer().begin(), src->getBuffer().end());
+			parallelFor(nf, ff, 16384);
+
+			std::vector<uint32_t> starts, faces;
+			_vertexFaces(corners, verts.size(), starts, faces);
+
+			SmoothNormals<T> sn = { &starts[0], &faces[0], &normals[0], &verts[0] };
+			parallelFor(verts.size(), sn, 16384);
+			g.swapIndices(corners);
+		} else {
+			verts.resize(nf * 3);
+			ff.pDst = &verts[0];
+			parallelFor(nf, ff, 16384);
+		}
+
+		g.swapBuffer(verts);
+		return g;
+	}
 	
 }
 
@@ -7,6 +7,7 @@
 */
 
 #include "s9/asset.hpp"
+#include "s9/utils.hpp"
 
 using namespace std;
 using namespace boost;
@@ -14,65 +15,156 @@ using namespace boost::assign;
 using namespace s9;
 
 const struct aiScene* AssetImporter::pScene;
+bool AssetImporter::mCacheEnabled = false;
+std::string AssetImporter::mCacheDir;
+bool AssetImporter::mOptimise = true;
+
+
+/*
+ * The meshes of a single node laid end to end in the output buffers
+ */
+
+struct MeshSpan {
+	const struct aiMesh *pMesh;
+	size_t mVertexOffset;
+	size_t mTriOffset;
+	size_t mTriCount;
+	bool mAllTriangles;
+};
+
+/*
+ * Find the span that holds element i, given the offset of each span
+ */
+
+static size_t findSpan(const vector<size_t> &offsets, size_t i) {
+	return (upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin()) - 1;
+}
+
+/*
+ * Decode a range of vertices, across mesh boundaries, straight into interleaved PNF
+ */
+
+struct DecodeVertices {
+	const vector<MeshSpan> *pSpans;
+	const vector<size_t> *pOffsets;
+	VertPNF *pDst;
+
+	void operator()(size_t b, size_t e) const {
+		size_t s = findSpan(*pOffsets, b);
+		for (size_t i = b; i < e; ++i) {
+			while (s + 1 < pOffsets->size() && i >= (*pOffsets)[s+1]) ++s;
+
+			const struct aiMesh *mesh = (*pSpans)[s].pMesh;
+			size_t k = i - (*pSpans)[s].mVertexOffset;
+
+			VertPNF &v = pDst[i];
+			v.mP.x = mesh->mVertices[k].x;
+			v.mP.y = mesh->mVertices[k].y;
+			v.mP.z = mesh->mVertices[k].z;
+
+			if (mesh->mNormals != NULL) {
+				v.mN.x = mesh->mNormals[k].x;
+				v.mN.y = mesh->mNormals[k].y;
+				v.mN.z = mesh->mNormals[k].z;
+			} else {
+				v.mN.x = v.mN.y = v.mN.z = 0.0f;
+			}
+		}
+	}
+};
+
+/*
+ * Decode a range of triangles into the index buffer, rebased onto the combined vertex buffer.
+ * Meshes with non-triangle faces are compacted serially afterwards
+ */
+
+struct DecodeTriangles {
+	const vector<MeshSpan> *pSpans;
+	const vector<size_t> *pOffsets;
+	uint32_t *pDst;
+
+	void operator()(size_t b, size_t e) const {
+		size_t s = findSpan(*pOffsets, b);
+		for (size_t t = b; t < e; ++t) {
+			while (s + 1 < pOffsets->size() && t >= (*pOffsets)[s+1]) ++s;
+
+			const MeshSpan &span = (*pSpans)[s];
+			if (!span.mAllTriangles) continue;
+
+			const struct aiFace *face = &span.pMesh->mFaces[t - span.mTriOffset];
+			uint32_t base = static_cast<uint32_t>(span.mVertexOffset);
+			pDst[t * 3] = face->mIndices[0] + base;
+			pDst[t * 3 + 1] = face->mIndices[1] + base;
+			pDst[t * 3 + 2] = face->mIndices[2] + base;
+		}
+	}
+};
+
 
 /*
- * Recursive load function. Dependent on the actual type of the geom
+ * Recursive load function. Each node becomes one asset with all of its meshes combined.
+ * The buffers are sized up front then filled in parallel
  */ 
 
 AssetPtr AssetImporter::_load (const struct aiScene *sc, const struct aiNode* nd, AssetPtr p ) {
 
-	vector<float_t> verts;
-	vector<float_t> norms;
-	vector<uint32_t> indices;
-
+	vector<MeshSpan> spans;
+	vector<size_t> voffsets, toffsets;
+	size_t nverts = 0, ntris = 0;
 
-	// draw all meshes assigned to this node - assuming triangles
+	// Sizing pass - only faces with three indices are kept
 	for (size_t n = 0; n < nd->mNumMeshes; ++n) {
-		const struct aiMesh* mesh = pScene->mMeshes[nd->mMeshes[n]];
-
-		// Allocate vertices
-	
+		const struct aiMesh* mesh = sc->mMeshes[nd->mMeshes[n]];
 
-		for (size_t k = 0; k < mesh->mNumVertices; k++){
+		MeshSpan span;
+		span.pMesh = mesh;
+		span.mVertexOffset = nverts;
+		span.mTriOffset = ntris;
+		span.mTriCount = 0;
 
-			verts.push_back(0.0f);
-			verts.push_back(0.0f);
-			verts.push_back(0.0f);
-			
-			norms.push_back(0.0f);
-			norms.push_back(0.0f);
-			norms.push_back(0.0f);
+		if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+			span.mTriCount = mesh->mNumFaces;
+		} else {
+			for (size_t t = 0; t < mesh->mNumFaces; ++t)
+				if (mesh->mFaces[t].mNumIndices == 3) span.mTriCount++;
 		}
-	
+		span.mAllTriangles = span.mTriCount == mesh->mNumFaces;
+
+		spans.push_back(span);
+		voffsets.push_back(nverts);
+		toffsets.push_back(ntris);
+		nverts += mesh->mNumVertices;
+		ntris += span.mTriCount;
+	}
+
+	vector<VertPNF> verts (nverts);
+	vector<uint32_t> indices (ntris * 3);
 
-		for (size_t t = 0; t < mesh->mNumFaces; ++t) {
-			const struct aiFace* face = &mesh->mFaces[t];
-			
-			if ( face->mNumIndices == 3) {
-				for(size_t i = 0; i < face->mNumIndices; ++i) {
-					int index = face->mIndices[i];
-					indices.push_back(index);
-					
-				//	if(mesh->mColors[0] != NULL)
-				//		glColor4fv((GLfloat*)&mesh->mColors[0][index]);
-					
-					if(mesh->mNormals != NULL) {
-						norms[index * 3 ] = mesh->mNormals[index].x;
-						norms[index * 3 + 1] =  mesh->mNormals[index].y;
-						norms[index * 3 + 2] =  mesh->mNormals[index].z;
-					}
-					
-					verts[index * 3 ] =  mesh->mVertices[index].x;
-					verts[index * 3 + 1] =  mesh->mVertices[index].y;
-					verts[index * 3 + 2] =  mesh->mVertices[index].z;	
-
-				}
+	if (nverts > 0) {
+		DecodeVertices dv = { &spans, &voffsets, &verts[0] };
+		parallelFor(nverts, dv, 8192);
+	}
+
+	if (ntris > 0) {
+		DecodeTriangles dt = { &spans, &toffsets, &indices[0] };
+		parallelFor(ntris, dt, 8192);
+
+		for (size_t s = 0; s < spans.size(); ++s) {
+			if (spans[s].mAllTriangles) continue;
+			size_t idx = spans[s].mTriOffset * 3;
+			for (size_t t = 0; t < spans[s].pMesh->mNumFaces; ++t) {
+				const struct aiFace *face = &spans[s].pMesh->mFaces[t];
+				if (face->mNumIndices != 3) continue;
+				for (size_t i = 0; i < 3; ++i)
+					indices[idx++] = face->mIndices[i] + spans[s].mVertexOffset;
 			}
 		}
 	}
 
-	GeometryPNF g (verts,norms);
-	g.addIndices(indices);
+	GeometryPNF g;
+	g.createEmpty();
+	g.swapBuffer(verts);
+	g.swapIndices(indices);
 
 	AssetPtr pp (new AssetBasic(g));
 
@@ -87,32 +179,99 @@ AssetPtr AssetImporter::_load (const struct aiScene *sc, const struct aiNode* nd
 
 
 /*
- * Load an Asset uisng the Assimp methodology for just PNF verts
+ * Load an Asset uisng the Assimp methodology for just PNF verts.
+ * A valid cache is mapped in without touching Assimp at all. Otherwise parsing and
+ * post processing are run as separate steps so each can be timed
  */
 
-AssetBasic AssetImporter::load(std::string filename){
+AssetBasic AssetImporter::load(std::string filename, unsigned int flags, AssetImportStats *stats){
 
 	AssetBasic p;
+	AssetImportStats st;
+	double_t t;
 
-	pScene = aiImportFile(filename.c_str(),aiProcessPreset_TargetRealtime_MaxQuality);
-	if (pScene) {
-	/*	get_bounding_box(&scene_min,&scene_max);
-		scene_center.x = (scene_min.x + scene_max.x) / 2.0f;
-		scene_center.y = (scene_min.y + scene_max.y) / 2.0f;
-		scene_center.z = (scene_min.z + scene_max.z) / 2.0f;*/
+	MeshSource src;
+	std::string cpath;
+	bool cacheable = mCacheEnabled && MeshCache::stat(filename, src);
+	uint32_t options = mOptimise ? MESHCACHE_OPTIMISED : 0;
+
+	if (cacheable) {
+		cpath = MeshCache::cachePath(filename, mCacheDir, flags);
+		t = timeNowS9();
+		MeshCache mc;
+		GeometryPNF g;
+		if (mc.open(cpath) && mc.isValidFor(src, flags, options) && mc.toGeometry(g)) {
+			// Matched on the hash alone - store the new mtime so the next load skips hashing
+			if (mc.getHeader().mSourceMTime != src.mMTime)
+				MeshCache::refresh(cpath, src);
+			p = AssetBasic(g);
+			st.mCacheHit = true;
+			st.mCacheLoad = timeNowS9() - t;
+			st.mVertices = g.size();
+			st.mIndices = g.indexsize();
+#ifdef DEBUG
+			cout << "S9Gear - " << filename << " loaded from cache with " << st.mVertices << " vertices in " << st.mCacheLoad << "s." << endl;
+#endif
+			if (stats != NULL)
+				*stats = st;
+			return p;
+		}
+	}
+
+	t = timeNowS9();
+	pScene = aiImportFile(filename.c_str(), 0);
+	st.mParse = timeNowS9() - t;
+
+	if (pScene && flags != 0) {
+		t = timeNowS9();
+		pScene = aiApplyPostProcessing(pScene, flags);
+		st.mPostProcess = timeNowS9() - t;
+	}
 
+	if (pScene) {
+		t = timeNowS9();
 		p = *(_load(pScene, pScene->mRootNode, AssetPtr()));
-	
+		st.mConvert = timeNowS9() - t;
+
+		bool flat = pScene->mRootNode->mNumChildren == 0;
+
+		// Child nodes keep their import order, only the root geometry is reordered
+		if (mOptimise && flat) {
+			MeshOptimiseStats ost;
+			optimiseGeometry(p.getGeometry(), &ost);
+			st.mOptimise = ost.mTime;
+			st.mCacheBefore = ost.mBefore;
+			st.mCacheAfter = ost.mAfter;
+		}
+
+		st.mVertices = p.getGeometry().size();
+		st.mIndices = p.getGeometry().indexsize();
+
+		// Only flat scenes are cached as child nodes are not stored
+		if (cacheable && flat) {
+			src.mHash = MeshCache::hashFile(filename);
+			MeshCache::write(cpath, p.getGeometry(), src, flags, options);
+		}
+
 #ifdef DEBUG
-		cout << "S9Gear - " << filename << " loaded with " <<  p.getGeometry().size()  << " vertices." << endl;
+		cout << "S9Gear - " << filename << " loaded with " <<  st.mVertices  << " vertices. Parse " 
+			<< st.mParse << "s, post-process " << st.mPostProcess << "s, convert " << st.mConvert << "s, optimise "
+			<< st.mOptimise << "s. ACMR " << st.mCacheBefore.mACMR << " -> " << st.mCacheAfter.mACMR << endl;
 #endif
+		// Everything has been copied out so the scene can go
+		aiReleaseImport(pScene);
+		pScene = NULL;
 	
 	} else
-		cout << "S9Gear - Failed to load asset: " << filename << endl;
+		cout << "S9Gear - Failed to load asset: " << filename << " - " << aiGetErrorString() << endl;
+
+	if (stats != NULL)
+		*stats = st;
 
 	return p;
 }
 
 AssetImporter::~AssetImporter() {
-	aiReleaseImport(pScene);
+	if (pScene != NULL)
+		aiReleaseImport(pScene);
 }
\ No newline at end of file
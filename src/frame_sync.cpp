@@ -0,0 +1,182 @@
+/**
+* @brief Timestamp aligned frame sets from several cameras
+* @file frame_sync.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 19/08/2012
+*
+*/
+
+#include "s9/frame_sync.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace s9;
+
+
+static void swapFrame(VideoFrame &a, VideoFrame &b) {
+	a.mData.swap(b.mData);
+	std::swap(a.mFormat, b.mFormat);
+	std::swap(a.mSeq, b.mSeq);
+	std::swap(a.mTimestamp, b.mTimestamp);
+}
+
+FrameSync::FrameSync(double_t tolerance, SyncPolicy policy, size_t history) : mHistory(std::max(history, static_cast<size_t>(1))),
+	mTolerance(tolerance), mTimeout(0.1), mPolicy(policy), mTimestamp(0), mCandidate(0), mLastDropped(-1.0) {}
+
+void FrameSync::add(boost::shared_ptr<VideoSource> source) {
+	Camera c;
+	c.pSource = source;
+	c.vHistory.resize(mHistory);
+	c.mHead = c.mCount = 0;
+	c.mPick = NOT_PICKED;
+	vCameras.push_back(c);
+	mStats.vOffset.push_back(0);
+}
+
+/*
+ * A full history loses its oldest frame - the source's slot gets that storage back
+ */
+
+void FrameSync::_gather() {
+	for (size_t i = 0; i < vCameras.size(); ++i) {
+		Camera &c = vCameras[i];
+		if (!c.pSource->newFrame())
+			continue;
+		if (c.mCount == c.vHistory.size()) {
+			c.mHead = (c.mHead + 1) % c.vHistory.size();
+			c.mCount--;
+		}
+		c.pSource->takeFrame(_at(c, c.mCount));
+		c.mCount++;
+	}
+}
+
+/*
+ * Picks each camera's frame nearest the newest time they have all reached, the one on
+ * show included so a stalled camera still has something to offer. Ties go to the newer.
+ * False if no camera would show anything new
+ */
+
+bool FrameSync::_choose(double_t &skew) {
+	if (vCameras.empty())
+		return false;
+
+	double_t t = 0;
+	for (size_t i = 0; i < vCameras.size(); ++i) {
+		Camera &c = vCameras[i];
+		double_t newest;
+		if (c.mCount > 0)
+			newest = _at(c, c.mCount - 1).mTimestamp;
+		else if (c.mShown.mSeq > 0)
+			newest = c.mShown.mTimestamp;
+		else
+			return false;		// Nothing from this camera yet
+		t = (i == 0) ? newest : std::min(t, newest);
+	}
+
+	bool fresh = false;
+	double_t lo = 0, hi = 0;
+	for (size_t i = 0; i < vCameras.size(); ++i) {
+		Camera &c = vCameras[i];
+		c.mPick = NOT_PICKED;
+		double_t best = c.mShown.mSeq > 0 ? fabs(c.mShown.mTimestamp - t) : HUGE_VAL;
+		double_t when = c.mShown.mTimestamp;
+
+		for (size_t j = 0; j < c.mCount; ++j) {
+			double_t d = fabs(_at(c, j).mTimestamp - t);
+			if (d <= best) {
+				best = d;
+				c.mPick = j;
+				when = _at(c, j).mTimestamp;
+			}
+		}
+
+		fresh = fresh || c.mPick != NOT_PICKED;
+		lo = (i == 0) ? when : std::min(lo, when);
+		hi = (i == 0) ? when : std::max(hi, when);
+	}
+
+	mCandidate = t;
+	skew = hi - lo;
+	return fresh;
+}
+
+/*
+ * Frames older than the ones picked can never be shown, so they go with them
+ */
+
+void FrameSync::_show(double_t skew) {
+	mStats.mSets++;
+	mStats.mSkew = skew;
+	mStats.mSkewMean += (skew - mStats.mSkewMean) / mStats.mSets;
+	mStats.mSkewMax = std::max(mStats.mSkewMax, skew);
+
+	for (size_t i = 0; i < vCameras.size(); ++i) {
+		Camera &c = vCameras[i];
+		if (c.mPick != NOT_PICKED) {
+			swapFrame(c.mShown, _at(c, c.mPick));
+			c.mHead = (c.mHead + c.mPick + 1) % c.vHistory.size();
+			c.mCount -= c.mPick + 1;
+			c.mPick = NOT_PICKED;
+		}
+		mStats.vOffset[i] += ((c.mShown.mTimestamp - mCandidate) - mStats.vOffset[i]) / mStats.mSets;
+	}
+
+	mTimestamp = mCandidate;
+}
+
+/*
+ * The set time never goes backwards and a set in tolerance has every frame within the
+ * tolerance of it, so anything older than that is of no further use
+ */
+
+void FrameSync::_prune(double_t before) {
+	for (size_t i = 0; i < vCameras.size(); ++i) {
+		Camera &c = vCameras[i];
+		while (c.mCount > 0 && _at(c, 0).mTimestamp < before) {
+			c.mHead = (c.mHead + 1) % c.vHistory.size();
+			c.mCount--;
+		}
+	}
+}
+
+bool FrameSync::update() {
+	double_t start = timeMonotonicS9();
+
+	while (true) {
+		_gather();
+
+		double_t skew = 0;
+		bool fresh = _choose(skew);
+
+		if (fresh && (skew <= mTolerance || mPolicy == SYNC_NEAREST)) {
+			if (skew > mTolerance)
+				mStats.mOutside++;
+			_show(skew);
+			if (mPolicy == SYNC_WAIT)
+				mStats.mWaited += timeMonotonicS9() - start;
+			return true;
+		}
+
+		if (fresh)
+			_prune(mCandidate - mTolerance);
+
+		double_t waited = timeMonotonicS9() - start;
+		if (mPolicy == SYNC_DROP || (mPolicy == SYNC_WAIT && waited >= mTimeout)) {
+			if (fresh && mCandidate != mLastDropped) {
+				mStats.mDropped++;
+				mLastDropped = mCandidate;
+			}
+			if (mPolicy == SYNC_WAIT)
+				mStats.mWaited += waited;
+			return false;
+		}
+
+		if (mPolicy != SYNC_WAIT)
+			return false;
+
+		boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	}
+}
@@ -8,37 +8,81 @@
 
 #include "s9/geometry.hpp"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 using namespace std;
 using namespace boost;
 using namespace boost::assign;
 
-/*
- * Convert Geometry from basic to Leeds 8 texture version
- */ 
 namespace s9 {
 
-	void convertGeometry( Geometry<VertPNF> a, Geometry<VertPNT8F> b) {
+	/*
+	 * PNF to PNT8F - copy position and normal, zero all 8 texture coordinates.
+	 * The structs are packed so we treat them as runs of floats: 6 in, 22 out.
+	 * This is bound by store bandwidth so 128 bit unaligned stores are plenty
+	 */
 
-		vector<VertPNT8F> vtemp;
-		vector<VertPNF> tv = a.getBuffer();
-
-		BOOST_FOREACH(VertPNF p, tv) {
+	void convertVertices(const VertPNF *src, VertPNT8F *dst, size_t n) {
+#ifdef __SSE__
+		const __m128 zero = _mm_setzero_ps();
+		for (size_t i = 0; i < n; ++i) {
+			const float *s = reinterpret_cast<const float*>(src + i);
+			float *d = reinterpret_cast<float*>(dst + i);
+			__m128 a = _mm_loadu_ps(s);								// px py pz nx
+			__m128 b = _mm_loadl_pi(zero, (const __m64*)(s + 4));	// ny nz 0 0
+			_mm_storeu_ps(d, a);
+			_mm_storeu_ps(d + 4, b);
+			_mm_storeu_ps(d + 8, zero);
+			_mm_storeu_ps(d + 12, zero);
+			_mm_storeu_ps(d + 16, zero);
+			_mm_storel_pi((__m64*)(d + 20), zero);
+		}
+#else
+		for (size_t i = 0; i < n; ++i) {
+			dst[i].mP = src[i].mP;
+			dst[i].mN = src[i].mN;
+			memset(dst[i].mT, 0, sizeof(dst[i].mT));
+		}
+#endif
+	}
 
-			VertPNT8F tp;
-			tp.mP = p.mP;
-			tp.mN = p.mN;
+	/*
+	 * PNF to PNCTF - copy position and normal, grey colour and zero texture coordinate.
+	 * 6 floats in, 12 out
+	 */
 
-			for (int i = 0; i < 8; i ++){
-				Float2 tt; tt.x = 0.0f; tt.y = 0.0f;
-				tp.mT[i] = tt;
-			}
-			vtemp += tp;
+	void convertVertices(const VertPNF *src, VertPNCTF *dst, size_t n) {
+#ifdef __SSE__
+		const __m128 grey = _mm_setr_ps(0.0f, 0.0f, 0.5f, 0.5f);
+		const __m128 tail = _mm_setr_ps(0.5f, 1.0f, 0.0f, 0.0f);
+		for (size_t i = 0; i < n; ++i) {
+			const float *s = reinterpret_cast<const float*>(src + i);
+			float *d = reinterpret_cast<float*>(dst + i);
+			__m128 a = _mm_loadu_ps(s);								// px py pz nx
+			__m128 b = _mm_loadl_pi(grey, (const __m64*)(s + 4));	// ny nz cr cg
+			_mm_storeu_ps(d, a);
+			_mm_storeu_ps(d + 4, b);
+			_mm_storeu_ps(d + 8, tail);								// cb ca tx ty
 		}
+#else
+		for (size_t i = 0; i < n; ++i) {
+			dst[i].mP = src[i].mP;
+			dst[i].mN = src[i].mN;
+			dst[i].mC.x = dst[i].mC.y = dst[i].mC.z = 0.5f;
+			dst[i].mC.w = 1.0f;
+			dst[i].mT.x = dst[i].mT.y = 0.0f;
+		}
+#endif
+	}
+
+	/*
+	 * Convert Geometry from basic to Leeds 8 texture version
+	 */ 
 
-		b = Geometry<VertPNT8F> (vtemp);
-		vector<uint32_t> ti = a.getIndices();
-		b.addIndices(ti);
+	void convertGeometry( Geometry<VertPNF> a, Geometry<VertPNT8F> &b) {
+		b = a.convert<Geometry<VertPNT8F> >();
 	}
 
 }
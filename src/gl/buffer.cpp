@@ -0,0 +1,205 @@
+/**
+* @brief OpenGL buffers for Geometry - attribute layouts and incremental uploads
+* @file buffer.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 08/08/2012
+*
+*/
+
+#include "s9/gl/buffer.hpp"
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+using namespace s9::gl;
+
+const size_t GeometryBuffer::RING_SEGMENTS;
+size_t GeometryBuffer::mBytesFrame = 0;
+size_t GeometryBuffer::mBytesLast = 0;
+
+// Grow with headroom so meshes built a vertex at a time do not reallocate every frame
+static size_t growCapacity(size_t current, size_t needed) {
+	return std::max(needed, current + current / 2);
+}
+
+static GLenum glFormat(AttribFormat f) {
+	switch (f) {
+		case ATTRIB_DOUBLE: return GL_DOUBLE;
+		case ATTRIB_HALF: return GL_HALF_FLOAT;
+		case ATTRIB_BYTE: return GL_BYTE;
+		case ATTRIB_UBYTE: return GL_UNSIGNED_BYTE;
+		case ATTRIB_SHORT: return GL_SHORT;
+		case ATTRIB_USHORT: return GL_UNSIGNED_SHORT;
+		default: return GL_FLOAT;
+	}
+}
+
+void s9::gl::bindVertexFormat(const VertexFormat &f) {
+	for (size_t i = 0; i < f.mCount; ++i) {
+		const VertexAttrib &a = f.vAttribs[i];
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, a.mComponents, glFormat(a.mFormat), a.mNormalised ? GL_TRUE : GL_FALSE,
+			f.mStride, (GLvoid*)a.mOffset);
+	}
+}
+
+GeometryBuffer::GeometryBuffer(UploadMode mode) {
+	mObj.reset(new SharedObj());
+	mObj->mMode = mode;
+}
+
+GeometryBuffer::SharedObj::~SharedObj() {
+	for (size_t i = 0; i < RING_SEGMENTS; ++i)
+		if (vFences[i] != 0) glDeleteSync(vFences[i]);
+}
+
+size_t GeometryBuffer::update(DrawableGeometry &g, GLuint vao, GLuint vbo, GLuint ibo) {
+	DirtyRange d = g.getDirty();
+	size_t bytes = 0;
+
+	if (mObj->mMode == UPLOAD_RING && !(GLEW_ARB_sync && GLEW_ARB_map_buffer_range && GLEW_ARB_draw_elements_base_vertex)) {
+		cerr << "S9Gear - Ring buffer uploads unsupported, falling back to glBufferSubData" << endl;
+		mObj->mMode = UPLOAD_SUBDATA;
+	}
+
+	if (g.size() > 0 && (d.any() || mObj->mCapacity == 0)) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		bytes += mObj->mMode == UPLOAD_RING ? _updateRing(g, d) : _updateSubData(g, d);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Meshes of up to 65536 vertices are drawn with 16 bit indices, halving index fetch.
+	// The element binding is VAO state so it is left bound rather than reset
+	size_t ni = g.indexsize();
+	GLenum type = g.size() <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+	if (ibo != 0 && ni > 0 && (d.mIndices || mObj->mIndexCapacity == 0 || type != mObj->mIndexType)) {
+		const void *src = g.indexaddr();
+		size_t isize = sizeof(uint32_t);
+
+		std::vector<uint16_t> shorts;
+		if (type == GL_UNSIGNED_SHORT) {
+			BufferView<uint32_t> iv = g.getIndexView();
+			shorts.resize(ni);
+			for (size_t i = 0; i < ni; ++i) shorts[i] = static_cast<uint16_t>(iv[i]);
+			src = &shorts[0];
+			isize = sizeof(uint16_t);
+		}
+
+		State::bindElementBuffer(vao, ibo);
+		if (ni > mObj->mIndexCapacity || type != mObj->mIndexType) {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, ni * isize, src, GL_STATIC_DRAW);
+			mObj->mIndexCapacity = ni;
+			mObj->mIndexType = type;
+		} else
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, ni * isize, src);
+		bytes += ni * isize;
+	}
+
+	g.clearDirty();
+	mBytesFrame += bytes;
+	return bytes;
+}
+
+size_t GeometryBuffer::_updateSubData(DrawableGeometry &g, const DirtyRange &d) {
+	size_t n = g.size();
+	size_t es = g.elementsize();
+	const uint8_t *src = static_cast<const uint8_t*>(g.addr());
+
+	if (n > mObj->mCapacity) {
+		mObj->mCapacity = growCapacity(mObj->mCapacity, n);
+		glBufferData(GL_ARRAY_BUFFER, mObj->mCapacity * es, NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, n * es, src);
+		return n * es;
+	}
+
+	size_t b = std::min<size_t>(d.mBegin, n);
+	size_t e = std::min<size_t>(d.mEnd, n);
+	if (e <= b) return 0;
+
+	glBufferSubData(GL_ARRAY_BUFFER, b * es, (e - b) * es, src + b * es);
+	return (e - b) * es;
+}
+
+/*
+ * Move to the next segment, waiting only if the GPU has not finished the draw that
+ * last read it, and write the changes it has missed since then
+ */
+
+size_t GeometryBuffer::_updateRing(DrawableGeometry &g, const DirtyRange &d) {
+	size_t n = g.size();
+	size_t es = g.elementsize();
+	const uint8_t *src = static_cast<const uint8_t*>(g.addr());
+
+	for (size_t i = 0; i < RING_SEGMENTS; ++i)
+		mObj->vPending[i].add(d);
+
+	if (n > mObj->mCapacity) {
+		mObj->mCapacity = growCapacity(mObj->mCapacity, n);
+
+		// A fresh store - nothing in flight can touch it so the fences can go
+		glBufferData(GL_ARRAY_BUFFER, RING_SEGMENTS * mObj->mCapacity * es, NULL, GL_STREAM_DRAW);
+		for (size_t i = 0; i < RING_SEGMENTS; ++i) {
+			if (mObj->vFences[i] != 0) glDeleteSync(mObj->vFences[i]);
+			mObj->vFences[i] = 0;
+			mObj->vPending[i] = DirtyRange();
+			mObj->vPending[i].add(0, n);
+		}
+	}
+
+	size_t k = (mObj->mSegment + 1) % RING_SEGMENTS;
+	DirtyRange &p = mObj->vPending[k];
+
+	if (mObj->vFences[k] != 0) {
+		if (glClientWaitSync(mObj->vFences[k], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_WAIT_FAILED)
+			cerr << "S9Gear - Ring buffer fence wait failed" << endl;
+		glDeleteSync(mObj->vFences[k]);
+		mObj->vFences[k] = 0;
+	}
+
+	size_t b = std::min<size_t>(p.mBegin, n);
+	size_t e = std::min<size_t>(p.mEnd, n);
+	size_t bytes = 0;
+
+	if (e > b) {
+		GLintptr offset = (k * mObj->mCapacity + b) * es;
+		bytes = (e - b) * es;
+
+		void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+		if (dst != NULL) {
+			memcpy(dst, src + b * es, bytes);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		} else
+			glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, src + b * es);
+	}
+
+	p = DirtyRange();
+	mObj->mSegment = k;
+	return bytes;
+}
+
+void GeometryBuffer::draw(DrawableGeometry &g, GLenum prim, GLsizei instances) {
+	GLint base = mObj->mMode == UPLOAD_RING ? static_cast<GLint>(mObj->mSegment * mObj->mCapacity) : 0;
+
+	if (instances > 1) {
+		if (g.indexsize() == 0)
+			glDrawArraysInstanced(prim, base, g.size(), instances);
+		else if (base != 0)
+			glDrawElementsInstancedBaseVertex(prim, g.indexsize(), mObj->mIndexType, 0, instances, base);
+		else
+			glDrawElementsInstanced(prim, g.indexsize(), mObj->mIndexType, 0, instances);
+	} else if (g.indexsize() > 0) {
+		if (base != 0)
+			glDrawElementsBaseVertex(prim, g.indexsize(), mObj->mIndexType, 0, base);
+		else
+			glDrawElements(prim, g.indexsize(), mObj->mIndexType, 0);
+	} else
+		glDrawArrays(prim, base, g.size());
+
+	if (mObj->mMode == UPLOAD_RING) {
+		if (mObj->vFences[mObj->mSegment] != 0) glDeleteSync(mObj->vFences[mObj->mSegment]);
+		mObj->vFences[mObj->mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
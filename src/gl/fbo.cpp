@@ -25,7 +25,7 @@ FBO::FBO (size_t w, size_t h){
 	mObj->mH = h;
 	
 	glGenFramebuffers(1, &(mObj->mID));
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mID);
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mID);
  
 	// Create depth renderbuffer
 	glGenRenderbuffers(1, &(mObj->mDepth));
@@ -34,7 +34,7 @@ FBO::FBO (size_t w, size_t h){
  
 	// Create the texture
 	glGenTextures(1, &(mObj->mColour));
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour);
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour);
 	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -45,7 +45,7 @@ FBO::FBO (size_t w, size_t h){
  
 	if (checkStatus() )  {
 		mObj->mOk = true;
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
 	}
 }
 
@@ -189,7 +189,7 @@ void FBO::resize(size_t w, size_t h){
 	mObj->mW = w;
 	mObj->mH = h;
 	
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour);
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mColour);
 	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
 	
 	glBindRenderbuffer(GL_RENDERBUFFER, mObj->mDepth);
@@ -345,11 +345,11 @@ namespace s9{
 
 			int width, height, format;
 			std::string formatName;
-			glBindTexture(GL_TEXTURE_2D, id);
+			State::bindTexture(GL_TEXTURE_2D, id);
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);            // get texture width
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);          // get texture height
 			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format); // get texture internal format
-			glBindTexture(GL_TEXTURE_2D, 0);
+			State::unbindTexture(GL_TEXTURE_2D);
 
 			formatName = convertInternalFormatToString(format);
 
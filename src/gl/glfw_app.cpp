@@ -37,10 +37,16 @@ void GLFWApp::mainLoop() {
 
 		BOOST_FOREACH ( GLFWwindow b, pThis->vWindows) {	
 			glfwMakeContextCurrent(b);
+			// State shadows one context
+			if (pThis->vWindows.size() > 1)
+				State::invalidate();
 			_display(b);
 			glfwSwapBuffers();
 		}
 
+		GeometryBuffer::endFrame();
+		State::endFrame();
+
 		pThis->mDX = glfwGetTime() - t;
 		
 		glfwPollEvents();
@@ -73,7 +79,12 @@ void GLFWApp::_reshape(GLFWwindow window, int w, int h) {
 
 void GLFWApp::_display(GLFWwindow window) {
 	pApp->display(pThis->mDX);
+
+	// The tweak bar binds behind State's back, and may expect nothing bound
+	State::flush();
 	TwDraw();
+	State::invalidate();
+	State::activeTexture(GL_TEXTURE0);
 }
 
 /*
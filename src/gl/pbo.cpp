@@ -0,0 +1,85 @@
+/**
+* @brief Pixel unpack buffer ring for streaming textures
+* @file pbo.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 16/08/2012
+*
+*/
+
+#include "s9/gl/pbo.hpp"
+
+using namespace std;
+using namespace boost;
+using namespace s9::gl;
+
+
+PBORing::PBORing(size_t bytes, size_t count) {
+	mObj.reset(new SharedObj());
+	mObj->mBytes = bytes;
+	mObj->vPBO.resize(std::max(count, static_cast<size_t>(1)), 0);
+
+	glGenBuffers(mObj->vPBO.size(), &(mObj->vPBO[0]));
+	for (size_t i = 0; i < mObj->vPBO.size(); ++i) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mObj->vPBO[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	CXGLERROR
+}
+
+PBORing::SharedObj::~SharedObj() {
+	if (!vPBO.empty()) glDeleteBuffers(vPBO.size(), &vPBO[0]);
+}
+
+/*
+ * Mapping with invalidate gives fresh storage if the GPU is still reading the last frame
+ * from this buffer. If mapping fails we fall back to a direct upload rather than lose the frame
+ */
+
+void PBORing::upload(GLuint tex, GLenum target, size_t w, size_t h, GLenum format, const unsigned char *data) {
+	size_t bytes = w * h * bytesPerPixel(format);
+
+	State::bindTexture(target, tex);
+
+	if (bytes > mObj->mBytes) {
+		cerr << "S9Gear - PBO too small for upload of " << bytes << " bytes" << endl;
+		glTexSubImage2D(target, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, data);
+		State::unbindTexture(target);
+		return;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mObj->vPBO[mObj->mNext]);
+	mObj->mNext = (mObj->mNext + 1) % mObj->vPBO.size();
+
+	void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (dst != NULL) {
+		memcpy(dst, data, bytes);
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+			glTexSubImage2D(target, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, 0);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			State::unbindTexture(target);
+			return;
+		}
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glTexSubImage2D(target, 0, 0, 0, w, h, format, GL_UNSIGNED_BYTE, data);
+	State::unbindTexture(target);
+}
+
+
+size_t s9::gl::bytesPerPixel(GLenum format) {
+	switch (format) {
+		case GL_RED:
+		case GL_LUMINANCE:
+			return 1;
+		case GL_RG:
+			return 2;
+		case GL_RGB:
+		case GL_BGR:
+			return 3;
+		default:
+			return 4;
+	}
+}
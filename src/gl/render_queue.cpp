@@ -0,0 +1,180 @@
+/**
+* @brief Draw packets sorted by state once a frame and drawn in as few calls as possible
+* @file render_queue.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 24/08/2012
+*
+*/
+
+#include "s9/gl/render_queue.hpp"
+
+using namespace std;
+using namespace s9::gl;
+
+const char * RenderQueue::INSTANCE_BLOCK = "S9Instances";
+
+RenderQueue::RenderQueue(GLuint binding) {
+	mObj.reset(new SharedObj());
+	mObj->mBinding = binding;
+
+	GLint align = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	if (align > 0) mObj->mAlign = align;
+
+	glGenBuffers(1, &mObj->mBuffer);
+}
+
+DrawPacket& RenderQueue::submit(ViaVAO &geometry, Shader &shader, const glm::mat4 &mvp) {
+	mObj->vPackets.push_back(DrawPacket());
+	DrawPacket &p = mObj->vPackets.back();
+	p.pGeometry = &geometry;
+	p.pShader = &shader;
+	p.mMVP = mvp;
+	p.mDepth = mvp[3][3];
+	return p;
+}
+
+/*
+ * Program, textures, geometry then depth, most to least costly to change. Only the low bits
+ * of each name fit, so equal keys are not proof of equal state - _sameState is. A positive
+ * float's bits sort as the float does, so depth needs no range
+ */
+
+uint64_t RenderQueue::_key(const DrawPacket &p) {
+	uint32_t textures = 0;
+	for (size_t i = 0; i < DrawPacket::MAX_TEXTURES; ++i)
+		textures = textures * 31 + p.mTextures[i];
+
+	float_t d = std::max(p.mDepth, 0.0f);
+	uint32_t depth;
+	memcpy(&depth, &d, sizeof(depth));
+
+	return (static_cast<uint64_t>(p.pShader->getProgram() & 0xfff) << 52)
+		| (static_cast<uint64_t>(textures & 0xffff) << 36)
+		| (static_cast<uint64_t>(p.pGeometry->mVAO & 0xffff) << 20)
+		| (depth >> 11);
+}
+
+bool RenderQueue::_sameState(const DrawPacket &a, const DrawPacket &b) {
+	if (a.pShader->getProgram() != b.pShader->getProgram() || a.pGeometry != b.pGeometry)
+		return false;
+	for (size_t i = 0; i < DrawPacket::MAX_TEXTURES; ++i)
+		if (a.mTextures[i] != b.mTextures[i] || (a.mTextures[i] != 0 && a.mTargets[i] != b.mTargets[i]))
+			return false;
+	return true;
+}
+
+/*
+ * Asked once a frame per shader, so a hot reloaded program is seen, and the block is
+ * pointed at our binding at the same time
+ */
+
+bool RenderQueue::_instanced(Shader *shader) {
+	std::vector< std::pair<Shader*, bool> > &programs = mObj->vPrograms;
+	for (size_t i = 0; i < programs.size(); ++i)
+		if (programs[i].first == shader)
+			return programs[i].second;
+
+	bool instanced = shader->block(INSTANCE_BLOCK, mObj->mBinding);
+	programs.push_back(make_pair(shader, instanced));
+	return instanced;
+}
+
+void RenderQueue::draw() {
+	SharedObj &o = *mObj;
+	size_t n = o.vPackets.size();
+	RenderQueueStats stats;
+	stats.mPackets = n;
+	o.vPrograms.clear();
+
+	// Sort keys and indices rather than the packets themselves
+	o.vOrder.resize(n);
+	for (size_t i = 0; i < n; ++i)
+		o.vOrder[i] = make_pair(_key(o.vPackets[i]), static_cast<uint32_t>(i));
+	sort(o.vOrder.begin(), o.vOrder.end());
+
+	// Split into batches and lay out the instance data, each batch at an aligned offset
+	o.vBatches.clear();
+	o.vStaging.clear();
+	size_t tail = 0;
+	for (size_t i = 0; i < n; ) {
+		const DrawPacket &first = o.vPackets[o.vOrder[i].second];
+		Batch b;
+		b.mBegin = i;
+		b.mInstanced = _instanced(first.pShader);
+		b.mOffset = 0;
+
+		size_t j = i + 1;
+		while (j < n && (!b.mInstanced || j - i < MAX_INSTANCES) && _sameState(first, o.vPackets[o.vOrder[j].second]))
+			++j;
+
+		if (b.mInstanced) {
+			b.mOffset = tail = (o.vStaging.size() + o.mAlign - 1) / o.mAlign * o.mAlign;
+			o.vStaging.resize(b.mOffset + (j - i) * sizeof(InstanceData));
+			InstanceData *dst = reinterpret_cast<InstanceData*>(&o.vStaging[b.mOffset]);
+			for (size_t k = i; k < j; ++k) {
+				const DrawPacket &p = o.vPackets[o.vOrder[k].second];
+				dst[k - i].mMVP = p.mMVP;
+				dst[k - i].mColour = p.mColour;
+			}
+			stats.mInstanced += j - i - 1;
+		}
+		b.mEnd = j;
+		o.vBatches.push_back(b);
+		i = j;
+	}
+
+	// One upload for the frame. Respecifying the store lets the driver hand back fresh
+	// memory rather than wait on last frame's draws. Every batch binds a whole block, so
+	// the last needs room past its own instances
+	size_t block = MAX_INSTANCES * sizeof(InstanceData);
+	if (!o.vStaging.empty()) {
+		o.vStaging.resize(tail + block);
+		glBindBuffer(GL_UNIFORM_BUFFER, o.mBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, o.vStaging.size(), &o.vStaging[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		stats.mBytes = o.vStaging.size();
+	}
+
+	size_t units = 0;
+	for (size_t i = 0; i < o.vBatches.size(); ++i) {
+		const Batch &b = o.vBatches[i];
+		const DrawPacket &first = o.vPackets[o.vOrder[b.mBegin].second];
+
+		first.pShader->bind();
+		for (size_t t = 0; t < DrawPacket::MAX_TEXTURES; ++t) {
+			if (first.mTextures[t] == 0) continue;
+			units = std::max(units, t + 1);
+			State::activeTexture(GL_TEXTURE0 + t);
+			State::bindTexture(first.mTargets[t], first.mTextures[t]);
+		}
+
+		if (b.mInstanced) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, o.mBinding, o.mBuffer, b.mOffset, block);
+			first.pGeometry->drawInstanced(b.mEnd - b.mBegin);
+			stats.mDraws++;
+			continue;
+		}
+
+		for (size_t k = b.mBegin; k < b.mEnd; ++k) {
+			const DrawPacket &p = o.vPackets[o.vOrder[k].second];
+			p.pShader->s("uMVPMatrix", p.mMVP);
+			if (p.pShader->location("uColour") >= 0)
+				p.pShader->s("uColour", p.mColour);
+			p.pGeometry->drawInstanced(1);
+			stats.mDraws++;
+		}
+	}
+
+	// Left free rather than unbound, so the next frame's first binds cost nothing
+	State::unbindVertexArray();
+	State::unbindProgram();
+	for (size_t t = units; t-- > 0; ) {
+		State::activeTexture(GL_TEXTURE0 + t);
+		State::unbindTexture(GL_TEXTURE_2D);
+		State::unbindTexture(GL_TEXTURE_RECTANGLE);
+	}
+
+	o.mStats = stats;
+	o.vPackets.clear();
+}
@@ -7,12 +7,58 @@
 */
 
 #include "s9/gl/shader.hpp"
+#ifdef _GEAR_X11_GLX
+#include "s9/linux/file_watcher.hpp"
+#endif
+
+#include <GL/glfw3.h>
 
 using namespace std;
 using namespace boost;
 using namespace boost::assign; 
 using namespace s9::gl;
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+bool Shader::mCacheEnabled = false;
+std::string Shader::mCacheDir;
+bool Shader::mHotReload = false;
+
+/*
+ * On disk program binary. Fields are fixed width and ordered so there is no padding
+ */
+
+namespace {
+
+	const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	struct ProgramCacheHeader {
+		char mMagic[8];			// "S9PROG"
+		uint32_t mVersion;
+		uint32_t mFormat;		// From glGetProgramBinary
+		uint64_t mKey;
+		uint64_t mLength;
+	};
+
+	uint64_t fnv1a(const std::string &s, uint64_t h = 14695981039346656037ULL) {
+		for (size_t i = 0; i < s.size(); ++i){
+			h ^= static_cast<uint8_t>(s[i]);
+			h *= 1099511628211ULL;
+		}
+		h ^= 0xff;		// So "ab" + "c" and "a" + "bc" differ
+		h *= 1099511628211ULL;
+		return h;
+	}
+
+	std::string glString(GLenum name) {
+		const GLubyte *s = glGetString(name);
+		return s != NULL ? reinterpret_cast<const char*>(s) : "";
+	}
+
+	typedef void (APIENTRY *MaxCompilerThreadsProc)(GLuint count);
+}
 
 
 /*
@@ -20,22 +66,100 @@ using namespace s9::gl;
  */
 
 
-void Shader::load(std::string vert, std::string frag) {
-	
-	int isCompiled_VS, isCompiled_FS;
-	
-	int maxLength;
-	int IsLinked;
-	char *vertexInfoLog;
-	char *fragmentInfoLog;
-	char *shaderProgramInfoLog;
-	
+void Shader::load(std::string vert, std::string frag, bool wait) {
+	string sv = textFileRead(vert), sf = textFileRead(frag);
+	begin(sv, sf, vert + ", " + frag);
+	if (wait)
+		finish();
+
+#ifdef _GEAR_X11_GLX
+	if (mHotReload && FileWatcher::get().add(vert) && FileWatcher::get().add(frag)) {
+		mVertPath = vert;
+		mFragPath = frag;
+		mVertGen = FileWatcher::get().generation(vert);
+		mFragGen = FileWatcher::get().generation(frag);
+		mVertSource = sv;
+		mFragSource = sf;
+	}
+#endif
+}
+
+/*
+ * Compile and link from source. Returns false and reports on failure
+ */
+
+bool Shader::loadSource(const std::string &sv, const std::string &sf, std::string name) {
+	begin(sv, sf, name);
+	return finish();
+}
+
+/*
+ * Asks the driver for as many compiler threads as it likes, once. Either the KHR or the
+ * ARB form of the extension will do
+ */
+
+bool Shader::parallelCompile() {
+	static int supported = -1;
+	if (supported >= 0)
+		return supported == 1;
+
+	supported = 0;
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count && supported == 0; ++i) {
+		const char *ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (ext == NULL) continue;
+		if (strcmp(ext, "GL_KHR_parallel_shader_compile") == 0) {
+			MaxCompilerThreadsProc threads = reinterpret_cast<MaxCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+			if (threads != NULL) threads(0xffffffff);
+			supported = 1;
+		} else if (strcmp(ext, "GL_ARB_parallel_shader_compile") == 0) {
+			MaxCompilerThreadsProc threads = reinterpret_cast<MaxCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+			if (threads != NULL) threads(0xffffffff);
+			supported = 1;
+		}
+	}
+	return supported == 1;
+}
+
+/*
+ * Queue everything and ask nothing - any status query would wait for the compiler
+ */
+
+void Shader::begin(const std::string &sv, const std::string &sf, std::string name, std::string cache) {
+	mName = name;
+	mCached = false;
+	mPending = false;
+	mVS = mFS = 0;
+
+	bool binaries = mCacheEnabled && GLEW_ARB_get_program_binary;
+	mCachePath = "";
+	if (binaries) {
+		mKey = fnv1a(sv);
+		mKey = fnv1a(sf, mKey);
+		mKey = fnv1a(glString(GL_VENDOR), mKey);
+		mKey = fnv1a(glString(GL_RENDERER), mKey);
+		mKey = fnv1a(glString(GL_VERSION), mKey);
+
+		if (!cache.empty())
+			mCachePath = cache;
+		else if (!mCacheDir.empty()) {
+			std::ostringstream s;
+			s << mCacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << mKey << ".s9prog";
+			mCachePath = s.str();
+		}
+
+		if (!mCachePath.empty() && _readCache()) {
+			mCached = true;
+			return;
+		}
+	}
+
+	parallelCompile();
+
 	mVS = glCreateShader(GL_VERTEX_SHADER);
 	mFS = glCreateShader(GL_FRAGMENT_SHADER);	
 
-	string sv = textFileRead(vert);
-	string sf = textFileRead(frag);
-
 	const char * vv = sv.c_str();
 	const char * ff = sf.c_str();
 
@@ -43,47 +167,289 @@ void Shader::load(std::string vert, std::string frag) {
 	glShaderSource(mFS, 1, &ff,NULL);
 
 	glCompileShader(mVS);
-	
-	glGetShaderiv(mVS, GL_COMPILE_STATUS, &isCompiled_VS);
-	if(isCompiled_VS == false) {
-		glGetShaderiv(mVS, GL_INFO_LOG_LENGTH, &maxLength);
- 
-		vertexInfoLog = new char[maxLength];
-		glGetShaderInfoLog(mVS, maxLength, &maxLength, vertexInfoLog);
- 
-		cerr << "S9Gear - Vertex Shader Error in " <<  vert << " - "<< vertexInfoLog << endl;
- 
-		delete [] vertexInfoLog;
-		return;
-	}
-	
 	glCompileShader(mFS);
-	glGetShaderiv(mFS, GL_COMPILE_STATUS, &isCompiled_FS);
-	if(isCompiled_FS == false) {
-		glGetShaderiv(mFS, GL_INFO_LOG_LENGTH, &maxLength);
-		fragmentInfoLog = new char[maxLength];
-		glGetShaderInfoLog(mFS, maxLength, &maxLength, fragmentInfoLog);
-		cerr << "S9Gear - Fragment Shader Error in " << frag << " - " << fragmentInfoLog << endl;
-		
-		delete [] fragmentInfoLog;
-		return;
-	}
 	
 	mProgram = glCreateProgram();
 
 	glAttachShader(mProgram,mVS);
 	glAttachShader(mProgram,mFS);
+	if (!mCachePath.empty())
+		glProgramParameteri(mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(mProgram);
+
+	mPending = true;
+}
+
+bool Shader::isReady() {
+	if (!mPending || !parallelCompile())
+		return true;
+	GLint done = GL_FALSE;
+	glGetProgramiv(mProgram, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+bool Shader::_check(GLuint shader, const char *stage) {
+	int isCompiled;
+	int maxLength;
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+	if(isCompiled == false) {
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
+		char *infoLog = new char[maxLength];
+		glGetShaderInfoLog(shader, maxLength, &maxLength, infoLog);
+		cerr << "S9Gear - " << stage << " Shader Error in " << mName << " - " << infoLog << endl;
+		delete [] infoLog;
+		return false;
+	}
+	return true;
+}
+
+bool Shader::finish() {
+	if (!mPending)
+		return mProgram != 0;
+	mPending = false;
+
+	if (!_check(mVS, "Vertex") || !_check(mFS, "Fragment"))
+		return false;
+
+	int maxLength;
+	int IsLinked;
+	char *shaderProgramInfoLog;
 	
 	glGetProgramiv(mProgram, GL_LINK_STATUS, (int *)&IsLinked);
 	if(IsLinked == false) {
 		glGetProgramiv(mProgram, GL_INFO_LOG_LENGTH, &maxLength);
 		shaderProgramInfoLog = new char[maxLength];
 		glGetProgramInfoLog(mProgram, maxLength, &maxLength, shaderProgramInfoLog);
-		cerr << "S9Gear - Shader Program Error " << shaderProgramInfoLog << endl;
-		free(shaderProgramInfoLog);
+		cerr << "S9Gear - Shader Program Error in " << mName << " - " << shaderProgramInfoLog << endl;
+		delete [] shaderProgramInfoLog;
+		return false;
+	}
+
+	_reflect();
+
+	if (!mCachePath.empty())
+		_writeCache();
+	return true;
+}
+
+/*
+ * A binary the driver no longer accepts fails to link rather than erroring, so the
+ * link status is the real test
+ */
+
+bool Shader::_readCache() {
+	FILE *f = fopen(mCachePath.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	ProgramCacheHeader h;
+	std::vector<char> binary;
+	bool ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.mMagic, "S9PROG", 6) == 0
+		&& h.mVersion == PROGRAM_CACHE_VERSION && h.mKey == mKey && h.mLength > 0 && h.mLength < (1 << 28);
+	if (ok) {
+		binary.resize(h.mLength);
+		ok = fread(&binary[0], 1, h.mLength, f) == h.mLength;
+	}
+	fclose(f);
+	if (!ok)
+		return false;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, h.mFormat, &binary[0], static_cast<GLsizei>(h.mLength));
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE) {
+		glDeleteProgram(program);
+		return false;
+	}
+
+	mProgram = program;
+	_reflect();
+	return true;
+}
+
+/*
+ * Write to a temporary then rename so a reader never sees a half written binary
+ */
+
+void Shader::_writeCache() {
+	GLint length = 0;
+	glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary (length);
+	GLenum format = 0;
+	glGetProgramBinary(mProgram, length, &length, &format, &binary[0]);
+
+	ProgramCacheHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.mMagic, "S9PROG", 6);
+	h.mVersion = PROGRAM_CACHE_VERSION;
+	h.mFormat = format;
+	h.mKey = mKey;
+	h.mLength = length;
+
+	std::string tmp = mCachePath + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL) {
+		cerr << "S9Gear - Unable to write program cache " << mCachePath << endl;
 		return;
 	}
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(&binary[0], 1, length, f) == static_cast<size_t>(length);
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok || rename(tmp.c_str(), mCachePath.c_str()) != 0) {
+		cerr << "S9Gear - Unable to write program cache " << mCachePath << endl;
+		remove(tmp.c_str());
+	}
+}
+
+/*
+ * Reads back every active uniform once, so the setters never look a name up in the
+ * driver. Uniforms inside blocks have no location and are left out
+ */
+
+void Shader::_reflect() {
+	vUniforms.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(mProgram, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	if (count <= 0 || maxLength <= 0) return;
+
+	std::vector<char> buffer (maxLength);
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(mProgram, i, maxLength, &length, &size, &type, &buffer[0]);
+
+		string name (&buffer[0], length);
+		GLint l = glGetUniformLocation(mProgram, name.c_str());
+		if (l < 0) continue;
+
+		vUniforms.push_back(make_pair(name, l));
+
+		// Arrays report their first element - add the bare name and the rest of the elements
+		size_t bracket = name.find("[0]");
+		if (bracket == string::npos || bracket + 3 != name.size())
+			continue;
+		string base = name.substr(0, bracket);
+		vUniforms.push_back(make_pair(base, l));
+		for (GLint j = 1; j < size; ++j) {
+			string element = base + "[" + toStringS9(j) + "]";
+			GLint le = glGetUniformLocation(mProgram, element.c_str());
+			if (le >= 0)
+				vUniforms.push_back(make_pair(element, le));
+		}
+	}
+
+	sort(vUniforms.begin(), vUniforms.end());
+}
+
+namespace {
+	struct UniformLess {
+		bool operator()(const pair<string, GLint> &a, const char *b) const { return strcmp(a.first.c_str(), b) < 0; }
+	};
+}
+
+GLint Shader::location(const char * name) const {
+	vector< pair<string, GLint> >::const_iterator it = lower_bound(vUniforms.begin(), vUniforms.end(), name, UniformLess());
+	if (it == vUniforms.end() || strcmp(it->first.c_str(), name) != 0)
+		return -1;
+	return it->second;
+}
+
+bool Shader::block(const char * name, GLuint binding) {
+	GLuint index = glGetUniformBlockIndex(mProgram, name);
+	if (index == GL_INVALID_INDEX) return false;
+	glUniformBlockBinding(mProgram, index, binding);
+
+	for (size_t i = 0; i < vBlocks.size(); ++i)
+		if (vBlocks[i].first == name) {
+			vBlocks[i].second = binding;
+			return true;
+		}
+	vBlocks.push_back(make_pair(string(name), binding));
+	return true;
+}
+
+/*
+ * The watcher has already read the files on its own thread, so all that happens here is
+ * queueing the compile and, frames later, a status query that no longer waits
+ */
+
+bool Shader::update() {
+#ifdef _GEAR_X11_GLX
+	if (mVertPath.empty())
+		return false;
+
+	if (pReload) {
+		if (!pReload->isReady())
+			return false;
+		boost::shared_ptr<Shader> reload = pReload;
+		pReload.reset();
+		if (!reload->finish()) {
+			glDeleteShader(reload->mVS);
+			glDeleteShader(reload->mFS);
+			glDeleteProgram(reload->mProgram);
+			reload->mProgram = reload->mVS = reload->mFS = 0;
+			cerr << "S9Gear - Keeping the last good program for " << mName << endl;
+			return false;
+		}
+		_swap(*reload);
+		cout << "S9Gear - Reloaded " << mName << endl;
+		return true;
+	}
+
+	FileWatcher &watcher = FileWatcher::get();
+	if (watcher.generation(mVertPath) == mVertGen && watcher.generation(mFragPath) == mFragGen)
+		return false;
+
+	// The file that has not changed keeps its last source, so nothing is read on this thread
+	watcher.read(mVertPath, mVertSource, mVertGen);
+	watcher.read(mFragPath, mFragSource, mFragGen);
+
+	pReload.reset(new Shader());
+	pReload->begin(mVertSource, mFragSource, mName);
+#endif
+	return false;
+}
+
+/*
+ * Takes over the program of a finished reload and gives it the old one's blocks. The
+ * reload is left empty so its destructor touches nothing
+ */
+
+void Shader::_swap(Shader &s) {
+	if (mVS != 0) {
+		glDetachShader(mProgram, mVS);
+		glDetachShader(mProgram, mFS);
+		glDeleteShader(mVS);
+		glDeleteShader(mFS);
+	}
+	if (mProgram != 0) {
+		State::forgetProgram(mProgram);
+		glDeleteProgram(mProgram);
+	}
+
+	mProgram = s.mProgram;
+	mVS = s.mVS;
+	mFS = s.mFS;
+	mKey = s.mKey;
+	mCached = s.mCached;
+	vUniforms.swap(s.vUniforms);
+	s.mProgram = s.mVS = s.mFS = 0;
+
+	for (size_t i = 0; i < vBlocks.size(); ++i) {
+		GLuint index = glGetUniformBlockIndex(mProgram, vBlocks[i].first.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(mProgram, index, vBlocks[i].second);
+	}
 }
 
 
@@ -91,34 +457,40 @@ void Shader::load(std::string vert, std::string frag) {
  * Fluent Style interface - Overloaded setters for uniforms
  */
 
+Shader& Shader::s(const char * name, glm::vec2 v) {
+	GLint l = location(name);
+	glUniform2f(l,v.x,v.y);
+	return *this;
+}
+
 Shader& Shader::s(const char * name, glm::vec3 v) {
-	GLuint l = location(name);
+	GLint l = location(name);
 	glUniform3f(l,v.x,v.y,v.z);
 	return *this;
 }
 
 Shader& Shader::s(const char * name, glm::vec4 v) {
-	GLuint l = location(name);
+	GLint l = location(name);
 	glUniform4f(l,v.x,v.y,v.z,v.w);
 	return *this;
 
 }
 
 Shader& Shader::s(const char * name, glm::mat4 v) {
-	GLuint l = location(name);
+	GLint l = location(name);
 	glUniformMatrix4fv(	l, 1, GL_FALSE, glm::value_ptr(v)); 
 	return *this;
 
 }
 
 Shader& Shader::s(const char * name, float_t f) {
-	GLuint l = location(name);
+	GLint l = location(name);
 	glUniform1f(l,f);
 	return *this;
 }
 
 Shader& Shader::s(const char * name, int i){
-	GLuint l = location(name);
+	GLint l = location(name);
 	glUniform1i(l,i);
 	return *this;
 }
\ No newline at end of file
@@ -16,15 +16,7 @@ using namespace std;
  */
 
 void Quad::_allocate() {
-
-	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-	glBufferData(GL_ARRAY_BUFFER, mGeom.size() * sizeof(VertPNCTF), mGeom.addr(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mGeom.indexsize() * sizeof(uint32_t), mGeom.indexaddr(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+	mBuffer.update(mGeom, mVAO, handle[0], handle[1]);
 }
 
 
@@ -39,49 +31,39 @@ void Quad::_gen() {
 	handle = new unsigned int[2];
 	glGenBuffers(2,handle);
 
-	_allocate();
-
 	bind();
 
-	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-
-	glEnableVertexAttribArray(0); // Pos
-	glEnableVertexAttribArray(1); // Normal
-	glEnableVertexAttribArray(2); // Colour
-	glEnableVertexAttribArray(3); // TexCoord0
-	glEnableVertexAttribArray(4); // Indices
-
+	_allocate();
 
-	glVertexAttribPointer(0,3, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mP) );
-	glVertexAttribPointer(1,3, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mN) );
-	glVertexAttribPointer(2,4, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mC) );
-	glVertexAttribPointer(3,2, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mT) );
+	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
+	bindVertexFormat(VertexLayout<VertPNCTF>::get());
 
 	// Indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handle[1]);
-	glVertexAttribPointer(4, 1,GL_UNSIGNED_INT,GL_FALSE,0, (GLubyte*) NULL);
+	State::bindElementBuffer(mVAO, handle[1]);
 
 	unbind();
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 
 	CXGLERROR
 }
 
 
 void Quad::draw() {
-	
+	drawInstanced(1);
+	unbind();
+
+	CXGLERROR
+}
+
+void Quad::drawInstanced(GLsizei count) {
+
 	if(mVAO == 0) _gen();
 
 	bind();
 	if (mGeom.isDirty()) _allocate();
 
-	glDrawElements(GL_TRIANGLES, mGeom.indexsize(), GL_UNSIGNED_INT, 0);
-
-	unbind();
-
-	CXGLERROR
+	mBuffer.draw(mGeom, GL_TRIANGLES, count);
 }
 
 
@@ -90,10 +72,7 @@ void Quad::draw() {
  */
 
 void Triangle::_allocate() {
-
-	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-	glBufferData(GL_ARRAY_BUFFER, mGeom.size() * sizeof(VertPNCTF), mGeom.addr(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	mBuffer.update(mGeom, mVAO, handle[0], 0);
 }
 
 /*
@@ -107,38 +86,29 @@ void Triangle::_gen() {
 	handle = new unsigned int[1];
 	glGenBuffers(1,handle);
 
-	_allocate();
-
 	bind();
 
-	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
-
-	glEnableVertexAttribArray(0); // Pos
-	glEnableVertexAttribArray(1); // Normal
-	glEnableVertexAttribArray(2); // Colour
-	glEnableVertexAttribArray(3); // TexCoord0
-
-
-	glVertexAttribPointer(0,3, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mP) );
-	glVertexAttribPointer(1,3, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mN) );
-	glVertexAttribPointer(2,4, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mC) );
-	glVertexAttribPointer(3,2, GL_FLOAT, GL_FALSE, sizeof(VertPNCTF), (GLvoid*)offsetof(VertPNCTF,mT) );
+	_allocate();
 
+	glBindBuffer(GL_ARRAY_BUFFER, handle[0]);
+	bindVertexFormat(VertexLayout<VertPNCTF>::get());
 
 	unbind();
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
 }
 
 void Triangle::draw() {
-	
+	drawInstanced(1);
+	unbind();
+}
+
+void Triangle::drawInstanced(GLsizei count) {
+
 	if(mVAO == 0) _gen();
 
 	bind();
 	if (mGeom.isDirty()) _allocate();
 
-	glDrawArrays(GL_TRIANGLES, 0, mGeom.size());
-
-	unbind();
+	mBuffer.draw(mGeom, GL_TRIANGLES, count);
 }
@@ -0,0 +1,267 @@
+/**
+* @brief Shadows the GL binding state so redundant binds never reach the driver
+* @file state.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 23/08/2012
+*
+*/
+
+#include "s9/gl/state.hpp"
+
+using namespace std;
+using namespace s9::gl;
+
+State::Slot State::mProgram;
+State::Slot State::mVAO;
+GLuint State::mDrawFBO = State::UNKNOWN;
+GLuint State::mReadFBO = State::UNKNOWN;
+GLenum State::mActive = State::UNKNOWN;
+State::Unit State::mUnits[State::MAX_UNITS];
+GLint State::mViewport[4] = {0, 0, 0, 0};
+bool State::mViewportKnown = false;
+
+StateCounts State::mFrame;
+StateCounts State::mLast;
+
+/*
+ * True when the call has to reach GL
+ */
+
+bool State::Slot::bind(GLuint id) {
+	mFree = false;
+	if (mBound == id)
+		return false;
+	mBound = id;
+	return true;
+}
+
+void State::Slot::unbind() {
+	mFree = mBound != 0;
+}
+
+void State::useProgram(GLuint program) {
+	if (mProgram.bind(program)) {
+		glUseProgram(program);
+		mFrame.mIssued++;
+	} else
+		mFrame.mSkipped++;
+}
+
+void State::unbindProgram() {
+	mProgram.unbind();
+	mFrame.mSkipped++;
+}
+
+void State::bindVertexArray(GLuint vao) {
+	if (mVAO.bind(vao)) {
+		glBindVertexArray(vao);
+		mFrame.mIssued++;
+	} else
+		mFrame.mSkipped++;
+}
+
+void State::unbindVertexArray() {
+	mVAO.unbind();
+	mFrame.mSkipped++;
+}
+
+// Never shadowed - each vertex array has its own
+void State::bindElementBuffer(GLuint vao, GLuint ibo) {
+	bindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	mFrame.mIssued++;
+}
+
+void State::bindFramebuffer(GLenum target, GLuint fbo) {
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if ((!draw || mDrawFBO == fbo) && (!read || mReadFBO == fbo)) {
+		mFrame.mSkipped++;
+		return;
+	}
+	glBindFramebuffer(target, fbo);
+	if (draw) mDrawFBO = fbo;
+	if (read) mReadFBO = fbo;
+	mFrame.mIssued++;
+}
+
+void State::activeTexture(GLenum unit) {
+	if (mActive == unit) {
+		mFrame.mSkipped++;
+		return;
+	}
+	glActiveTexture(unit);
+	mActive = unit;
+	mFrame.mIssued++;
+}
+
+/*
+ * The shadow for target on the active unit, or NULL if it is not kept
+ */
+
+State::Slot* State::_texture(GLenum target) {
+	if (mActive == UNKNOWN) {
+		GLint active = GL_TEXTURE0;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+		mActive = active;
+	}
+	size_t unit = mActive - GL_TEXTURE0;
+	if (unit >= MAX_UNITS)
+		return NULL;
+	if (target == GL_TEXTURE_2D)
+		return &mUnits[unit].m2D;
+	if (target == GL_TEXTURE_RECTANGLE)
+		return &mUnits[unit].mRect;
+	return NULL;
+}
+
+void State::bindTexture(GLenum target, GLuint tex) {
+	Slot *s = _texture(target);
+	if (s != NULL && !s->bind(tex)) {
+		mFrame.mSkipped++;
+		return;
+	}
+	glBindTexture(target, tex);
+	mFrame.mIssued++;
+}
+
+void State::unbindTexture(GLenum target) {
+	Slot *s = _texture(target);
+	if (s == NULL) {
+		glBindTexture(target, 0);
+		mFrame.mIssued++;
+		return;
+	}
+	s->unbind();
+	mFrame.mSkipped++;
+}
+
+void State::viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+	if (mViewportKnown && mViewport[0] == x && mViewport[1] == y && mViewport[2] == w && mViewport[3] == h) {
+		mFrame.mSkipped++;
+		return;
+	}
+	glViewport(x, y, w, h);
+	mViewport[0] = x; mViewport[1] = y; mViewport[2] = w; mViewport[3] = h;
+	mViewportKnown = true;
+	mFrame.mIssued++;
+}
+
+/*
+ * Getters fill in what is unknown, so saving and restoring around a pass asks GL at most
+ * once after an invalidate
+ */
+
+GLuint State::getProgram() {
+	if (mProgram.mBound == UNKNOWN) {
+		GLint p = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &p);
+		mProgram.mBound = p;
+	}
+	return mProgram.mBound;
+}
+
+GLuint State::getVertexArray() {
+	if (mVAO.mBound == UNKNOWN) {
+		GLint v = 0;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &v);
+		mVAO.mBound = v;
+	}
+	return mVAO.mBound;
+}
+
+GLuint State::getFramebuffer() {
+	if (mDrawFBO == UNKNOWN) {
+		GLint f = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &f);
+		mDrawFBO = f;
+	}
+	return mDrawFBO;
+}
+
+GLenum State::getActiveTexture() {
+	_texture(GL_TEXTURE_2D);
+	return mActive;
+}
+
+GLuint State::getTexture(GLenum target) {
+	Slot *s = _texture(target);
+	if (s != NULL && s->mBound != UNKNOWN)
+		return s->mBound;
+
+	GLint t = 0;
+	glGetIntegerv(target == GL_TEXTURE_RECTANGLE ? GL_TEXTURE_BINDING_RECTANGLE : GL_TEXTURE_BINDING_2D, &t);
+	if (s != NULL) s->mBound = t;
+	return t;
+}
+
+void State::getViewport(GLint *v) {
+	if (!mViewportKnown) {
+		glGetIntegerv(GL_VIEWPORT, mViewport);
+		mViewportKnown = true;
+	}
+	for (int i = 0; i < 4; ++i)
+		v[i] = mViewport[i];
+}
+
+/*
+ * A deleted program stays in use until another replaces it, so its binding is unknown
+ * rather than zero. Everything else reverts to zero in this context
+ */
+
+void State::forgetProgram(GLuint program) {
+	if (mProgram.mBound == program) {
+		mProgram.mBound = UNKNOWN;
+		mProgram.mFree = false;
+	}
+}
+
+void State::forgetVertexArray(GLuint vao) {
+	if (mVAO.mBound == vao) {
+		mVAO.mBound = 0;
+		mVAO.mFree = false;
+	}
+}
+
+void State::forgetFramebuffer(GLuint fbo) {
+	if (mDrawFBO == fbo) mDrawFBO = 0;
+	if (mReadFBO == fbo) mReadFBO = 0;
+}
+
+void State::forgetTexture(GLuint tex) {
+	for (size_t i = 0; i < MAX_UNITS; ++i) {
+		Slot *s[] = { &mUnits[i].m2D, &mUnits[i].mRect };
+		for (int j = 0; j < 2; ++j)
+			if (s[j]->mBound == tex) {
+				s[j]->mBound = 0;
+				s[j]->mFree = false;
+			}
+	}
+}
+
+void State::flush() {
+	if (mProgram.mFree)
+		useProgram(0);
+	if (mVAO.mFree)
+		bindVertexArray(0);
+
+	GLenum active = getActiveTexture();
+	for (size_t i = 0; i < MAX_UNITS; ++i) {
+		if (mUnits[i].m2D.mFree || mUnits[i].mRect.mFree)
+			activeTexture(GL_TEXTURE0 + i);
+		if (mUnits[i].m2D.mFree)
+			bindTexture(GL_TEXTURE_2D, 0);
+		if (mUnits[i].mRect.mFree)
+			bindTexture(GL_TEXTURE_RECTANGLE, 0);
+	}
+	activeTexture(active);
+}
+
+void State::invalidate() {
+	mProgram = mVAO = Slot();
+	mDrawFBO = mReadFBO = UNKNOWN;
+	mActive = UNKNOWN;
+	for (size_t i = 0; i < MAX_UNITS; ++i)
+		mUnits[i] = Unit();
+	mViewportKnown = false;
+}
@@ -7,6 +7,9 @@
 */
 
 #include "s9/gl/video.hpp"
+#include "s9/utils.hpp"
+
+#include <boost/bind.hpp>
 
 using namespace std;
 #ifdef _GEAR_OPENCV
@@ -17,49 +20,307 @@ using namespace s9;
 using namespace s9::gl;
 
 
-VidCam::VidCam(std::string dev, size_t w, size_t h, size_t fps) {
+/*
+ * YUYV to RGB. Each texel of the RG texture is one pixel's y and every other pixel's u or
+ * v, so a pixel reads its own y plus the u,v of its pair. Same coefficients as colorspaces
+ */
+
+static const char *gDecodeVert =
+	"#version 150\n"
+	"void main() {\n"
+	"	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"	gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static const char *gDecodeFrag =
+	"#version 150\n"
+	"uniform sampler2DRect uRaw;\n"
+	"out vec4 fragColour;\n"
+	"void main() {\n"
+	"	ivec2 p = ivec2(gl_FragCoord.xy);\n"
+	"	int x = p.x & ~1;\n"
+	"	float y = texelFetch(uRaw, p).r;\n"
+	"	float u = texelFetch(uRaw, ivec2(x, p.y)).g - 0.50196;\n"
+	"	float v = texelFetch(uRaw, ivec2(x + 1, p.y)).g - 0.50196;\n"
+	"	fragColour = vec4(clamp(vec3(y + 1.402 * v, y - 0.34414 * u - 0.71414 * v, y + 1.772 * u), 0.0, 1.0), 1.0);\n"
+	"}\n";
+
+#ifdef _GEAR_OPENCV
+
+/*
+ * The OpenCV distortion model run forwards, as initUndistortRectifyMap does with the camera
+ * matrix kept - each rectified pixel finds where it landed in the camera image. Pixels
+ * that came from outside the image are black, as remap leaves them
+ */
+
+static const char *gUndistortFrag =
+	"#version 150\n"
+	"uniform sampler2DRect uImage;\n"
+	"uniform vec2 uFocal;\n"
+	"uniform vec2 uCentre;\n"
+	"uniform vec3 uRadial;\n"			// k1 k2 k3
+	"uniform vec3 uRational;\n"			// k4 k5 k6
+	"uniform vec2 uTangential;\n"		// p1 p2
+	"uniform vec2 uSize;\n"
+	"out vec4 fragColour;\n"
+	"void main() {\n"
+	"	vec2 p = (gl_FragCoord.xy - 0.5 - uCentre) / uFocal;\n"
+	"	float r2 = dot(p, p);\n"
+	"	vec3 r = vec3(r2, r2 * r2, r2 * r2 * r2);\n"
+	"	float radial = (1.0 + dot(uRadial, r)) / (1.0 + dot(uRational, r));\n"
+	"	vec2 d = p * radial + vec2(2.0 * uTangential.x * p.x * p.y + uTangential.y * (r2 + 2.0 * p.x * p.x),\n"
+	"		uTangential.x * (r2 + 2.0 * p.y * p.y) + 2.0 * uTangential.y * p.x * p.y);\n"
+	"	vec2 s = d * uFocal + uCentre;\n"
+	"	if (any(lessThan(s, vec2(-0.5))) || any(greaterThan(s, uSize - 0.5)))\n"
+	"		fragColour = vec4(0.0, 0.0, 0.0, 1.0);\n"
+	"	else\n"
+	"		fragColour = texture(uImage, s + 0.5);\n"
+	"}\n";
+
+#endif
+
+
+VidCam::VidCam(std::string dev, size_t w, size_t h, size_t fps, size_t buffers, DecodeMode decode, CaptureFormat format) {
 	mObj.reset(new SharedObj());
 
 #ifdef _GEAR_X11_GLX
-	mObj->pCam.reset(new UVCVideo());
-	mObj->pCam->startCapture(dev,w,h,fps);
+	UVCVideo *cam = new UVCVideo();
+	mObj->pCam.reset(cam);
+	mObj->pCam->setRaw(decode == DECODE_GPU);
+	if (!cam->startCapture(dev,w,h,fps,buffers,format)) {
+		cerr << "S9Gear - Unable to start capture on " << dev << endl;
+		mObj.reset();
+		return;
+	}
 #endif
 	
-	mObj->mW = w; mObj->mH = h; mObj->mFPS = fps; 
+	mObj->mFPS = fps; 
+	_init(w, h, decode);
+}
+
+/*
+ * Any source of frames, a recording or a simulated camera for instance
+ */
+
+VidCam::VidCam(boost::shared_ptr<VideoSource> source, size_t w, size_t h, DecodeMode decode) {
+	mObj.reset(new SharedObj());
+	mObj->pCam = source;
+	mObj->mFPS = 0;
+	_init(w, h, decode);
+}
+
+void VidCam::_init(size_t w, size_t h, DecodeMode decode) {
+	mObj->mW = w; mObj->mH = h;
 
 	glEnable(GL_TEXTURE_RECTANGLE);
 	
-	// Initialise texture - using GL_TEXTURE_RECTANGLE
+	// Initialise texture - using GL_TEXTURE_RECTANGLE. RGBA so it can be rendered to
+	std::vector<unsigned char> blank (w * h * 3, 0);
 	glGenTextures(1, &(mObj->mTexID));
 	
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexID);   
-	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, 3, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, mObj->pCam->getBuffer());
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexID);   
+	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, &blank[0]);
+	State::unbindTexture(GL_TEXTURE_RECTANGLE);
+
+	setDecode(decode);
+
+	CXGLERROR
+}
+
+VidCam::SharedObj::~SharedObj() {
+	State::forgetTexture(mTexID);
+	State::forgetTexture(mRawTexID);
+	State::forgetFramebuffer(mFBO);
+	State::forgetVertexArray(mVAO);
+	if (mTexID != 0) glDeleteTextures(1, &mTexID);
+	if (mRawTexID != 0) glDeleteTextures(1, &mRawTexID);
+	if (mFBO != 0) glDeleteFramebuffers(1, &mFBO);
+	if (mVAO != 0) glDeleteVertexArrays(1, &mVAO);
+}
+
+
+bool VidCam::setDecode(DecodeMode decode) {
+	mObj->mDecode = decode;
+	if (decode == DECODE_GPU && !_initGPU()) {
+		cerr << "S9Gear - GPU YUYV decode unavailable, decoding on the CPU" << endl;
+		mObj->mDecode = DECODE_CPU;
+	}
+	mObj->pCam->setRaw(mObj->mDecode == DECODE_GPU);
+	return mObj->mDecode == decode;
+}
+
+/*
+ * Raw texture, shader and framebuffer for the decode pass - created once, on first use
+ */
+
+bool VidCam::_initGPU() {
+	if (mObj->pDecodeShader) return true;
+
+	boost::shared_ptr<Shader> shader (new Shader());
+	if (!shader->loadSource(gDecodeVert, gDecodeFrag, "YUYV decode")) return false;
 
+	if (mObj->mRawTexID == 0) glGenTextures(1, &(mObj->mRawTexID));
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mRawTexID);
+	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RG8, mObj->mW, mObj->mH, 0, GL_RG, GL_UNSIGNED_BYTE, NULL);
+	State::unbindTexture(GL_TEXTURE_RECTANGLE);
 
+	GLuint fbo = State::getFramebuffer();
+	if (mObj->mFBO == 0) glGenFramebuffers(1, &(mObj->mFBO));
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mFBO);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, mObj->mTexID, 0);
+	bool ok = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+
+	if (mObj->mVAO == 0) glGenVertexArrays(1, &(mObj->mVAO));
+
+	if (!ok) {
+		cerr << "S9Gear - YUYV decode framebuffer incomplete" << endl;
+		return false;
+	}
+
+	mObj->pDecodeShader = shader;
 	CXGLERROR
+	return true;
 }
 
+/*
+ * Everything a fullscreen pass into one of our framebuffers disturbs - saved on
+ * construction, with texture unit 0 made active, and put back on destruction. The
+ * bindings come from State, so GL is only asked for what it has not seen
+ */
+
+class SavedPassState {
+public:
+	SavedPassState() {
+		mFBO = State::getFramebuffer();
+		mProgram = State::getProgram();
+		mVAO = State::getVertexArray();
+		mActive = State::getActiveTexture();
+		State::getViewport(mViewport);
+		mDepth = glIsEnabled(GL_DEPTH_TEST);
+		mBlend = glIsEnabled(GL_BLEND);
+
+		State::activeTexture(GL_TEXTURE0);
+		mTex = State::getTexture(GL_TEXTURE_RECTANGLE);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+	}
+
+	~SavedPassState() {
+		State::bindVertexArray(mVAO);
+		State::useProgram(mProgram);
+		State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mFBO);
+		State::viewport(mViewport[0], mViewport[1], mViewport[2], mViewport[3]);
+		State::bindTexture(GL_TEXTURE_RECTANGLE, mTex);
+		State::activeTexture(mActive);
+		if (mDepth) glEnable(GL_DEPTH_TEST);
+		if (mBlend) glEnable(GL_BLEND);
+	}
+
+protected:
+	GLuint mFBO, mProgram, mVAO, mTex;
+	GLenum mActive;
+	GLint mViewport[4];
+	GLboolean mDepth, mBlend;
+};
+
+/*
+ * Upload the raw frame and convert it into the RGB texture. The caller's framebuffer,
+ * program, vertex array, viewport and texture bindings are left as they were
+ */
+
+void VidCam::_decodeGPU(const unsigned char *yuyv) {
+	SavedPassState saved;
+
+	_upload(mObj->mRawTexID, GL_RG, yuyv);
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mRawTexID);
+
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mFBO);
+	State::viewport(0, 0, mObj->mW, mObj->mH);
+
+	mObj->pDecodeShader->bind();
+	mObj->pDecodeShader->s("uRaw", 0);
+	State::bindVertexArray(mObj->mVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
 
 void VidCam::bind(){
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexID);
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexID);
 }
 
 void VidCam::unbind(){
-	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+	State::unbindTexture(GL_TEXTURE_RECTANGLE);
 }
 
 
-void VidCam::update() {
-	bind();
-	glTexSubImage2D(GL_TEXTURE_RECTANGLE,0,0,0,mObj->mW, mObj->mH, GL_RGB, GL_UNSIGNED_BYTE, mObj->pCam->getBuffer() );		
-	unbind();
+bool VidCam::update() {
+	if (!mObj->pCam->newFrame()) {
+		mObj->mStats.mDuplicated++;
+		return false;
+	}
+
+	mObj->pFrame = NULL;
+	_show(mObj->pCam->getFrame());
+	return true;
+}
+
+void VidCam::update(const VideoFrame &frame) {
+	mObj->pFrame = &frame;
+	_show(frame);
+}
+
+void VidCam::_show(const VideoFrame &frame) {
+	// A frame captured before a mode switch may still be in the other format
+	if (frame.mFormat == FRAME_YUYV && mObj->pDecodeShader)
+		_decodeGPU(&frame.mData[0]);
+	else if (frame.mFormat == FRAME_RGB)
+		_upload(mObj->mTexID, GL_RGB, &frame.mData[0]);
+	else {
+		if (!mObj->mRawWarned) {
+			cerr << "S9Gear - VidCam skipping YUYV frames with no GPU decode - is the source raw?" << endl;
+			mObj->mRawWarned = true;
+		}
+		return;		// Not shown, so not counted
+	}
+
+	VidCamStats &st = mObj->mStats;
+	st.mUploaded++;
+	st.mSeq = frame.mSeq;
+	st.mTimestamp = frame.mTimestamp;
+	st.mLatency = timeMonotonicS9() - st.mTimestamp;
+	st.mLatencyMean += (st.mLatency - st.mLatencyMean) / st.mUploaded;
+	st.mLatencyMax = std::max(st.mLatencyMax, st.mLatency);
+}
+
+/*
+ * One ring per camera, sized for RGB so it also carries the smaller raw frames
+ */
+
+void VidCam::setUpload(TextureUpload upload) {
+	if (upload == UPLOAD_PBO && !mObj->mRing)
+		mObj->mRing = PBORing(mObj->mW * mObj->mH * 3);
+	mObj->mUpload = upload;
+}
+
+void VidCam::_upload(GLuint tex, GLenum format, const unsigned char *data) {
+	if (mObj->mUpload == UPLOAD_PBO)
+		mObj->mRing.upload(tex, GL_TEXTURE_RECTANGLE, mObj->mW, mObj->mH, format, data);
+	else {
+		State::bindTexture(GL_TEXTURE_RECTANGLE, tex);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, mObj->mW, mObj->mH, format, GL_UNSIGNED_BYTE, data);
+		State::unbindTexture(GL_TEXTURE_RECTANGLE);
+	}
+}
+
+VidCamStats VidCam::getStats() {
+	VidCamStats st = mObj->mStats;
+	st.mCaptured = mObj->pCam->framesCaptured();
+	st.mDropped = mObj->pCam->framesDropped();
+	return st;
 }
 
 void VidCam::stop(){
-#ifdef _GEAR_X11_GLX
 	mObj->pCam->stop();
-#endif	
-	
 }
 
 #ifdef _GEAR_OPENCV
@@ -80,12 +341,13 @@ CVVidCam::CVVidCam(VidCam &cam){
 	mObj->mImageRectified = Mat(size, CV_8UC3);
 	mObj->mResult = Mat(size,CV_8UC3);
 	glGenTextures(1, &(mObj->mTexResultID));
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexResultID);
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexResultID);
 	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, 3, mObj->mCam.getSize().x,  mObj->mCam.getSize().y,
 		0, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *) IplImage(mObj->mResult).imageData);
+	// RGBA so the shader undistortion can render to it
 	glGenTextures(1, &(mObj->mRectifiedTexID));
-	glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mRectifiedTexID);               
-	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, 3,  mObj->mCam.getSize().x,  mObj->mCam.getSize().y,
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mRectifiedTexID);               
+	glTexImage2D(GL_TEXTURE_RECTANGLE, 0, GL_RGBA8,  mObj->mCam.getSize().x,  mObj->mCam.getSize().y,
 	 0, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *) IplImage(mObj->mImageRectified).imageData);
 
 	mObj->mPlaneNormal = Mat(Size(1,3), CV_64FC1);
@@ -113,28 +375,226 @@ void CVVidCam::computeNormal() {
 }
 		
 	
-void CVVidCam::bindRectified(){ glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mRectifiedTexID); }
-void CVVidCam::bindResult(){ glBindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexResultID); }
+void CVVidCam::bindRectified(){ State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mRectifiedTexID); }
+void CVVidCam::bindResult(){ State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mTexResultID); }
 	
 	
-void CVVidCam::update(){
+bool CVVidCam::update(){
+	// The remap in flight reads mImage, which the new frame replaces
+	_finishRemap();
+
+	// The VidCam is shared, so it may already have taken the frame through another handle.
+	// Its upload count, not its update, says whether there is anything new
 	mObj->mCam.update();
-	
-	mObj->mImage = cv::Mat (mObj->mImage.size(), CV_8UC3, mObj->mCam.getBuffer());
-	
-	if (mObj->mP.mCalibrated){
-		undistort(mObj->mImage, mObj->mImageRectified, mObj->mP.M,mObj->mP.D);
-		
-		bindRectified();
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE,0,0,0, mObj->mImageRectified.size().width, 
-			mObj->mImageRectified.size().height, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *) IplImage(mObj->mImageRectified).imageData );
-		unbind();
-		
-		bindResult();
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE,0,0,0, mObj->mResult.size().width, 
-			mObj->mResult.size().height, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *) IplImage(mObj->mResult).imageData );
+	uint64_t shown = mObj->mCam.getStats().mUploaded;
+	if (shown == mObj->mShown) return false;
+	mObj->mShown = shown;
+
+	_undistort();
+	return true;
+}
+
+void CVVidCam::update(const VideoFrame &frame) {
+	_finishRemap();
+	mObj->mCam.update(frame);
+	mObj->mShown = mObj->mCam.getStats().mUploaded;
+	_undistort();
+}
+
+/*
+ * Start on the camera's new frame - at once in the shader, or on the pool
+ */
+
+void CVVidCam::_undistort() {
+	mObj->mImageStale = mObj->mRectifiedStale = true;
+	if (!mObj->mP.mCalibrated || mObj->mMap1.empty()) return;
+
+	if (mObj->mUndistort == UNDISTORT_GPU)
+		_undistortGPU();
+	else {
+		_fillImage();
+		_startRemap();
+	}
+}
+
+/*
+ * Copy, rather than wrap, the camera's frame - the camera may move on while a remap of
+ * it is still running. OpenCV still wants RGB when the camera is decoding on the GPU
+ */
+
+void CVVidCam::_fillImage() {
+	if (!mObj->mImageStale) return;
+
+	const VideoFrame &f = mObj->mCam.getFrame();
+	size_t w = mObj->mImage.size().width, h = mObj->mImage.size().height;
+#ifdef _GEAR_X11_GLX
+	if (f.mFormat == FRAME_YUYV)
+		yuyv2rgb(const_cast<unsigned char*>(&f.mData[0]), mObj->mImage.data, w, h);
+	else
+#endif
+		memcpy(mObj->mImage.data, &f.mData[0], std::min(f.mData.size(), w * h * 3));
+
+	mObj->mImageStale = false;
+}
+
+static void remapRows(const Mat *src, Mat *dst, const Mat *map1, const Mat *map2, size_t begin, size_t end) {
+	int b = static_cast<int>(begin), e = static_cast<int>(end);
+	Mat band = dst->rowRange(b, e);
+	remap(*src, band, map1->rowRange(b, e), map2->rowRange(b, e), INTER_LINEAR, BORDER_CONSTANT);
+}
+
+void CVVidCam::_startRemap() {
+	mObj->mJob = WorkerPool::get().start(mObj->mImage.rows, boost::bind(remapRows, &mObj->mImage, &mObj->mImageRectified,
+		&mObj->mMap1, &mObj->mMap2, _1, _2), 16);
+}
+
+void CVVidCam::_finishRemap() {
+	if (!mObj->mRectifiedStale || mObj->mUndistort != UNDISTORT_CPU || mObj->mMap1.empty())
+		return;
+
+	WorkerPool::get().finish(mObj->mJob);
+	_upload(mObj->mRectifiedTexID, mObj->mImageRectified);
+	mObj->mRectifiedStale = false;
+}
+
+cv::Mat& CVVidCam::getImage() {
+	_fillImage();
+	return mObj->mImage;
+}
+
+/*
+ * The GPU path only has the rectified image as a texture, so remap here if asked
+ */
+
+cv::Mat& CVVidCam::getImageRectified() {
+	if (mObj->mRectifiedStale && !mObj->mMap1.empty()) {
+		if (mObj->mUndistort == UNDISTORT_CPU)
+			_finishRemap();
+		else {
+			_fillImage();
+			parallelFor(mObj->mImage.rows, boost::bind(remapRows, &mObj->mImage, &mObj->mImageRectified,
+				&mObj->mMap1, &mObj->mMap2, _1, _2), 16);
+			mObj->mRectifiedStale = false;
+		}
+	}
+	return mObj->mImageRectified;
+}
+
+void CVVidCam::updateResult() {
+	_upload(mObj->mTexResultID, mObj->mResult);
+}
+
+/*
+ * Maps as undistort would build them each frame - no rectification and the camera matrix
+ * kept - but once, in the fixed point form remap is fastest with
+ */
+
+bool CVVidCam::initUndistort() {
+	WorkerPool::get().finish(mObj->mJob);
+	mObj->mMap1.release();
+	mObj->mMap2.release();
+	mObj->mRectifiedStale = true;
+	if (!mObj->mP.mCalibrated) return false;
+
+	initUndistortRectifyMap(mObj->mP.M, mObj->mP.D, Mat(), mObj->mP.M, mObj->mImage.size(), CV_16SC2,
+		mObj->mMap1, mObj->mMap2);
+	return true;
+}
+
+bool CVVidCam::setUndistort(UndistortMode mode) {
+	WorkerPool::get().finish(mObj->mJob);
+	mObj->mUndistort = mode;
+	if (mode == UNDISTORT_GPU && !_initGPU()) {
+		cerr << "S9Gear - Shader undistortion unavailable, undistorting on the CPU" << endl;
+		mObj->mUndistort = UNDISTORT_CPU;
+	}
+	mObj->mRectifiedStale = true;
+	return mObj->mUndistort == mode;
+}
+
+bool CVVidCam::_initGPU() {
+	if (mObj->pUndistortShader) return true;
+
+	boost::shared_ptr<Shader> shader (new Shader());
+	if (!shader->loadSource(gDecodeVert, gUndistortFrag, "Undistort")) return false;
+
+	GLuint fbo = State::getFramebuffer();
+	if (mObj->mFBO == 0) glGenFramebuffers(1, &(mObj->mFBO));
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mFBO);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_RECTANGLE, mObj->mRectifiedTexID, 0);
+	bool ok = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+
+	if (mObj->mVAO == 0) glGenVertexArrays(1, &(mObj->mVAO));
+
+	if (!ok) {
+		cerr << "S9Gear - Undistortion framebuffer incomplete" << endl;
+		return false;
+	}
+
+	mObj->pUndistortShader = shader;
+	CXGLERROR
+	return true;
+}
+
+/*
+ * Up to the eight coefficient rational model. The camera texture is the RGB one whichever
+ * decode the camera uses
+ */
+
+void CVVidCam::_undistortGPU() {
+	const Mat &M = mObj->mP.M;
+	const Mat &D = mObj->mP.D;
+	float_t k[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	for (size_t i = 0; i < std::min(D.total(), static_cast<size_t>(8)); ++i)
+		k[i] = D.at<double_t>(static_cast<int>(i));
+
+	SavedPassState saved;
+
+	State::bindTexture(GL_TEXTURE_RECTANGLE, mObj->mCam.getTexture());
+	State::bindFramebuffer(GL_DRAW_FRAMEBUFFER, mObj->mFBO);
+	State::viewport(0, 0, mObj->mImage.size().width, mObj->mImage.size().height);
+
+	mObj->pUndistortShader->bind();
+	mObj->pUndistortShader->s("uImage", 0)
+		.s("uFocal", glm::vec2(M.at<double_t>(0,0), M.at<double_t>(1,1)))
+		.s("uCentre", glm::vec2(M.at<double_t>(0,2), M.at<double_t>(1,2)))
+		.s("uRadial", glm::vec3(k[0], k[1], k[4]))
+		.s("uRational", glm::vec3(k[5], k[6], k[7]))
+		.s("uTangential", glm::vec2(k[2], k[3]))
+		.s("uSize", glm::vec2(mObj->mImage.size().width, mObj->mImage.size().height));
+	State::bindVertexArray(mObj->mVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+CVVidCam::SharedObj::~SharedObj() {
+	WorkerPool::get().finish(mJob);
+	State::forgetTexture(mRectifiedTexID);
+	State::forgetTexture(mTexResultID);
+	State::forgetFramebuffer(mFBO);
+	State::forgetVertexArray(mVAO);
+	if (mRectifiedTexID != 0) glDeleteTextures(1, &mRectifiedTexID);
+	if (mTexResultID != 0) glDeleteTextures(1, &mTexResultID);
+	if (mFBO != 0) glDeleteFramebuffers(1, &mFBO);
+	if (mVAO != 0) glDeleteVertexArrays(1, &mVAO);
+}
+
+void CVVidCam::setUpload(TextureUpload upload) {
+	mObj->mCam.setUpload(upload);
+}
+
+// Follows the camera's mode, so the ring is made here in case that was set on the VidCam
+void CVVidCam::_upload(GLuint tex, cv::Mat &image) {
+	unsigned char *data = (unsigned char *) IplImage(image).imageData;
+	if (getUpload() == UPLOAD_PBO) {
+		if (!mObj->mRing)
+			mObj->mRing = PBORing(image.size().width * image.size().height * 3);
+		mObj->mRing.upload(tex, GL_TEXTURE_RECTANGLE, image.size().width, image.size().height, GL_RGB, data);
+	} else {
+		State::bindTexture(GL_TEXTURE_RECTANGLE, tex);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE,0,0,0, image.size().width, image.size().height, GL_RGB, GL_UNSIGNED_BYTE, data);
 		unbind();
-	}	
+	}
 }
 
 void CVVidCam::bind(){
@@ -142,7 +602,7 @@ void CVVidCam::bind(){
 }
 
 void CVVidCam::unbind(){
-	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+	State::unbindTexture(GL_TEXTURE_RECTANGLE);
 }
 
 
@@ -176,6 +636,7 @@ bool CVVidCam::loadParameters(string filename) {
 		mObj->mP.mCalibrated = true;
 		fs.release();
 		computeNormal();
+		initUndistort();
 		return true;
 		
 	} catch(...) {
@@ -0,0 +1,247 @@
+/**
+* @brief Flat, index based half edge mesh
+* @file halfedge.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 06/08/2012
+*
+*/
+
+#include "s9/halfedge.hpp"
+
+#include <algorithm>
+#include <boost/unordered_set.hpp>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+const uint32_t HalfEdgeMesh::NONE;
+
+// Directed edge key packed with the half edge it came from
+typedef std::pair<uint64_t, uint32_t> EdgeKey;
+
+static inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+	return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+/*
+ * Parallel helpers - one functor per pass
+ */
+
+struct SortBuckets {
+	const uint32_t *pStarts;
+	EdgeKey *pKeys;
+	void operator()(size_t b, size_t e) const {
+		for (size_t v = b; v < e; ++v)
+			std::sort(pKeys + pStarts[v], pKeys + pStarts[v+1]);
+	}
+};
+
+struct FillFaces {
+	const uint32_t *pIndices;
+	const uint32_t *pSource;
+	uint32_t *pVertex, *pFace, *pNext, *pPrev, *pFaceEdge;
+	void operator()(size_t b, size_t e) const {
+		for (size_t f = b; f < e; ++f) {
+			uint32_t src = pSource[f];
+			uint32_t h = static_cast<uint32_t>(f * 3);
+			pFaceEdge[f] = h;
+			for (uint32_t j = 0; j < 3; ++j) {
+				pVertex[h + j] = pIndices[src * 3 + j];
+				pFace[h + j] = static_cast<uint32_t>(f);
+				pNext[h + j] = h + (j == 2 ? 0 : j + 1);
+				pPrev[h + j] = h + (j == 0 ? 2 : j - 1);
+			}
+		}
+	}
+};
+
+struct MatchTwins {
+	const EdgeKey *pKeys;
+	const uint32_t *pStarts;
+	const uint32_t *pVertex, *pNext;
+	uint32_t *pTwin;
+	void operator()(size_t b, size_t e) const {
+		for (size_t h = b; h < e; ++h) {
+			uint32_t from = pVertex[pNext[h]];
+			uint64_t rev = edgeKey(from, pVertex[h]);
+			pTwin[h] = HalfEdgeMesh::NONE;
+			for (uint32_t i = pStarts[from]; i < pStarts[from + 1]; ++i) {
+				if (pKeys[i].first == rev) {
+					pTwin[h] = pKeys[i].second;
+					break;
+				}
+			}
+		}
+	}
+};
+
+
+/*
+ * Directed edges are bucketed by their origin vertex with a counting sort, then each small
+ * bucket is sorted - the result is the fully sorted key list plus a start offset per vertex.
+ * Only faces that share a directed edge with another face need the sequential check, the
+ * rest can never be rejected. Keys and starts are handed back for twin matching
+ */
+
+static size_t findWellWound(BufferView<const uint32_t> indices, size_t numverts, std::vector<uint8_t> &keep, bool parallel,
+	std::vector<EdgeKey> &keys, std::vector<uint32_t> &starts) {
+
+	size_t nt = indices.size() / 3;
+	keep.assign(nt, 1);
+	keys.resize(nt * 3);
+	starts.assign(numverts + 1, 0);
+
+	if (nt == 0)
+		return 0;
+
+	for (size_t i = 0; i < nt * 3; ++i)
+		starts[indices[i] + 1]++;
+	for (size_t v = 0; v < numverts; ++v)
+		starts[v + 1] += starts[v];
+
+	std::vector<uint32_t> fill (starts.begin(), starts.end() - 1);
+	for (size_t h = 0; h < nt * 3; ++h) {
+		size_t f = h / 3, j = h % 3;
+		uint32_t a = indices[f * 3 + j];
+		uint32_t c = indices[f * 3 + (j == 2 ? 0 : j + 1)];
+		keys[fill[a]++] = EdgeKey(edgeKey(a, c), static_cast<uint32_t>(h));
+	}
+
+	SortBuckets sb = { &starts[0], &keys[0] };
+	if (parallel)
+		parallelFor(numverts, sb, 16384);
+	else
+		sb(0, numverts);
+
+	std::vector<uint8_t> conflict (nt, 0);
+	for (size_t i = 1; i < keys.size(); ++i) {
+		if (keys[i].first == keys[i-1].first) {
+			conflict[keys[i].second / 3] = 1;
+			conflict[keys[i-1].second / 3] = 1;
+		}
+	}
+
+	size_t bw = 0;
+	boost::unordered_set<uint64_t> used;
+
+	for (size_t f = 0; f < nt; ++f) {
+		if (!conflict[f]) continue;
+
+		uint64_t fkeys[3];
+		size_t added = 0;
+		for (size_t j = 0; j < 3; ++j) {
+			fkeys[j] = edgeKey(indices[f * 3 + j], indices[f * 3 + (j == 2 ? 0 : j + 1)]);
+			if (used.count(fkeys[j])) {
+				keep[f] = 0;
+				break;
+			}
+			used.insert(fkeys[j]);
+			added++;
+		}
+
+		if (!keep[f]) {
+			bw++;
+			for (size_t j = 0; j < added; ++j)
+				used.erase(fkeys[j]);
+		}
+	}
+
+	return bw;
+}
+
+size_t s9::markWellWound(BufferView<const uint32_t> indices, std::vector<uint8_t> &keep, bool parallel) {
+	size_t numverts = 0;
+	for (size_t i = 0; i < indices.size(); ++i)
+		numverts = std::max(numverts, static_cast<size_t>(indices[i]) + 1);
+
+	std::vector<EdgeKey> keys;
+	std::vector<uint32_t> starts;
+	return findWellWound(indices, numverts, keep, parallel, keys, starts);
+}
+
+
+/*
+ * Build the connectivity. Badly wound faces are dropped and the survivors renumbered
+ */
+
+void HalfEdgeMesh::make(BufferView<const uint32_t> indices, size_t numverts, bool parallel) {
+
+	mObj.reset(new SharedObj());
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (indices[i] >= numverts) {
+			cerr << "S9Gear - Half edge index " << indices[i] << " out of range " << numverts << endl;
+			mObj.reset();
+			return;
+		}
+	}
+
+	std::vector<uint8_t> keep;
+	std::vector<EdgeKey> keys;
+	std::vector<uint32_t> starts;
+	mObj->mDiscarded = findWellWound(indices, numverts, keep, parallel, keys, starts);
+
+	// Renumber the kept faces
+	std::vector<uint32_t> remap (keep.size(), NONE);
+	for (size_t f = 0; f < keep.size(); ++f) {
+		if (keep[f]) {
+			remap[f] = static_cast<uint32_t>(mObj->vFaceSource.size());
+			mObj->vFaceSource.push_back(static_cast<uint32_t>(f));
+		}
+	}
+
+	size_t nf = mObj->vFaceSource.size();
+	size_t nh = nf * 3;
+
+	mObj->vVertex.resize(nh);
+	mObj->vFace.resize(nh);
+	mObj->vNext.resize(nh);
+	mObj->vPrev.resize(nh);
+	mObj->vTwin.resize(nh);
+	mObj->vFaceEdge.resize(nf);
+	mObj->vVertexEdge.assign(numverts, NONE);
+
+	if (nf == 0)
+		return;
+
+	FillFaces ff = { indices.data(), &mObj->vFaceSource[0], &mObj->vVertex[0], &mObj->vFace[0],
+		&mObj->vNext[0], &mObj->vPrev[0], &mObj->vFaceEdge[0] };
+
+	// Keys of kept faces are unique - compact them in place, keeping the per vertex buckets
+	size_t n = 0;
+	for (size_t v = 0; v < numverts; ++v) {
+		uint32_t b = starts[v], e = starts[v + 1];
+		starts[v] = static_cast<uint32_t>(n);
+		for (uint32_t i = b; i < e; ++i) {
+			uint32_t f = keys[i].second / 3;
+			if (keep[f])
+				keys[n++] = EdgeKey(keys[i].first, remap[f] * 3 + keys[i].second % 3);
+		}
+	}
+	starts[numverts] = static_cast<uint32_t>(n);
+
+	MatchTwins mt = { &keys[0], &starts[0], &mObj->vVertex[0], &mObj->vNext[0], &mObj->vTwin[0] };
+
+	if (parallel) {
+		parallelFor(nf, ff, 16384);
+		parallelFor(nh, mt, 16384);
+	} else {
+		ff(0, nf);
+		mt(0, nh);
+	}
+
+	// Outgoing edge per vertex - boundary edges win so walks around a boundary vertex can start there
+	for (size_t h = 0; h < nh; ++h) {
+		uint32_t v = mObj->vVertex[h];
+		bool boundary = mObj->vTwin[h] == NONE;
+		if (boundary) mObj->mBoundary++;
+		if (mObj->vVertexEdge[v] == NONE || boundary)
+			mObj->vVertexEdge[v] = static_cast<uint32_t>(h);
+	}
+
+#ifdef DEBUG
+	cerr << "S9Gear Half Edge - faces " << nf << " half edges " << nh << " boundary " << mObj->mBoundary
+		<< " discarded " << mObj->mDiscarded << endl;
+#endif
+}
@@ -26,109 +26,74 @@
 #include "s9/colorspaces.h"
 
 /*------------------------------- Color space conversions --------------------*/
+
+/* one yuyv macropixel (two pixels) to rgb or bgr - see colorspaces.h for the
+*  fixed point formula. standart: r = y + 1.402 (v-128)
+*                                 g = y - 0.34414 (u-128) - 0.71414 (v-128)
+*                                 b = y + 1.772 (u-128)
+*  logitech uses 1.370705, 0.337633, 0.698001 and 1.732446
+*/
+static inline void
+yuyv_pair (const BYTE *p, BYTE *out, int bgr)
+{
+	int u = p[1] - 128;
+	int v = p[3] - 128;
+	int r = (CS_RV * v + CS_ROUND) >> CS_FIX;
+	int g = (CS_GU * u + CS_GV * v + CS_ROUND) >> CS_FIX;
+	int b = (CS_BU * u + CS_ROUND) >> CS_FIX;
+	int ri = bgr ? 2 : 0;
+	int bi = bgr ? 0 : 2;
+
+	out[ri] = CLIP(p[0] + r);
+	out[1] = CLIP(p[0] + g);
+	out[bi] = CLIP(p[0] + b);
+	out[ri + 3] = CLIP(p[2] + r);
+	out[4] = CLIP(p[2] + g);
+	out[bi + 3] = CLIP(p[2] + b);
+}
+
 /* regular yuv (YUYV) to rgb24*/
-extern void 
-yuyv2rgb (BYTE *pyuv, BYTE *prgb, int width, int height)
+void 
+yuyv2rgb_c (BYTE *pyuv, BYTE *prgb, int width, int height)
 {
 	int l=0;
 	int SizeYUV=height * width * 2; /* 2 bytes per pixel*/
 	for(l=0;l<SizeYUV;l=l+4) 
 	{	/*iterate every 4 bytes*/
-		/* standart: r = y0 + 1.402 (v-128) */
-		/* logitech: r = y0 + 1.370705 (v-128) */
-		*prgb++=CLIP(pyuv[l] + 1.402 * (pyuv[l+3]-128));
-		/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-		/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-		*prgb++=CLIP(pyuv[l] - 0.34414 * (pyuv[l+1]-128) -0.71414*(pyuv[l+3]-128));
-		/* standart: b = y0 + 1.772 (u-128) */
-		/* logitech: b = y0 + 1.732446 (u-128) */
-		*prgb++=CLIP(pyuv[l] + 1.772 *( pyuv[l+1]-128));
-		/* standart: r1 =y1 + 1.402 (v-128) */
-		/* logitech: r1 = y1 + 1.370705 (v-128) */
-		*prgb++=CLIP(pyuv[l+2] + 1.402 * (pyuv[l+3]-128));
-		/* standart: g1 = y1 - 0.34414 (u-128) - 0.71414 (v-128)*/
-		/* logitech: g1 = y1 - 0.337633 (u-128)- 0.698001 (v-128)*/
-		*prgb++=CLIP(pyuv[l+2] - 0.34414 * (pyuv[l+1]-128) -0.71414 * (pyuv[l+3]-128));
-		/* standart: b1 = y1 + 1.772 (u-128) */
-		/* logitech: b1 = y1 + 1.732446 (u-128) */
-		*prgb++=CLIP(pyuv[l+2] + 1.772*(pyuv[l+1]-128));
+		yuyv_pair(pyuv + l, prgb, 0);
+		prgb += 6;
 	}
 }
 
 /* used for rgb video (fourcc="RGB ")           */
 /* lines are on correct order                   */
 void 
-yuyv2bgr1 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+yuyv2bgr1_c (BYTE *pyuv, BYTE *pbgr, int width, int height)
 {
-
 	int l=0;
 	int SizeYUV=height * width * 2; /* 2 bytes per pixel*/
 	for(l=0;l<SizeYUV;l=l+4) 
 	{	/*iterate every 4 bytes*/
-		/* standart: b = y0 + 1.772 (u-128) */
-		/* logitech: b = y0 + 1.732446 (u-128) */
-		*pbgr++=CLIP(pyuv[l] + 1.772 *( pyuv[l+1]-128));
-		/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-		/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-		*pbgr++=CLIP(pyuv[l] - 0.34414 * (pyuv[l+1]-128) -0.71414*(pyuv[l+3]-128));
-		/* standart: r = y0 + 1.402 (v-128) */
-		/* logitech: r = y0 + 1.370705 (v-128) */
-		*pbgr++=CLIP(pyuv[l] + 1.402 * (pyuv[l+3]-128));
-		/* standart: b1 = y1 + 1.772 (u-128) */
-		/* logitech: b1 = y1 + 1.732446 (u-128) */
-		*pbgr++=CLIP(pyuv[l+2] + 1.772*(pyuv[l+1]-128));
-		/* standart: g1 = y1 - 0.34414 (u-128) - 0.71414 (v-128)*/
-		/* logitech: g1 = y1 - 0.337633 (u-128)- 0.698001 (v-128)*/
-		*pbgr++=CLIP(pyuv[l+2] - 0.34414 * (pyuv[l+1]-128) -0.71414 * (pyuv[l+3]-128));
-		/* standart: r1 =y1 + 1.402 (v-128) */
-		/* logitech: r1 = y1 + 1.370705 (v-128) */
-		*pbgr++=CLIP(pyuv[l+2] + 1.402 * (pyuv[l+3]-128));
+		yuyv_pair(pyuv + l, pbgr, 1);
+		pbgr += 6;
 	}
 }
 
 /* yuv (YUYV) to bgr with lines upsidedown */
 /* used for bitmap files (DIB24)           */
 void 
-yuyv2bgr (BYTE *pyuv, BYTE *pbgr, int width, int height)
+yuyv2bgr_c (BYTE *pyuv, BYTE *pbgr, int width, int height)
 {
-
 	int l=0;
-	int k=0;
 	BYTE *preverse;
-	int bytesUsed;
 	int SizeBGR=height * width * 3; /* 3 bytes per pixel*/
 	/* BMP byte order is bgr and the lines start from last to first*/
 	preverse=pbgr+SizeBGR;/*start at the end and decrement*/
 	for(l=0;l<height;l++) 
 	{	/*iterate every 1 line*/
 		preverse-=width*3;/*put pointer at begin of unprocessed line*/
-		bytesUsed=l*width*2;
-		for (k=0;k<(width*2);k=k+4)/*iterate every 4 bytes in the line*/
-		{                              
-			/* standart: b = y0 + 1.772 (u-128) */
-			/* logitech: b = y0 + 1.732446 (u-128) */
-			*preverse++=CLIP(pyuv[k+bytesUsed] + 1.772 *( pyuv[k+1+bytesUsed]-128)); 
-			/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*preverse++=CLIP(pyuv[k+bytesUsed] - 0.34414 * (pyuv[k+1+bytesUsed]-128) 
-				-0.71414*(pyuv[k+3+bytesUsed]-128));
-			/* standart: r = y0 + 1.402 (v-128) */
-			/* logitech: r = y0 + 1.370705 (v-128) */
-			*preverse++=CLIP(pyuv[k+bytesUsed] + 1.402 * (pyuv[k+3+bytesUsed]-128));
-			/* standart: b1 = y1 + 1.772 (u-128) */
-			/* logitech: b1 = y1 + 1.732446 (u-128) */
-			*preverse++=CLIP(pyuv[k+2+bytesUsed] + 1.772*(pyuv[k+1+bytesUsed]-128));
-			/* standart: g1 = y1 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g1 = y1 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*preverse++=CLIP(pyuv[k+2+bytesUsed] - 0.34414 * (pyuv[k+1+bytesUsed]-128) 
-				-0.71414 * (pyuv[k+3+bytesUsed]-128)); 
-			/* standart: r1 =y1 + 1.402 (v-128) */
-			/* logitech: r1 = y1 + 1.370705 (v-128) */
-			*preverse++=CLIP(pyuv[k+2+bytesUsed] + 1.402 * (pyuv[k+3+bytesUsed]-128));
-		}
-		preverse-=width*3;/*get it back at the begin of processed line*/
+		yuyv2bgr1_c(pyuv + l*width*2, preverse, width, 1);
 	}
-	preverse=NULL;
 }
 
 /*convert y16 (grey) to yuyv (packed)
@@ -207,7 +172,7 @@ void yyuv_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
 *      width: picture width
 *      height: picture height
 */
-void uyvy_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+void uyvy_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
 {
 	BYTE *ptmp = tmpbuffer;
 	BYTE *pfmb = framebuffer;
@@ -277,7 +242,7 @@ void yvyu_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
 *      width: picture width
 *      height: picture height
 */
-void yuv420_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height) 
+void yuv420_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height) 
 {
 	BYTE *py;
 	BYTE *pu;
@@ -415,7 +380,7 @@ void yvu420_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
 *      width: picture width
 *      height: picture height
 */
-void nv12_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height) 
+void nv12_to_yuyv_c (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height) 
 {
 	BYTE *py;
 	BYTE *puv;
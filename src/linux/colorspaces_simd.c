@@ -0,0 +1,573 @@
+/**
+* @brief SSE2, SSSE3 and AVX2 kernels for the capture colour conversions, with runtime dispatch
+* @file colorspaces_simd.c
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 14/08/2012
+*
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include "s9/colorspaces.h"
+
+/*
+ * Each kernel is compiled for its own instruction set with a target attribute, so the
+ * library still runs on anything and picks the best set once, on the first conversion.
+ * Every kernel matches its scalar reference in colorspaces.c bit for bit - the yuyv to
+ * rgb maths is 16 bit integer with pmaddwd, which all three sets can do exactly. Tails
+ * shorter than a vector go to the scalar code
+ */
+
+typedef void (*cs_convert) (BYTE *src, BYTE *dst, int width, int height);
+typedef void (*cs_to_yuyv) (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height);
+
+static struct {
+	int level;
+	int detected;
+	cs_convert rgb;
+	cs_convert bgr;
+	cs_convert bgr1;
+	cs_to_yuyv nv12;
+	cs_to_yuyv yuv420;
+	cs_to_yuyv uyvy;
+} cs;
+
+static pthread_once_t cs_once = PTHREAD_ONCE_INIT;
+
+#if defined(__i386__) || defined(__x86_64__)
+#define CS_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifdef CS_X86
+
+/*------------------------------------ SSE2 ----------------------------------*/
+
+/* 8 yuyv pixels to r,g packed in rg and b in the low half of b */
+__attribute__((target("sse2")))
+static inline void
+yuyv8_sse2 (__m128i x, __m128i *rg, __m128i *b)
+{
+	const __m128i round = _mm_set1_epi32(CS_ROUND);
+	__m128i y = _mm_and_si128(x, _mm_set1_epi16(0x00ff));
+	__m128i c = _mm_sub_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(128));	/* u v u v ... */
+
+	__m128i r = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c, _mm_set_epi16(CS_RV,0,CS_RV,0,CS_RV,0,CS_RV,0)), round), CS_FIX);
+	__m128i g = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c, _mm_set_epi16(CS_GV,CS_GU,CS_GV,CS_GU,CS_GV,CS_GU,CS_GV,CS_GU)), round), CS_FIX);
+	__m128i bb = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(c, _mm_set_epi16(0,CS_BU,0,CS_BU,0,CS_BU,0,CS_BU)), round), CS_FIX);
+
+	/* one chroma term per pair - copy it to both pixels' 16 bit lanes */
+	const __m128i lo = _mm_set1_epi32(0xffff);
+	r = _mm_or_si128(_mm_slli_epi32(r, 16), _mm_and_si128(r, lo));
+	g = _mm_or_si128(_mm_slli_epi32(g, 16), _mm_and_si128(g, lo));
+	bb = _mm_or_si128(_mm_slli_epi32(bb, 16), _mm_and_si128(bb, lo));
+
+	*rg = _mm_packus_epi16(_mm_add_epi16(y, r), _mm_add_epi16(y, g));
+	bb = _mm_add_epi16(y, bb);
+	*b = _mm_packus_epi16(bb, bb);
+}
+
+__attribute__((target("sse2")))
+static void
+yuyv_row_sse2 (BYTE *src, BYTE *dst, int n, int bgr)
+{
+	BYTE rg[16], b[16];
+	int ri = bgr ? 2 : 0;
+	int bi = bgr ? 0 : 2;
+	int i = 0, k;
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i vrg, vb;
+		yuyv8_sse2(_mm_loadu_si128((const __m128i*)(src + i * 2)), &vrg, &vb);
+		_mm_storeu_si128((__m128i*)rg, vrg);
+		_mm_storeu_si128((__m128i*)b, vb);
+
+		for (k = 0; k < 8; ++k) {
+			dst[i * 3 + k * 3 + ri] = rg[k];
+			dst[i * 3 + k * 3 + 1] = rg[k + 8];
+			dst[i * 3 + k * 3 + bi] = b[k];
+		}
+	}
+
+	if (i < n) {
+		if (bgr) yuyv2bgr1_c(src + i * 2, dst + i * 3, n - i, 1);
+		else yuyv2rgb_c(src + i * 2, dst + i * 3, n - i, 1);
+	}
+}
+
+/* yuyv bytes are y u y v - the nv12 uv row is u v u v, so one unpack interleaves them */
+__attribute__((target("sse2")))
+static void
+yuyv_rows_sse2 (BYTE *y0, BYTE *y1, BYTE *uv, BYTE *out0, BYTE *out1, int width)
+{
+	int i = 0;
+	for (; i + 16 <= width; i += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i*)(uv + i));
+		__m128i a = _mm_loadu_si128((const __m128i*)(y0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(y1 + i));
+		_mm_storeu_si128((__m128i*)(out0 + i * 2), _mm_unpacklo_epi8(a, c));
+		_mm_storeu_si128((__m128i*)(out0 + i * 2 + 16), _mm_unpackhi_epi8(a, c));
+		_mm_storeu_si128((__m128i*)(out1 + i * 2), _mm_unpacklo_epi8(b, c));
+		_mm_storeu_si128((__m128i*)(out1 + i * 2 + 16), _mm_unpackhi_epi8(b, c));
+	}
+	for (; i < width; i += 2) {
+		out0[i * 2] = y0[i];     out0[i * 2 + 1] = uv[i]; out0[i * 2 + 2] = y0[i + 1]; out0[i * 2 + 3] = uv[i + 1];
+		out1[i * 2] = y1[i];     out1[i * 2 + 1] = uv[i]; out1[i * 2 + 2] = y1[i + 1]; out1[i * 2 + 3] = uv[i + 1];
+	}
+}
+
+__attribute__((target("sse2")))
+static void
+yuyv2rgb_sse2 (BYTE *pyuv, BYTE *prgb, int width, int height)
+{
+	yuyv_row_sse2(pyuv, prgb, width * height, 0);
+}
+
+__attribute__((target("sse2")))
+static void
+yuyv2bgr1_sse2 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	yuyv_row_sse2(pyuv, pbgr, width * height, 1);
+}
+
+__attribute__((target("sse2")))
+static void
+yuyv2bgr_sse2 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	int l;
+	for (l = 0; l < height; ++l)
+		yuyv_row_sse2(pyuv + l * width * 2, pbgr + (height - 1 - l) * width * 3, width, 1);
+}
+
+__attribute__((target("sse2")))
+static void
+nv12_to_yuyv_sse2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	BYTE *py = tmpbuffer;
+	BYTE *puv = py + width * height;
+	int h;
+	for (h = 0; h < height; h += 2)
+		yuyv_rows_sse2(py + h * width, py + (h + 1) * width, puv + (h / 2) * width,
+			framebuffer + h * width * 2, framebuffer + (h + 1) * width * 2, width);
+}
+
+__attribute__((target("sse2")))
+static void
+yuv420_to_yuyv_sse2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	BYTE *py = tmpbuffer;
+	BYTE *pu = py + width * height;
+	BYTE *pv = pu + width * height / 4;
+	BYTE uv[4096];
+	int h, i;
+
+	if (width > (int)sizeof(uv)) {
+		yuv420_to_yuyv_c(framebuffer, tmpbuffer, width, height);
+		return;
+	}
+
+	for (h = 0; h < height; h += 2) {
+		BYTE *u = pu + (h / 2) * (width / 2);
+		BYTE *v = pv + (h / 2) * (width / 2);
+		for (i = 0; i + 8 <= width / 2; i += 8)
+			_mm_storeu_si128((__m128i*)(uv + i * 2), _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i*)(u + i)), _mm_loadl_epi64((const __m128i*)(v + i))));
+		for (; i < width / 2; ++i) {
+			uv[i * 2] = u[i];
+			uv[i * 2 + 1] = v[i];
+		}
+		yuyv_rows_sse2(py + h * width, py + (h + 1) * width, uv,
+			framebuffer + h * width * 2, framebuffer + (h + 1) * width * 2, width);
+	}
+}
+
+__attribute__((target("sse2")))
+static void
+uyvy_to_yuyv_sse2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	int n = width * height * 2;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(tmpbuffer + i));
+		_mm_storeu_si128((__m128i*)(framebuffer + i), _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+	if (i < n)
+		uyvy_to_yuyv_c(framebuffer + i, tmpbuffer + i, (n - i) / 2, 1);
+}
+
+/*------------------------------------ SSSE3 ---------------------------------*/
+
+/*
+ * pshufb masks that interleave rg (r0..r7 g0..g7) and b (b0..b7) into 24 bytes of
+ * rgb or bgr - m[0],m[1] give the first 16 bytes, m[2],m[3] the last 8
+ */
+
+static void
+rgb_masks (BYTE m[4][16], int bgr)
+{
+	int k;
+	memset(m, 0x80, 4 * 16);
+	for (k = 0; k < 24; ++k) {
+		int p = k / 3, ch = k % 3;
+		int reg = k < 16 ? 0 : 2;
+		int pos = k < 16 ? k : k - 16;
+		if (bgr) ch = 2 - ch;
+		if (ch == 2) m[reg + 1][pos] = p;
+		else m[reg][pos] = ch == 0 ? p : p + 8;
+	}
+}
+
+__attribute__((target("ssse3")))
+static void
+yuyv_row_ssse3 (BYTE *src, BYTE *dst, int n, int bgr)
+{
+	BYTE m[4][16];
+	int i = 0;
+	rgb_masks(m, bgr);
+
+	__m128i m0 = _mm_loadu_si128((const __m128i*)m[0]);
+	__m128i m1 = _mm_loadu_si128((const __m128i*)m[1]);
+	__m128i m2 = _mm_loadu_si128((const __m128i*)m[2]);
+	__m128i m3 = _mm_loadu_si128((const __m128i*)m[3]);
+
+	for (; i + 8 <= n; i += 8) {
+		__m128i rg, b;
+		yuyv8_sse2(_mm_loadu_si128((const __m128i*)(src + i * 2)), &rg, &b);
+		_mm_storeu_si128((__m128i*)(dst + i * 3), _mm_or_si128(_mm_shuffle_epi8(rg, m0), _mm_shuffle_epi8(b, m1)));
+		_mm_storel_epi64((__m128i*)(dst + i * 3 + 16), _mm_or_si128(_mm_shuffle_epi8(rg, m2), _mm_shuffle_epi8(b, m3)));
+	}
+
+	if (i < n) {
+		if (bgr) yuyv2bgr1_c(src + i * 2, dst + i * 3, n - i, 1);
+		else yuyv2rgb_c(src + i * 2, dst + i * 3, n - i, 1);
+	}
+}
+
+__attribute__((target("ssse3")))
+static void
+yuyv2rgb_ssse3 (BYTE *pyuv, BYTE *prgb, int width, int height)
+{
+	yuyv_row_ssse3(pyuv, prgb, width * height, 0);
+}
+
+__attribute__((target("ssse3")))
+static void
+yuyv2bgr1_ssse3 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	yuyv_row_ssse3(pyuv, pbgr, width * height, 1);
+}
+
+__attribute__((target("ssse3")))
+static void
+yuyv2bgr_ssse3 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	int l;
+	for (l = 0; l < height; ++l)
+		yuyv_row_ssse3(pyuv + l * width * 2, pbgr + (height - 1 - l) * width * 3, width, 1);
+}
+
+__attribute__((target("ssse3")))
+static void
+uyvy_to_yuyv_ssse3 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	const __m128i m = _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+	int n = width * height * 2;
+	int i = 0;
+	for (; i + 16 <= n; i += 16)
+		_mm_storeu_si128((__m128i*)(framebuffer + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(tmpbuffer + i)), m));
+	if (i < n)
+		uyvy_to_yuyv_c(framebuffer + i, tmpbuffer + i, (n - i) / 2, 1);
+}
+
+/*------------------------------------ AVX2 ----------------------------------*/
+
+/* as yuyv8_sse2, each 128 bit lane an independent group of 8 pixels */
+__attribute__((target("avx2")))
+static inline void
+yuyv16_avx2 (__m256i x, __m256i *rg, __m256i *b)
+{
+	const __m256i round = _mm256_set1_epi32(CS_ROUND);
+	__m256i y = _mm256_and_si256(x, _mm256_set1_epi16(0x00ff));
+	__m256i c = _mm256_sub_epi16(_mm256_srli_epi16(x, 8), _mm256_set1_epi16(128));
+
+	__m256i r = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c, _mm256_set1_epi32((int)((uint32_t)(uint16_t)CS_RV << 16))), round), CS_FIX);
+	__m256i g = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c, _mm256_set1_epi32((int)((uint32_t)(uint16_t)CS_GV << 16 | (uint16_t)CS_GU))), round), CS_FIX);
+	__m256i bb = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(c, _mm256_set1_epi32((uint16_t)CS_BU)), round), CS_FIX);
+
+	const __m256i lo = _mm256_set1_epi32(0xffff);
+	r = _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_and_si256(r, lo));
+	g = _mm256_or_si256(_mm256_slli_epi32(g, 16), _mm256_and_si256(g, lo));
+	bb = _mm256_or_si256(_mm256_slli_epi32(bb, 16), _mm256_and_si256(bb, lo));
+
+	*rg = _mm256_packus_epi16(_mm256_add_epi16(y, r), _mm256_add_epi16(y, g));
+	bb = _mm256_add_epi16(y, bb);
+	*b = _mm256_packus_epi16(bb, bb);
+}
+
+__attribute__((target("avx2")))
+static void
+yuyv_row_avx2 (BYTE *src, BYTE *dst, int n, int bgr)
+{
+	BYTE m[4][16];
+	int i = 0;
+	rgb_masks(m, bgr);
+
+	__m256i m0 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)m[0]));
+	__m256i m1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)m[1]));
+	__m256i m2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)m[2]));
+	__m256i m3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)m[3]));
+
+	for (; i + 16 <= n; i += 16) {
+		__m256i rg, b;
+		yuyv16_avx2(_mm256_loadu_si256((const __m256i*)(src + i * 2)), &rg, &b);
+		__m256i o0 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m0), _mm256_shuffle_epi8(b, m1));
+		__m256i o1 = _mm256_or_si256(_mm256_shuffle_epi8(rg, m2), _mm256_shuffle_epi8(b, m3));
+		BYTE *d = dst + i * 3;
+		_mm_storeu_si128((__m128i*)d, _mm256_castsi256_si128(o0));
+		_mm_storel_epi64((__m128i*)(d + 16), _mm256_castsi256_si128(o1));
+		_mm_storeu_si128((__m128i*)(d + 24), _mm256_extracti128_si256(o0, 1));
+		_mm_storel_epi64((__m128i*)(d + 40), _mm256_extracti128_si256(o1, 1));
+	}
+
+	if (i < n)
+		yuyv_row_ssse3(src + i * 2, dst + i * 3, n - i, bgr);
+}
+
+/* unpacks stay inside 128 bit lanes, so put the halves back in order afterwards */
+__attribute__((target("avx2")))
+static void
+yuyv_rows_avx2 (BYTE *y0, BYTE *y1, BYTE *uv, BYTE *out0, BYTE *out1, int width)
+{
+	int i = 0;
+	for (; i + 32 <= width; i += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)(uv + i));
+		__m256i a = _mm256_loadu_si256((const __m256i*)(y0 + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(y1 + i));
+		__m256i alo = _mm256_unpacklo_epi8(a, c), ahi = _mm256_unpackhi_epi8(a, c);
+		__m256i blo = _mm256_unpacklo_epi8(b, c), bhi = _mm256_unpackhi_epi8(b, c);
+		_mm256_storeu_si256((__m256i*)(out0 + i * 2), _mm256_permute2x128_si256(alo, ahi, 0x20));
+		_mm256_storeu_si256((__m256i*)(out0 + i * 2 + 32), _mm256_permute2x128_si256(alo, ahi, 0x31));
+		_mm256_storeu_si256((__m256i*)(out1 + i * 2), _mm256_permute2x128_si256(blo, bhi, 0x20));
+		_mm256_storeu_si256((__m256i*)(out1 + i * 2 + 32), _mm256_permute2x128_si256(blo, bhi, 0x31));
+	}
+	if (i < width)
+		yuyv_rows_sse2(y0 + i, y1 + i, uv + i, out0 + i * 2, out1 + i * 2, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+yuyv2rgb_avx2 (BYTE *pyuv, BYTE *prgb, int width, int height)
+{
+	yuyv_row_avx2(pyuv, prgb, width * height, 0);
+}
+
+__attribute__((target("avx2")))
+static void
+yuyv2bgr1_avx2 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	yuyv_row_avx2(pyuv, pbgr, width * height, 1);
+}
+
+__attribute__((target("avx2")))
+static void
+yuyv2bgr_avx2 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	int l;
+	for (l = 0; l < height; ++l)
+		yuyv_row_avx2(pyuv + l * width * 2, pbgr + (height - 1 - l) * width * 3, width, 1);
+}
+
+__attribute__((target("avx2")))
+static void
+nv12_to_yuyv_avx2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	BYTE *py = tmpbuffer;
+	BYTE *puv = py + width * height;
+	int h;
+	for (h = 0; h < height; h += 2)
+		yuyv_rows_avx2(py + h * width, py + (h + 1) * width, puv + (h / 2) * width,
+			framebuffer + h * width * 2, framebuffer + (h + 1) * width * 2, width);
+}
+
+__attribute__((target("avx2")))
+static void
+yuv420_to_yuyv_avx2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	BYTE *py = tmpbuffer;
+	BYTE *pu = py + width * height;
+	BYTE *pv = pu + width * height / 4;
+	BYTE uv[4096];
+	int h, i;
+
+	if (width > (int)sizeof(uv)) {
+		yuv420_to_yuyv_c(framebuffer, tmpbuffer, width, height);
+		return;
+	}
+
+	for (h = 0; h < height; h += 2) {
+		BYTE *u = pu + (h / 2) * (width / 2);
+		BYTE *v = pv + (h / 2) * (width / 2);
+		for (i = 0; i + 16 <= width / 2; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(u + i));
+			__m128i b = _mm_loadu_si128((const __m128i*)(v + i));
+			_mm_storeu_si128((__m128i*)(uv + i * 2), _mm_unpacklo_epi8(a, b));
+			_mm_storeu_si128((__m128i*)(uv + i * 2 + 16), _mm_unpackhi_epi8(a, b));
+		}
+		for (; i < width / 2; ++i) {
+			uv[i * 2] = u[i];
+			uv[i * 2 + 1] = v[i];
+		}
+		yuyv_rows_avx2(py + h * width, py + (h + 1) * width, uv,
+			framebuffer + h * width * 2, framebuffer + (h + 1) * width * 2, width);
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+uyvy_to_yuyv_avx2 (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	const __m256i m = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+		1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+	int n = width * height * 2;
+	int i = 0;
+	for (; i + 32 <= n; i += 32)
+		_mm256_storeu_si256((__m256i*)(framebuffer + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(tmpbuffer + i)), m));
+	if (i < n)
+		uyvy_to_yuyv_ssse3(framebuffer + i, tmpbuffer + i, (n - i) / 2, 1);
+}
+
+#endif
+
+/*--------------------------------- Dispatch ---------------------------------*/
+
+int
+colorspaces_simd_detect (void)
+{
+	int level = CS_SIMD_NONE;
+#ifdef CS_X86
+	unsigned int a, b, c, d;
+	if (!__get_cpuid(1, &a, &b, &c, &d))
+		return level;
+
+	if (d & bit_SSE2) level = CS_SIMD_SSE2;
+	if ((c & bit_SSSE3) && level == CS_SIMD_SSE2) level = CS_SIMD_SSSE3;
+
+	/* AVX2 also needs the os to save the upper halves of the registers */
+	if (level == CS_SIMD_SSSE3 && (c & bit_OSXSAVE) && (c & bit_AVX) && __get_cpuid_max(0, NULL) >= 7) {
+		unsigned int xlo, xhi;
+		__asm__ ("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+		__cpuid_count(7, 0, a, b, c, d);
+		if ((xlo & 6) == 6 && (b & bit_AVX2)) level = CS_SIMD_AVX2;
+	}
+#endif
+	return level;
+}
+
+static void
+cs_select (int level)
+{
+	cs.level = level;
+	cs.rgb = yuyv2rgb_c;
+	cs.bgr = yuyv2bgr_c;
+	cs.bgr1 = yuyv2bgr1_c;
+	cs.nv12 = nv12_to_yuyv_c;
+	cs.yuv420 = yuv420_to_yuyv_c;
+	cs.uyvy = uyvy_to_yuyv_c;
+
+#ifdef CS_X86
+	switch (level) {
+	case CS_SIMD_AVX2:
+		cs.rgb = yuyv2rgb_avx2;
+		cs.bgr = yuyv2bgr_avx2;
+		cs.bgr1 = yuyv2bgr1_avx2;
+		cs.nv12 = nv12_to_yuyv_avx2;
+		cs.yuv420 = yuv420_to_yuyv_avx2;
+		cs.uyvy = uyvy_to_yuyv_avx2;
+		break;
+	case CS_SIMD_SSSE3:
+		cs.rgb = yuyv2rgb_ssse3;
+		cs.bgr = yuyv2bgr_ssse3;
+		cs.bgr1 = yuyv2bgr1_ssse3;
+		cs.nv12 = nv12_to_yuyv_sse2;
+		cs.yuv420 = yuv420_to_yuyv_sse2;
+		cs.uyvy = uyvy_to_yuyv_ssse3;
+		break;
+	case CS_SIMD_SSE2:
+		cs.rgb = yuyv2rgb_sse2;
+		cs.bgr = yuyv2bgr_sse2;
+		cs.bgr1 = yuyv2bgr1_sse2;
+		cs.nv12 = nv12_to_yuyv_sse2;
+		cs.yuv420 = yuv420_to_yuyv_sse2;
+		cs.uyvy = uyvy_to_yuyv_sse2;
+		break;
+	}
+#endif
+}
+
+static void
+cs_init (void)
+{
+	cs.detected = colorspaces_simd_detect();
+	cs_select(cs.detected);
+}
+
+int
+colorspaces_simd_level (void)
+{
+	pthread_once(&cs_once, cs_init);
+	return cs.level;
+}
+
+/* not safe while another thread is converting */
+int
+colorspaces_set_simd_level (int level)
+{
+	pthread_once(&cs_once, cs_init);
+	if (level < CS_SIMD_NONE) level = CS_SIMD_NONE;
+	if (level > cs.detected) level = cs.detected;
+	cs_select(level);
+	return cs.level;
+}
+
+void
+yuyv2rgb (BYTE *pyuv, BYTE *prgb, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.rgb(pyuv, prgb, width, height);
+}
+
+void
+yuyv2bgr (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.bgr(pyuv, pbgr, width, height);
+}
+
+void
+yuyv2bgr1 (BYTE *pyuv, BYTE *pbgr, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.bgr1(pyuv, pbgr, width, height);
+}
+
+void
+nv12_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.nv12(framebuffer, tmpbuffer, width, height);
+}
+
+void
+yuv420_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.yuv420(framebuffer, tmpbuffer, width, height);
+}
+
+void
+uyvy_to_yuyv (BYTE *framebuffer, BYTE *tmpbuffer, int width, int height)
+{
+	pthread_once(&cs_once, cs_init);
+	cs.uyvy(framebuffer, tmpbuffer, width, height);
+}
@@ -0,0 +1,176 @@
+/**
+* @brief Watches files for changes with inotify, reading them back on its own thread
+* @file file_watcher.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 22/08/2012
+*
+*/
+
+#include "s9/linux/file_watcher.hpp"
+#include "s9/utils.hpp"
+
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+using namespace std;
+using namespace s9;
+
+// A file is read once no event has come in for this long
+static const double_t SETTLE_TIME = 0.05;
+
+FileWatcher& FileWatcher::get() {
+	static FileWatcher watcher;
+	return watcher;
+}
+
+FileWatcher::FileWatcher() : pThread(NULL) {
+	mWake[0] = mWake[1] = -1;
+	mFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mFD < 0) {
+		cerr << "S9Gear - Could not start watching files: " << strerror(errno) << endl;
+		return;
+	}
+	if (pipe(mWake) < 0) {
+		cerr << "S9Gear - Could not start watching files: " << strerror(errno) << endl;
+		::close(mFD);
+		mFD = -1;
+		return;
+	}
+	pThread = new boost::thread(&FileWatcher::_run, this);
+}
+
+FileWatcher::~FileWatcher() {
+	if (pThread != NULL) {
+		char c = 0;
+		if (write(mWake[1], &c, 1) == 1)
+			pThread->join();
+		delete pThread;
+	}
+	if (mFD >= 0) ::close(mFD);
+	if (mWake[0] >= 0) ::close(mWake[0]);
+	if (mWake[1] >= 0) ::close(mWake[1]);
+}
+
+void FileWatcher::_split(const std::string &path, std::string &dir, std::string &name) {
+	size_t slash = path.rfind('/');
+	if (slash == string::npos) {
+		dir = ".";
+		name = path;
+	} else {
+		dir = slash == 0 ? "/" : path.substr(0, slash);
+		name = path.substr(slash + 1);
+	}
+}
+
+/*
+ * Watch the directory rather than the file - a rename over the file would leave a watch
+ * on the file itself pointing at the old one
+ */
+
+bool FileWatcher::add(const std::string &path) {
+	if (mFD < 0) return false;
+
+	string dir, name;
+	_split(path, dir, name);
+
+	boost::mutex::scoped_lock lock(mMutex);
+	int wd = inotify_add_watch(mFD, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0) {
+		cerr << "S9Gear - Could not watch " << dir << ": " << strerror(errno) << endl;
+		return false;
+	}
+	// The same directory spelt two ways shares a watch descriptor
+	std::vector<string> &dirs = mDirs[wd];
+	if (find(dirs.begin(), dirs.end(), dir) == dirs.end())
+		dirs.push_back(dir);
+	mFiles[dir + "/" + name];
+	return true;
+}
+
+uint64_t FileWatcher::generation(const std::string &path) {
+	string dir, name;
+	_split(path, dir, name);
+
+	boost::mutex::scoped_lock lock(mMutex);
+	std::map<string, Entry>::iterator it = mFiles.find(dir + "/" + name);
+	return it != mFiles.end() ? it->second.mGeneration : 0;
+}
+
+bool FileWatcher::read(const std::string &path, std::string &contents, uint64_t &generation) {
+	string dir, name;
+	_split(path, dir, name);
+
+	boost::mutex::scoped_lock lock(mMutex);
+	std::map<string, Entry>::iterator it = mFiles.find(dir + "/" + name);
+	if (it == mFiles.end() || it->second.mGeneration == 0)
+		return false;
+	contents = it->second.mContents;
+	generation = it->second.mGeneration;
+	return true;
+}
+
+/*
+ * Events only mark a file changed. Reading waits until it settles, and happens outside
+ * the lock so a large file never holds up a caller
+ */
+
+void FileWatcher::_run() {
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+		struct pollfd fds[2];
+		fds[0].fd = mFD;
+		fds[0].events = POLLIN;
+		fds[1].fd = mWake[0];
+		fds[1].events = POLLIN;
+
+		if (poll(fds, 2, static_cast<int>(SETTLE_TIME * 1000.0)) < 0 && errno != EINTR)
+			break;
+		if (fds[1].revents & POLLIN)
+			break;
+
+		double_t now = timeMonotonicS9();
+
+		if (fds[0].revents & POLLIN) {
+			ssize_t n;
+			while ((n = ::read(mFD, buffer, sizeof buffer)) > 0) {
+				boost::mutex::scoped_lock lock(mMutex);
+				for (char *p = buffer; p < buffer + n; ) {
+					const struct inotify_event *e = reinterpret_cast<const struct inotify_event*>(p);
+					p += sizeof(struct inotify_event) + e->len;
+					if (e->len == 0) continue;
+
+					std::map<int, std::vector<string> >::iterator d = mDirs.find(e->wd);
+					if (d == mDirs.end()) continue;
+					for (size_t i = 0; i < d->second.size(); ++i) {
+						std::map<string, Entry>::iterator f = mFiles.find(d->second[i] + "/" + e->name);
+						if (f != mFiles.end())
+							f->second.mChanged = now;
+					}
+				}
+			}
+		}
+
+		vector<string> settled;
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+			for (std::map<string, Entry>::iterator it = mFiles.begin(); it != mFiles.end(); ++it)
+				if (it->second.mChanged > 0 && now - it->second.mChanged >= SETTLE_TIME) {
+					settled.push_back(it->first);
+					it->second.mChanged = 0;
+				}
+		}
+
+		// Empty is a file caught mid save - the save's own event brings it back
+		for (size_t i = 0; i < settled.size(); ++i) {
+			string contents = textFileRead(settled[i]);
+			if (contents.empty()) continue;
+			boost::mutex::scoped_lock lock(mMutex);
+			Entry &e = mFiles[settled[i]];
+			e.mContents.swap(contents);
+			e.mGeneration++;
+		}
+	}
+}
@@ -0,0 +1,250 @@
+/**
+* @brief Recording camera streams to disk and replaying them as a camera
+* @file replay_camera.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 18/08/2012
+*
+*/
+
+#include "s9/linux/replay_camera.hpp"
+#include "s9/utils.hpp"
+
+#include <sys/stat.h>
+
+using namespace std;
+using namespace s9;
+
+static const size_t DUMP_ALIGN = 8;
+
+static size_t padTo(size_t bytes) {
+	return (bytes + DUMP_ALIGN - 1) & ~(DUMP_ALIGN - 1);
+}
+
+static void sleepUntil(double_t when) {
+	double_t wait = when - timeMonotonicS9();
+	if (wait > 0)
+		boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(wait * 1.0e6)));
+}
+
+
+bool FrameRecorder::open(string filename, unsigned int width, unsigned int height, CaptureFormat format, unsigned int fps) {
+	close();
+
+	pFile = fopen(filename.c_str(), "wb");
+	if (pFile == NULL) {
+		cerr << "S9Gear - Could not open " << filename << " for recording: " << strerror(errno) << endl;
+		return false;
+	}
+	setvbuf(pFile, NULL, _IOFBF, 1 << 20);
+
+	DumpHeader h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.mMagic, S9_DUMP_MAGIC, 4);
+	h.mVersion = S9_DUMP_VERSION;
+	h.mWidth = width;
+	h.mHeight = height;
+	h.mFormat = format;
+	h.mFPS = fps;
+
+	if (fwrite(&h, sizeof h, 1, pFile) != 1) {
+		cerr << "S9Gear - Could not write recording header to " << filename << endl;
+		close();
+		return false;
+	}
+
+	mFrames = 0;
+	return true;
+}
+
+bool FrameRecorder::write(const unsigned char *data, size_t bytes, uint64_t seq, double_t timestamp) {
+	if (pFile == NULL) return false;
+
+	DumpFrame fh;
+	memset(&fh, 0, sizeof fh);
+	fh.mBytes = bytes;
+	fh.mSeq = static_cast<uint32_t>(seq);
+	fh.mTimestamp = timestamp;
+
+	static const unsigned char pad[DUMP_ALIGN] = {0};
+
+	if (fwrite(&fh, sizeof fh, 1, pFile) != 1 || fwrite(data, 1, bytes, pFile) != bytes
+		|| fwrite(pad, 1, padTo(bytes) - bytes, pFile) != padTo(bytes) - bytes)
+		return false;
+
+	mFrames++;
+	return true;
+}
+
+void FrameRecorder::close() {
+	if (pFile == NULL) return;
+	if (fclose(pFile) != 0)
+		cerr << "S9Gear - Recording did not close cleanly: " << strerror(errno) << endl;
+	pFile = NULL;
+}
+
+
+/*
+ * Map the whole dump and index it before the first frame goes out
+ */
+
+bool ReplayVideo::startCapture(string filename, unsigned int width, unsigned int height, unsigned int fps, bool loop) {
+	stop();
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cerr << "S9Gear - Could not open recording " << filename << ": " << strerror(errno) << endl;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(DumpHeader)) {
+		cerr << "S9Gear - Recording " << filename << " is too short" << endl;
+		::close(fd);
+		return false;
+	}
+
+	mMapBytes = st.st_size;
+	pMap = mmap(NULL, mMapBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (pMap == MAP_FAILED) {
+		cerr << "S9Gear - Could not map recording " << filename << ": " << strerror(errno) << endl;
+		pMap = NULL;
+		return false;
+	}
+	madvise(pMap, mMapBytes, MADV_SEQUENTIAL);
+
+	const DumpHeader *h = static_cast<const DumpHeader*>(pMap);
+	if (memcmp(h->mMagic, S9_DUMP_MAGIC, 4) != 0 || h->mVersion != S9_DUMP_VERSION || h->mFormat > CAPTURE_MJPEG) {
+		cerr << "S9Gear - " << filename << " is not a recording this version can play" << endl;
+		stop();
+		return false;
+	}
+
+	if (h->mWidth != width || h->mHeight != height) {
+		cerr << "S9Gear - Recording " << filename << " is " << h->mWidth << "x" << h->mHeight << " not "
+			<< width << "x" << height << endl;
+		stop();
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mFormat = static_cast<CaptureFormat>(h->mFormat);
+	mFPS = fps;
+	mLoop = loop;
+
+	if (!_index()) {
+		cerr << "S9Gear - Recording " << filename << " has no frames" << endl;
+		stop();
+		return false;
+	}
+
+	VideoFrame blank;
+	blank.mData.assign(mWidth * mHeight * 3, 0);
+	mFrames.reset(blank);
+
+	mSkipped = 0;
+	mFinished = false;
+	mRunning = true;
+	pThread = new boost::thread(&ReplayVideo::_run, this);
+	return true;
+}
+
+/*
+ * A truncated final frame is dropped, not an error - recordings end when the app does
+ */
+
+bool ReplayVideo::_index() {
+	const unsigned char *base = static_cast<const unsigned char*>(pMap);
+	size_t pos = sizeof(DumpHeader);
+
+	vIndex.clear();
+	while (pos + sizeof(DumpFrame) <= mMapBytes) {
+		DumpFrame fh;
+		memcpy(&fh, base + pos, sizeof fh);
+		pos += sizeof fh;
+		if (fh.mBytes == 0 || fh.mBytes > mMapBytes - pos)
+			break;
+
+		Entry e;
+		e.pData = base + pos;
+		e.mBytes = fh.mBytes;
+		e.mTimestamp = fh.mTimestamp;
+		vIndex.push_back(e);
+
+		pos += padTo(fh.mBytes);
+	}
+
+	return !vIndex.empty();
+}
+
+void ReplayVideo::stop() {
+	if (pThread != NULL) {
+		mRunning = false;
+		// Wakes the thread from a long gap between recorded frames
+		pThread->interrupt();
+		pThread->join();
+		delete pThread;
+		pThread = NULL;
+	}
+
+	if (pMap != NULL) {
+		munmap(pMap, mMapBytes);
+		pMap = NULL;
+		mMapBytes = 0;
+	}
+	vIndex.clear();
+}
+
+/*
+ * Replay thread. With recorded spacing each pass through the dump is shifted by its
+ * length plus one mean frame interval, so looping keeps the rate steady
+ */
+
+void ReplayVideo::_run() {
+	double_t start = timeMonotonicS9();
+	double_t next = start;
+	double_t first = vIndex.front().mTimestamp;
+	double_t span = vIndex.back().mTimestamp - first;
+	double_t period = vIndex.size() > 1 ? span / (vIndex.size() - 1) : 1.0 / 30.0;
+	double_t offset = 0;
+	uint64_t seq = 0;
+	size_t i = 0;
+
+	try {
+		while (mRunning) {
+			const Entry &e = vIndex[i];
+
+			if (mFPS == REPLAY_RECORDED)
+				sleepUntil(start + offset + (e.mTimestamp - first));
+
+			VideoFrame &f = mFrames.back();
+			if (mDecoder.decode(f, e.pData, e.mBytes, mFormat, mWidth, mHeight, mRaw)) {
+				f.mSeq = ++seq;
+				f.mTimestamp = timeMonotonicS9();
+				_publish();
+			} else {
+				++seq;
+				__sync_fetch_and_add(&mSkipped, 1);
+			}
+
+			if (++i == vIndex.size()) {
+				if (!mLoop) break;
+				i = 0;
+				offset += span + period;
+			}
+
+			if (mFPS == REPLAY_RECORDED)
+				continue;
+			if (mFPS > 0) {
+				next += 1.0 / mFPS;
+				sleepUntil(next);
+			} else
+				boost::this_thread::yield();
+		}
+	} catch (boost::thread_interrupted&) {
+		// stop, while sleeping
+	}
+
+	mFinished = true;
+}
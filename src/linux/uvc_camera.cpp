@@ -20,8 +20,11 @@
  ///http://stackoverflow.com/questions/5280756/libjpeg-ver-6b-jpeg-stdio-src-vs-jpeg-mem-src
  
 #include "s9/linux/uvc_camera.hpp"
+#include "s9/linux/replay_camera.hpp"
+#include "s9/utils.hpp"
 
 using namespace std;
+using namespace s9;
 
 
 /*
@@ -32,7 +35,7 @@ int UVCVideo::video_open(const char *devname) {
 	struct v4l2_capability cap;
 	int dev, ret;
 
-	dev = open(devname, O_RDWR);
+	dev = open(devname, O_RDWR | O_NONBLOCK);
 	if (dev < 0) {
 		printf("Error opening device %s: %d.\n", devname, errno);
 		return dev;
@@ -309,12 +312,14 @@ int UVCVideo::video_set_input(int dev, unsigned int input) {
  * Set everything up and launch a thread to start capture
  */
 
-bool UVCVideo::startCapture(string devname, unsigned int width, unsigned int height, unsigned int fps) {
+bool UVCVideo::startCapture(string devname, unsigned int width, unsigned int height, unsigned int fps, unsigned int nbufs,
+	CaptureFormat format) {
 	/* Video buffers */
 	mWidth = width;
 	mHeight = height;
-	unsigned int pixelformat = V4L2_PIX_FMT_YUYV;//V4L2_PIX_FMT_MJPEG;
-	unsigned int nbufs = 2;// V4L_BUFFERS_DEFAULT;
+	mFormat = format;
+	unsigned int pixelformat = format == CAPTURE_MJPEG ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
+	nbufs = std::min(std::max(nbufs, 2u), (unsigned int)V4L_BUFFERS_MAX);
 	unsigned int input = 0;
 	unsigned int skip = 0;
 
@@ -344,7 +349,7 @@ bool UVCVideo::startCapture(string devname, unsigned int width, unsigned int hei
 	/* Allocate buffers. */
 	if ((int)(nbufs = video_reqbufs(dev, nbufs)) < 0) {
 		close(dev);
-		return 1;
+		return false;
 	}
 
 	/* Map the buffers. */
@@ -356,26 +361,25 @@ bool UVCVideo::startCapture(string devname, unsigned int width, unsigned int hei
 		ret = ioctl(dev, VIDIOC_QUERYBUF, &buf);
 		if (ret < 0) {
 			printf("Unable to query buffer %u (%d).\n", i, errno);
-			close(dev);
+			_release(i);
 			return false;
 		}
 		printf("length: %u offset: %u\n", buf.length, buf.m.offset);
 
+		mMemLength[i] = buf.length;
 		mem[i] = mmap(0, buf.length, PROT_READ, MAP_SHARED, dev, buf.m.offset);
 		if (mem[i] == MAP_FAILED) {
 			printf("Unable to map buffer %u (%d)\n", i, errno);
-			close(dev);
+			_release(i);
 			return false;
 		}
 		printf("Buffer %u mapped at address %p.\n", i, mem[i]);
 	}
 	
-	// RGB8 Buffer
-	mBufferSize = 0;
-		
-	int size = mWidth*mHeight * 3;
-	jbuffer = new unsigned char[size];
-	memset(jbuffer, 0, size);
+	// RGB8 frames - black until the first capture
+	VideoFrame blank;
+	blank.mData.assign(mWidth * mHeight * 3, 0);
+	mFrames.reset(blank);
 	
 	/* Queue the buffers. */
 	for (int i = 0; i < nbufs; ++i) {
@@ -387,83 +391,334 @@ bool UVCVideo::startCapture(string devname, unsigned int width, unsigned int hei
 		ret = ioctl(dev, VIDIOC_QBUF, &buf);
 		if (ret < 0) {
 			printf("Unable to queue buffer (%d).\n", errno);
-			close(dev);
-			return 1;
+			_release(nbufs);
+			return false;
 		}
 	}
 		
 	/* Start streaming. */
 	video_enable(dev, 1);
 	mFPS = fps;
+	mBuffers = nbufs;
+	mSkipped = 0;
+	mSeq = 0;
+	mLastSequence = 0;
 	mRunning = true;
-	pWorkerThread =  new boost::thread(&UVCVideo::capture, this);
 
+	if (!CaptureEngine::get().add(this)) {
+		stop();
+		return false;
+	}
+
+	return true;
 }
 
 /*
- * Alert the thread to close
+ * Leave the capture engine then shut the device down
  */
 
 void UVCVideo::stop() {
-	mRunning = false;	
+	if (!mRunning)
+		return;
+
+	CaptureEngine::get().remove(this);
+	mRunning = false;
+	stopRecording();
+
+	video_enable(dev, 0);
+	_release(mBuffers);
 }
 
 /*
- * Return the decoded buffer
+ * Unmap the first mapped buffers and close the device - all of them on stop, only those
+ * mapped so far when startCapture fails part way
  */
 
-unsigned char* UVCVideo::getBuffer() { 
-	return jbuffer;
+void UVCVideo::_release(unsigned int mapped) {
+	for (unsigned int i = 0; i < mapped; ++i)
+		munmap(mem[i], mMemLength[i]);
+	close(dev);
+	dev = -1;
 }
 
 /*
- * Threaded function that queries buffers and performs yuyv to RGB conversion
+ * The recording takes the capture's size and format, so it can only start once capture has
  */
 
+bool UVCVideo::startRecording(string filename) {
+	if (!mRunning) {
+		cerr << "S9Gear - Cannot record a camera that is not capturing" << endl;
+		return false;
+	}
 
-void UVCVideo::capture() {
+	FrameRecorder *r = new FrameRecorder();
+	if (!r->open(filename, mWidth, mHeight, mFormat, mFPS)) {
+		delete r;
+		return false;
+	}
 
-	while(mRunning){
-		
-		// try and grab at the requested framerate
-		
-		/* Dequeue a buffer. */
-		memset(&buf, 0, sizeof buf);
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
-		int ret = ioctl(dev, VIDIOC_DQBUF, &buf);
-		if (ret < 0) {
-			printf("Unable to dequeue buffer (%d).\n", errno);
-			close(dev);
-			return;
+	boost::mutex::scoped_lock lock(mRecordMutex);
+	delete pRecorder;
+	pRecorder = r;
+	return true;
+}
+
+void UVCVideo::stopRecording() {
+	boost::mutex::scoped_lock lock(mRecordMutex);
+	delete pRecorder;
+	pRecorder = NULL;
+}
+
+bool UVCVideo::isRecording() {
+	boost::mutex::scoped_lock lock(mRecordMutex);
+	return pRecorder != NULL;
+}
+
+/*
+ * Prefer the driver's capture time - it excludes our own scheduling delay
+ */
+
+static double_t bufferTime(const struct v4l2_buffer &b) {
+#ifdef V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
+	if ((b.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+		return static_cast<double_t>(b.timestamp.tv_sec) + static_cast<double_t>(b.timestamp.tv_usec) * 1.0e-6;
+#endif
+	return timeMonotonicS9();
+}
+
+/*
+ * MJPEG decodes straight into the frame when it is wanted as YUYV
+ */
+
+bool CaptureDecoder::decode(VideoFrame &f, const unsigned char *src, size_t bytes, CaptureFormat format,
+	size_t w, size_t h, bool raw) {
+	size_t yuyvBytes = w * h * 2;
+
+	if (format == CAPTURE_MJPEG) {
+		unsigned char *dst;
+		if (raw) {
+			f.mData.resize(yuyvBytes);
+			dst = &f.mData[0];
+		} else {
+			vYUYV.resize(yuyvBytes);
+			dst = &vYUYV[0];
 		}
-		
-		try{
-			if (buf.bytesused > 0) {
-				//jpeg_decode((BYTE**)&jbuffer, (BYTE*)mem[buf.index], mWidth, mHeight);
-				yuyv2rgb((BYTE*)mem[buf.index],(BYTE*)jbuffer,mWidth,mHeight);
-				//memcpy((void*)jbuffer,(void*) mem[buf.index], buf.bytesused);
-			}
+		if (!mDecoder.decode(src, bytes, dst, w, h))
+			return false;
+		src = dst;
+	} else if (bytes < yuyvBytes)
+		return false;
+
+	if (raw) {
+		f.mFormat = FRAME_YUYV;
+		f.mData.resize(yuyvBytes);
+		if (format == CAPTURE_YUYV)
+			memcpy(&f.mData[0], src, yuyvBytes);
+	} else {
+		f.mFormat = FRAME_RGB;
+		f.mData.resize(w * h * 3);
+		yuyv2rgb(const_cast<unsigned char*>(src), &f.mData[0], w, h);
+	}
+	return true;
+}
+
+/*
+ * Dequeue everything the driver has ready, decode only the newest and requeue the lot.
+ * Decoding stale frames would only add latency
+ */
+
+bool UVCVideo::_service() {
+	struct v4l2_buffer b, newest;
+	bool have = false;
+	uint64_t stale = 0;
+
+	while (true) {
+		memset(&b, 0, sizeof b);
+		b.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		b.memory = V4L2_MEMORY_MMAP;
+		if (ioctl(dev, VIDIOC_DQBUF, &b) < 0) {
+			if (errno == EAGAIN)
+				break;
+			printf("Unable to dequeue buffer (%d).\n", errno);
+			if (have) ioctl(dev, VIDIOC_QBUF, &newest);
+			return false;
 		}
-		catch (...){
-			
+
+		if (have) {
+			ioctl(dev, VIDIOC_QBUF, &newest);
+			stale++;
 		}
-			
-		ret = ioctl(dev, VIDIOC_QBUF, &buf);
-		if (ret < 0) {
-			printf("Unable to requeue buffer (%d).\n", errno);
-			close(dev);
-			return;
+		newest = b;
+		have = true;
+	}
+
+	if (!have)
+		return true;
+
+	// Sequence gaps also count frames the driver dropped for want of a queued buffer
+	uint64_t skipped = stale;
+	if (mSeq > 0 && newest.sequence > mLastSequence)
+		skipped = std::max(skipped, static_cast<uint64_t>(newest.sequence - mLastSequence - 1));
+	mLastSequence = newest.sequence;
+
+	if (skipped > 0)
+		__sync_fetch_and_add(&mSkipped, skipped);
+	mSeq += skipped + 1;
+
+	try{
+		if (newest.bytesused > 0) {
+			const BYTE *src = (const BYTE*)mem[newest.index];
+			double_t t = bufferTime(newest);
+
+			{
+				boost::mutex::scoped_lock lock(mRecordMutex);
+				if (pRecorder != NULL && !pRecorder->write(src, newest.bytesused, mSeq, t)) {
+					cerr << "S9Gear - Recording stopped on a write error" << endl;
+					delete pRecorder;
+					pRecorder = NULL;
+				}
+			}
+
+			VideoFrame &f = mFrames.back();
+			if (mDecoder.decode(f, src, newest.bytesused, mFormat, mWidth, mHeight, mRaw)) {
+				f.mTimestamp = t;
+				f.mSeq = mSeq;
+				_publish();
+			} else
+				__sync_fetch_and_add(&mSkipped, 1);		// Corrupt - the camera does send these
 		}
-		
-		// Pause for the length of time to match the fps
-		usleep( 1.0 / (float)mFPS * 1000000.0);
+	}
+	catch (...){
 		
 	}
-	
-	/* Stop streaming. */
-	video_enable(dev, 0);
-	close(dev);
+
+	if (ioctl(dev, VIDIOC_QBUF, &newest) < 0) {
+		printf("Unable to requeue buffer (%d).\n", errno);
+		return false;
+	}
+	return true;
 }
 
 
+/*
+ * The shared engine - created when the first camera starts
+ */
+
+size_t CaptureEngine::mThreads = 1;
+
+CaptureEngine& CaptureEngine::get() {
+	static CaptureEngine engine (mThreads);
+	return engine;
+}
+
+CaptureEngine::CaptureEngine(size_t nthreads) {
+	mEpoll = epoll_create(V4L_BUFFERS_MAX);
+	if (mEpoll < 0)
+		cerr << "S9Gear - Capture engine could not create epoll instance " << strerror(errno) << endl;
+
+	// The read end stays readable once written, waking every thread to exit
+	if (pipe(mWake) == 0) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWake[0], &ev);
+	}
+
+	for (size_t i = 0; i < std::max(nthreads, (size_t)1); ++i)
+		vThreads.push_back(new boost::thread(&CaptureEngine::_run, this));
+}
+
+CaptureEngine::~CaptureEngine() {
+	char c = 0;
+	if (write(mWake[1], &c, 1) != 1)
+		cerr << "S9Gear - Capture engine could not wake its threads" << endl;
+
+	for (size_t i = 0; i < vThreads.size(); ++i){
+		vThreads[i]->join();
+		delete vThreads[i];
+	}
+
+	close(mWake[0]);
+	close(mWake[1]);
+	close(mEpoll);
+}
+
+bool CaptureEngine::add(UVCVideo *cam) {
+	boost::mutex::scoped_lock lock(mMutex);
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = cam;
+	if (epoll_ctl(mEpoll, EPOLL_CTL_ADD, cam->dev, &ev) < 0) {
+		cerr << "S9Gear - Capture engine could not watch device " << strerror(errno) << endl;
+		return false;
+	}
+
+	mCams.insert(cam);
+	return true;
+}
+
+void CaptureEngine::remove(UVCVideo *cam) {
+	boost::mutex::scoped_lock lock(mMutex);
+
+	if (mCams.erase(cam) > 0)
+		epoll_ctl(mEpoll, EPOLL_CTL_DEL, cam->dev, NULL);
+
+	while (mBusy.count(cam) > 0)
+		mIdle.wait(lock);
+}
+
+/*
+ * Engine thread loop. A camera is only touched while registered and marked busy, so
+ * remove can return knowing no thread is inside it
+ */
+
+void CaptureEngine::_run() {
+	const int MAX_EVENTS = 16;
+	struct epoll_event events[MAX_EVENTS];
+
+	while (true) {
+		int n = epoll_wait(mEpoll, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			cerr << "S9Gear - Capture engine wait failed " << strerror(errno) << endl;
+			return;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			if (events[i].data.ptr == NULL)
+				return;
+
+			UVCVideo *cam = static_cast<UVCVideo*>(events[i].data.ptr);
+			{
+				boost::mutex::scoped_lock lock(mMutex);
+				if (mCams.count(cam) == 0)
+					continue;
+				mBusy.insert(cam);
+			}
+
+			bool ok = cam->_service();
+
+			boost::mutex::scoped_lock lock(mMutex);
+			mBusy.erase(cam);
+
+			if (mCams.count(cam) > 0) {
+				if (ok) {
+					struct epoll_event ev;
+					memset(&ev, 0, sizeof ev);
+					ev.events = EPOLLIN | EPOLLONESHOT;
+					ev.data.ptr = cam;
+					epoll_ctl(mEpoll, EPOLL_CTL_MOD, cam->dev, &ev);
+				} else {
+					cerr << "S9Gear - Capture engine dropping a camera after a device error" << endl;
+					mCams.erase(cam);
+					epoll_ctl(mEpoll, EPOLL_CTL_DEL, cam->dev, NULL);
+				}
+			}
+			mIdle.notify_all();
+		}
+	}
+}
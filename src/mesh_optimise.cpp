@@ -0,0 +1,255 @@
+/**
+* @brief Index and vertex reordering for faster drawing
+* @file mesh_optimise.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 10/08/2012
+*
+*/
+
+#include "s9/mesh_optimise.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+static const uint32_t NONE = 0xffffffff;
+
+/*
+ * FIFO cache model - a vertex is resident if it was inserted within the last cachesize
+ * misses. Stamps start at 0 and the clock past cachesize so every vertex begins cold
+ */
+
+class FifoCache {
+public:
+	FifoCache(size_t numverts, size_t cachesize) : vStamp(numverts, 0), mSize(cachesize), mClock(cachesize + 1) {};
+
+	void reset() { mClock += mSize + 1; };
+
+	// Returns 1 on a miss
+	uint32_t touch(uint32_t v) {
+		if (mClock - vStamp[v] <= mSize) return 0;
+		vStamp[v] = mClock++;
+		return 1;
+	};
+
+	uint32_t triangle(const uint32_t *t) { return touch(t[0]) + touch(t[1]) + touch(t[2]); };
+
+protected:
+	std::vector<uint64_t> vStamp;
+	uint64_t mSize;
+	uint64_t mClock;
+};
+
+
+VertexCacheStats s9::analyseVertexCache(BufferView<const uint32_t> indices, size_t numverts, size_t cachesize) {
+	VertexCacheStats st;
+	size_t nt = indices.size() / 3;
+	if (nt == 0) return st;
+
+	FifoCache cache (numverts, cachesize);
+	std::vector<uint8_t> seen (numverts, 0);
+	size_t misses = 0, used = 0;
+
+	for (size_t i = 0; i < nt * 3; ++i) {
+		misses += cache.touch(indices[i]);
+		if (!seen[indices[i]]) { seen[indices[i]] = 1; used++; }
+	}
+
+	st.mACMR = static_cast<double_t>(misses) / nt;
+	st.mATVR = static_cast<double_t>(misses) / used;
+	return st;
+}
+
+
+/*
+ * Tipsify. Emit every remaining triangle around the fanning vertex, then pick the next
+ * fan from the vertices just touched - the oldest one that will still be cached once its
+ * remaining triangles are emitted. With no such vertex, fall back to recently touched
+ * vertices with live triangles (the dead end stack) and finally a linear scan
+ */
+
+void s9::optimiseVertexCache(BufferView<const uint32_t> indices, size_t numverts, std::vector<uint32_t> &out, size_t cachesize) {
+
+	size_t nt = indices.size() / 3;
+	out.clear();
+	out.reserve(nt * 3);
+	if (nt == 0) return;
+
+	// Triangles around each vertex
+	std::vector<uint32_t> live (numverts, 0);
+	for (size_t i = 0; i < nt * 3; ++i)
+		live[indices[i]]++;
+
+	std::vector<uint32_t> starts (numverts + 1, 0);
+	for (size_t v = 0; v < numverts; ++v)
+		starts[v + 1] = starts[v] + live[v];
+
+	std::vector<uint32_t> adj (nt * 3);
+	std::vector<uint32_t> fill (starts.begin(), starts.end() - 1);
+	for (size_t i = 0; i < nt * 3; ++i)
+		adj[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<uint64_t> stamp (numverts, 0);
+	std::vector<uint8_t> emitted (nt, 0);
+	std::vector<uint32_t> deadend, candidates;
+	deadend.reserve(nt * 3);
+
+	uint64_t k = cachesize;
+	uint64_t s = k + 1;
+	size_t cursor = 0;
+
+	while (cursor < numverts && live[cursor] == 0) cursor++;
+	uint32_t f = cursor < numverts ? static_cast<uint32_t>(cursor) : NONE;
+
+	while (f != NONE) {
+		candidates.clear();
+
+		for (uint32_t a = starts[f]; a < starts[f + 1]; ++a) {
+			uint32_t t = adj[a];
+			if (emitted[t]) continue;
+
+			for (size_t j = 0; j < 3; ++j) {
+				uint32_t v = indices[t * 3 + j];
+				out.push_back(v);
+				deadend.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (s - stamp[v] > k) stamp[v] = s++;
+			}
+			emitted[t] = 1;
+		}
+
+		uint32_t best = NONE;
+		int64_t bestp = -1;
+
+		for (size_t c = 0; c < candidates.size(); ++c) {
+			uint32_t v = candidates[c];
+			if (live[v] == 0) continue;
+
+			int64_t p = 0;
+			if (s - stamp[v] + 2 * live[v] <= k) p = static_cast<int64_t>(s - stamp[v]);
+			if (p > bestp) { bestp = p; best = v; }
+		}
+
+		while (best == NONE && !deadend.empty()) {
+			uint32_t d = deadend.back();
+			deadend.pop_back();
+			if (live[d] > 0) best = d;
+		}
+
+		while (best == NONE && cursor < numverts) {
+			if (live[cursor] > 0) best = static_cast<uint32_t>(cursor);
+			else cursor++;
+		}
+
+		f = best;
+	}
+}
+
+
+/*
+ * Clusters end where the cache restarts (a triangle with three misses) and are split
+ * further once their running ACMR reaches threshold times the cluster's own. Each is
+ * then keyed by how far its area weighted centroid sits out from the mesh centre along
+ * its average normal, largest first
+ */
+
+struct ClusterKey {
+	double_t mKey;
+	uint32_t mCluster;
+	bool operator<(const ClusterKey &c) const { return mKey > c.mKey; };
+};
+
+void s9::optimiseOverdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, size_t cachesize, double_t threshold) {
+
+	size_t nt = indices.size() / 3;
+	if (nt < 2) return;
+
+	FifoCache cache (positions.size(), cachesize);
+
+	std::vector<uint32_t> hard;
+	for (size_t t = 0; t < nt; ++t)
+		if (cache.triangle(&indices[t * 3]) == 3 || t == 0)
+			hard.push_back(static_cast<uint32_t>(t));
+	hard.push_back(static_cast<uint32_t>(nt));
+
+	std::vector<uint32_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h) {
+		uint32_t b = hard[h], e = hard[h + 1];
+
+		cache.reset();
+		size_t misses = 0;
+		for (uint32_t t = b; t < e; ++t)
+			misses += cache.triangle(&indices[t * 3]);
+		double_t target = threshold * misses / (e - b);
+
+		clusters.push_back(b);
+		cache.reset();
+		size_t rmisses = 0, rfaces = 0;
+
+		for (uint32_t t = b; t < e; ++t) {
+			rmisses += cache.triangle(&indices[t * 3]);
+			rfaces++;
+			if (t + 1 < e && static_cast<double_t>(rmisses) / rfaces <= target) {
+				clusters.push_back(t + 1);
+				cache.reset();
+				rmisses = rfaces = 0;
+			}
+		}
+	}
+	clusters.push_back(static_cast<uint32_t>(nt));
+
+	glm::dvec3 centre (0.0);
+	for (size_t i = 0; i < nt * 3; ++i)
+		centre += glm::dvec3(positions[indices[i]]);
+	centre /= static_cast<double_t>(nt * 3);
+
+	size_t nc = clusters.size() - 1;
+	std::vector<ClusterKey> keys (nc);
+
+	for (size_t c = 0; c < nc; ++c) {
+		glm::dvec3 centroid (0.0), normal (0.0);
+		double_t area = 0.0;
+
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+			glm::dvec3 p0 (positions[indices[t * 3]]);
+			glm::dvec3 p1 (positions[indices[t * 3 + 1]]);
+			glm::dvec3 p2 (positions[indices[t * 3 + 2]]);
+			glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+			double_t a = glm::length(n);
+
+			centroid += (p0 + p1 + p2) * (a / 3.0);
+			normal += n;
+			area += a;
+		}
+
+		double_t nl = glm::length(normal);
+		keys[c].mCluster = static_cast<uint32_t>(c);
+		keys[c].mKey = (area > 0.0 && nl > 0.0) ? glm::dot(centroid / area - centre, normal / nl) : 0.0;
+	}
+
+	std::stable_sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> out;
+	out.reserve(nt * 3);
+	for (size_t c = 0; c < nc; ++c) {
+		uint32_t k = keys[c].mCluster;
+		out.insert(out.end(), indices.begin() + clusters[k] * 3, indices.begin() + clusters[k + 1] * 3);
+	}
+	indices.swap(out);
+}
+
+
+size_t s9::optimiseVertexFetch(std::vector<uint32_t> &indices, size_t numverts, std::vector<uint32_t> &remap) {
+	remap.assign(numverts, NONE);
+	uint32_t next = 0;
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		uint32_t &r = remap[indices[i]];
+		if (r == NONE) r = next++;
+		indices[i] = r;
+	}
+	return next;
+}
@@ -0,0 +1,187 @@
+/**
+* @brief Binary mesh cache - memory mapped interleaved geometry
+* @file meshcache.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 03/08/2012
+*
+*/
+
+#include "s9/meshcache.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+
+/*
+ * 64 bit FNV-1a over a run of bytes
+ */
+
+static uint64_t fnv1a(const uint8_t *p, size_t n, uint64_t h = 14695981039346656037ULL) {
+	for (size_t i = 0; i < n; ++i){
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+MeshCache::SharedObj::~SharedObj() {
+	if (pData != NULL)
+		munmap(const_cast<uint8_t*>(pData), mSize);
+}
+
+/*
+ * Map an existing cache file and sanity check its header against its size
+ */
+
+bool MeshCache::open(std::string path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(MeshCacheHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+
+	boost::shared_ptr<SharedObj> obj (new SharedObj());
+	obj->pData = static_cast<const uint8_t*>(p);
+	obj->pHeader = reinterpret_cast<const MeshCacheHeader*>(p);
+	obj->mSize = st.st_size;
+
+	const MeshCacheHeader *h = obj->pHeader;
+	uint64_t expected = sizeof(MeshCacheHeader) + h->mNumVertices * h->mVertexSize + h->mNumIndices * sizeof(uint32_t);
+
+	if (memcmp(h->mMagic, "S9MESH", 6) != 0 || h->mVersion != MESHCACHE_VERSION || expected != obj->mSize) {
+		cerr << "S9Gear - Ignoring corrupt mesh cache " << path << endl;
+		return false;
+	}
+
+	// Readahead - we are about to touch every page
+	madvise(p, st.st_size, MADV_WILLNEED);
+
+	mObj = obj;
+	return true;
+}
+
+/*
+ * Size and mtime must match, or failing that the contents must hash the same
+ * (a touched but unchanged file). The hash is only computed when needed
+ */
+
+bool MeshCache::isValidFor(MeshSource &src, uint32_t flags, uint32_t options) {
+	const MeshCacheHeader &h = getHeader();
+
+	if (h.mImportFlags != flags || h.mOptions != options || h.mSourceSize != src.mSize)
+		return false;
+
+	if (h.mSourceMTime == src.mMTime)
+		return true;
+
+	if (src.mHash == 0)
+		src.mHash = hashFile(src.mPath);
+
+	return h.mSourceHash == src.mHash;
+}
+
+/*
+ * The cache either sits beside the source or in dir, named after a hash of the path
+ */
+
+std::string MeshCache::cachePath(std::string source, std::string dir, uint32_t flags) {
+	if (dir == "")
+		return source + ".s9mesh";
+
+	uint64_t h = fnv1a(reinterpret_cast<const uint8_t*>(source.c_str()), source.size());
+	h = fnv1a(reinterpret_cast<const uint8_t*>(&flags), sizeof(flags), h);
+
+	std::ostringstream s;
+	s << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << h << ".s9mesh";
+	return s.str();
+}
+
+/*
+ * A source that was touched but not changed - rewrite just the stored mtime in place
+ */
+
+bool MeshCache::refresh(std::string path, const MeshSource &src) {
+	int fd = ::open(path.c_str(), O_WRONLY);
+	if (fd < 0)
+		return false;
+
+	int64_t mtime = src.mMTime;
+	bool ok = pwrite(fd, &mtime, sizeof(mtime), offsetof(MeshCacheHeader, mSourceMTime)) == sizeof(mtime);
+	close(fd);
+	return ok;
+}
+
+bool MeshCache::stat(std::string path, MeshSource &src) {
+	struct stat st;
+	if (::stat(path.c_str(), &st) < 0)
+		return false;
+
+	src.mPath = path;
+	src.mSize = st.st_size;
+	src.mMTime = st.st_mtime;
+	src.mHash = 0;
+	return true;
+}
+
+uint64_t MeshCache::hashFile(std::string path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return 0;
+
+	uint64_t h = fnv1a(static_cast<const uint8_t*>(p), st.st_size);
+	munmap(p, st.st_size);
+	return h;
+}
+
+/*
+ * Write to a temporary then rename so readers never see a half written file
+ */
+
+bool MeshCache::_write(std::string path, const MeshCacheHeader &h, const void *verts, const void *indices) {
+	std::string tmp = path + ".tmp";
+	FILE *f = fopen(tmp.c_str(), "wb");
+	if (f == NULL) {
+		cerr << "S9Gear - Unable to write mesh cache " << path << endl;
+		return false;
+	}
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	if (ok && h.mNumVertices > 0)
+		ok = fwrite(verts, h.mVertexSize, h.mNumVertices, f) == h.mNumVertices;
+	if (ok && h.mNumIndices > 0)
+		ok = fwrite(indices, sizeof(uint32_t), h.mNumIndices, f) == h.mNumIndices;
+
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+		cerr << "S9Gear - Unable to write mesh cache " << path << endl;
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
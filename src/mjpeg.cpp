@@ -0,0 +1,569 @@
+/**
+* @brief Baseline JPEG decoder for MJPEG camera streams
+* @file mjpeg.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 17/08/2012
+*
+*/
+
+#include "s9/mjpeg.hpp"
+#include "s9/parallel.hpp"
+#include "s9/huffman.h"
+
+#include <boost/bind.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+
+// Position in the block of the nth coefficient in the stream
+static const uint8_t gNatural[64 + 16] = {
+	0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+	// A corrupt run past the end lands here rather than outside the block
+	63, 63, 63, 63, 63, 63, 63, 63,
+	63, 63, 63, 63, 63, 63, 63, 63
+};
+
+// IJG AAN scale factors, cos(k * pi / 16) * sqrt(2) for k > 0
+static const float gAAN[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+	1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+static inline int extend(int v, int bits) {
+	return v < (1 << (bits - 1)) ? v - (1 << bits) + 1 : v;
+}
+
+/*
+ * Entropy coded data, most significant bit first in a 64 bit word. Stuffed zero bytes are
+ * removed and zeros fed in past the end, which only matter if the data is corrupt
+ */
+
+struct BitReader {
+	const unsigned char *mP, *mEnd;
+	uint64_t mBits;
+	int mCount;
+
+	BitReader(const unsigned char *begin, const unsigned char *end) : mP(begin), mEnd(end), mBits(0), mCount(0) {};
+
+	void fill() {
+		while (mCount <= 56) {
+			uint64_t b = 0;
+			if (mP < mEnd) {
+				b = *mP++;
+				if (b == 0xff) {
+					if (mP < mEnd && *mP == 0) ++mP;
+					else { mP = mEnd; b = 0; }
+				}
+			}
+			mBits |= b << (56 - mCount);
+			mCount += 8;
+		}
+	}
+
+	uint32_t peek(int n) { return static_cast<uint32_t>(mBits >> (64 - n)); };
+	void skip(int n) { mBits <<= n; mCount -= n; };
+
+	int receive(int n) {
+		if (n == 0) return 0;
+		if (mCount < n) fill();
+		int v = peek(n);
+		skip(n);
+		return extend(v, n);
+	}
+};
+
+
+/*
+ * IDCT - the floating point AAN algorithm from the IJG library, columns then rows.
+ * The dequantisation table carries the AAN scale factors and the final divide by 8
+ */
+
+#define IDCT_1D(i0, i1, i2, i3, i4, i5, i6, i7, o0, o1, o2, o3, o4, o5, o6, o7, ADD, SUB, MUL, K) { \
+	T tmp10 = ADD(i0, i4), tmp11 = SUB(i0, i4); \
+	T tmp13 = ADD(i2, i6); \
+	T tmp12 = SUB(MUL(SUB(i2, i6), K(1.414213562f)), tmp13); \
+	T e0 = ADD(tmp10, tmp13), e3 = SUB(tmp10, tmp13); \
+	T e1 = ADD(tmp11, tmp12), e2 = SUB(tmp11, tmp12); \
+	T z13 = ADD(i5, i3), z10 = SUB(i5, i3); \
+	T z11 = ADD(i1, i7), z12 = SUB(i1, i7); \
+	T d7 = ADD(z11, z13); \
+	T d11 = MUL(SUB(z11, z13), K(1.414213562f)); \
+	T z5 = MUL(ADD(z10, z12), K(1.847759065f)); \
+	T d10 = SUB(MUL(z12, K(1.082392200f)), z5); \
+	T d12 = ADD(MUL(z10, K(-2.613125930f)), z5); \
+	T d6 = SUB(d12, d7); \
+	T d5 = SUB(d11, d6); \
+	T d4 = ADD(d10, d5); \
+	o0 = ADD(e0, d7); o7 = SUB(e0, d7); \
+	o1 = ADD(e1, d6); o6 = SUB(e1, d6); \
+	o2 = ADD(e2, d5); o5 = SUB(e2, d5); \
+	o4 = ADD(e3, d4); o3 = SUB(e3, d4); \
+}
+
+#define S_ADD(a, b) ((a) + (b))
+#define S_SUB(a, b) ((a) - (b))
+#define S_MUL(a, b) ((a) * (b))
+#define S_K(k) (k)
+
+static void idctScalar(const float *in, unsigned char *out) {
+	typedef float T;
+	float ws[64];
+
+	for (int c = 0; c < 8; ++c) {
+		const float *i = in + c;
+		float *o = ws + c;
+		IDCT_1D(i[0], i[8], i[16], i[24], i[32], i[40], i[48], i[56],
+			o[0], o[8], o[16], o[24], o[32], o[40], o[48], o[56], S_ADD, S_SUB, S_MUL, S_K)
+	}
+
+	for (int r = 0; r < 8; ++r) {
+		const float *i = ws + r * 8;
+		float o[8];
+		IDCT_1D(i[0], i[1], i[2], i[3], i[4], i[5], i[6], i[7],
+			o[0], o[1], o[2], o[3], o[4], o[5], o[6], o[7], S_ADD, S_SUB, S_MUL, S_K)
+		for (int x = 0; x < 8; ++x) {
+			float v = o[x] + 128.0f;
+			v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+			out[r * 8 + x] = static_cast<unsigned char>(static_cast<int>(v + 0.5f));
+		}
+	}
+}
+
+#ifdef __SSE2__
+
+#define V_ADD(a, b) _mm_add_ps(a, b)
+#define V_SUB(a, b) _mm_sub_ps(a, b)
+#define V_MUL(a, b) _mm_mul_ps(a, b)
+#define V_K(k) _mm_set1_ps(k)
+
+static inline void transpose8(__m128 *m) {
+	// m[2r] holds columns 0-3 of row r, m[2r+1] columns 4-7
+	_MM_TRANSPOSE4_PS(m[0], m[2], m[4], m[6]);
+	_MM_TRANSPOSE4_PS(m[9], m[11], m[13], m[15]);
+	_MM_TRANSPOSE4_PS(m[1], m[3], m[5], m[7]);
+	_MM_TRANSPOSE4_PS(m[8], m[10], m[12], m[14]);
+	std::swap(m[1], m[8]); std::swap(m[3], m[10]); std::swap(m[5], m[12]); std::swap(m[7], m[14]);
+}
+
+// Same operations in the same order as idctScalar, on four lanes at once
+static void idctSSE2(const float *in, unsigned char *out) {
+	typedef __m128 T;
+	__m128 m[16];
+	for (int i = 0; i < 16; ++i) m[i] = _mm_loadu_ps(in + i * 4);
+
+	for (int h = 0; h < 2; ++h)
+		IDCT_1D(m[h], m[2 + h], m[4 + h], m[6 + h], m[8 + h], m[10 + h], m[12 + h], m[14 + h],
+			m[h], m[2 + h], m[4 + h], m[6 + h], m[8 + h], m[10 + h], m[12 + h], m[14 + h], V_ADD, V_SUB, V_MUL, V_K)
+
+	transpose8(m);
+
+	for (int h = 0; h < 2; ++h)
+		IDCT_1D(m[h], m[2 + h], m[4 + h], m[6 + h], m[8 + h], m[10 + h], m[12 + h], m[14 + h],
+			m[h], m[2 + h], m[4 + h], m[6 + h], m[8 + h], m[10 + h], m[12 + h], m[14 + h], V_ADD, V_SUB, V_MUL, V_K)
+
+	transpose8(m);
+
+	const __m128 bias = _mm_set1_ps(128.0f), zero = _mm_setzero_ps(), top = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+	for (int r = 0; r < 8; r += 2) {
+		__m128i q[4];
+		for (int j = 0; j < 4; ++j) {
+			__m128 v = _mm_add_ps(m[r * 2 + j], bias);
+			v = _mm_min_ps(_mm_max_ps(v, zero), top);
+			q[j] = _mm_cvttps_epi32(_mm_add_ps(v, half));
+		}
+		__m128i b = _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + r * 8), b);
+	}
+}
+
+#endif
+
+typedef void (*IDCTFunc)(const float *in, unsigned char *out);
+
+
+MJPEGDecoder::MJPEGDecoder() : mNumComps(0), mRestart(0), pOut(NULL), mW(0), mH(0), mErrors(0), mParallel(true), mSIMD(false) {
+	setSIMD(true);
+
+	// The standard tables MJPEG streams leave out - same layout as a DHT segment
+	const unsigned char *p = JPEGHuffmanTable;
+	const unsigned char *end = p + JPG_HUFFMAN_TABLE_LENGTH;
+	while (p < end) {
+		int tc = *p >> 4, th = *p & 15;
+		int n = 0;
+		for (int i = 0; i < 16; ++i) n += p[1 + i];
+		_buildHuffman(mDefault[tc * 2 + th], p + 1, p + 17);
+		p += 17 + n;
+	}
+}
+
+void MJPEGDecoder::setSIMD(bool simd) {
+#ifdef __SSE2__
+	mSIMD = simd;
+#else
+	mSIMD = false;
+#endif
+}
+
+/*
+ * Canonical codes from the counts per length. Codes of up to FAST_BITS fill a direct lookup,
+ * and for AC tables so do short codes whose value bits also fit
+ */
+
+bool MJPEGDecoder::_buildHuffman(Huffman &h, const unsigned char *counts, const unsigned char *symbols) {
+	memset(h.mFastSize, 0, sizeof(h.mFastSize));
+	memset(h.mFastAC, 0, sizeof(h.mFastAC));
+
+	uint32_t code = 0;
+	int k = 0;
+	for (int len = 1; len <= 16; ++len) {
+		h.mDelta[len] = k - static_cast<int32_t>(code);
+		for (int i = 0; i < counts[len - 1]; ++i, ++k, ++code) {
+			if (k >= 256 || code >= (1u << len)) return false;
+			h.mSymbols[k] = symbols[k];
+			if (len <= FAST_BITS) {
+				int shift = FAST_BITS - len;
+				for (uint32_t j = 0; j < (1u << shift); ++j) {
+					uint32_t look = (code << shift) | j;
+					h.mFastSize[look] = len;
+					h.mFastSym[look] = symbols[k];
+				}
+			}
+		}
+		h.mMaxCode[len] = code << (16 - len);
+		code <<= 1;
+	}
+	h.mMaxCode[17] = 0xffffffff;
+	h.mCount = k;
+
+	for (uint32_t look = 0; look < (1u << FAST_BITS); ++look) {
+		int len = h.mFastSize[look];
+		if (len == 0) continue;
+		int run = h.mFastSym[look] >> 4, size = h.mFastSym[look] & 15;
+		if (size == 0 || len + size > FAST_BITS) continue;
+		int v = extend((look >> (FAST_BITS - len - size)) & ((1 << size) - 1), size);
+		if (v >= -128 && v <= 127)
+			h.mFastAC[look] = static_cast<int16_t>(v * 256 + (run << 4) + len + size);
+	}
+	return true;
+}
+
+/*
+ * Everything up to and including the SOS header
+ */
+
+bool MJPEGDecoder::_readTables(const unsigned char *&p, const unsigned char *end, bool &dht) {
+	bool frame = false;
+
+	while (p + 4 <= end) {
+		if (p[0] != 0xff) return false;
+		int m = p[1];
+		if (m == 0xff) { ++p; continue; }
+		size_t len = (p[2] << 8) | p[3];
+		const unsigned char *s = p + 4, *e = p + 2 + len;
+		if (len < 2 || e > end) return false;
+		p = e;
+
+		switch (m) {
+			case 0xdb: // DQT
+				while (s < e) {
+					int pq = *s >> 4, tq = *s & 15;
+					++s;
+					if (tq > 3 || s + (pq ? 128 : 64) > e) return false;
+					for (int k = 0; k < 64; ++k) {
+						int q = pq ? (s[k * 2] << 8) | s[k * 2 + 1] : s[k];
+						int n = gNatural[k];
+						mQuant[tq][n] = q * gAAN[n >> 3] * gAAN[n & 7] * 0.125f;
+					}
+					s += pq ? 128 : 64;
+				}
+				break;
+
+			case 0xc4: // DHT
+				while (s + 17 <= e) {
+					int tc = *s >> 4, th = *s & 15;
+					int n = 0;
+					for (int i = 0; i < 16; ++i) n += s[1 + i];
+					if (tc > 1 || th > 1 || s + 17 + n > e) return false;
+					if (!_buildHuffman(mTables[tc * 2 + th], s + 1, s + 17)) return false;
+					s += 17 + n;
+				}
+				dht = true;
+				break;
+
+			case 0xdd: // DRI
+				if (len < 4) return false;
+				mRestart = (s[0] << 8) | s[1];
+				break;
+
+			case 0xc0: // SOF0 and SOF1, both baseline Huffman
+			case 0xc1: {
+				if (len < 8 || s[0] != 8) return false;
+				size_t h = (s[1] << 8) | s[2], w = (s[3] << 8) | s[4];
+				mNumComps = s[5];
+				if (w != mW || h != mH || (mNumComps != 1 && mNumComps != 3) || len < static_cast<size_t>(8 + 3 * mNumComps))
+					return false;
+				for (int i = 0; i < mNumComps; ++i) {
+					Component &c = mComps[i];
+					c.mId = s[6 + i * 3];
+					c.mH = s[7 + i * 3] >> 4;
+					c.mV = s[7 + i * 3] & 15;
+					c.mTQ = s[8 + i * 3];
+					if (c.mH < 1 || c.mH > 2 || c.mV < 1 || c.mV > 2 || c.mTQ > 3) return false;
+					if (i > 0 && (c.mH != 1 || c.mV != 1)) return false;
+				}
+				// A lone component is never interleaved so its MCU is one block whatever it says
+				if (mNumComps == 1) mComps[0].mH = mComps[0].mV = 1;
+				mHMax = mComps[0].mH;
+				mVMax = mComps[0].mV;
+				mMCUsX = (w + mHMax * 8 - 1) / (mHMax * 8);
+				mMCUsY = (h + mVMax * 8 - 1) / (mVMax * 8);
+				frame = true;
+				break;
+			}
+
+			case 0xda: { // SOS - only interleaved scans of every component
+				if (!frame || len < static_cast<size_t>(6 + 2 * mNumComps) || s[0] != mNumComps) return false;
+				for (int i = 0; i < mNumComps; ++i) {
+					int id = s[1 + i * 2], t = s[2 + i * 2];
+					if (mComps[i].mId != id) return false;
+					mComps[i].mTD = t >> 4;
+					mComps[i].mTA = t & 15;
+					if (mComps[i].mTD > 1 || mComps[i].mTA > 1) return false;
+				}
+				return true;
+			}
+
+			case 0xc2: // Progressive, lossless and arithmetic coding
+			case 0xc3:
+			case 0xc5: case 0xc6: case 0xc7:
+			case 0xc9: case 0xca: case 0xcb:
+			case 0xcd: case 0xce: case 0xcf:
+				return false;
+
+			default: // APPn, COM and the rest
+				break;
+		}
+	}
+	return false;
+}
+
+/*
+ * Cut the scan at its restart markers - each interval starts with fresh DC predictions so
+ * they decode independently
+ */
+
+bool MJPEGDecoder::_split(const unsigned char *p, const unsigned char *end) {
+	size_t total = mMCUsX * mMCUsY;
+	size_t per = mRestart > 0 ? mRestart : total;
+	bool ended = false;
+
+	vSegments.clear();
+	Segment s;
+	s.mBegin = p;
+	s.mFirst = 0;
+
+	for (; p + 1 < end; ++p) {
+		if (p[0] != 0xff || p[1] == 0 || p[1] == 0xff) continue;	// Stuffing and fill bytes
+		s.mEnd = p;
+		s.mCount = std::min(per, total - s.mFirst);
+		vSegments.push_back(s);
+		if (p[1] < 0xd0 || p[1] > 0xd7 || s.mFirst + s.mCount >= total) {
+			ended = true;
+			break;
+		}
+		s.mFirst += s.mCount;
+		s.mBegin = p + 2;
+		++p;
+	}
+
+	// Truncated - decode what is there, the rest reads as zeros
+	if (!ended) {
+		s.mEnd = end;
+		s.mCount = std::min(per, total - s.mFirst);
+		vSegments.push_back(s);
+	}
+
+	return ended && vSegments.back().mFirst + vSegments.back().mCount == total;
+}
+
+bool MJPEGDecoder::decode(const unsigned char *src, size_t bytes, unsigned char *yuyv, size_t w, size_t h) {
+	if (src == NULL || bytes < 4 || src[0] != 0xff || src[1] != 0xd8) return false;
+
+	mW = w; mH = h;
+	mRestart = 0;
+	mNumComps = 0;
+	for (int i = 0; i < 4; ++i) mTables[i] = mDefault[i];
+
+	const unsigned char *p = src + 2, *end = src + bytes;
+	bool dht = false;
+	if (!_readTables(p, end, dht)) return false;
+
+	bool complete = _split(p, end);
+
+	pOut = yuyv;
+	mErrors = 0;
+	if (mParallel && vSegments.size() > 1) {
+		// Enough MCUs per chunk to be worth a hand off
+		size_t grain = std::max(static_cast<size_t>(1), 256 / std::max(mRestart, static_cast<size_t>(1)));
+		parallelFor(vSegments.size(), boost::bind(&MJPEGDecoder::_decodeSegments, this, _1, _2), grain);
+	} else
+		_decodeSegments(0, vSegments.size());
+
+	return complete && mErrors == 0;
+}
+
+void MJPEGDecoder::_decodeSegments(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i)
+		if (!_decodeSegment(vSegments[i]))
+			__sync_fetch_and_add(&mErrors, 1);
+}
+
+
+static inline int decodeSymbol(BitReader &br, const MJPEGDecoder::Huffman &h) {
+	if (br.mCount < 16) br.fill();
+	uint32_t look = br.peek(MJPEGDecoder::FAST_BITS);
+	int len = h.mFastSize[look];
+	if (len) {
+		br.skip(len);
+		return h.mFastSym[look];
+	}
+	uint32_t code = br.peek(16);
+	for (len = MJPEGDecoder::FAST_BITS + 1; code >= h.mMaxCode[len]; ++len);
+	if (len > 16) return -1;
+	int k = static_cast<int>(code >> (16 - len)) + h.mDelta[len];
+	if (k < 0 || k >= h.mCount) return -1;
+	br.skip(len);
+	return h.mSymbols[k];
+}
+
+/*
+ * One block - coefficients are dequantised straight into natural order. Returns how many
+ * coefficients were coded, 1 for DC alone, or 0 if the data is bad
+ */
+
+static inline int decodeBlock(BitReader &br, float *block, const MJPEGDecoder::Huffman &dc,
+	const MJPEGDecoder::Huffman &ac, int &pred, const float *q) {
+
+	memset(block, 0, 64 * sizeof(float));
+
+	int t = decodeSymbol(br, dc);
+	if (t < 0 || t > 11) return 0;
+	pred += br.receive(t);
+	block[0] = pred * q[0];
+
+	int k = 1;
+	while (k < 64) {
+		if (br.mCount < 16) br.fill();
+		uint32_t look = br.peek(MJPEGDecoder::FAST_BITS);
+		int f = ac.mFastAC[look];
+		if (f) {
+			k += (f >> 4) & 15;
+			br.skip(f & 15);
+			int n = gNatural[k];
+			block[n] = (f >> 8) * q[n];
+			++k;
+			continue;
+		}
+		int rs = decodeSymbol(br, ac);
+		if (rs < 0) return 0;
+		int r = rs >> 4, s = rs & 15;
+		if (s == 0) {
+			if (r != 15) break;		// End of block
+			k += 16;
+			continue;
+		}
+		k += r;
+		int n = gNatural[k];
+		block[n] = br.receive(s) * q[n];
+		++k;
+	}
+	return k;
+}
+
+// A block with only DC is flat - the IDCT passes leave it exactly as it is
+static inline void flatBlock(float dc, unsigned char *out) {
+	float v = dc + 128.0f;
+	v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+	memset(out, static_cast<int>(v + 0.5f), 64);
+}
+
+/*
+ * Decode the MCUs of one interval and write them out as YUYV. Each pixel pair takes the
+ * chroma under its first pixel, averaged with the second when chroma is full width
+ */
+
+bool MJPEGDecoder::_decodeSegment(const Segment &s) {
+	BitReader br (s.mBegin, s.mEnd);
+	IDCTFunc idct = idctScalar;
+#ifdef __SSE2__
+	if (mSIMD) idct = idctSSE2;
+#endif
+
+	int pred[3] = { 0, 0, 0 };
+	float block[64];
+	unsigned char pix[6][64];	// Up to four luma blocks then Cb and Cr
+	const int lumaBlocks = mHMax * mVMax;
+	const int mcuW = mHMax * 8, mcuH = mVMax * 8;
+
+	for (size_t m = s.mFirst; m < s.mFirst + s.mCount; ++m) {
+		int b = 0;
+		for (int c = 0; c < mNumComps; ++c) {
+			const Component &comp = mComps[c];
+			for (int i = 0; i < comp.mH * comp.mV; ++i, ++b) {
+				int coded = decodeBlock(br, block, mTables[comp.mTD], mTables[2 + comp.mTA], pred[c], mQuant[comp.mTQ]);
+				if (coded == 0) return false;
+				if (coded == 1) flatBlock(block[0], pix[b]);
+				else idct(block, pix[b]);
+			}
+		}
+
+		size_t x0 = (m % mMCUsX) * mcuW, y0 = (m / mMCUsX) * mcuH;
+		size_t cols = std::min(static_cast<size_t>(mcuW), mW - x0) & ~static_cast<size_t>(1);
+		size_t rows = std::min(static_cast<size_t>(mcuH), mH - y0);
+		const unsigned char *cb = pix[lumaBlocks], *cr = pix[lumaBlocks + 1];
+
+		for (size_t y = 0; y < rows; ++y) {
+			unsigned char *o = pOut + ((y0 + y) * mW + x0) * 2;
+			const unsigned char *luma = pix[(y >> 3) * mHMax] + (y & 7) * 8;
+			const unsigned char *cbr = cb + (mVMax == 2 ? y >> 1 : y) * 8;
+			const unsigned char *crr = cr + (mVMax == 2 ? y >> 1 : y) * 8;
+
+			if (mNumComps == 1) {
+				for (size_t x = 0; x < cols; x += 2, o += 4) {
+					o[0] = luma[x];
+					o[1] = 128;
+					o[2] = luma[x + 1];
+					o[3] = 128;
+				}
+			} else if (mHMax == 2) {
+				// The second luma block follows the first for each row
+				for (size_t x = 0; x < cols; x += 2, o += 4) {
+					const unsigned char *l = x < 8 ? luma + x : luma + 64 + x - 8;
+					o[0] = l[0];
+					o[1] = cbr[x >> 1];
+					o[2] = l[1];
+					o[3] = crr[x >> 1];
+				}
+			} else {
+				for (size_t x = 0; x < cols; x += 2, o += 4) {
+					o[0] = luma[x];
+					o[1] = (cbr[x] + cbr[x + 1] + 1) >> 1;
+					o[2] = luma[x + 1];
+					o[3] = (crr[x] + crr[x + 1] + 1) >> 1;
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,148 @@
+/**
+* @brief Worker pool for data parallel loops
+* @file parallel.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 02/08/2012
+*
+*/
+
+#include "s9/parallel.hpp"
+
+using namespace std;
+using namespace boost;
+using namespace s9;
+
+
+/*
+ * The shared pool - created on first use
+ */
+
+WorkerPool& WorkerPool::get() {
+	static WorkerPool pool (boost::thread::hardware_concurrency());
+	return pool;
+}
+
+WorkerPool::WorkerPool(size_t nthreads) {
+	mStop = false;
+	// The calling thread makes up the last worker
+	for (size_t i = 1; i < nthreads; ++i)
+		vThreads.push_back(new boost::thread(&WorkerPool::_run, this));
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	for (size_t i = 0; i < vThreads.size(); ++i){
+		vThreads[i]->join();
+		delete vThreads[i];
+	}
+}
+
+/*
+ * Grab the next chunk of work if there is any
+ */
+
+bool WorkerPool::_pop(Chunk &c) {
+	boost::mutex::scoped_lock lock(mMutex);
+	if (mQueue.empty())
+		return false;
+	c = mQueue.front();
+	mQueue.pop_front();
+	return true;
+}
+
+void WorkerPool::_execute(Chunk &c) {
+	c.pBatch->mFunc(c.mBegin, c.mEnd);
+
+	boost::mutex::scoped_lock lock(c.pBatch->mMutex);
+	if (--c.pBatch->mRemaining == 0)
+		c.pBatch->mDone.notify_all();
+}
+
+/*
+ * Worker thread loop
+ */
+
+void WorkerPool::_run() {
+	while (true) {
+		Chunk c;
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+			while (mQueue.empty() && !mStop)
+				mWake.wait(lock);
+			if (mStop)
+				return;
+			c = mQueue.front();
+			mQueue.pop_front();
+		}
+		_execute(c);
+	}
+}
+
+/*
+ * Split [0,count) into chunks of at least grain elements and block until all are done
+ */
+
+void WorkerPool::parallelFor(size_t count, RangeFunc f, size_t grain) {
+	Job job = start(count, f, grain);
+	finish(job);
+}
+
+WorkerPool::Job WorkerPool::start(size_t count, RangeFunc f, size_t grain) {
+	Job job;
+	if (count == 0)
+		return job;
+
+	if (grain == 0) grain = 1;
+
+	// Aim for a few chunks per thread so uneven work balances out
+	size_t nchunks = size() * 4;
+	size_t csize = (count + nchunks - 1) / nchunks;
+	if (csize < grain) csize = grain;
+	nchunks = (count + csize - 1) / csize;
+
+	if (nchunks == 1 || vThreads.empty()) {
+		f(0, count);
+		return job;
+	}
+
+	boost::shared_ptr<Batch> batch (new Batch());
+	batch->mFunc = f;
+	batch->mRemaining = nchunks;
+
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		for (size_t i = 0; i < nchunks; ++i){
+			Chunk c;
+			c.pBatch = batch;
+			c.mBegin = i * csize;
+			c.mEnd = std::min(count, c.mBegin + csize);
+			mQueue.push_back(c);
+		}
+	}
+	mWake.notify_all();
+
+	job.pBatch = batch;
+	return job;
+}
+
+void WorkerPool::finish(Job &job) {
+	if (!job.pBatch)
+		return;
+
+	// Help out rather than sit idle - this may pick up chunks from other batches which is fine
+	Chunk c;
+	while (_pop(c))
+		_execute(c);
+
+	{
+		boost::mutex::scoped_lock lock(job.pBatch->mMutex);
+		while (job.pBatch->mRemaining > 0)
+			job.pBatch->mDone.wait(lock);
+	}
+	job.pBatch.reset();
+}
@@ -0,0 +1,361 @@
+/**
+* @brief Per camera processing pipeline - stages on workers joined by bounded queues
+* @file pipeline.cpp
+* @author Benjamin Blundell <oni@section9.co.uk>
+* @date 20/08/2012
+*
+*/
+
+#include "s9/pipeline.hpp"
+#include "s9/utils.hpp"
+
+#ifdef _GEAR_X11_GLX
+extern "C" {
+	#include "s9/colorspaces.h"
+}
+#endif
+
+using namespace std;
+using namespace s9;
+
+
+VideoFrame* Pipeline::FrameQueue::push(VideoFrame *frame, size_t &depth) {
+	VideoFrame *out = NULL;
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		if (mQueue.size() >= mDepth) {
+			out = mQueue.front();
+			mQueue.pop_front();
+		}
+		mQueue.push_back(frame);
+		depth = mQueue.size();
+	}
+	mReady.notify_one();
+	return out;
+}
+
+VideoFrame* Pipeline::FrameQueue::pop() {
+	boost::mutex::scoped_lock lock(mMutex);
+	while (mQueue.empty() && !mClosed)
+		mReady.wait(lock);
+	if (mClosed)
+		return NULL;
+	VideoFrame *frame = mQueue.front();
+	mQueue.pop_front();
+	return frame;
+}
+
+void Pipeline::FrameQueue::close() {
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mClosed = true;
+	}
+	mReady.notify_all();
+}
+
+
+Pipeline::Pipeline(boost::shared_ptr<VideoSource> source, size_t depth) : pSource(source),
+	mDepth(std::max(depth, static_cast<size_t>(1))), mRunning(false), mLatency(0), mStaged(0) {}
+
+void Pipeline::add(boost::shared_ptr<PipelineStage> stage, bool fuse) {
+	if (mRunning) {
+		cerr << "S9Gear - Pipeline stages must be added before it starts" << endl;
+		return;
+	}
+	vStages.push_back(stage);
+	vFused.push_back(fuse);
+}
+
+/*
+ * A ConvertStage wants raw frames whatever comes out of the end. Without one the source
+ * converts, unless raw output is asked for
+ */
+
+void Pipeline::setRaw(bool raw) {
+	mRaw = raw;
+	bool convert = false;
+#ifdef _GEAR_X11_GLX
+	for (size_t i = 0; i < vStages.size(); ++i)
+		if (dynamic_cast<ConvertStage*>(vStages[i].get()) != NULL)
+			convert = true;
+#endif
+	pSource->setRaw(raw || convert);
+}
+
+/*
+ * Group the stages onto workers, then size the frame pool so every queue can be full
+ * with every worker busy and capture still have a frame to fill
+ */
+
+bool Pipeline::start() {
+	if (mRunning) return true;
+
+	vWorkers.clear();
+	Worker capture;
+	capture.mFirst = 1;
+	capture.mLast = 0;
+	capture.pThread = NULL;
+	vWorkers.push_back(capture);
+
+	for (size_t i = 0; i < vStages.size(); ++i) {
+		if (!vFused[i]) {
+			Worker w;
+			w.mFirst = i + 1;
+			w.mLast = i;
+			w.pIn.reset(new FrameQueue(mDepth));
+			w.pThread = NULL;
+			vWorkers.push_back(w);
+		}
+		vWorkers.back().mLast = i + 1;
+	}
+
+	size_t frames = (vWorkers.size() - 1) * (mDepth + 1) + 2;
+	vPool.assign(frames, pSource->getFrame());
+	vQueued.assign(frames, 0);
+	vFree.clear();
+	for (size_t i = 0; i < frames; ++i)
+		vFree.push_back(&vPool[i]);
+
+	vStats.assign(vStages.size() + 2, StageStats());
+	vDepthSamples.assign(vStats.size(), 0);
+	vStats.front().mName = "capture";
+	vStats.back().mName = "staging";
+	for (size_t i = 0; i < vStages.size(); ++i)
+		vStats[i + 1].mName = vStages[i]->getName();
+	for (size_t w = 0; w < vWorkers.size(); ++w)
+		for (size_t s = vWorkers[w].mFirst; s <= vWorkers[w].mLast; ++s)
+			vStats[s].mWorker = w;
+	vStats.back().mWorker = vWorkers.size() - 1;
+	mLatency = 0;
+	mStaged = 0;
+
+	mFrames.reset(pSource->getFrame());
+
+	mRunning = true;
+	vWorkers[0].pThread = new boost::thread(&Pipeline::_capture, this);
+	for (size_t w = 1; w < vWorkers.size(); ++w)
+		vWorkers[w].pThread = new boost::thread(&Pipeline::_work, this, w);
+
+	return true;
+}
+
+/*
+ * Stops the source too - the pipeline stands in for it
+ */
+
+void Pipeline::stop() {
+	if (mRunning) {
+		mRunning = false;
+		for (size_t w = 1; w < vWorkers.size(); ++w)
+			vWorkers[w].pIn->close();
+		for (size_t w = 0; w < vWorkers.size(); ++w) {
+			vWorkers[w].pThread->join();
+			delete vWorkers[w].pThread;
+		}
+		vWorkers.clear();
+	}
+	pSource->stop();
+}
+
+VideoFrame* Pipeline::_acquire() {
+	boost::mutex::scoped_lock lock(mFreeMutex);
+	if (vFree.empty()) return NULL;
+	VideoFrame *frame = vFree.back();
+	vFree.pop_back();
+	return frame;
+}
+
+void Pipeline::_release(VideoFrame *frame) {
+	boost::mutex::scoped_lock lock(mFreeMutex);
+	vFree.push_back(frame);
+}
+
+void Pipeline::_drop(size_t stage, VideoFrame *frame) {
+	{
+		boost::mutex::scoped_lock lock(mStatsMutex);
+		vStats[stage].mDropped++;
+	}
+	_release(frame);
+}
+
+/*
+ * Runs the worker's stages on the frame and passes it on. The wait is charged to the
+ * worker's first stage
+ */
+
+void Pipeline::_forward(size_t w, VideoFrame *frame) {
+	const Worker &worker = vWorkers[w];
+
+	for (size_t s = worker.mFirst; s <= worker.mLast; ++s) {
+		double_t start = timeMonotonicS9();
+		bool ok = vStages[s - 1]->process(*frame);
+		double_t took = timeMonotonicS9() - start;
+
+		{
+			boost::mutex::scoped_lock lock(mStatsMutex);
+			StageStats &st = vStats[s];
+			st.mFrames++;
+			st.mLatencyMean += (took - st.mLatencyMean) / st.mFrames;
+			st.mLatencyMax = std::max(st.mLatencyMax, took);
+			if (s == worker.mFirst && w > 0)
+				st.mWaitMean += ((start - vQueued[frame - &vPool[0]]) - st.mWaitMean) / st.mFrames;
+		}
+
+		if (!ok) {
+			_drop(s, frame);
+			return;
+		}
+	}
+
+	if (w + 1 == vWorkers.size()) {
+		_stage(frame);
+		return;
+	}
+
+	const Worker &next = vWorkers[w + 1];
+	vQueued[frame - &vPool[0]] = timeMonotonicS9();
+	size_t depth;
+	VideoFrame *out = next.pIn->push(frame, depth);
+
+	{
+		boost::mutex::scoped_lock lock(mStatsMutex);
+		StageStats &st = vStats[next.mFirst];
+		uint64_t n = ++vDepthSamples[next.mFirst];
+		st.mDepth = depth;
+		st.mDepthMax = std::max(st.mDepthMax, depth);
+		st.mDepthMean += (depth - st.mDepthMean) / n;
+	}
+
+	if (out != NULL)
+		_drop(next.mFirst, out);
+}
+
+/*
+ * Swap into the back buffer - the frame takes the old back buffer's storage with it
+ */
+
+void Pipeline::_stage(VideoFrame *frame) {
+	double_t start = timeMonotonicS9();
+
+	VideoFrame &back = mFrames.back();
+	back.mData.swap(frame->mData);
+	back.mFormat = frame->mFormat;
+	back.mSeq = frame->mSeq;
+	back.mTimestamp = frame->mTimestamp;
+	_publish();
+
+	double_t end = timeMonotonicS9();
+	{
+		boost::mutex::scoped_lock lock(mStatsMutex);
+		StageStats &st = vStats.back();
+		st.mFrames++;
+		st.mLatencyMean += ((end - start) - st.mLatencyMean) / st.mFrames;
+		st.mLatencyMax = std::max(st.mLatencyMax, end - start);
+		mStaged++;
+		mLatency += ((end - back.mTimestamp) - mLatency) / mStaged;
+	}
+
+	_release(frame);
+}
+
+/*
+ * Capture worker. A frame only goes missing here if every pooled frame is in flight
+ */
+
+void Pipeline::_capture() {
+	while (mRunning) {
+		if (!pSource->waitFrame(0.1))
+			continue;
+
+		double_t start = timeMonotonicS9();
+		VideoFrame *frame = _acquire();
+		if (frame == NULL) {
+			boost::mutex::scoped_lock lock(mStatsMutex);
+			vStats.front().mDropped++;
+			continue;
+		}
+		pSource->takeFrame(*frame);
+		double_t took = timeMonotonicS9() - start;
+
+		{
+			boost::mutex::scoped_lock lock(mStatsMutex);
+			StageStats &st = vStats.front();
+			st.mFrames++;
+			st.mLatencyMean += (took - st.mLatencyMean) / st.mFrames;
+			st.mLatencyMax = std::max(st.mLatencyMax, took);
+		}
+
+		_forward(0, frame);
+	}
+}
+
+void Pipeline::_work(size_t w) {
+	VideoFrame *frame;
+	while ((frame = vWorkers[w].pIn->pop()) != NULL)
+		_forward(w, frame);
+}
+
+/*
+ * Frames dropped before the pipeline, inside it, or published and never fetched
+ */
+
+uint64_t Pipeline::framesDropped() {
+	uint64_t dropped = pSource->framesDropped() + mFrames.dropped();
+	boost::mutex::scoped_lock lock(mStatsMutex);
+	for (size_t i = 0; i < vStats.size(); ++i)
+		dropped += vStats[i].mDropped;
+	return dropped;
+}
+
+std::vector<StageStats> Pipeline::getStats() {
+	boost::mutex::scoped_lock lock(mStatsMutex);
+	return vStats;
+}
+
+double_t Pipeline::getLatency() {
+	boost::mutex::scoped_lock lock(mStatsMutex);
+	return mLatency;
+}
+
+
+#ifdef _GEAR_X11_GLX
+
+/*
+ * Converts into a spare buffer and swaps it in - the spare is the YUYV buffer next time
+ */
+
+bool ConvertStage::process(VideoFrame &frame) {
+	if (frame.mFormat != FRAME_YUYV)
+		return true;
+	if (frame.mData.size() < mW * mH * 2)
+		return false;
+
+	vRGB.resize(mW * mH * 3);
+	yuyv2rgb(&frame.mData[0], &vRGB[0], mW, mH);
+	frame.mData.swap(vRGB);
+	frame.mFormat = FRAME_RGB;
+	return true;
+}
+
+#endif
+
+#ifdef _GEAR_OPENCV
+
+UndistortStage::UndistortStage(const cv::Mat &M, const cv::Mat &D, size_t w, size_t h) : PipelineStage("undistort"),
+	mW(w), mH(h) {
+	cv::initUndistortRectifyMap(M, D, cv::Mat(), M, cv::Size(w, h), CV_16SC2, mMap1, mMap2);
+}
+
+bool UndistortStage::process(VideoFrame &frame) {
+	if (frame.mFormat != FRAME_RGB || frame.mData.size() < mW * mH * 3)
+		return true;
+
+	vOut.resize(mW * mH * 3);
+	cv::Mat src (mH, mW, CV_8UC3, &frame.mData[0]);
+	cv::Mat dst (mH, mW, CV_8UC3, &vOut[0]);
+	cv::remap(src, dst, mMap1, mMap2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+	frame.mData.swap(vOut);
+	return true;
+}
+
+#endif
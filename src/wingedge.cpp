@@ -7,6 +7,7 @@
 */
 
 #include "s9/wingedge.hpp"
+#include "s9/halfedge.hpp"
 
 using namespace std;
 using namespace boost;
@@ -19,15 +20,16 @@ using namespace s9;
  * This assumes that primitives have buffer 0 as vertices and buffer 1 as indices
  */
 
-void WingedEdge::make(DrawableGeometry geom) {
+void WingedEdge::make(boost::shared_ptr<DrawableGeometry> geom) {
 	
 	mObj.reset(new SharedObj());
 	mObj->mGeom = geom;
 	
-	// Create a temporary array of vertices for now. 
+	// Create a temporary array of vertices for now - one per interleaved vertex
 	std::vector< boost::shared_ptr<WE_Vertex> > vs;
+	vs.reserve(mObj->mGeom->size());
 
-	for (size_t i=0; i < mObj->mGeom.size(); i+=3){
+	for (size_t i=0; i < mObj->mGeom->size(); ++i){
 		shared_ptr<WE_Vertex> sv (new WE_Vertex);
 		vs.push_back(sv);
 		sv->idc = i; // Copy the indices
@@ -41,31 +43,27 @@ void WingedEdge::make(DrawableGeometry geom) {
 	
 	map< uint64_t, shared_ptr<WE_Edge> > es;
 	
-	size_t bw = 0;
+	BufferView<uint32_t> indices = mObj->mGeom->getIndexView();
 
-	uint32_t *indices = mObj->mGeom.indexaddr();
+	// Badly wound faces are found up front with the same rule the half edge mesh uses
+	std::vector<uint8_t> keep;
+	size_t bw = markWellWound(indices, keep);
 
-	for (size_t i = 0; i < mObj->mGeom.indexsize(); i+=3) {
+	for (size_t i = 0; i + 2 < indices.size(); i+=3) {
+
+		if (!keep[i / 3]) continue;
 
 		shared_ptr<WE_Face>  f (new WE_Face());
-		bool bf = false;
 		uint32_t idcs[3];
 
-
-
 		idcs[0] = indices[i];
 		idcs[1] = indices[i+1];
 		idcs[2] = indices[i+2]; 
 
-		// Find Edges to add to face
-		map< uint64_t, shared_ptr<WE_Edge> >::iterator pi = es.end();
-		
 		boost::shared_ptr<WE_Edge> prev;
 		boost::shared_ptr<WE_Edge> current;
 		boost::shared_ptr<WE_Edge> first;
 		
-		vector<uint64_t> keys;
-		
 		for (int j = 0; j < 3; j++){
 			
 			map< uint64_t, shared_ptr<WE_Edge> >::iterator fi;
@@ -103,34 +101,14 @@ void WingedEdge::make(DrawableGeometry geom) {
 				prev = current;
 			}
 			
-			
-			// this should never happen as its basically a badly wound polygon - 
-			// in this case remove the face and all associated edges
-			fi = es.find(jk);
-			if (fi != es.end()){
-				bf = true;
-				bw++;
-				break;
-			}
-			keys.push_back(jk);
 			es.insert( pair<uint64_t, shared_ptr<WE_Edge> > (jk, sp) );
-			
 		}
 		
-		if (!bf) {
-			// Close the loop off
-			first->prev = current;
-			current->next = first;
-	
-			
-			mObj->mWE.push_back(f);
-		}else {
-			// Delete any added edges for this badly wound face
-			for (size_t i = 0; i < keys.size(); i++){
-				map< uint64_t, shared_ptr<WE_Edge> >::iterator pi = es.find(keys[i]);
-				es.erase (pi);      
-			}
-		}
+		// Close the loop off
+		first->prev = current;
+		current->next = first;
+		
+		mObj->mWE.push_back(f);
 	}
 		
 	cerr << "S9Gear Winged Edge edges count: " << es.size() << endl;
@@ -139,55 +117,46 @@ void WingedEdge::make(DrawableGeometry geom) {
 }
 
 /*
- * Generate a primitive from this. Essentially flatten it out
+ * Faces are walked from their edge, which keeps the winding
  */
- /*
 
-Primitive WingedEdge::flatten() { 
-	
-	VBOData v;
-	
-	VBOBuffer<GLfloat> verts(3);
-	VBOBuffer<GLfloat> texs(2);
-	VBOBuffer<GLfloat> norms(3);
-	VBOBuffer<GLuint> tids(1);
-	
-	for (size_t i = 0; i < mObj->mWE.size(); ++i) {
-	
-		shared_ptr<WE_Face> sf = mObj->mWE[i];
-		
-		size_t i0 = sf->edge->v0->idc;
-		size_t i1 = sf->edge->next->v0->idc;
-		size_t i2 = sf->edge->next->next->v0->idc;
-		
-		VBOBuffer<GLfloat> vv = mObj->mPrimitive.getVBO().getBuffer<GLfloat>(0);
-		
-		glm::vec3 v0 (vv[i0], vv[i0+1], vv[i0+2]);
-		glm::vec3 v1 (vv[i1], vv[i1+1], vv[i1+2]);
-		glm::vec3 v2 (vv[i2], vv[i2+1], vv[i2+2]);
-			 
-		// Vertices
-		verts += v0.x,v0.y,v0.z, v1.x,v1.y,v1.z,v2.x,v2.y,v2.z;
-	
-		glm::vec3 t0 = v1 - v0;
-		glm::vec3 t1 = v2 - v0;
-		glm::vec3 n = glm::cross(t0,t1);
-		
-		// TexCoords, normals and ids
-		
-		for (size_t j =0; j < 3; j++){
-			texs += 0,0;
-			norms += n.x, n.y, n.z;			
+struct GatherCorners {
+	const WEP_Face *pFaces;
+	uint32_t *pCorners;
+	void operator()(size_t b, size_t e) const {
+		for (size_t f = b; f < e; ++f) {
+			const WE_Edge *edge = pFaces[f]->edge.get();
+			pCorners[f * 3] = static_cast<uint32_t>(edge->v0->idc);
+			pCorners[f * 3 + 1] = static_cast<uint32_t>(edge->next->v0->idc);
+			pCorners[f * 3 + 2] = static_cast<uint32_t>(edge->next->next->v0->idc);
 		}
 	}
-			
-	// Finally, compile the VBO
-	v.push_back(verts);
-	v.push_back(norms);
-	v.push_back(texs);
-	v.setNumElements(verts.size());
-	
-	Primitive p(v);
-	
-	return p;
-}*/
+};
+
+void WingedEdge::_faceCorners(std::vector<uint32_t> &corners) {
+	corners.resize(mObj->mWE.size() * 3);
+	if (mObj->mWE.empty()) return;
+
+	GatherCorners gc = { &mObj->mWE[0], &corners[0] };
+	parallelFor(mObj->mWE.size(), gc, 16384);
+}
+
+/*
+ * Counting sort of faces by vertex
+ */
+
+void WingedEdge::_vertexFaces(const std::vector<uint32_t> &corners, size_t numverts,
+	std::vector<uint32_t> &starts, std::vector<uint32_t> &faces) {
+
+	starts.assign(numverts + 1, 0);
+	faces.resize(corners.size());
+
+	for (size_t i = 0; i < corners.size(); ++i)
+		starts[corners[i] + 1]++;
+	for (size_t v = 0; v < numverts; ++v)
+		starts[v + 1] += starts[v];
+
+	std::vector<uint32_t> fill (starts.begin(), starts.end() - 1);
+	for (size_t i = 0; i < corners.size(); ++i)
+		faces[fill[corners[i]]++] = static_cast<uint32_t>(i / 3);
+}